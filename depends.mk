@@ -4,6 +4,7 @@
 #   protobuf-v2
 #   sofa-pbrpc
 #   gflags
+#   snappy
 #   gtest(only for unittests)
 
 # Protobuf is used to serialize protocol and data structure
@@ -15,6 +16,9 @@ SOFA_PBRPC_DIR=/usr/local
 # GFlags is used to parse command line flags
 GFLAGS_DIR=/usr/local
 
+# Snappy is used to compress raft log entries
+SNAPPY_DIR=/usr/local
+
 # GTest is used for unittest
 GTEST_DIR=/usr/local
 
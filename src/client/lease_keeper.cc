@@ -0,0 +1,157 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "lease_keeper.h"
+
+#include <set>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace client {
+
+// a failed keepalive is sent again after this delay at most, in milliseconds
+static const int64_t s_retry_delay = 100;
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LeaseKeeper::LeaseKeeper(const std::string& ns, const send_func_t& send,
+        common::ThreadPool* pool) : _ns(ns), _send(send), _pool(pool), _task_id(0),
+        _next(0), _min_ttl(0), _sending(false), _stop(false) {
+}
+
+void LeaseKeeper::add(int64_t lease_id, int64_t ttl, const lease_func_t& on_expired) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return;
+    }
+    Lease& lease = _leases[lease_id];
+    lease.ttl = std::max(ttl, 1L);
+    lease.renewed = now_ms();
+    lease.on_expired = on_expired;
+    _min_ttl = _min_ttl == 0 ? lease.ttl : std::min(_min_ttl, lease.ttl);
+    schedule(interval());
+}
+
+bool LeaseKeeper::remove(int64_t lease_id) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _leases.erase(lease_id) > 0;
+}
+
+size_t LeaseKeeper::size() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _leases.size();
+}
+
+void LeaseKeeper::stop() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _stop = true;
+    _leases.clear();
+    _pool->cancel_task(_task_id, false);
+    _task_id = 0;
+}
+
+void LeaseKeeper::schedule(int64_t delay) {
+    // the keepalive in flight schedules the next one once it returns
+    if (_stop || _sending || _leases.empty()) {
+        return;
+    }
+    int64_t next = now_ms() + delay;
+    if (_task_id != 0) {
+        if (_next <= next) {
+            return;
+        }
+        // a task failing to cancel is running, and finds a keepalive in flight
+        _pool->cancel_task(_task_id, false);
+    }
+    _task_id = _pool->delay_task(delay, std::bind(&LeaseKeeper::keep_alive, this));
+    _next = next;
+}
+
+void LeaseKeeper::keep_alive() {
+    std::unique_lock<std::mutex> locker(_mutex);
+    _task_id = 0;
+    if (_stop || _sending || _leases.empty()) {
+        return;
+    }
+    request_t request(new service::KeepAliveRequest());
+    response_t response(new service::KeepAliveResponse());
+    request->set_ns(_ns);
+    request->mutable_lease_ids()->Reserve(_leases.size());
+    for (const auto& lease : _leases) {
+        request->add_lease_ids(lease.first);
+    }
+    _sending = true;
+    // leases are renewed on server no earlier than the keepalive is sent
+    int64_t sent = now_ms();
+    // done may be called at once if client is being destroyed
+    locker.unlock();
+    _send(request.get(), response.get(), [this, request, response, sent](int32_t status) {
+                on_keep_alive(request, response, sent, status);
+            });
+}
+
+void LeaseKeeper::on_keep_alive(const request_t& request, const response_t& response,
+        int64_t sent, int32_t status) {
+    std::vector<std::pair<int64_t, lease_func_t> > expired;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _sending = false;
+        if (_stop) {
+            return;
+        }
+        if (status == status_code::OK) {
+            std::set<int64_t> gone(response->expired().begin(), response->expired().end());
+            for (int64_t lease_id : request->lease_ids()) {
+                auto it = _leases.find(lease_id);
+                if (it == _leases.end()) {
+                    continue;
+                }
+                if (gone.count(lease_id) > 0) {
+                    expired.push_back(std::make_pair(lease_id, it->second.on_expired));
+                    _leases.erase(it);
+                } else {
+                    it->second.renewed = std::max(it->second.renewed, sent);
+                }
+            }
+        } else {
+            LOG(WARNING, "[lease]: keepalive of %d leases failed: %d",
+                    request->lease_ids_size(), status);
+        }
+        // server has expired the leases not renewed within ttl
+        int64_t now = now_ms();
+        _min_ttl = 0;
+        for (auto it = _leases.begin(); it != _leases.end();) {
+            if (now - it->second.renewed >= it->second.ttl) {
+                expired.push_back(std::make_pair(it->first, it->second.on_expired));
+                it = _leases.erase(it);
+                continue;
+            }
+            _min_ttl = _min_ttl == 0 ? it->second.ttl : std::min(_min_ttl, it->second.ttl);
+            ++it;
+        }
+        schedule(status == status_code::OK ? interval() : std::min(interval(), s_retry_delay));
+    }
+    for (const auto& lease : expired) {
+        LOG(INFO, "[lease]: lease %ld expired", lease.first);
+        if (lease.second) {
+            _pool->add_task(std::bind(lease.second, lease.first));
+        }
+    }
+}
+
+int64_t LeaseKeeper::interval() const {
+    return std::max(_min_ttl / 3, 1L);
+}
+
+} // namespace client
+} // namespace orion
@@ -0,0 +1,91 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_CLIENT_LEASE_KEEPER_H
+#define ORION_CLIENT_LEASE_KEEPER_H
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "client/ori.h"
+#include "proto/service.pb.h"
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace client {
+
+/**
+ * @brief Keeps all the leases of a client alive with one stream of keepalives
+ *
+ * However many leases the client holds, for sessions, locks or temp nodes,
+ * a single keepalive carrying all of them is sent every third of the
+ * shortest ttl, and a new one is never sent before the last one returns.
+ * A lease reported expired by server is dropped and its callback called.
+ * So is a lease which no keepalive has renewed within its ttl, as server
+ * has expired it by then, even if the cluster is unreachable.
+ */
+class LeaseKeeper {
+public:
+    /// sends a keepalive to the leader owning the namespace, done is called with its status
+    typedef std::function<void (const service::KeepAliveRequest*, service::KeepAliveResponse*,
+            const std::function<void (int32_t)>&)> send_func_t;
+
+    /**
+     * @param ns    [IN] namespace of the leases
+     * @param send  [IN] sends the keepalives
+     * @param pool  [IN] runs delayed keepalives and expiry callbacks
+     */
+    LeaseKeeper(const std::string& ns, const send_func_t& send, common::ThreadPool* pool);
+    ~LeaseKeeper() { }
+    /// disable copy and move for lease keeper
+    LeaseKeeper(const LeaseKeeper&) = delete;
+    void operator=(const LeaseKeeper&) = delete;
+
+    /// keeps a lease granted just now alive, on_expired is called once if it expires
+    void add(int64_t lease_id, int64_t ttl, const lease_func_t& on_expired);
+    /// stops renewing a lease, returns false if it is not kept
+    bool remove(int64_t lease_id);
+    size_t size() const;
+    /// stops sending keepalives, callbacks are not called any more
+    void stop();
+private:
+    struct Lease {
+        int64_t ttl;
+        // time of the last keepalive renewing the lease, when it was sent
+        int64_t renewed;
+        lease_func_t on_expired;
+    };
+    typedef std::shared_ptr<service::KeepAliveRequest> request_t;
+    typedef std::shared_ptr<service::KeepAliveResponse> response_t;
+
+    /// makes the next keepalive go within delay, called with mutex locked
+    void schedule(int64_t delay);
+    void keep_alive();
+    void on_keep_alive(const request_t& request, const response_t& response, int64_t sent,
+            int32_t status);
+    /// interval of keepalives, called with mutex locked
+    int64_t interval() const;
+private:
+    std::string _ns;
+    send_func_t _send;
+    common::ThreadPool* _pool;
+    mutable std::mutex _mutex;
+    std::map<int64_t, Lease> _leases;
+    // delayed keepalive and when it runs, 0 if none
+    int64_t _task_id;
+    int64_t _next;
+    // shortest ttl of the leases, refreshed by every keepalive returned
+    int64_t _min_ttl;
+    bool _sending;
+    bool _stop;
+};
+
+} // namespace client
+} // namespace orion
+
+#endif // ORION_CLIENT_LEASE_KEEPER_H
@@ -0,0 +1,211 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "near_cache.h"
+
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include "common/const.h"
+
+namespace orion {
+namespace client {
+
+// shards sharing the capacity, fewer for a small cache
+static const size_t s_max_shard_num = 16;
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+NearCache::NearCache(size_t capacity, int64_t ttl, int64_t revalidate_interval) :
+        _ttl(ttl), _revalidate_interval(revalidate_interval), _watching(false),
+        _hits(0), _misses(0), _evictions(0), _invalidations(0) {
+    size_t shard_num = std::max(std::min(capacity / 64, s_max_shard_num), 1UL);
+    _shard_capacity = std::max(capacity / shard_num, 1UL);
+    for (size_t i = 0; i < shard_num; ++i) {
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+bool NearCache::get(int32_t& status, std::string& value, const std::string& key) {
+    Shard* shard = shard_of(key);
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    auto it = shard->entries.find(key);
+    int64_t max_age = it != shard->entries.end() && it->second.trusted && _watching ?
+        _ttl : std::min(_ttl, _revalidate_interval);
+    if (it == shard->entries.end() || now_ms() - it->second.filled_time >= max_age) {
+        ++_misses;
+        return false;
+    }
+    shard->lru.splice(shard->lru.begin(), shard->lru, it->second.lru);
+    status = it->second.status;
+    value = it->second.value;
+    ++_hits;
+    return true;
+}
+
+int64_t NearCache::begin_fill(const std::string& key) {
+    Shard* shard = shard_of(key);
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    return ++shard->version;
+}
+
+void NearCache::fill(const std::string& key, int64_t ticket, int32_t status,
+        const std::string& value) {
+    if (status != status_code::OK && status != status_code::NOT_FOUND) {
+        return;
+    }
+    Shard* shard = shard_of(key);
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    // a change in the shard may have made the result stale
+    if (shard->changed > ticket) {
+        return;
+    }
+    insert(shard, key, ticket, status, value);
+}
+
+void NearCache::update(const std::string& key, const std::string& value) {
+    Shard* shard = shard_of(key);
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    shard->changed = ++shard->version;
+    // only cached keys are updated, the cache is filled by reads
+    auto it = shard->entries.find(key);
+    if (it != shard->entries.end()) {
+        it->second.status = status_code::OK;
+        it->second.value = value;
+        it->second.filled_time = now_ms();
+    }
+}
+
+void NearCache::invalidate(const std::string& key) {
+    Shard* shard = shard_of(key);
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    shard->changed = ++shard->version;
+    auto it = shard->entries.find(key);
+    if (it != shard->entries.end()) {
+        erase(shard, it);
+        ++_invalidations;
+    }
+}
+
+void NearCache::invalidate_prefix(const std::string& prefix) {
+    std::string dir = prefix;
+    if (dir.empty() || dir.back() != '/') {
+        dir.push_back('/');
+    }
+    for (auto& shard : _shards) {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        shard->changed = ++shard->version;
+        for (auto it = shard->entries.begin(); it != shard->entries.end();) {
+            const std::string& key = it->first;
+            if (key == prefix || key.compare(0, dir.size(), dir) == 0) {
+                erase(shard.get(), it++);
+                ++_invalidations;
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void NearCache::invalidate_all() {
+    for (auto& shard : _shards) {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        shard->changed = ++shard->version;
+        _invalidations += shard->entries.size();
+        for (const auto& entry : shard->entries) {
+            record(entry.first, -1);
+        }
+        shard->entries.clear();
+        shard->lru.clear();
+    }
+}
+
+void NearCache::set_watching(bool watching) {
+    _watching = watching;
+}
+
+void NearCache::take_changes(std::map<std::string, int32_t>* changes) {
+    changes->clear();
+    std::lock_guard<std::mutex> locker(_changes_mutex);
+    changes->swap(_changes);
+}
+
+void NearCache::set_watched(const std::string& key, int32_t type) {
+    Shard* shard = shard_of(key);
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    auto it = shard->entries.find(key);
+    if (it != shard->entries.end()
+            && (type == WATCH_SUBTREE || type == watch_type(it->second.status))) {
+        // results being read may have missed changes before the watch
+        it->second.watched = true;
+        it->second.watched_version = ++shard->version;
+    }
+}
+
+CacheStats NearCache::stats() const {
+    CacheStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.evictions = _evictions;
+    stats.invalidations = _invalidations;
+    for (const auto& shard : _shards) {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        stats.size += shard->entries.size();
+    }
+    return stats;
+}
+
+NearCache::Shard* NearCache::shard_of(const std::string& key) const {
+    return _shards[std::hash<std::string>()(key) % _shards.size()].get();
+}
+
+int32_t NearCache::watch_type(int32_t status) {
+    return status == status_code::OK ? WATCH_KEY : WATCH_SUBTREE;
+}
+
+void NearCache::record(const std::string& key, int32_t type) {
+    std::lock_guard<std::mutex> locker(_changes_mutex);
+    _changes[key] = type;
+}
+
+void NearCache::insert(Shard* shard, const std::string& key, int64_t ticket,
+        int32_t status, const std::string& value) {
+    auto it = shard->entries.find(key);
+    if (it == shard->entries.end()) {
+        shard->lru.push_front(key);
+        it = shard->entries.insert(std::make_pair(key, Entry())).first;
+        it->second.lru = shard->lru.begin();
+        it->second.watched = false;
+        it->second.watched_version = 0;
+        record(key, watch_type(status));
+    } else {
+        shard->lru.splice(shard->lru.begin(), shard->lru, it->second.lru);
+        if (watch_type(it->second.status) != watch_type(status)) {
+            it->second.watched = false;
+            record(key, watch_type(status));
+        }
+    }
+    it->second.status = status;
+    it->second.value = value;
+    it->second.filled_time = now_ms();
+    it->second.trusted = it->second.watched && ticket > it->second.watched_version;
+    while (shard->entries.size() > _shard_capacity) {
+        erase(shard, shard->entries.find(shard->lru.back()));
+        ++_evictions;
+    }
+}
+
+void NearCache::erase(Shard* shard, std::unordered_map<std::string, Entry>::iterator it) {
+    record(it->first, -1);
+    shard->lru.erase(it->second.lru);
+    shard->entries.erase(it);
+}
+
+} // namespace client
+} // namespace orion
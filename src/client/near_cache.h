@@ -0,0 +1,125 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_CLIENT_NEAR_CACHE_H
+#define ORION_CLIENT_NEAR_CACHE_H
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include "client/ori.h"
+
+namespace orion {
+namespace client {
+
+/**
+ * @brief Caches results of get in client, including keys not found
+ *
+ * Entries are read again from cluster once they are older than ttl. Every
+ * cached key needs a watch delivering its changes, keys entering or leaving
+ * the cache are handed to the watcher by take_changes. Only an entry filled
+ * after the watch of its key is set up is kept for ttl, the others and all
+ * the entries while the watch breaks are read again after revalidate interval.
+ * A result read from cluster is dropped if the key changes while it is being
+ * read, see begin_fill. Keys are spread over shards, each of which evicts
+ * its least recently used entries. Thread-safe.
+ */
+class NearCache {
+public:
+    /// ttl and revalidate interval are in milliseconds
+    NearCache(size_t capacity, int64_t ttl, int64_t revalidate_interval);
+    ~NearCache() { }
+    /// disable copy and move for near cache
+    NearCache(const NearCache&) = delete;
+    void operator=(const NearCache&) = delete;
+
+    /**
+     * @brief Looks up a key
+     * @param status  [OUT] status answered by cluster, OK or NOT_FOUND
+     * @param value   [OUT] value of the key if status is OK
+     * @param key     [IN] key to look up
+     * @return        false if the key is not cached or needs to be read again
+     */
+    bool get(int32_t& status, std::string& value, const std::string& key);
+    /// returns the ticket to fill a key about to be read from cluster
+    int64_t begin_fill(const std::string& key);
+    /// caches the result read with ticket, unless the key has changed since then
+    void fill(const std::string& key, int64_t ticket, int32_t status, const std::string& value);
+
+    /// caches the latest value of a changed key, e.g. delivered by watch
+    void update(const std::string& key, const std::string& value);
+    void invalidate(const std::string& key);
+    /// drops the key and all the keys under it
+    void invalidate_prefix(const std::string& prefix);
+    void invalidate_all();
+    /// true if changes of cached keys are delivered by a watch
+    void set_watching(bool watching);
+    /**
+     * @brief Takes the keys which entered or left the cache since the last call
+     * @param changes  [OUT] type of the watch a cached key needs, -1 if the key has left
+     */
+    void take_changes(std::map<std::string, int32_t>* changes);
+    /// marks key as watched with type, results read from now on are kept for ttl
+    void set_watched(const std::string& key, int32_t type);
+
+    CacheStats stats() const;
+private:
+    struct Entry {
+        int32_t status;
+        std::string value;
+        int64_t filled_time;
+        // the watch of the key is set up, and the version then
+        bool watched;
+        int64_t watched_version;
+        // the value was read after the watch was set up
+        bool trusted;
+        std::list<std::string>::iterator lru;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        // the most recently used first
+        std::list<std::string> lru;
+        // bumped by every fill started, change and watch set up
+        int64_t version;
+        // version of the latest change, fills started before it are dropped
+        int64_t changed;
+
+        Shard() : version(0), changed(0) { }
+    };
+
+    Shard* shard_of(const std::string& key) const;
+    /// a missing key is created by writes under it, which are not its own changes
+    static int32_t watch_type(int32_t status);
+    /// records that key needs a watch of type, -1 for none
+    void record(const std::string& key, int32_t type);
+    /// caches an entry in shard, called with shard locked
+    void insert(Shard* shard, const std::string& key, int64_t ticket, int32_t status,
+            const std::string& value);
+    void erase(Shard* shard, std::unordered_map<std::string, Entry>::iterator it);
+private:
+    size_t _shard_capacity;
+    int64_t _ttl;
+    int64_t _revalidate_interval;
+    std::atomic<bool> _watching;
+    std::vector<std::unique_ptr<Shard> > _shards;
+    std::atomic<int64_t> _hits;
+    std::atomic<int64_t> _misses;
+    std::atomic<int64_t> _evictions;
+    std::atomic<int64_t> _invalidations;
+    std::mutex _changes_mutex;
+    std::map<std::string, int32_t> _changes;
+};
+
+} // namespace client
+} // namespace orion
+
+#endif // ORION_CLIENT_NEAR_CACHE_H
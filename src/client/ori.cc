@@ -0,0 +1,106 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "ori.h"
+
+#include <memory>
+#include "client/ori_impl.h"
+#include "common/const.h"
+
+namespace orion {
+
+Ori* Ori::open(const OriOptions& options) {
+    if (options.servers.empty()) {
+        return nullptr;
+    }
+    return new client::OriImpl(options);
+}
+
+std::future<int32_t> Ori::async_put(const std::string& key, const std::string& value) {
+    std::shared_ptr<std::promise<int32_t> > result(new std::promise<int32_t>());
+    async_put(key, value, [result](int32_t status) { result->set_value(status); });
+    return result->get_future();
+}
+
+std::future<GetResult> Ori::async_get(const std::string& key) {
+    std::shared_ptr<std::promise<GetResult> > result(new std::promise<GetResult>());
+    async_get(key, [result](int32_t status, const std::string& value) {
+        GetResult get_result;
+        get_result.status = status;
+        get_result.value = value;
+        result->set_value(get_result);
+    });
+    return result->get_future();
+}
+
+std::future<int32_t> Ori::async_remove(const std::string& key) {
+    std::shared_ptr<std::promise<int32_t> > result(new std::promise<int32_t>());
+    async_remove(key, [result](int32_t status) { result->set_value(status); });
+    return result->get_future();
+}
+
+int32_t Ori::wait_all(std::vector<std::future<int32_t> >& futures,
+        std::vector<int32_t>* statuses) {
+    int32_t first_failed = status_code::OK;
+    for (auto& future : futures) {
+        int32_t status = future.get();
+        if (first_failed == status_code::OK) {
+            first_failed = status;
+        }
+        if (statuses != nullptr) {
+            statuses->push_back(status);
+        }
+    }
+    futures.clear();
+    return first_failed;
+}
+
+int32_t Ori::wait_all(std::vector<std::future<GetResult> >& futures,
+        std::vector<GetResult>* results) {
+    int32_t first_failed = status_code::OK;
+    for (auto& future : futures) {
+        GetResult result = future.get();
+        if (first_failed == status_code::OK) {
+            first_failed = result.status;
+        }
+        if (results != nullptr) {
+            results->push_back(result);
+        }
+    }
+    futures.clear();
+    return first_failed;
+}
+
+std::string Ori::status_name(int32_t return_status) {
+    switch (return_status) {
+    case status_code::OK:
+        return "OK";
+    case status_code::DATABASE_ERROR:
+        return "DATABASE_ERROR";
+    case status_code::NOT_FOUND:
+        return "NOT_FOUND";
+    case status_code::INVALID:
+        return "INVALID";
+    case status_code::EXISTED:
+        return "EXISTED";
+    case status_code::NOT_LEADER:
+        return "NOT_LEADER";
+    case status_code::TIMEOUT:
+        return "TIMEOUT";
+    case status_code::NOT_SUPPORTED:
+        return "NOT_SUPPORTED";
+    case status_code::RESYNC:
+        return "RESYNC";
+    case status_code::LEASE_EXPIRED:
+        return "LEASE_EXPIRED";
+    case status_code::LOCKED:
+        return "LOCKED";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+} // namespace orion
@@ -8,6 +8,9 @@
 #define ORION_CLIENT_SDK_ORI_H
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include <future>
+#include <functional>
 
 namespace orion {
 
@@ -22,38 +25,213 @@ public:
     virtual ~ScanIterator() { }
 };
 
+/// nodes are fetched page by page, the next page is fetched while the current one is read
+struct ScanOptions {
+    // nodes and bytes of a page, server may shrink them
+    int32_t page_size;
+    int32_t page_bytes;
+    // values are left empty if true
+    bool keys_only;
+
+    ScanOptions() : page_size(1000), page_bytes(1024 * 1024), keys_only(false) { }
+};
+
 struct WatchParam {
     std::string key;
     std::string value;
     bool deleted;
+    // raft index of the change, increasing within a namespace
+    int64_t revision;
     void* context;
-}
+};
+
+/// a directory watch sees changes of its children, or of all the keys under it
+enum WatchType {
+    WATCH_KEY = 0,
+    WATCH_CHILDREN = 1,
+    WATCH_SUBTREE = 2,
+};
 
 typedef void (*watch_cb_t)(const WatchParam& param, int32_t status);
+/// status is OK for a change, or RESYNC if changes are lost and watched keys need to be read again
+typedef std::function<void (const WatchParam& param, int32_t status)> watch_func_t;
 typedef void (*timeout_cb_t)(void* ctx);
+/// called once a lease kept alive by the client expires, on a client thread
+typedef std::function<void (int64_t lease_id)> lease_func_t;
+
+/// result of an asynchronous get, value is set only if status is OK
+struct GetResult {
+    int32_t status;
+    std::string value;
+
+    GetResult() : status(0) { }
+};
+
+/// statistics of the client cache of get results
+struct CacheStats {
+    int64_t hits;
+    int64_t misses;
+    // entries dropped for capacity and for changes of keys
+    int64_t evictions;
+    int64_t invalidations;
+    int64_t size;
+
+    CacheStats() : hits(0), misses(0), evictions(0), invalidations(0), size(0) { }
+    double hit_rate() const {
+        return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0;
+    }
+};
+
+/// completion callbacks of asynchronous requests, called on a client thread
+typedef std::function<void (int32_t status)> done_cb_t;
+typedef std::function<void (int32_t status, const std::string& value)> get_cb_t;
+
+struct OriOptions {
+    // addresses of all the servers of the cluster
+    std::vector<std::string> servers;
+    // namespace of all the keys written and read by the client
+    std::string ns;
+    // timeout of a single rpc in seconds
+    int32_t rpc_timeout;
+    // a request fails if no leader answers it in time, in milliseconds,
+    // requests wait for a new leader during failover within this time
+    int64_t request_timeout;
+    // redirects followed by a request before it waits for routes to be refreshed
+    int32_t max_redirects;
+    // threads retrying requests and refreshing routes
+    int32_t thread_num;
+    // connections to every server, requests go to the least busy one
+    int32_t channel_num;
+    // keys whose get results are cached in client, 0 to disable the cache
+    int32_t cache_size;
+    // a cached key is read again from cluster after ttl, in milliseconds
+    int64_t cache_ttl;
+    // same as above, used instead while changes of cached keys are not watched
+    int64_t cache_revalidate_interval;
+    // a poll of watches waits for changes on server at most this long, in milliseconds,
+    // needs to be shorter than rpc timeout
+    int32_t watch_wait;
+    // ttl of the session lease holding temp nodes written by the client, in milliseconds
+    int64_t session_ttl;
+    // a lock request waits on server at most this long before it is sent again,
+    // in milliseconds, needs to be shorter than rpc timeout
+    int32_t lock_wait;
+
+    OriOptions() : rpc_timeout(2), request_timeout(10000), max_redirects(3), thread_num(2),
+            channel_num(2), cache_size(0), cache_ttl(60000), cache_revalidate_interval(1000),
+            watch_wait(1000), session_ttl(10000), lock_wait(1000) { }
+};
 
 class Ori {
 public:
+    /// connects to the cluster, user needs to delete the returned pointer
+    static Ori* open(const OriOptions& options);
+
+    /// a temp node is attached to the session lease of the client, granted by the first one
     virtual int32_t put(const std::string& key, const std::string& value, bool temp = false) = 0;
     virtual int32_t get(std::string& value, const std::string& key) = 0;
     virtual int32_t remove(const std::string& key) = 0;
-    virtual ScanIterator* scan(const std::string& start, const std::string end) = 0;
-    virtual ScanIterator* list(const std::string& key) = 0;
+    /**
+     * @brief Reads many keys in one request
+     * @param values    [OUT] value of every key, empty if the key is not found
+     * @param statuses  [OUT] status of every key
+     * @param keys      [IN] keys to read
+     * @return          OK if the batch is served, statuses tell the result of every key
+     */
+    virtual int32_t batch_get(std::vector<std::string>& values, std::vector<int32_t>& statuses,
+            const std::vector<std::string>& keys) = 0;
+    /// writes of a batch are committed together and applied in order
+    virtual int32_t batch_put(std::vector<int32_t>& statuses, const std::vector<std::string>& keys,
+            const std::vector<std::string>& values) = 0;
+    virtual int32_t batch_remove(std::vector<int32_t>& statuses,
+            const std::vector<std::string>& keys) = 0;
+    /**
+     * @brief Iterates the nodes at the same depth as start whose keys are in [start, end),
+     *        e.g. scan("/dir/a", "/dir/b") visits children of /dir between them
+     * @return  iterator which needs to be deleted before ori, status of the
+     *          iterator tells whether it stops for an error
+     */
+    virtual ScanIterator* scan(const std::string& start, const std::string end,
+            const ScanOptions& options = ScanOptions()) = 0;
+    /// iterates children of the key
+    virtual ScanIterator* list(const std::string& key,
+            const ScanOptions& options = ScanOptions()) = 0;
     virtual int32_t watch(const std::string& key, watch_cb_t user_callback, void* context) = 0;
+    /**
+     * @brief Watches changes of a key, all the watches of a client share one stream
+     * @param key       [IN] key or directory to watch, watching it again replaces the watch
+     * @param type      [IN] whether changes of the key, its children or all the keys under it
+     * @param callback  [IN] called for every change in order, one at a time, even across
+     *                       failover, should not block since it runs on a client thread
+     * @return          OK if the watch is added
+     */
+    virtual int32_t watch(const std::string& key, WatchType type,
+            const watch_func_t& callback) = 0;
+    virtual int32_t unwatch(const std::string& key) = 0;
+    /**
+     * @brief Waits for a lock, which goes to waiters in order of arrival
+     * @param key   [IN] key of the lock, waiters are temp nodes under it
+     * @return      OK once the lock is held, by the session of the client, so threads
+     *              of a client share it, and it is released if the session expires
+     */
     virtual int32_t lock(const std::string& key) = 0;
+    /// returns LOCKED at once if the lock is held by others
     virtual int32_t try_lock(const std::string& key) = 0;
+    /// wakes the next waiter, NOT_FOUND if the lock is not held
     virtual int32_t unlock(const std::string& key) = 0;
     virtual int32_t login(const std::string& user, const std::string& token) = 0;
     virtual int32_t logout(const std::string& user) = 0;
     virtual int32_t enroll(const std::string& user, const std::string& token) = 0;
     virtual int32_t destroy(const std::string& user) = 0;
+    /// handler is called with the client once its session lease expires
     virtual int32_t timeout_handler(timeout_cb_t handler) = 0;
+    /**
+     * @brief Grants a lease kept alive by the client until it is revoked or expires,
+     *        all the leases of a client share one stream of keepalives
+     * @param lease_id      [OUT] id of the lease
+     * @param ttl           [IN] the lease expires if not renewed within ttl, in milliseconds,
+     *                           server may clamp it
+     * @param on_expired    [IN] called once if the lease expires
+     * @return              OK if the lease is granted
+     */
+    virtual int32_t grant_lease(int64_t& lease_id, int64_t ttl,
+            const lease_func_t& on_expired = lease_func_t()) = 0;
+    /// removes the temp nodes attached to the lease at once
+    virtual int32_t revoke_lease(int64_t lease_id) = 0;
+    /// writes a temp node removed once the lease is revoked or expires
+    virtual int32_t put_with_lease(const std::string& key, const std::string& value,
+            int64_t lease_id) = 0;
     // show cluster
     // get stats
     virtual std::string current_session() = 0;
     virtual std::string current_user() = 0;
     virtual bool is_logged_in() = 0;
 
+    // asynchronous requests are all sent at once without waiting for each other,
+    // callbacks should not block since they run on the threads receiving responses
+    virtual void async_put(const std::string& key, const std::string& value,
+            const done_cb_t& done) = 0;
+    virtual void async_get(const std::string& key, const get_cb_t& done) = 0;
+    virtual void async_remove(const std::string& key, const done_cb_t& done) = 0;
+    /// same as above, but the result is delivered by the returned future
+    std::future<int32_t> async_put(const std::string& key, const std::string& value);
+    std::future<GetResult> async_get(const std::string& key);
+    std::future<int32_t> async_remove(const std::string& key);
+
+    /**
+     * @brief Waits for all the requests to finish
+     * @param futures   [IN] futures of the requests, all of them are consumed
+     * @param statuses  [OUT] status of every request in order, ignored if null
+     * @return OK if all the requests succeed, otherwise status of the first failed one
+     */
+    static int32_t wait_all(std::vector<std::future<int32_t> >& futures,
+            std::vector<int32_t>* statuses = nullptr);
+    static int32_t wait_all(std::vector<std::future<GetResult> >& futures,
+            std::vector<GetResult>* results = nullptr);
+
+    /// statistics of the cache of get results, all zero if cache is disabled
+    virtual CacheStats cache_stats() = 0;
+
     static std::string cluster_status(int32_t cluster_status);
     static std::string status_name(int32_t return_status);
 
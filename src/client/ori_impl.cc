@@ -0,0 +1,746 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "ori_impl.h"
+
+#include <chrono>
+#include <future>
+#include <algorithm>
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace client {
+
+// routes are asked for at most once in this interval, in milliseconds
+static const int64_t s_refresh_interval = 50;
+
+static rpc::RpcClientOptions rpc_options(const OriOptions& options) {
+    rpc::RpcClientOptions rpc_options;
+    rpc_options.channel_num = options.channel_num;
+    return rpc_options;
+}
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+OriImpl::OriImpl(const OriOptions& options,
+        const rpc::RpcClient::channel_factory_t& channel_factory) :
+        _options(options), _rpc(rpc_options(options), channel_factory), _session(0),
+        _timeout_handler(nullptr), _next_server(0), _refreshing(false), _last_refresh(0),
+        _in_flight(0), _stop(false), _pool(options.thread_num, "ori") {
+    if (options.cache_size > 0) {
+        _cache.reset(new NearCache(options.cache_size, options.cache_ttl,
+                    options.cache_revalidate_interval));
+    }
+    LeaseKeeper::send_func_t send = [this](const service::KeepAliveRequest* request,
+            service::KeepAliveResponse* response, const std::function<void (int32_t)>& done) {
+        this->request(&service::OrionService_Stub::keep_alive, request, response, done);
+    };
+    _leases.reset(new LeaseKeeper(_options.ns, send, &_pool));
+    // leaders are learned before the first request in most cases
+    refresh_routes();
+    if (_cache) {
+        watch_stream();
+    }
+}
+
+OriImpl::~OriImpl() {
+    {
+        std::lock_guard<std::mutex> locker(_watch_mutex);
+        if (_watch) {
+            _watch->stop();
+        }
+    }
+    // session lease is left to expire on server
+    _leases->stop();
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _stop = true;
+    }
+    _pool.stop(false);
+    std::vector<call_t> waiting;
+    {
+        std::unique_lock<std::mutex> locker(_mutex);
+        while (_in_flight > 0) {
+            _cond.wait(locker);
+        }
+        waiting.swap(_waiting);
+    }
+    for (auto& call : waiting) {
+        call->done(status_code::TIMEOUT);
+    }
+}
+
+int32_t OriImpl::put(const std::string& key, const std::string& value, bool temp) {
+    if (temp) {
+        int64_t lease_id = 0;
+        int32_t status = session(&lease_id);
+        if (status != status_code::OK) {
+            return status;
+        }
+        status = put_with_lease(key, value, lease_id);
+        check_session(lease_id, status);
+        return status;
+    }
+    return async_put(key, value).get();
+}
+
+int32_t OriImpl::get(std::string& value, const std::string& key) {
+    GetResult result = async_get(key).get();
+    if (result.status == status_code::OK) {
+        value.swap(result.value);
+    }
+    return result.status;
+}
+
+int32_t OriImpl::remove(const std::string& key) {
+    return async_remove(key).get();
+}
+
+int32_t OriImpl::batch_get(std::vector<std::string>& values, std::vector<int32_t>& statuses,
+        const std::vector<std::string>& keys) {
+    service::BatchGetRequest request;
+    service::BatchGetResponse response;
+    request.mutable_keys()->Reserve(keys.size());
+    for (const auto& key : keys) {
+        request.add_keys(key);
+    }
+    request.set_ns(_options.ns);
+    int32_t status = wait(&service::OrionService_Stub::batch_get, &request, &response);
+    if (status != status_code::OK) {
+        return status;
+    }
+    if (response.statuses_size() != static_cast<int>(keys.size())
+            || response.values_size() != static_cast<int>(keys.size())) {
+        return status_code::INVALID;
+    }
+    statuses.assign(response.statuses().begin(), response.statuses().end());
+    values.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        values[i].swap(*response.mutable_values(i));
+    }
+    return status;
+}
+
+int32_t OriImpl::batch_put(std::vector<int32_t>& statuses, const std::vector<std::string>& keys,
+        const std::vector<std::string>& values) {
+    if (keys.size() != values.size()) {
+        return status_code::INVALID;
+    }
+    service::BatchPutRequest request;
+    service::BatchPutResponse response;
+    request.mutable_keys()->Reserve(keys.size());
+    request.mutable_values()->Reserve(values.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        request.add_keys(keys[i]);
+        request.add_values(values[i]);
+    }
+    request.set_ns(_options.ns);
+    int32_t status = wait(&service::OrionService_Stub::batch_put, &request, &response);
+    for (const auto& key : keys) {
+        drop_cached(key);
+    }
+    if (status == status_code::OK) {
+        statuses.assign(response.statuses().begin(), response.statuses().end());
+    }
+    return status;
+}
+
+int32_t OriImpl::batch_remove(std::vector<int32_t>& statuses,
+        const std::vector<std::string>& keys) {
+    service::BatchDeleteRequest request;
+    service::BatchDeleteResponse response;
+    request.mutable_keys()->Reserve(keys.size());
+    for (const auto& key : keys) {
+        request.add_keys(key);
+    }
+    request.set_ns(_options.ns);
+    int32_t status = wait(&service::OrionService_Stub::batch_remove, &request, &response);
+    for (const auto& key : keys) {
+        drop_cached(key);
+    }
+    if (status == status_code::OK) {
+        statuses.assign(response.statuses().begin(), response.statuses().end());
+    }
+    return status;
+}
+
+void OriImpl::async_put(const std::string& key, const std::string& value,
+        const done_cb_t& done) {
+    std::shared_ptr<service::PutRequest> request(new service::PutRequest());
+    std::shared_ptr<service::PutResponse> response(new service::PutResponse());
+    request->set_key(key);
+    request->set_value(value);
+    request->set_ns(_options.ns);
+    // request and response live as long as the call holding them
+    this->request(&service::OrionService_Stub::put, request.get(), response.get(),
+            [this, request, response, done](int32_t status) {
+                // a failed write may have been applied as well
+                drop_cached(request->key());
+                if (done) {
+                    done(status);
+                }
+            });
+}
+
+void OriImpl::async_get(const std::string& key, const get_cb_t& done) {
+    std::shared_ptr<service::GetRequest> request(new service::GetRequest());
+    std::shared_ptr<service::GetResponse> response(new service::GetResponse());
+    request->set_key(key);
+    request->set_ns(_options.ns);
+    int64_t ticket = 0;
+    if (_cache) {
+        int32_t status = status_code::OK;
+        std::string value;
+        if (_cache->get(status, value, key)) {
+            if (done) {
+                done(status, value);
+            }
+            return;
+        }
+        ticket = _cache->begin_fill(key);
+    }
+    this->request(&service::OrionService_Stub::get, request.get(), response.get(),
+            [this, request, response, done, ticket](int32_t status) {
+                if (_cache) {
+                    _cache->fill(request->key(), ticket, status, response->value());
+                    // keys dropped by writes and evictions are unwatched with it as well
+                    watch_stream()->sync_cache();
+                }
+                if (done) {
+                    done(status, status == status_code::OK ? response->value() : "");
+                }
+            });
+}
+
+void OriImpl::async_remove(const std::string& key, const done_cb_t& done) {
+    std::shared_ptr<service::DeleteRequest> request(new service::DeleteRequest());
+    std::shared_ptr<service::DeleteResponse> response(new service::DeleteResponse());
+    request->set_key(key);
+    request->set_ns(_options.ns);
+    this->request(&service::OrionService_Stub::remove, request.get(), response.get(),
+            [this, request, response, done](int32_t status) {
+                drop_cached(request->key());
+                if (done) {
+                    done(status);
+                }
+            });
+}
+
+/**
+ * @brief Iterates nodes fetched page by page
+ *
+ * The next page is requested as soon as the current one arrives, so that
+ * reading a page overlaps with fetching the next one. At most two pages are
+ * held in memory. Pages left in flight by destruction are released when done.
+ */
+template <class Request>
+class PageIterator : public ScanIterator {
+public:
+    typedef void (service::OrionService_Stub::*method_t)(google::protobuf::RpcController*,
+            const Request*, service::ScanResponse*, google::protobuf::Closure*);
+
+    PageIterator(OriImpl* ori, method_t method, const Request& request) :
+            _ori(ori), _method(method), _pos(0), _status(status_code::OK) {
+        _current = fetch(request);
+        wait_page();
+    }
+    virtual ~PageIterator() { }
+
+    virtual std::string key() {
+        return done() ? "" : _current->response.keys(_pos);
+    }
+    virtual std::string value() {
+        return done() || _pos >= _current->response.values_size() ?
+            "" : _current->response.values(_pos);
+    }
+    virtual ScanIterator* next() {
+        if (done()) {
+            return this;
+        }
+        ++_pos;
+        while (_status == status_code::OK && _pos >= _current->response.keys_size() && _next) {
+            _current = _next;
+            _next.reset();
+            _pos = 0;
+            wait_page();
+        }
+        return this;
+    }
+    virtual bool done() {
+        return _status != status_code::OK || _pos >= _current->response.keys_size();
+    }
+    virtual int32_t status() {
+        return _status;
+    }
+private:
+    struct Page {
+        Request request;
+        service::ScanResponse response;
+        std::promise<int32_t> promise;
+        std::future<int32_t> result;
+    };
+    typedef std::shared_ptr<Page> page_t;
+
+    page_t fetch(const Request& request) {
+        page_t page(new Page());
+        page->request = request;
+        page->result = page->promise.get_future();
+        // page is held by the call until done, even if iterator is gone
+        _ori->request(_method, &page->request, &page->response,
+                [page](int32_t status) { page->promise.set_value(status); });
+        return page;
+    }
+    /// waits for current page and prefetches the next one
+    void wait_page() {
+        _status = _current->result.get();
+        const std::string& continuation = _current->response.continuation_key();
+        if (_status == status_code::OK && !continuation.empty()) {
+            Request request = _current->request;
+            request.set_continuation_key(continuation);
+            _next = fetch(request);
+        }
+    }
+private:
+    OriImpl* _ori;
+    method_t _method;
+    page_t _current;
+    page_t _next;
+    int32_t _pos;
+    int32_t _status;
+};
+
+ScanIterator* OriImpl::scan(const std::string& start, const std::string end,
+        const ScanOptions& options) {
+    service::ScanRequest request;
+    request.set_start(start);
+    request.set_end(end);
+    request.set_ns(_options.ns);
+    request.set_limit(options.page_size);
+    request.set_max_bytes(options.page_bytes);
+    request.set_keys_only(options.keys_only);
+    return new PageIterator<service::ScanRequest>(this, &service::OrionService_Stub::scan,
+            request);
+}
+
+ScanIterator* OriImpl::list(const std::string& key, const ScanOptions& options) {
+    service::ListRequest request;
+    request.set_key(key);
+    request.set_ns(_options.ns);
+    request.set_limit(options.page_size);
+    request.set_max_bytes(options.page_bytes);
+    request.set_keys_only(options.keys_only);
+    return new PageIterator<service::ListRequest>(this, &service::OrionService_Stub::list,
+            request);
+}
+
+int32_t OriImpl::watch(const std::string& key, watch_cb_t user_callback, void* context) {
+    if (user_callback == nullptr) {
+        return status_code::INVALID;
+    }
+    return watch(key, WATCH_KEY, [user_callback, context](const WatchParam& param,
+                int32_t status) {
+                WatchParam user_param = param;
+                user_param.context = context;
+                user_callback(user_param, status);
+            });
+}
+
+int32_t OriImpl::watch(const std::string& key, WatchType type, const watch_func_t& callback) {
+    return watch_stream()->watch(key, type, callback);
+}
+
+int32_t OriImpl::unwatch(const std::string& key) {
+    return watch_stream()->unwatch(key);
+}
+
+int32_t OriImpl::lock(const std::string& key) {
+    return acquire(key, true);
+}
+
+int32_t OriImpl::try_lock(const std::string& key) {
+    return acquire(key, false);
+}
+
+int32_t OriImpl::unlock(const std::string& key) {
+    int64_t lease_id = 0;
+    {
+        std::lock_guard<std::mutex> locker(_session_mutex);
+        lease_id = _session;
+    }
+    if (lease_id == 0) {
+        return status_code::NOT_FOUND;
+    }
+    service::UnlockRequest request;
+    service::UnlockResponse response;
+    request.set_key(key);
+    request.set_ns(_options.ns);
+    request.set_lease_id(lease_id);
+    return wait(&service::OrionService_Stub::unlock, &request, &response);
+}
+
+int32_t OriImpl::login(const std::string& /*user*/, const std::string& /*token*/) {
+    return status_code::NOT_SUPPORTED;
+}
+
+int32_t OriImpl::logout(const std::string& /*user*/) {
+    return status_code::NOT_SUPPORTED;
+}
+
+int32_t OriImpl::enroll(const std::string& /*user*/, const std::string& /*token*/) {
+    return status_code::NOT_SUPPORTED;
+}
+
+int32_t OriImpl::destroy(const std::string& /*user*/) {
+    return status_code::NOT_SUPPORTED;
+}
+
+int32_t OriImpl::timeout_handler(timeout_cb_t handler) {
+    std::lock_guard<std::mutex> locker(_session_mutex);
+    _timeout_handler = handler;
+    return status_code::OK;
+}
+
+int32_t OriImpl::grant_lease(int64_t& lease_id, int64_t ttl, const lease_func_t& on_expired) {
+    if (ttl <= 0) {
+        return status_code::INVALID;
+    }
+    service::GrantLeaseRequest request;
+    service::GrantLeaseResponse response;
+    request.set_ns(_options.ns);
+    request.set_ttl(ttl);
+    int32_t status = wait(&service::OrionService_Stub::grant_lease, &request, &response);
+    if (status != status_code::OK) {
+        return status;
+    }
+    lease_id = response.lease_id();
+    _leases->add(lease_id, response.ttl(), on_expired);
+    return status;
+}
+
+int32_t OriImpl::revoke_lease(int64_t lease_id) {
+    _leases->remove(lease_id);
+    {
+        std::lock_guard<std::mutex> locker(_session_mutex);
+        if (_session == lease_id) {
+            _session = 0;
+        }
+    }
+    service::RevokeLeaseRequest request;
+    service::RevokeLeaseResponse response;
+    request.set_ns(_options.ns);
+    request.set_lease_id(lease_id);
+    return wait(&service::OrionService_Stub::revoke_lease, &request, &response);
+}
+
+int32_t OriImpl::put_with_lease(const std::string& key, const std::string& value,
+        int64_t lease_id) {
+    if (lease_id == 0) {
+        return status_code::INVALID;
+    }
+    service::PutRequest request;
+    service::PutResponse response;
+    request.set_key(key);
+    request.set_value(value);
+    request.set_ns(_options.ns);
+    request.set_lease_id(lease_id);
+    int32_t status = wait(&service::OrionService_Stub::put, &request, &response);
+    // a failed write may have been applied as well
+    drop_cached(key);
+    return status;
+}
+
+std::string OriImpl::current_session() {
+    std::lock_guard<std::mutex> locker(_session_mutex);
+    return _session != 0 ? std::to_string(_session) : "";
+}
+
+std::string OriImpl::current_user() {
+    return "";
+}
+
+bool OriImpl::is_logged_in() {
+    return false;
+}
+
+CacheStats OriImpl::cache_stats() {
+    return _cache ? _cache->stats() : CacheStats();
+}
+
+std::string OriImpl::leader(const std::string& ns) const {
+    return _routes.leader(_routes.group_of(ns));
+}
+
+template <class Request, class Response>
+void OriImpl::request(void (service::OrionService_Stub::*method)(google::protobuf::RpcController*,
+            const Request*, Response*, google::protobuf::Closure*),
+        const Request* request, Response* response, const std::function<void (int32_t)>& done) {
+    call_t call(new Call());
+    call->ns = request->ns();
+    call->group_id = 0;
+    call->hops = 0;
+    call->deadline = now_ms() + _options.request_timeout;
+    call->done = done;
+    call->send = [this, method, request, response](const call_t& call, const std::string& server) {
+        if (!begin_rpc()) {
+            call->done(status_code::TIMEOUT);
+            return;
+        }
+        service::OrionService_Stub* stub = _rpc.stub<service::OrionService_Stub>(server);
+        response->Clear();
+        std::function<void (const Request*, Response*, bool, int)> callback =
+            [this, call, server](const Request*, Response* response, bool failed, int) {
+                if (failed) {
+                    on_response(call, server, -1, "");
+                } else {
+                    on_response(call, server, response->status(), response->leader_id());
+                }
+                end_rpc();
+            };
+        _rpc.async_request(stub, method, request, response, callback, _options.rpc_timeout, 1);
+    };
+    dispatch(call);
+}
+
+template <class Request, class Response>
+int32_t OriImpl::wait(void (service::OrionService_Stub::*method)(google::protobuf::RpcController*,
+            const Request*, Response*, google::protobuf::Closure*),
+        const Request* request, Response* response) {
+    std::promise<int32_t> result;
+    this->request(method, request, response,
+            [&result](int32_t status) { result.set_value(status); });
+    return result.get_future().get();
+}
+
+void OriImpl::dispatch(const call_t& call) {
+    if (now_ms() >= call->deadline) {
+        call->done(status_code::TIMEOUT);
+        return;
+    }
+    call->group_id = _routes.group_of(call->ns);
+    std::string server = _routes.leader(call->group_id);
+    if (server.empty()) {
+        server = next_server();
+    }
+    call->send(call, server);
+}
+
+void OriImpl::on_response(const call_t& call, const std::string& server, int32_t status,
+        const std::string& leader) {
+    if (status == status_code::NOT_LEADER && !leader.empty() && leader != server
+            && call->hops < _options.max_redirects) {
+        // follower knows the leader, which saves a round trip to ask for routes
+        ++call->hops;
+        _routes.update(call->group_id, leader, 0);
+        call->send(call, leader);
+        return;
+    }
+    if (status < 0 || status == status_code::NOT_LEADER) {
+        // server is unreachable or not the leader anymore
+        if (_routes.leader(call->group_id) == server) {
+            _routes.update(call->group_id, "", 0);
+        }
+        retry(call);
+        return;
+    }
+    if (_routes.leader(call->group_id).empty()) {
+        _routes.update(call->group_id, server, 0);
+    }
+    call->done(status);
+}
+
+void OriImpl::retry(const call_t& call) {
+    if (now_ms() >= call->deadline) {
+        call->done(status_code::TIMEOUT);
+        return;
+    }
+    bool parked = false;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (!_stop) {
+            call->hops = 0;
+            _waiting.push_back(call);
+            parked = true;
+        }
+    }
+    // a parked call is completed by whoever takes it from the waiting list
+    if (!parked) {
+        call->done(status_code::TIMEOUT);
+        return;
+    }
+    refresh_routes();
+}
+
+void OriImpl::refresh_routes() {
+    int64_t delay = 0;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (_refreshing || _stop) {
+            return;
+        }
+        _refreshing = true;
+        delay = std::max(_last_refresh + s_refresh_interval - now_ms(), 0L);
+    }
+    _pool.delay_task(delay, std::bind(&OriImpl::send_route, this));
+}
+
+void OriImpl::send_route() {
+    const std::string& server = next_server();
+    if (!begin_rpc()) {
+        return;
+    }
+    service::OrionService_Stub* stub = _rpc.stub<service::OrionService_Stub>(server);
+    service::RouteRequest* request = new service::RouteRequest();
+    service::RouteResponse* response = new service::RouteResponse();
+    std::function<void (const service::RouteRequest*, service::RouteResponse*, bool, int)> callback =
+        [this](const service::RouteRequest* request, service::RouteResponse* response,
+                bool failed, int) {
+            on_route(response, failed);
+            delete request;
+            delete response;
+            end_rpc();
+        };
+    _rpc.async_request(stub, &service::OrionService_Stub::route, request, response,
+            callback, _options.rpc_timeout, 1);
+}
+
+void OriImpl::on_route(const service::RouteResponse* response, bool failed) {
+    if (!failed && response->status() == status_code::OK) {
+        _routes.reset(response->group_num());
+        for (const auto& route : response->groups()) {
+            _routes.update(route.group_id(), route.leader_id(), route.term());
+        }
+    }
+    std::vector<call_t> waiting;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _refreshing = false;
+        _last_refresh = now_ms();
+        waiting.swap(_waiting);
+    }
+    // groups still without leader are sent to any server, and wait for the next refresh
+    // if that server does not know the leader either
+    for (auto& call : waiting) {
+        dispatch(call);
+    }
+}
+
+void OriImpl::drop_cached(const std::string& key) {
+    if (!_cache) {
+        return;
+    }
+    _cache->invalidate(key);
+    // parents missing before may be created by the write
+    for (size_t sep = key.rfind('/', key.size() - 1); sep != std::string::npos && sep > 0;
+            sep = key.rfind('/', sep - 1)) {
+        _cache->invalidate(key.substr(0, sep));
+    }
+}
+
+WatchStream* OriImpl::watch_stream() {
+    std::lock_guard<std::mutex> locker(_watch_mutex);
+    if (!_watch) {
+        WatchStream::send_func_t send = [this](const service::WatchRequest* request,
+                service::WatchResponse* response, const std::function<void (int32_t)>& done) {
+            this->request(&service::OrionService_Stub::watch, request, response, done);
+        };
+        _watch.reset(new WatchStream(_options.ns, _options.watch_wait, send, &_pool,
+                    _cache.get()));
+    }
+    return _watch.get();
+}
+
+int32_t OriImpl::session(int64_t* lease_id) {
+    // held while granting, so that concurrent temp writes share one session
+    std::lock_guard<std::mutex> locker(_session_mutex);
+    if (_session == 0) {
+        int32_t status = grant_lease(_session, _options.session_ttl,
+                std::bind(&OriImpl::on_session_expired, this, std::placeholders::_1));
+        if (status != status_code::OK) {
+            _session = 0;
+            return status;
+        }
+    }
+    *lease_id = _session;
+    return status_code::OK;
+}
+
+void OriImpl::check_session(int64_t lease_id, int32_t status) {
+    if (status == status_code::LEASE_EXPIRED && _leases->remove(lease_id)) {
+        on_session_expired(lease_id);
+    }
+}
+
+int32_t OriImpl::acquire(const std::string& key, bool queue) {
+    int64_t lease_id = 0;
+    int32_t status = session(&lease_id);
+    if (status != status_code::OK) {
+        return status;
+    }
+    service::LockRequest request;
+    service::LockResponse response;
+    request.set_key(key);
+    request.set_ns(_options.ns);
+    request.set_lease_id(lease_id);
+    request.set_wait_ms(_options.lock_wait);
+    request.set_queue(queue);
+    // the session keeps its place in the queue between requests, and server
+    // answers the next one alone once the lock is released
+    do {
+        status = wait(&service::OrionService_Stub::lock, &request, &response);
+    } while (status == status_code::LOCKED && queue);
+    check_session(lease_id, status);
+    if (status != status_code::OK && status != status_code::LOCKED
+            && status != status_code::LEASE_EXPIRED) {
+        // a waiter left behind would hold the lock once it comes to the head
+        unlock(key);
+    }
+    return status;
+}
+
+void OriImpl::on_session_expired(int64_t lease_id) {
+    timeout_cb_t handler = nullptr;
+    {
+        std::lock_guard<std::mutex> locker(_session_mutex);
+        if (_session != lease_id) {
+            return;
+        }
+        _session = 0;
+        handler = _timeout_handler;
+    }
+    LOG(WARNING, "[lease]: session %ld expired", lease_id);
+    if (handler != nullptr) {
+        handler(this);
+    }
+}
+
+std::string OriImpl::next_server() {
+    if (_options.servers.empty()) {
+        return "";
+    }
+    return _options.servers[_next_server++ % _options.servers.size()];
+}
+
+bool OriImpl::begin_rpc() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return false;
+    }
+    ++_in_flight;
+    return true;
+}
+
+void OriImpl::end_rpc() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    --_in_flight;
+    _cond.notify_all();
+}
+
+} // namespace client
+} // namespace orion
@@ -0,0 +1,185 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_CLIENT_ORI_IMPL_H
+#define ORION_CLIENT_ORI_IMPL_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include "client/ori.h"
+#include "proto/service.pb.h"
+#include "common/rpc_client.h"
+#include "common/routing_table.h"
+#include "common/thread_pool.h"
+#include "client/near_cache.h"
+#include "client/watch_stream.h"
+#include "client/lease_keeper.h"
+
+namespace orion {
+namespace client {
+
+/**
+ * @brief Client of an orion cluster sending requests straight to leaders
+ *
+ * Leader of every raft group is cached in a RoutingTable learned from the
+ * route rpc. A request sent to a follower follows the leader carried by
+ * the response, at most max_redirects times. A request that finds no leader
+ * waits until routes are refreshed in background and is sent again, so that
+ * requests in flight survive a failover as long as a new leader is elected
+ * before request timeout. Results of get are cached in client if cache is
+ * enabled, keys written by the client itself are dropped from cache, and
+ * keys written by others are refreshed by a watch of the whole namespace.
+ */
+class OriImpl : public Ori {
+public:
+    /// channel factory replaces the network if given
+    OriImpl(const OriOptions& options, const rpc::RpcClient::channel_factory_t& channel_factory =
+            rpc::RpcClient::channel_factory_t());
+    /// waits for all the rpc in flight
+    virtual ~OriImpl();
+    /// disable copy and move for ori impl
+    OriImpl(const OriImpl&) = delete;
+    void operator=(const OriImpl&) = delete;
+
+    virtual int32_t put(const std::string& key, const std::string& value, bool temp = false);
+    virtual int32_t get(std::string& value, const std::string& key);
+    virtual int32_t remove(const std::string& key);
+    virtual int32_t batch_get(std::vector<std::string>& values, std::vector<int32_t>& statuses,
+            const std::vector<std::string>& keys);
+    virtual int32_t batch_put(std::vector<int32_t>& statuses, const std::vector<std::string>& keys,
+            const std::vector<std::string>& values);
+    virtual int32_t batch_remove(std::vector<int32_t>& statuses,
+            const std::vector<std::string>& keys);
+    virtual ScanIterator* scan(const std::string& start, const std::string end,
+            const ScanOptions& options = ScanOptions());
+    virtual ScanIterator* list(const std::string& key,
+            const ScanOptions& options = ScanOptions());
+    virtual int32_t watch(const std::string& key, watch_cb_t user_callback, void* context);
+    virtual int32_t watch(const std::string& key, WatchType type, const watch_func_t& callback);
+    virtual int32_t unwatch(const std::string& key);
+    virtual int32_t lock(const std::string& key);
+    virtual int32_t try_lock(const std::string& key);
+    virtual int32_t unlock(const std::string& key);
+    virtual int32_t login(const std::string& user, const std::string& token);
+    virtual int32_t logout(const std::string& user);
+    virtual int32_t enroll(const std::string& user, const std::string& token);
+    virtual int32_t destroy(const std::string& user);
+    virtual int32_t timeout_handler(timeout_cb_t handler);
+    virtual int32_t grant_lease(int64_t& lease_id, int64_t ttl,
+            const lease_func_t& on_expired = lease_func_t());
+    virtual int32_t revoke_lease(int64_t lease_id);
+    virtual int32_t put_with_lease(const std::string& key, const std::string& value,
+            int64_t lease_id);
+    virtual std::string current_session();
+    virtual std::string current_user();
+    virtual bool is_logged_in();
+    virtual void async_put(const std::string& key, const std::string& value,
+            const done_cb_t& done);
+    virtual void async_get(const std::string& key, const get_cb_t& done);
+    virtual void async_remove(const std::string& key, const done_cb_t& done);
+    using Ori::async_put;
+    using Ori::async_get;
+    using Ori::async_remove;
+    virtual CacheStats cache_stats();
+
+    /// returns the cached leader of the group owning namespace, empty if unknown
+    std::string leader(const std::string& ns) const;
+private:
+    template <class Request> friend class PageIterator;
+    /// a request being routed to the leader of its group
+    struct Call {
+        std::string ns;
+        // group owning ns when the call is dispatched, routes may change between retries
+        int32_t group_id;
+        // redirects followed since last time routes are refreshed
+        int32_t hops;
+        int64_t deadline;
+        // sends the request to a server, response is handled by on_response
+        std::function<void (const std::shared_ptr<Call>&, const std::string&)> send;
+        std::function<void (int32_t)> done;
+    };
+    typedef std::shared_ptr<Call> call_t;
+
+    /**
+     * @brief Sends a request to the leader of the group owning its namespace
+     * @param method    [IN] method of the stub
+     * @param request   [IN] request, must be valid until done is called
+     * @param response  [OUT] response, must be valid until done is called
+     * @param done      [IN] called with the status answered by leader
+     */
+    template <class Request, class Response>
+    void request(void (service::OrionService_Stub::*method)(google::protobuf::RpcController*,
+                const Request*, Response*, google::protobuf::Closure*),
+            const Request* request, Response* response, const std::function<void (int32_t)>& done);
+    /// sends a request and waits for it to be done, returns status of the request
+    template <class Request, class Response>
+    int32_t wait(void (service::OrionService_Stub::*method)(google::protobuf::RpcController*,
+                const Request*, Response*, google::protobuf::Closure*),
+            const Request* request, Response* response);
+    /// sends call to the cached leader, or any server if leader is unknown
+    void dispatch(const call_t& call);
+    /// status is -1 if rpc failed
+    void on_response(const call_t& call, const std::string& server, int32_t status,
+            const std::string& leader);
+    /// parks call until routes are refreshed
+    void retry(const call_t& call);
+    /// refreshes routes in background, at most once every refresh interval
+    void refresh_routes();
+    void send_route();
+    void on_route(const service::RouteResponse* response, bool failed);
+    /// drops key and its parents from cache after the key is written
+    void drop_cached(const std::string& key);
+    /// returns the stream of watches, created if not yet
+    WatchStream* watch_stream();
+    /// returns the session lease, granted if not yet
+    int32_t session(int64_t* lease_id);
+    void on_session_expired(int64_t lease_id);
+    /// lease found gone by a request is not waited to be reported by keepalives
+    void check_session(int64_t lease_id, int32_t status);
+    /// queues the session on lock, or tries it only
+    int32_t acquire(const std::string& key, bool queue);
+    std::string next_server();
+    /// returns false if client is being destroyed
+    bool begin_rpc();
+    void end_rpc();
+private:
+    OriOptions _options;
+    rpc::RpcClient _rpc;
+    common::RoutingTable _routes;
+    // null if get results are not cached
+    std::unique_ptr<NearCache> _cache;
+    // created by the first watch, or with cache
+    std::unique_ptr<WatchStream> _watch;
+    std::mutex _watch_mutex;
+    // keeps alive the session lease and the leases granted by user
+    std::unique_ptr<LeaseKeeper> _leases;
+    // session lease, 0 if not granted yet or expired
+    int64_t _session;
+    timeout_cb_t _timeout_handler;
+    std::mutex _session_mutex;
+    std::atomic<uint32_t> _next_server;
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    // calls waiting for routes to be refreshed
+    std::vector<call_t> _waiting;
+    bool _refreshing;
+    int64_t _last_refresh;
+    int64_t _in_flight;
+    bool _stop;
+    // runs route refreshes, keepalives of _leases and deliveries of _watch,
+    // which all outlive it
+    common::ThreadPool _pool;
+};
+
+} // namespace client
+} // namespace orion
+
+#endif // ORION_CLIENT_ORI_IMPL_H
@@ -0,0 +1,326 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "watch_stream.h"
+
+#include <algorithm>
+#include "client/near_cache.h"
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace client {
+
+// delay of the first poll after a failure, doubled by every failure in a row
+static const int64_t s_min_backoff = 50;
+static const int64_t s_max_backoff = 2000;
+
+WatchStream::WatchStream(const std::string& ns, int32_t wait_ms, const send_func_t& send,
+        common::ThreadPool* pool, NearCache* cache) : _ns(ns), _wait_ms(wait_ms),
+        _send(send), _pool(pool), _cache(cache), _stream_id(0), _revision(0), _polling(0),
+        _failures(0), _stop(false), _delivering(false) {
+}
+
+int32_t WatchStream::watch(const std::string& key, WatchType type,
+        const watch_func_t& callback) {
+    if (key.empty() || !callback) {
+        return status_code::INVALID;
+    }
+    std::unique_lock<std::mutex> locker(_mutex);
+    if (_stop) {
+        return status_code::TIMEOUT;
+    }
+    Watch& watch = _watches[key];
+    watch.type = type;
+    watch.callback = callback;
+    _removed.erase(key);
+    _added[key] = watch_type(key);
+    // a parked poll is answered once the new one reaches server, and an open
+    // in flight is followed by a poll carrying the new watch
+    if (_stream_id != 0 || _polling == 0) {
+        poll(locker);
+    }
+    return status_code::OK;
+}
+
+int32_t WatchStream::unwatch(const std::string& key) {
+    std::unique_lock<std::mutex> locker(_mutex);
+    auto it = _watches.find(key);
+    if (it == _watches.end()) {
+        return status_code::NOT_FOUND;
+    }
+    _watches.erase(it);
+    if (_cached.count(key) > 0) {
+        // the key stays watched for cache
+        _added[key] = watch_type(key);
+        return status_code::OK;
+    }
+    _added.erase(key);
+    _removed.insert(key);
+    // removal is sent with the next poll, changes of the key are dropped until then
+    return status_code::OK;
+}
+
+void WatchStream::sync_cache() {
+    std::unique_lock<std::mutex> locker(_mutex);
+    if (_stop || !take_cache_changes()) {
+        return;
+    }
+    if (_stream_id != 0 || _polling == 0) {
+        poll(locker);
+    }
+}
+
+void WatchStream::stop() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _stop = true;
+    _callbacks.clear();
+}
+
+bool WatchStream::match(int32_t type, const std::string& watched, const std::string& key) {
+    if (type == WATCH_KEY) {
+        return key == watched;
+    }
+    std::string dir = watched;
+    if (dir.empty() || dir.back() != '/') {
+        dir.push_back('/');
+    }
+    if (key.size() <= dir.size() || key.compare(0, dir.size(), dir) != 0) {
+        return type == WATCH_SUBTREE && key == watched;
+    }
+    return type == WATCH_SUBTREE || key.find('/', dir.size()) == std::string::npos;
+}
+
+int32_t WatchStream::watch_type(const std::string& key) const {
+    auto user = _watches.find(key);
+    auto cached = _cached.find(key);
+    if (user == _watches.end()) {
+        return cached->second.type;
+    }
+    if (cached == _cached.end() || cached->second.type == user->second.type) {
+        return user->second.type;
+    }
+    return WATCH_SUBTREE;
+}
+
+bool WatchStream::take_cache_changes() {
+    if (_cache == nullptr) {
+        return false;
+    }
+    std::map<std::string, int32_t> changes;
+    _cache->take_changes(&changes);
+    bool changed = false;
+    for (const auto& change : changes) {
+        const std::string& key = change.first;
+        auto it = _cached.find(key);
+        if (change.second < 0) {
+            if (it == _cached.end()) {
+                continue;
+            }
+            _cached.erase(it);
+            if (_watches.count(key) > 0) {
+                _added[key] = watch_type(key);
+            } else {
+                _added.erase(key);
+                _removed.insert(key);
+            }
+            changed = true;
+        } else if (it != _cached.end() && it->second.type == change.second) {
+            // the key has left the cache and come back, server kept watching it
+            if (it->second.confirmed) {
+                _cache->set_watched(key, change.second);
+            }
+        } else {
+            CacheWatch& watch = _cached[key];
+            watch.type = change.second;
+            watch.confirmed = false;
+            _removed.erase(key);
+            _added[key] = watch_type(key);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void WatchStream::poll(std::unique_lock<std::mutex>& locker) {
+    take_cache_changes();
+    if (_stop || (_watches.empty() && _cached.empty())) {
+        return;
+    }
+    request_t request(new service::WatchRequest());
+    response_t response(new service::WatchResponse());
+    request->set_ns(_ns);
+    request->set_stream_id(_stream_id);
+    request->set_revision(_revision);
+    request->set_wait_ms(_wait_ms);
+    if (_stream_id == 0) {
+        for (const auto& watch : _watches) {
+            service::WatchKey* key = request->add_add();
+            key->set_key(watch.first);
+            key->set_type(watch_type(watch.first));
+        }
+        for (const auto& watch : _cached) {
+            if (_watches.count(watch.first) == 0) {
+                service::WatchKey* key = request->add_add();
+                key->set_key(watch.first);
+                key->set_type(watch.second.type);
+            }
+        }
+    } else {
+        for (const auto& watch : _added) {
+            service::WatchKey* key = request->add_add();
+            key->set_key(watch.first);
+            key->set_type(watch.second);
+        }
+        for (const auto& key : _removed) {
+            request->add_remove(key);
+        }
+    }
+    _added.clear();
+    _removed.clear();
+    ++_polling;
+    // done may be called at once if client is being destroyed
+    locker.unlock();
+    _send(request.get(), response.get(), [this, request, response](int32_t status) {
+                on_poll(request, response, status);
+            });
+}
+
+void WatchStream::on_poll(const request_t& request, const response_t& response,
+        int32_t status) {
+    std::unique_lock<std::mutex> locker(_mutex);
+    --_polling;
+    if (_stop) {
+        return;
+    }
+    bool reopen = false;
+    if (status == status_code::OK || status == status_code::RESYNC) {
+        _failures = 0;
+        if (_stream_id == 0 && request->stream_id() == 0) {
+            _stream_id = response->stream_id();
+        }
+        if (_cache != nullptr) {
+            _cache->set_watching(true);
+        }
+        int64_t stream_id = request->stream_id() != 0 ? request->stream_id()
+            : response->stream_id();
+        for (const auto& watch : request->add()) {
+            auto it = _cached.find(watch.key());
+            if (stream_id != _stream_id || it == _cached.end()) {
+                continue;
+            }
+            if (watch.type() == WATCH_SUBTREE || watch.type() == it->second.type) {
+                it->second.confirmed = true;
+                _cache->set_watched(watch.key(), it->second.type);
+            }
+        }
+    } else {
+        // stream is gone with its server, or the poll is lost, it is reopened
+        // from the revision received so far
+        if (request->stream_id() == _stream_id) {
+            _stream_id = 0;
+        }
+        reopen = status != status_code::NOT_FOUND;
+        if (reopen && _cache != nullptr) {
+            _cache->set_watching(false);
+        }
+    }
+    bool queued = false;
+    if (status == status_code::OK) {
+        service::WatchEvent event;
+        for (const auto& data : response->events()) {
+            if (!event.ParseFromString(data)) {
+                LOG(WARNING, "[watch]: drop a broken event");
+                continue;
+            }
+            // events received by a replaced poll are skipped
+            if (event.revision() <= _revision) {
+                continue;
+            }
+            if (_cache != nullptr) {
+                // dropped instead of updated, as the event may be older than a value
+                // read after the client's own write
+                const std::string& key = event.key();
+                _cache->invalidate(key);
+                // parents created by the write have no events of their own
+                for (size_t sep = key.rfind('/', key.size() - 1);
+                        sep != std::string::npos && sep > 0 && !event.deleted();
+                        sep = key.rfind('/', sep - 1)) {
+                    _cache->invalidate(key.substr(0, sep));
+                }
+            }
+            WatchParam param;
+            param.key = event.key();
+            param.value = event.value();
+            param.deleted = event.deleted();
+            param.revision = event.revision();
+            param.context = nullptr;
+            for (const auto& watch : _watches) {
+                if (match(watch.second.type, watch.first, event.key())) {
+                    watch_func_t callback = watch.second.callback;
+                    _callbacks.push_back([callback, param]() {
+                                callback(param, status_code::OK);
+                            });
+                    queued = true;
+                }
+            }
+        }
+        _revision = std::max(_revision, response->revision());
+    } else if (status == status_code::RESYNC && response->revision() > _revision) {
+        LOG(WARNING, "[watch]: changes before %ld are lost", response->revision());
+        if (_cache != nullptr) {
+            _cache->invalidate_all();
+        }
+        for (const auto& watch : _watches) {
+            WatchParam param;
+            param.key = watch.first;
+            param.deleted = false;
+            param.revision = response->revision();
+            param.context = nullptr;
+            watch_func_t callback = watch.second.callback;
+            _callbacks.push_back([callback, param]() {
+                        callback(param, status_code::RESYNC);
+                    });
+            queued = true;
+        }
+        _revision = response->revision();
+    }
+    if (queued && !_delivering) {
+        _delivering = true;
+        _pool->add_task(std::bind(&WatchStream::deliver, this));
+    }
+    if (_polling > 0) {
+        return;
+    }
+    if (reopen) {
+        int64_t delay = std::min(s_min_backoff << std::min(_failures, 10), s_max_backoff);
+        ++_failures;
+        _pool->delay_task(delay, [this]() {
+                    std::unique_lock<std::mutex> locker(_mutex);
+                    if (_polling == 0) {
+                        poll(locker);
+                    }
+                });
+        return;
+    }
+    poll(locker);
+}
+
+void WatchStream::deliver() {
+    std::unique_lock<std::mutex> locker(_mutex);
+    while (!_callbacks.empty() && !_stop) {
+        std::function<void ()> callback;
+        callback.swap(_callbacks.front());
+        _callbacks.pop_front();
+        locker.unlock();
+        callback();
+        locker.lock();
+    }
+    _delivering = false;
+}
+
+} // namespace client
+} // namespace orion
@@ -0,0 +1,119 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_CLIENT_WATCH_STREAM_H
+#define ORION_CLIENT_WATCH_STREAM_H
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "client/ori.h"
+#include "proto/service.pb.h"
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace client {
+
+class NearCache; // forward declaration
+
+/**
+ * @brief Multiplexes all the watches of a client on one stream
+ *
+ * The stream is polled with one request at a time, which waits on server
+ * until any watched key changes, and carries the watches added or removed
+ * since the last poll. Every poll acknowledges the revision received so
+ * far. A stream lost by failover or by server restart is reopened with
+ * that revision, so that changes in between are delivered as well. If they
+ * are gone from server, every watch is notified with RESYNC. Callbacks run
+ * on client threads one at a time, in order of revision. If the cache of get
+ * results is enabled, every cached key is watched as well to keep it fresh,
+ * and its watch goes away with the key.
+ */
+class WatchStream {
+public:
+    /// sends a poll to the leader owning the namespace, done is called with status of the poll
+    typedef std::function<void (const service::WatchRequest*, service::WatchResponse*,
+            const std::function<void (int32_t)>&)> send_func_t;
+
+    /**
+     * @param ns       [IN] namespace of the watched keys
+     * @param wait_ms  [IN] longest time a poll waits on server
+     * @param send     [IN] sends the polls
+     * @param pool     [IN] runs callbacks and delayed polls
+     * @param cache    [IN] cache updated by changes, null if disabled
+     */
+    WatchStream(const std::string& ns, int32_t wait_ms, const send_func_t& send,
+            common::ThreadPool* pool, NearCache* cache);
+    ~WatchStream() { }
+    /// disable copy and move for watch stream
+    WatchStream(const WatchStream&) = delete;
+    void operator=(const WatchStream&) = delete;
+
+    /// watching a key again replaces its type and callback
+    int32_t watch(const std::string& key, WatchType type, const watch_func_t& callback);
+    /// returns NOT_FOUND if the key is not watched
+    int32_t unwatch(const std::string& key);
+    /// watches keys newly cached and drops the watches of keys left the cache
+    void sync_cache();
+    /// stops polling, callbacks already queued are dropped
+    void stop();
+private:
+    struct Watch {
+        int32_t type;
+        watch_func_t callback;
+    };
+    struct CacheWatch {
+        int32_t type;
+        // server has answered a poll carrying the watch
+        bool confirmed;
+    };
+    typedef std::shared_ptr<service::WatchRequest> request_t;
+    typedef std::shared_ptr<service::WatchResponse> response_t;
+
+    static bool match(int32_t type, const std::string& watched, const std::string& key);
+    /// type sent to server for key, covering both user and cache watches
+    int32_t watch_type(const std::string& key) const;
+    /// moves changes of cached keys to the watches, called with mutex locked
+    bool take_cache_changes();
+    /// sends a poll unless one is parked on server already, called with mutex locked
+    void poll(std::unique_lock<std::mutex>& locker);
+    void on_poll(const request_t& request, const response_t& response, int32_t status);
+    /// runs the queued callbacks in order
+    void deliver();
+private:
+    std::string _ns;
+    int32_t _wait_ms;
+    send_func_t _send;
+    common::ThreadPool* _pool;
+    NearCache* _cache;
+    std::mutex _mutex;
+    // watches of user and of cached keys, a key may be in both
+    std::map<std::string, Watch> _watches;
+    std::map<std::string, CacheWatch> _cached;
+    // changes of watches not sent yet
+    std::map<std::string, int32_t> _added;
+    std::set<std::string> _removed;
+    // 0 if the stream needs to be opened
+    int64_t _stream_id;
+    // all the changes up to revision are received
+    int64_t _revision;
+    int32_t _polling;
+    // failed polls in a row, which delay the next one
+    int32_t _failures;
+    bool _stop;
+    // callbacks waiting to run, and whether a thread is running them
+    std::deque<std::function<void ()> > _callbacks;
+    bool _delivering;
+};
+
+} // namespace client
+} // namespace orion
+
+#endif // ORION_CLIENT_WATCH_STREAM_H
@@ -0,0 +1,77 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_CODING_H
+#define ORION_COMMON_CODING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace orion {
+namespace common {
+
+/// appends a varint encoded integer, 7 bits a byte, lower bits first
+inline void put_varint64(std::string* out, uint64_t value) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief Decodes a varint at the head of the buffer
+ * @param p      [IN/OUT] current position, moved over the varint
+ * @param limit  [IN] end of the buffer
+ * @param value  [OUT] decoded integer
+ * @return       false if the varint is truncated or malformed
+ */
+inline bool get_varint64(const char** p, const char* limit, uint64_t* value) {
+    uint64_t result = 0;
+    for (uint32_t shift = 0; shift <= 63 && *p < limit; shift += 7) {
+        uint64_t byte = static_cast<uint8_t>(**p);
+        ++*p;
+        result |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// maps signed integers to unsigned ones so that small negatives stay short
+inline uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/// appends a string prefixed by its varint encoded length
+inline void put_length_prefixed(std::string* out, const std::string& value) {
+    put_varint64(out, value.size());
+    out->append(value);
+}
+
+/// the string is skipped if value is nullptr
+inline bool get_length_prefixed(const char** p, const char* limit, std::string* value) {
+    uint64_t len = 0;
+    if (!get_varint64(p, limit, &len) || len > static_cast<uint64_t>(limit - *p)) {
+        return false;
+    }
+    if (value != nullptr) {
+        value->assign(*p, len);
+    }
+    *p += len;
+    return true;
+}
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_CODING_H
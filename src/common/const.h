@@ -18,15 +18,47 @@ static const int32_t DATABASE_ERROR = 1;
 static const int32_t NOT_FOUND = 2;
 static const int32_t INVALID = 3;
 static const int32_t EXISTED = 4;
+static const int32_t NOT_LEADER = 5;
+static const int32_t TIMEOUT = 6;
+static const int32_t NOT_SUPPORTED = 7;
+// events are lost, watched keys need to be read again
+static const int32_t RESYNC = 8;
+// lease is revoked or expired, temp nodes attached to it are gone
+static const int32_t LEASE_EXPIRED = 9;
+// lock is held by another lease
+static const int32_t LOCKED = 10;
 
 } // namespace status_code
 
 namespace common {
 
 static const std::string INTERNAL_NS("__internal__");
+// last log index applied to the data, kept in internal namespace. A store without it
+// is loaded from the latest snapshot on restart
+static const std::string APPLIED_INDEX_KEY("applied_index");
 
 } // namespace common
 
+/// operations carried by raft log entries
+namespace raft_op {
+
+static const int32_t NOP = 0;
+static const int32_t PUT = 1;
+static const int32_t REMOVE = 2;
+// value carries serialize::BatchOps of the same namespace
+static const int32_t BATCH = 3;
+// grants lease session_id, value carries its ttl in milliseconds
+static const int32_t GRANT_LEASE = 4;
+// value carries serialize::LeaseList, temp nodes attached to the leases go with them
+static const int32_t REVOKE_LEASES = 5;
+// queues lease session_id on lock key as a temp waiter node named by the index of the
+// entry, the first waiter holds the lock, value is "try" to fail rather than queue
+static const int32_t LOCK = 6;
+// removes the waiter of lease session_id from lock key, giving up the lock or the queue
+static const int32_t UNLOCK = 7;
+
+} // namespace raft_op
+
 } // namespace orion
 
 #endif // ORION_COMMON_CONST_H
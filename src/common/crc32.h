@@ -0,0 +1,52 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_CRC32_H
+#define ORION_COMMON_CRC32_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace orion {
+namespace common {
+
+/**
+ * @brief Computes CRC-32C (Castagnoli) checksum
+ * @param data  [IN] buffer to checksum
+ * @param n     [IN] length of the buffer
+ * @param init  [IN] checksum of the preceding data, used to extend a checksum
+ * @return      the checksum of all the data
+ */
+inline uint32_t crc32c(const char* data, size_t n, uint32_t init = 0) {
+    // lookup table is built once and shared by all threads
+    static const struct Table {
+        uint32_t value[256];
+        Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int j = 0; j < 8; ++j) {
+                    crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+                }
+                value[i] = crc;
+            }
+        }
+    } s_table;
+    uint32_t crc = ~init;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < n; ++i) {
+        crc = s_table.value[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t crc32c(const std::string& data) {
+    return crc32c(data.data(), data.size());
+}
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_CRC32_H
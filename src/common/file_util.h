@@ -0,0 +1,102 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_FILE_UTIL_H
+#define ORION_COMMON_FILE_UTIL_H
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string>
+
+namespace orion {
+namespace common {
+
+/// creates the directory and all its parents
+inline bool make_dirs(const std::string& path) {
+    size_t pos = 0;
+    while (pos != std::string::npos) {
+        pos = path.find_first_of('/', pos + 1);
+        const std::string& cur = path.substr(0, pos);
+        if (mkdir(cur.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// reads len bytes at offset, returns false if the file is not long enough
+inline bool read_file(int fd, char* data, size_t len, int64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t ret = pread(fd, data + done, len - done, offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        done += ret;
+    }
+    return true;
+}
+
+/// reads the whole file into buffer
+inline bool read_file(int fd, std::string* buffer) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    buffer->resize(st.st_size);
+    return buffer->empty() || read_file(fd, &(*buffer)[0], buffer->size(), 0);
+}
+
+/// writes all the data at offset
+inline bool write_file(int fd, const char* data, size_t len, int64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t ret = pwrite(fd, data + done, len - done, offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            return false;
+        }
+        done += ret;
+    }
+    return true;
+}
+
+/// flushes the entries of a directory, makes files created or renamed in it durable
+inline bool sync_dir(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/// replaces the file with content atomically
+inline bool replace_file(const std::string& path, const std::string& content) {
+    const std::string& tmp_path = path + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write_file(fd, content.data(), content.size(), 0) && fsync(fd) == 0;
+    close(fd);
+    return ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_FILE_UTIL_H
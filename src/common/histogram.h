@@ -0,0 +1,128 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_HISTOGRAM_H
+#define ORION_COMMON_HISTOGRAM_H
+#include <stdint.h>
+#include <math.h>
+#include <atomic>
+#include <algorithm>
+
+namespace orion {
+namespace common {
+
+/**
+ * @brief Lock-free histogram of latencies in microseconds
+ *
+ * Every power of two is split into four buckets, so a percentile is reported
+ * at most a quarter above the exact value, and any latency fits in a fixed
+ * array of counters. Recording is a few relaxed atomic additions, readers
+ * may see a record partly while it is being added.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram() : _count(0), _sum(0), _max(0) {
+        for (auto& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+    /// disable copy and move for histogram
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    void operator=(const LatencyHistogram&) = delete;
+
+    void record(int64_t micros) {
+        micros = std::max(micros, 0L);
+        _buckets[bucket_of(micros)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(micros, std::memory_order_relaxed);
+        int64_t max = _max.load(std::memory_order_relaxed);
+        while (micros > max && !_max.compare_exchange_weak(max, micros,
+                    std::memory_order_relaxed)) { }
+    }
+    int64_t count() const {
+        return _count.load(std::memory_order_relaxed);
+    }
+    int64_t average() const {
+        int64_t count = this->count();
+        return count == 0 ? 0 : _sum.load(std::memory_order_relaxed) / count;
+    }
+    int64_t max() const {
+        return _max.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Returns the latency below which the given percent of records fall
+     * @param percent  [IN] in (0, 100]
+     * @return         upper bound of the bucket holding the percentile, 0 if nothing is recorded
+     */
+    int64_t percentile(double percent) const {
+        int64_t counts[s_bucket_num];
+        int64_t total = 0;
+        for (int32_t i = 0; i < s_bucket_num; ++i) {
+            counts[i] = _buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) {
+            return 0;
+        }
+        int64_t rank = static_cast<int64_t>(ceil(total * std::min(percent, 100.0) / 100));
+        rank = std::max(rank, 1L);
+        int64_t seen = 0;
+        for (int32_t i = 0; i < s_bucket_num; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(upper_bound(i), std::max(max(), lower_bound(i)));
+            }
+        }
+        return max();
+    }
+    /// drops all the records, records added meanwhile may be partly kept
+    void reset() {
+        for (auto& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        _count.store(0, std::memory_order_relaxed);
+        _sum.store(0, std::memory_order_relaxed);
+        _max.store(0, std::memory_order_relaxed);
+    }
+private:
+    // latencies below 1 << s_sub_bits have a bucket each
+    static const int32_t s_sub_bits = 2;
+    static const int32_t s_bucket_num = 64 << s_sub_bits;
+
+    static int32_t bucket_of(int64_t micros) {
+        if (micros < (1L << s_sub_bits)) {
+            return static_cast<int32_t>(micros);
+        }
+        int32_t shift = 63 - __builtin_clzll(static_cast<uint64_t>(micros)) - s_sub_bits;
+        int32_t sub = static_cast<int32_t>((micros >> shift) & ((1L << s_sub_bits) - 1));
+        return ((shift + 1) << s_sub_bits) + sub;
+    }
+    static int64_t lower_bound(int32_t bucket) {
+        if (bucket < (1 << s_sub_bits)) {
+            return bucket;
+        }
+        int32_t shift = (bucket >> s_sub_bits) - 1;
+        int64_t sub = bucket & ((1 << s_sub_bits) - 1);
+        return ((1L << s_sub_bits) + sub) << shift;
+    }
+    static int64_t upper_bound(int32_t bucket) {
+        if (bucket < (1 << s_sub_bits)) {
+            return bucket;
+        }
+        int32_t shift = (bucket >> s_sub_bits) - 1;
+        return lower_bound(bucket) + (1L << shift) - 1;
+    }
+private:
+    std::atomic<int64_t> _buckets[s_bucket_num];
+    std::atomic<int64_t> _count;
+    std::atomic<int64_t> _sum;
+    std::atomic<int64_t> _max;
+};
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_HISTOGRAM_H
@@ -118,10 +118,13 @@ bool get_new_log(bool append) {
  */
 class AsyncLogger {
 public:
-    AsyncLogger() : _work(std::bind(&AsyncLogger::async_write, this)),
-            _log_buffer(new logbuf_t()), _stop(false) { }
+    AsyncLogger() : _log_buffer(new logbuf_t()), _stop(false),
+            _work(std::bind(&AsyncLogger::async_write, this)) { }
     ~AsyncLogger() {
-        _stop = true;
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            _stop = true;
+        }
         _flush_cv.notify_one();
         _work.join();
         // close fd
@@ -154,9 +157,10 @@ private:
     std::mutex _mutex;
     std::condition_variable _flush_cv;
     std::condition_variable _done_cv;
-    std::thread _work;
     std::unique_ptr<logbuf_t> _log_buffer;
     bool _stop;
+    // work thread starts last, after all the states it uses are ready
+    std::thread _work;
 };
 
 void AsyncLogger::async_write() {
@@ -0,0 +1,70 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_RECORD_IO_H
+#define ORION_COMMON_RECORD_IO_H
+#include <stdint.h>
+#include <string>
+#include "common/crc32.h"
+
+namespace orion {
+namespace common {
+
+/// every record written to disk is framed as follows:
+///   fixed32 length | fixed32 crc32c of payload | payload
+/// fixed32 is encoded in little endian
+static const size_t RECORD_HEADER_SIZE = 8;
+
+inline void encode_fixed32(char* buf, uint32_t value) {
+    buf[0] = static_cast<char>(value & 0xFF);
+    buf[1] = static_cast<char>((value >> 8) & 0xFF);
+    buf[2] = static_cast<char>((value >> 16) & 0xFF);
+    buf[3] = static_cast<char>((value >> 24) & 0xFF);
+}
+
+inline uint32_t decode_fixed32(const char* buf) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+        (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/// appends a framed record of payload to the end of out
+inline void append_record(const std::string& payload, std::string* out) {
+    char header[RECORD_HEADER_SIZE];
+    encode_fixed32(header, static_cast<uint32_t>(payload.size()));
+    encode_fixed32(header + 4, crc32c(payload));
+    out->append(header, RECORD_HEADER_SIZE);
+    out->append(payload);
+}
+
+/**
+ * @brief Parses a framed record at the head of the buffer
+ * @param buf      [IN] buffer to parse
+ * @param len      [IN] length of the buffer
+ * @param payload  [OUT] content of the record
+ * @return         bytes consumed by the record,
+ *                 0 if the record is incomplete or corrupted
+ */
+inline size_t parse_record(const char* buf, size_t len, std::string* payload) {
+    if (len < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    size_t length = decode_fixed32(buf);
+    if (len - RECORD_HEADER_SIZE < length) {
+        return 0;
+    }
+    const char* data = buf + RECORD_HEADER_SIZE;
+    if (crc32c(data, length) != decode_fixed32(buf + 4)) {
+        return 0;
+    }
+    payload->assign(data, length);
+    return RECORD_HEADER_SIZE + length;
+}
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_RECORD_IO_H
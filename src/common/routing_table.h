@@ -0,0 +1,99 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_ROUTING_TABLE_H
+#define ORION_COMMON_ROUTING_TABLE_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include "common/crc32.h"
+#include "common/const.h"
+
+namespace orion {
+namespace common {
+
+/**
+ * @brief Maps namespaces to raft groups and caches the leader of every group
+ *
+ * Namespaces are spread over groups by hash, internal namespace always
+ * belongs to group 0. Servers and clients share the same mapping, so
+ * a client only needs to learn the leaders. All methods are thread-safe.
+ */
+class RoutingTable {
+public:
+    RoutingTable(int32_t group_num = 1) : _routes(std::max(group_num, 1)) { }
+    ~RoutingTable() { }
+
+    /// returns the group owning the namespace
+    static int32_t group_of(const std::string& ns, int32_t group_num) {
+        if (group_num <= 1 || ns == INTERNAL_NS) {
+            return 0;
+        }
+        return static_cast<int32_t>(crc32c(ns) % static_cast<uint32_t>(group_num));
+    }
+
+    int32_t group_of(const std::string& ns) const {
+        return group_of(ns, group_num());
+    }
+
+    int32_t group_num() const {
+        std::lock_guard<std::mutex> locker(_mutex);
+        return static_cast<int32_t>(_routes.size());
+    }
+
+    /// drops all the routes if group number changes
+    void reset(int32_t group_num) {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (group_num >= 1 && group_num != static_cast<int32_t>(_routes.size())) {
+            _routes.assign(group_num, Route());
+        }
+    }
+
+    /// returns the cached leader of a group, empty if unknown
+    std::string leader(int32_t group_id) const {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (group_id < 0 || group_id >= static_cast<int32_t>(_routes.size())) {
+            return "";
+        }
+        return _routes[group_id].leader;
+    }
+
+    /**
+     * @brief Updates the leader of a group, outdated information is ignored
+     * @param group_id  [IN] id of the group
+     * @param leader    [IN] address of the leader, empty to invalidate the route
+     * @param term      [IN] term of the leader, 0 if unknown
+     * @return          true if the route is changed
+     */
+    bool update(int32_t group_id, const std::string& leader, int64_t term) {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (group_id < 0 || group_id >= static_cast<int32_t>(_routes.size())) {
+            return false;
+        }
+        Route& route = _routes[group_id];
+        if ((term != 0 && term < route.term) || (leader == route.leader && term == route.term)) {
+            return false;
+        }
+        route.leader = leader;
+        route.term = std::max(route.term, term);
+        return true;
+    }
+private:
+    struct Route {
+        std::string leader;
+        int64_t term;
+        Route() : term(0) { }
+    };
+    mutable std::mutex _mutex;
+    std::vector<Route> _routes;
+};
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_ROUTING_TABLE_H
@@ -10,8 +10,18 @@
 #ifndef  ORION_RPC_RPC_CLIENT_H
 #define  ORION_RPC_RPC_CLIENT_H
 
+#include <unistd.h>
 #include <sofa/pbrpc/pbrpc.h>
+#include <map>
+#include <vector>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <typeindex>
+#include <random>
+#include <future>
+#include <chrono>
+#include <algorithm>
 #include <functional>
 #include "common/thread_pool.h"
 #include "common/logging.h"
@@ -19,83 +29,159 @@
 namespace orion {
 namespace rpc {
 
+/// how a failed rpc is retried
+struct RetryOptions {
+    // attempts after the first one
+    int32_t max_retries;
+    // backoff before the n-th retry is initial_backoff * 2^(n-1) capped by max_backoff,
+    // then shortened by a random ratio in [0, jitter), all in milliseconds
+    int64_t initial_backoff;
+    int64_t max_backoff;
+    double jitter;
+    // time budget of all the attempts in milliseconds, 0 for no budget.
+    // Timeout of every attempt is cut to the time left
+    int64_t deadline;
+    // a request which is not idempotent is retried only if it never reached server
+    bool idempotent;
+
+    RetryOptions(int32_t retries = 0) : max_retries(retries), initial_backoff(100),
+            max_backoff(2000), jitter(0.5), deadline(0), idempotent(true) { }
+};
+
+/// how a request picks one of the channels to a server
+enum ChannelSelect {
+    SELECT_ROUND_ROBIN = 0,
+    SELECT_LEAST_PENDING = 1,
+};
+
+struct RpcClientOptions {
+    // connections to every server, requests are spread over them
+    // so that a large request does not block the others
+    int32_t channel_num;
+    // see ChannelSelect
+    int32_t channel_select;
+    // buffer of every connection for requests not sent yet in MB,
+    // requests fail with RPC_ERROR_SEND_BUFFER_FULL once it is full
+    int64_t max_pending_buffer_size;
+    // bandwidth of every connection in MB/s, -1 for no limit
+    int64_t max_throughput_in;
+    int64_t max_throughput_out;
+
+    RpcClientOptions() : channel_num(1), channel_select(SELECT_LEAST_PENDING),
+            max_pending_buffer_size(10), max_throughput_in(-1), max_throughput_out(-1) { }
+};
+
 /**
  * @brief Wrapper for sofa-pbrpc interfaces,
  *        provides trivial interface and channel management
+ *
+ * Every server is reached through several channels, each on a connection
+ * of its own. Stubs are cached and looked up without lock, new servers are
+ * published by copying the lookup table, and old tables are kept until
+ * RpcClient is released since servers are rarely added.
+ * Failed rpc are retried with exponential backoff scheduled on a timer
+ * thread of RpcClient, so that no thread sleeps between attempts.
+ * Retries pending when RpcClient is released are dropped.
  */
 class RpcClient {
 public:
-    RpcClient() {
-        // define client object, which only one is needed for a single client program
-        sofa::pbrpc::RpcClientOptions options;
-        options.max_pending_buffer_size = 10;
-        _client = new sofa::pbrpc::RpcClient(options);
+    /// creates the channel to a server, the channel is owned by RpcClient
+    typedef std::function<google::protobuf::RpcChannel* (const std::string&)> channel_factory_t;
+
+    /// channels are sofa-pbrpc connections unless a factory is given,
+    /// which is used to replace network in tests
+    explicit RpcClient(const channel_factory_t& factory = channel_factory_t()) :
+            _factory(factory), _stub_map(nullptr), _random(std::random_device()()),
+            _timer(1, "rpc_retry") {
+        init();
+    }
+    RpcClient(const RpcClientOptions& options,
+            const channel_factory_t& factory = channel_factory_t()) :
+            _options(options), _factory(factory), _stub_map(nullptr),
+            _random(std::random_device()()), _timer(1, "rpc_retry") {
+        init();
     }
     ~RpcClient() {
-        delete _client;
+        _timer.stop(false);
+        // stubs are released before their channels, and channels before clients
+        _stub_sets.clear();
+        _hosts.clear();
+        for (auto* client : _clients) {
+            delete client;
+        }
     }
     /// disable copy for RpcClient, move maybe needed in the future
     RpcClient(const RpcClient&) = delete;
     void operator=(const RpcClient&) = delete;
 
     /**
-     * @brief Gets a stub to launch RPC
+     * @brief Gets a cached stub on one of the channels to server,
+     *        picked by channel_select for every call
+     * @param server [IN] address of remote server
+     * @return       stub owned by RpcClient, valid until RpcClient is released
+     */
+    template <class T>
+    T* stub(const std::string& server) {
+        const stub_map_t* stubs = _stub_map.load(std::memory_order_acquire);
+        auto it = stubs->find(std::make_pair(server, std::type_index(typeid(T))));
+        StubSet* stub_set = it != stubs->end() ? it->second : add_stubs<T>(server);
+        return static_cast<T*>(stub_set->stubs[pick_channel(stub_set->host)].get());
+    }
+
+    /**
+     * @brief Gets a stub bound to one channel to server, requests of the stub
+     *        keep their order, otherwise use stub() instead
      * @param server [IN] sepcify the address of remote server
      * @param stub   [OUT] returns a pointer to the stub, user needs to delete it
      * @return       true if successfully created(always true for now)
      */
     template <class T>
     bool get_stub(const std::string server, T** stub) {
-        std::lock_guard<std::mutex> locker(_host_map_lock);
-        sofa::pbrpc::RpcChannel* channel = NULL;
-        auto it = _host_map.find(server);
-        if (it != _host_map.end()) {
-            channel = it->second;
-        } else {
-            // define a channel, which represents a particular connection to server
-            sofa::pbrpc::RpcChannelOptions channel_options;
-            channel = new sofa::pbrpc::RpcChannel(_client, server, channel_options);
-            _host_map[server] = channel;
-        }
-        *stub = new T(channel);
+        Host* host = nullptr;
+        {
+            std::lock_guard<std::mutex> locker(_update_lock);
+            host = get_host(server);
+        }
+        *stub = new T(host->channels[pick_channel(host)].get());
         return true;
     }
 
     /**
-     * @brief Sends a request to remote server synchronously
+     * @brief Sends a request to remote server synchronously, the caller is blocked
+     *        until the last attempt finishes but sleeps in no backoff, so this
+     *        may be called from any thread except the callbacks of rpc
      * @param stub        [IN] stub to handle the RPC
      * @param func        [IN] specify the process to call
      * @param request     [IN] user defined request proto
      * @param response    [OUT] user defined response proto
-     * @param rpc_timeout [IN] set the timeout for rpc client
-     * @param retry_times [IN] set the times for client to retry
+     * @param rpc_timeout [IN] timeout of every attempt in seconds
+     * @param retry       [IN] how failed attempts are retried
      * @return            true if get proper response in retry times
      */
     template <class Stub, class Request, class Response, class Callback>
+    bool send_request(Stub* stub, void(Stub::*func)(
+                    google::protobuf::RpcController*,
+                    const Request*, Response*, Callback*),
+                    const Request* request, Response* response,
+                    int32_t rpc_timeout, const RetryOptions& retry) {
+        std::shared_ptr<std::promise<bool> > result(new std::promise<bool>());
+        async_request(stub, func, request, response,
+                std::function<void (const Request*, Response*, bool, int)>(
+                    [result](const Request*, Response*, bool failed, int) {
+                        result->set_value(!failed);
+                    }), rpc_timeout, retry);
+        return result->get_future().get();
+    }
+
+    /// sends a request synchronously with at most retry_times attempts
+    template <class Stub, class Request, class Response, class Callback>
     bool send_request(Stub* stub, void(Stub::*func)(
                     google::protobuf::RpcController*,
                     const Request*, Response*, Callback*),
                     const Request* request, Response* response,
                     int32_t rpc_timeout, int retry_times) {
-        // use controller to manage this RPC process
-        sofa::pbrpc::RpcController controller;
-        // set timeout time, default to 10s
-        controller.SetTimeout(rpc_timeout * 1000L);
-        for (int32_t retry = 0; retry < retry_times; ++retry) {
-            (stub->*func)(&controller, request, response, NULL);
-            if (controller.Failed()) {
-                if (retry < retry_times - 1) {
-                    LOG(WARNING, "send failed, retry ...\n");
-                    usleep(1000000);
-                } else {
-                    LOG(WARNING, "send request fail: %s\n", controller.ErrorText().c_str());
-                }
-            } else {
-                return true;
-            }
-            controller.Reset();
-        }
-        return false;
+        return send_request(stub, func, request, response, rpc_timeout,
+                RetryOptions(std::max(retry_times - 1, 0)));
     }
 
     /**
@@ -104,9 +190,9 @@ public:
      * @param func        [IN] specify the process to call
      * @param request     [IN] user defined request proto
      * @param response    [OUT] user defined response proto
-     * @param callback    [IN] callback function used when get proper response
-     * @param rpc_timeout [IN] set the timeout for rpc client
-     * @param retry_times [IN] set the times for client to retry(@deprecated)
+     * @param callback    [IN] called once with the result of the last attempt
+     * @param rpc_timeout [IN] timeout of every attempt in seconds
+     * @param retry       [IN] how failed attempts are retried
      * @return            void
      */
     template <class Stub, class Request, class Response, class Callback>
@@ -115,42 +201,290 @@ public:
                     const Request*, Response*, Callback*),
                     const Request* request, Response* response,
                     std::function<void (const Request*, Response*, bool, int)> callback,
-                    int32_t rpc_timeout, int /*retry_times*/) {
+                    int32_t rpc_timeout, const RetryOptions& retry) {
+        std::shared_ptr<Attempt<Stub, Request, Response, Callback> > attempt(
+                new Attempt<Stub, Request, Response, Callback>());
+        attempt->stub = stub;
+        attempt->func = func;
+        attempt->request = request;
+        attempt->response = response;
+        attempt->callback = callback;
+        attempt->rpc_timeout = rpc_timeout * 1000L;
+        attempt->retry = retry;
+        attempt->count = 0;
+        attempt->deadline = retry.deadline > 0 ? now_ms() + retry.deadline : 0;
+        launch(attempt);
+    }
+
+    /// sends a request asynchronously with at most retry_times attempts
+    template <class Stub, class Request, class Response, class Callback>
+    void async_request(Stub* stub, void(Stub::*func)(
+                    google::protobuf::RpcController*,
+                    const Request*, Response*, Callback*),
+                    const Request* request, Response* response,
+                    std::function<void (const Request*, Response*, bool, int)> callback,
+                    int32_t rpc_timeout, int retry_times) {
+        async_request(stub, func, request, response, callback, rpc_timeout,
+                RetryOptions(std::max(retry_times - 1, 0)));
+    }
+private:
+    /// wraps a channel to count its rpc in flight
+    class Channel : public google::protobuf::RpcChannel {
+    public:
+        explicit Channel(google::protobuf::RpcChannel* channel) : _channel(channel), _pending(0) { }
+        virtual ~Channel() { }
+
+        virtual void CallMethod(const google::protobuf::MethodDescriptor* method,
+                                google::protobuf::RpcController* controller,
+                                const google::protobuf::Message* request,
+                                google::protobuf::Message* response,
+                                google::protobuf::Closure* done) {
+            ++_pending;
+            if (done == nullptr) {
+                // synchronous call returns once it is finished
+                _channel->CallMethod(method, controller, request, response, nullptr);
+                --_pending;
+                return;
+            }
+            _channel->CallMethod(method, controller, request, response,
+                    new PendingClosure(&_pending, done));
+        }
+        int64_t pending() const {
+            return _pending.load(std::memory_order_relaxed);
+        }
+    private:
+        class PendingClosure : public google::protobuf::Closure {
+        public:
+            PendingClosure(std::atomic<int64_t>* pending, google::protobuf::Closure* done) :
+                    _pending(pending), _done(done) { }
+            virtual void Run() {
+                --*_pending;
+                google::protobuf::Closure* done = _done;
+                delete this;
+                done->Run();
+            }
+        private:
+            std::atomic<int64_t>* _pending;
+            google::protobuf::Closure* _done;
+        };
+        std::unique_ptr<google::protobuf::RpcChannel> _channel;
+        std::atomic<int64_t> _pending;
+    };
+
+    /// all the channels to a server
+    struct Host {
+        std::vector<std::unique_ptr<Channel> > channels;
+        std::atomic<uint32_t> next;
+    };
+
+    /// stubs of one type on every channel to a server
+    struct StubSet {
+        Host* host;
+        std::vector<std::unique_ptr<google::protobuf::Service> > stubs;
+    };
+    typedef std::map<std::pair<std::string, std::type_index>, StubSet*> stub_map_t;
+
+    void init() {
+        _options.channel_num = std::max(_options.channel_num, 1);
+        if (!_factory) {
+            // sofa-pbrpc shares one connection to a server among the channels of a client,
+            // so every channel to the same server is created on a client of its own
+            sofa::pbrpc::RpcClientOptions options;
+            options.max_pending_buffer_size = _options.max_pending_buffer_size;
+            options.max_throughput_in = _options.max_throughput_in;
+            options.max_throughput_out = _options.max_throughput_out;
+            for (int32_t i = 0; i < _options.channel_num; ++i) {
+                _clients.push_back(new sofa::pbrpc::RpcClient(options));
+            }
+        }
+        _versions.push_back(std::unique_ptr<const stub_map_t>(new stub_map_t()));
+        _stub_map.store(_versions.back().get(), std::memory_order_release);
+    }
+
+    /// returns channels to server, created on first use, called with update lock held
+    Host* get_host(const std::string& server) {
+        std::unique_ptr<Host>& host = _hosts[server];
+        if (host != nullptr) {
+            return host.get();
+        }
+        host.reset(new Host());
+        host->next = 0;
+        for (int32_t i = 0; i < _options.channel_num; ++i) {
+            google::protobuf::RpcChannel* channel = nullptr;
+            if (_factory) {
+                channel = _factory(server);
+            } else {
+                // define a channel, which represents a particular connection to server
+                sofa::pbrpc::RpcChannelOptions channel_options;
+                channel = new sofa::pbrpc::RpcChannel(_clients[i], server, channel_options);
+            }
+            host->channels.push_back(std::unique_ptr<Channel>(new Channel(channel)));
+        }
+        return host.get();
+    }
+
+    /// creates stubs of type T to server and publishes a new lookup table
+    template <class T>
+    StubSet* add_stubs(const std::string& server) {
+        std::lock_guard<std::mutex> locker(_update_lock);
+        const stub_map_t* stubs = _stub_map.load(std::memory_order_acquire);
+        auto key = std::make_pair(server, std::type_index(typeid(T)));
+        auto it = stubs->find(key);
+        if (it != stubs->end()) {
+            return it->second;
+        }
+        StubSet* stub_set = new StubSet();
+        _stub_sets.push_back(std::unique_ptr<StubSet>(stub_set));
+        stub_set->host = get_host(server);
+        for (auto& channel : stub_set->host->channels) {
+            stub_set->stubs.push_back(std::unique_ptr<google::protobuf::Service>(
+                        new T(channel.get())));
+        }
+        stub_map_t* version = new stub_map_t(*stubs);
+        (*version)[key] = stub_set;
+        _versions.push_back(std::unique_ptr<const stub_map_t>(version));
+        _stub_map.store(version, std::memory_order_release);
+        return stub_set;
+    }
+
+    /// returns index of the channel for next request to host
+    size_t pick_channel(Host* host) {
+        size_t num = host->channels.size();
+        size_t start = host->next++ % num;
+        if (_options.channel_select != SELECT_LEAST_PENDING || num == 1) {
+            return start;
+        }
+        // channels are scanned from a rotating start, so that idle channels share load
+        size_t best = start;
+        for (size_t i = 1; i < num; ++i) {
+            size_t pos = (start + i) % num;
+            if (host->channels[pos]->pending() < host->channels[best]->pending()) {
+                best = pos;
+            }
+        }
+        return best;
+    }
+
+    /// state of a request shared by its attempts
+    template <class Stub, class Request, class Response, class Callback>
+    struct Attempt {
+        Stub* stub;
+        void (Stub::*func)(google::protobuf::RpcController*, const Request*, Response*, Callback*);
+        const Request* request;
+        Response* response;
+        std::function<void (const Request*, Response*, bool, int)> callback;
+        int64_t rpc_timeout;
+        RetryOptions retry;
+        // attempts launched
+        int32_t count;
+        // absolute time in milliseconds, 0 for no deadline
+        int64_t deadline;
+    };
+
+    static int64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// returns true if the request never left this process or never reached server
+    static bool is_unsent(int error) {
+        return error == sofa::pbrpc::RPC_ERROR_SEND_BUFFER_FULL
+            || error == sofa::pbrpc::RPC_ERROR_RESOLVE_ADDRESS
+            || error == sofa::pbrpc::RPC_ERROR_SERVER_UNREACHABLE;
+    }
+
+    template <class Stub, class Request, class Response, class Callback>
+    void launch(std::shared_ptr<Attempt<Stub, Request, Response, Callback> > attempt) {
+        int64_t timeout = attempt->rpc_timeout;
+        if (attempt->deadline > 0) {
+            timeout = std::min(timeout, attempt->deadline - now_ms());
+            if (timeout <= 0) {
+                attempt->callback(attempt->request, attempt->response, true,
+                        sofa::pbrpc::RPC_ERROR_REQUEST_TIMEOUT);
+                return;
+            }
+        }
+        if (attempt->count++ > 0) {
+            attempt->response->Clear();
+        }
+        // use controller to manage this RPC process
         sofa::pbrpc::RpcController* controller = new sofa::pbrpc::RpcController();
-        controller->SetTimeout(rpc_timeout * 1000L);
-        google::protobuf::Closure* done = 
-            sofa::pbrpc::NewClosure(&RpcClient::template rpc_callback<Request, Response, Callback>,
-                                          controller, request, response, callback);
-        (stub->*func)(controller, request, response, done);
+        controller->SetTimeout(timeout);
+        google::protobuf::Closure* done =
+            sofa::pbrpc::NewClosure(&RpcClient::template rpc_callback<Stub, Request, Response, Callback>,
+                                    this, controller, attempt);
+        (attempt->stub->*attempt->func)(controller, attempt->request, attempt->response, done);
+    }
+
+    /// returns the backoff before next attempt, -1 if the request should not be retried
+    template <class Stub, class Request, class Response, class Callback>
+    int64_t backoff(const Attempt<Stub, Request, Response, Callback>& attempt, int error) {
+        const RetryOptions& retry = attempt.retry;
+        if (attempt.count > retry.max_retries || (!retry.idempotent && !is_unsent(error))) {
+            return -1;
+        }
+        int64_t backoff = retry.initial_backoff;
+        for (int32_t i = 1; i < attempt.count && backoff < retry.max_backoff; ++i) {
+            backoff *= 2;
+        }
+        backoff = std::min(backoff, retry.max_backoff);
+        if (retry.jitter > 0) {
+            std::lock_guard<std::mutex> locker(_random_lock);
+            // spreads retries of clients failed at the same time
+            backoff -= static_cast<int64_t>(backoff *
+                    std::uniform_real_distribution<double>(0, retry.jitter)(_random));
+        }
+        if (attempt.deadline > 0 && now_ms() + backoff >= attempt.deadline) {
+            return -1;
+        }
+        return backoff;
     }
 
     /**
-     * @brief Wrapper for user callback, user callback will focus on status and content
+     * @brief Wrapper for user callback, failed attempts are retried before
+     *        user callback is called, which will focus on status and content
+     * @param client         [IN] client sending the request
      * @param rpc_controller [IN] the controller defined to manage the connection
-     * @param request        [IN] user defined request proto
-     * @param response       [IN] user defined response proto
-     * @param callback       [IN] user defined callback function
+     * @param attempt        [IN] request, response and user callback
      * @return               void
      */
-    template <class Request, class Response, class Callback>
-    static void rpc_callback(sofa::pbrpc::RpcController* rpc_controller,
-                            const Request* request,
-                            Response* response,
-                            std::function<void (const Request*, Response*, bool, int)> callback) {
+    template <class Stub, class Request, class Response, class Callback>
+    static void rpc_callback(RpcClient* client, sofa::pbrpc::RpcController* rpc_controller,
+                             std::shared_ptr<Attempt<Stub, Request, Response, Callback> > attempt) {
         bool failed = rpc_controller->Failed();
         int error = rpc_controller->ErrorCode();
         if (failed || error) {
+            int64_t backoff = client->backoff(*attempt, error);
+            if (backoff >= 0) {
+                delete rpc_controller;
+                client->_timer.delay_task(backoff,
+                        std::bind(&RpcClient::template launch<Stub, Request, Response, Callback>,
+                                  client, attempt));
+                return;
+            }
             if (error != sofa::pbrpc::RPC_ERROR_SEND_BUFFER_FULL) {
                 LOG(WARNING, "RPC callback: %s\n", rpc_controller->ErrorText().c_str());
             }
         }
         delete rpc_controller;
-        callback(request, response, failed, error);
+        attempt->callback(attempt->request, attempt->response, failed, error);
     }
 private:
-    sofa::pbrpc::RpcClient* _client;
-    std::map<std::string, sofa::pbrpc::RpcChannel*> _host_map;
-    std::mutex _host_map_lock;
+    RpcClientOptions _options;
+    // one sofa-pbrpc client for each channel to a server
+    std::vector<sofa::pbrpc::RpcClient*> _clients;
+    channel_factory_t _factory;
+    // guards updates of hosts and stubs, lookups take no lock
+    std::mutex _update_lock;
+    std::map<std::string, std::unique_ptr<Host> > _hosts;
+    std::vector<std::unique_ptr<StubSet> > _stub_sets;
+    // every published lookup table, readers may still hold old ones
+    std::vector<std::unique_ptr<const stub_map_t> > _versions;
+    std::atomic<const stub_map_t*> _stub_map;
+    std::default_random_engine _random;
+    std::mutex _random_lock;
+    // schedules retries, which relaunch attempts on the stubs in _stub_map
+    common::ThreadPool _timer;
 };
 
 } // namespace rpc
@@ -0,0 +1,83 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "strands.h"
+
+#include <algorithm>
+
+namespace orion {
+namespace common {
+
+Strands::Strands(ThreadPool* pool, int32_t batch_size, int32_t shard_num) :
+        _pool(pool), _batch_size(std::max(batch_size, 1)) {
+    shard_num = std::max(shard_num, 1);
+    for (int32_t i = 0; i < shard_num; ++i) {
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+void Strands::add_task(int64_t key, task_t&& task) {
+    Shard* shard = shard_of(key);
+    {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        auto it = shard->strands.find(key);
+        ++shard->pending;
+        if (it != shard->strands.end()) {
+            // picked up by the turn of the key already in the pool
+            it->second.push_back(std::move(task));
+            return;
+        }
+        shard->strands[key].push_back(std::move(task));
+    }
+    _pool->add_task(std::bind(&Strands::run, this, key));
+}
+
+size_t Strands::size() const {
+    size_t size = 0;
+    for (const auto& shard : _shards) {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        size += shard->strands.size();
+    }
+    return size;
+}
+
+int64_t Strands::pending() const {
+    int64_t pending = 0;
+    for (const auto& shard : _shards) {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        pending += shard->pending;
+    }
+    return pending;
+}
+
+void Strands::run(int64_t key) {
+    Shard* shard = shard_of(key);
+    for (int32_t i = 0; i < _batch_size; ++i) {
+        task_t task;
+        {
+            std::lock_guard<std::mutex> locker(shard->mutex);
+            auto it = shard->strands.find(key);
+            if (it->second.empty()) {
+                // the next task of the key starts a new turn
+                shard->strands.erase(it);
+                return;
+            }
+            task = std::move(it->second.front());
+            it->second.pop_front();
+            --shard->pending;
+        }
+        task();
+    }
+    // the rest goes back to pool, whose other tasks may run first
+    _pool->add_task(std::bind(&Strands::run, this, key));
+}
+
+Strands::Shard* Strands::shard_of(int64_t key) const {
+    return _shards[static_cast<uint64_t>(key) % _shards.size()].get();
+}
+
+} // namespace common
+} // namespace orion
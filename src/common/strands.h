@@ -0,0 +1,73 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_STRANDS_H
+#define ORION_COMMON_STRANDS_H
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace common {
+
+/**
+ * @brief Serial executors by key on top of a shared thread pool
+ *
+ * Tasks added with the same key run in the order they are added and never at
+ * the same time, while tasks of different keys run in parallel on the pool.
+ * A key with queued tasks has a single task in the pool, which runs a few of
+ * them in a row and queues itself again behind the other keys if more are
+ * left, so a busy key neither holds a thread nor starves the others. A key
+ * without tasks takes no memory. Keys are spread over shards, each locked on
+ * its own. All methods are thread-safe.
+ */
+class Strands {
+public:
+    typedef ThreadPool::task_t task_t;
+
+    /**
+     * @param pool        [IN] runs the tasks, must be stopped before the strands are destroyed
+     * @param batch_size  [IN] tasks of a key run in a row before the others have their turn
+     * @param shard_num   [IN] shards of keys, more for more threads adding tasks
+     */
+    Strands(ThreadPool* pool, int32_t batch_size = 16, int32_t shard_num = 16);
+    /// disable copy and move for strands
+    Strands(const Strands&) = delete;
+    void operator=(const Strands&) = delete;
+
+    /// runs task after the tasks added before with the same key
+    void add_task(int64_t key, task_t&& task);
+    /// number of keys with tasks queued or running
+    size_t size() const;
+    /// number of tasks queued and not started yet
+    int64_t pending() const;
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        // a key is here as long as its turn is in the pool
+        std::unordered_map<int64_t, std::deque<task_t> > strands;
+        int64_t pending;
+
+        Shard() : pending(0) { }
+    };
+
+    /// turn of a key in the pool
+    void run(int64_t key);
+    Shard* shard_of(int64_t key) const;
+private:
+    ThreadPool* _pool;
+    int32_t _batch_size;
+    std::vector<std::unique_ptr<Shard> > _shards;
+};
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_STRANDS_H
@@ -0,0 +1,154 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_TASK_H
+#define ORION_COMMON_TASK_H
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace orion {
+namespace common {
+
+/**
+ * @brief A move-only void() callable kept inline when it is small
+ *
+ * Unlike std::function a task is never copied, so moving it through queues
+ * costs no allocation. Callables up to s_inline_size bytes which are nothrow
+ * movable, such as a bind of a member function with a few pointers or a lambda
+ * capturing a couple of shared pointers, live in the task itself. Larger ones
+ * are allocated once when the task is built and moved by pointer afterwards.
+ */
+class Task {
+public:
+    static const size_t s_inline_size = 64;
+
+    Task() : _ops(nullptr) { }
+    Task(std::nullptr_t) : _ops(nullptr) { }
+    /// wraps any callable taking no argument, std::function included
+    template <typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& func) : _ops(nullptr) {
+        typedef typename std::decay<F>::type func_t;
+        store<func_t>(std::forward<F>(func),
+                std::integral_constant<bool, fits<func_t>()>());
+    }
+    Task(Task&& task) noexcept : _ops(task._ops) {
+        if (_ops != nullptr) {
+            _ops->relocate(&task._buffer, &_buffer);
+            task._ops = nullptr;
+        }
+    }
+    Task& operator=(Task&& task) noexcept {
+        if (this != &task) {
+            reset();
+            _ops = task._ops;
+            if (_ops != nullptr) {
+                _ops->relocate(&task._buffer, &_buffer);
+                task._ops = nullptr;
+            }
+        }
+        return *this;
+    }
+    ~Task() {
+        reset();
+    }
+    /// Task does not support copy
+    Task(const Task&) = delete;
+    void operator=(const Task&) = delete;
+
+    void operator()() {
+        _ops->invoke(&_buffer);
+    }
+    explicit operator bool() const {
+        return _ops != nullptr;
+    }
+    void swap(Task& task) noexcept {
+        Task temp(std::move(task));
+        task = std::move(*this);
+        *this = std::move(temp);
+    }
+    /// returns true if a callable of type F is kept without allocation
+    template <typename F>
+    static constexpr bool fits() {
+        return sizeof(F) <= s_inline_size && alignof(F) <= alignof(buffer_t)
+            && std::is_nothrow_move_constructible<F>::value;
+    }
+private:
+    typedef typename std::aligned_storage<s_inline_size>::type buffer_t;
+
+    /// operations on the callable stored in buffer
+    struct Ops {
+        void (*invoke)(void* buffer);
+        /// moves the callable to another buffer and destroys it in this one
+        void (*relocate)(void* from, void* to);
+        void (*destroy)(void* buffer);
+    };
+    template <typename F>
+    struct Inline {
+        static void invoke(void* buffer) {
+            (*static_cast<F*>(buffer))();
+        }
+        static void relocate(void* from, void* to) {
+            F* func = static_cast<F*>(from);
+            new (to) F(std::move(*func));
+            func->~F();
+        }
+        static void destroy(void* buffer) {
+            static_cast<F*>(buffer)->~F();
+        }
+        static const Ops s_ops;
+    };
+    template <typename F>
+    struct Heap {
+        static void invoke(void* buffer) {
+            (**static_cast<F**>(buffer))();
+        }
+        static void relocate(void* from, void* to) {
+            new (to) F*(*static_cast<F**>(from));
+        }
+        static void destroy(void* buffer) {
+            delete *static_cast<F**>(buffer);
+        }
+        static const Ops s_ops;
+    };
+
+    template <typename T, typename F>
+    void store(F&& func, std::true_type /*fits*/) {
+        new (&_buffer) T(std::forward<F>(func));
+        _ops = &Inline<T>::s_ops;
+    }
+    template <typename T, typename F>
+    void store(F&& func, std::false_type /*fits*/) {
+        new (&_buffer) T*(new T(std::forward<F>(func)));
+        _ops = &Heap<T>::s_ops;
+    }
+    void reset() {
+        if (_ops != nullptr) {
+            _ops->destroy(&_buffer);
+            _ops = nullptr;
+        }
+    }
+private:
+    const Ops* _ops;
+    buffer_t _buffer;
+};
+
+template <typename F>
+const Task::Ops Task::Inline<F>::s_ops = {
+    &Task::Inline<F>::invoke, &Task::Inline<F>::relocate, &Task::Inline<F>::destroy
+};
+
+template <typename F>
+const Task::Ops Task::Heap<F>::s_ops = {
+    &Task::Heap<F>::invoke, &Task::Heap<F>::relocate, &Task::Heap<F>::destroy
+};
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_TASK_H
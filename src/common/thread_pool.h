@@ -16,26 +16,81 @@
 #include <deque>
 #include <queue>
 #include <map>
+#include <set>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 #include <sstream>
 #include <functional>
 #include <thread>
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include <pthread.h>
+#include "common/task.h"
+#include "common/histogram.h"
 
 namespace orion {
 namespace common {
 
+struct ThreadPoolOptions {
+    int32_t thread_num;
+    // per-worker queues with stealing instead of a single shared queue
+    bool work_stealing;
+    // names the threads and the stats of the pool
+    std::string name;
+
+    ThreadPoolOptions() : thread_num(10), work_stealing(false) { }
+};
+
+/// a moment of a pool, latencies are in microseconds since the pool started
+struct ThreadPoolStats {
+    std::string name;
+    int32_t threads;
+    // workers running a task now
+    int32_t active;
+    // tasks waiting for a worker
+    int64_t queued;
+    // delayed tasks waiting for their time
+    int64_t delayed;
+    int64_t tasks;
+    // from when a task is due to when a worker starts it
+    int64_t wait_p50;
+    int64_t wait_p99;
+    int64_t wait_p999;
+    int64_t wait_max;
+    // time a task runs
+    int64_t run_p50;
+    int64_t run_p99;
+    int64_t run_max;
+
+    ThreadPoolStats() : threads(0), active(0), queued(0), delayed(0), tasks(0), wait_p50(0),
+            wait_p99(0), wait_p999(0), wait_max(0), run_p50(0), run_p99(0), run_max(0) { }
+};
+
 /**
  * @brief A thread pool using C++11 threading library
+ *
+ * By default all the workers share one queue under one mutex. In work stealing
+ * mode every worker owns its queues instead: tasks added by a worker of the pool
+ * are pushed to its own queue and run last in first out, tasks added by other
+ * threads are spread over the workers, and a worker running out of tasks steals
+ * the oldest ones of a random victim. Workers without tasks to steal park on
+ * their own condition variable and a new task wakes a single one of them.
+ * Priority tasks stay in a shared queue checked first by every worker, and
+ * delayed tasks are handed to the workers by a timer thread once they are due.
  */
 class ThreadPool {
 public:
-    ThreadPool(int32_t thread_num = 10) :
-            _last_task_id(0), _running_id(0), _pending(0), _stop(false),
+    ThreadPool(int32_t thread_num = 10, const std::string& name = "") :
+            ThreadPool(with_threads(thread_num, name)) { }
+    explicit ThreadPool(const ThreadPoolOptions& options) :
+            _name(options.name), _work_stealing(options.work_stealing), _thread_num(0),
+            _last_task_id(0), _active(0), _pending(0),
+            _stop(false), _priority_num(0), _next_worker(0), _parked(0),
             _schedule_cost_sum(0), _schedule_count(0),
             _task_cost_sum(0), _task_count(0) {
-        start(thread_num);
+        start(options.thread_num);
     }
     ~ThreadPool() {
         stop(false);
@@ -44,8 +99,8 @@ public:
     ThreadPool(const ThreadPool&) = delete;
     void operator=(const ThreadPool&) = delete;
 
-    /// ThreadPool accepts std::function<void()> as a single task
-    typedef std::function<void()> task_t;
+    /// ThreadPool accepts any void() callable as a single task, moved all the way to the worker
+    typedef Task task_t;
 
     /// Starts all working threads, should not be called by user
     bool start(int32_t thread_num) {
@@ -54,9 +109,23 @@ public:
             return false;
         }
         _stop = false;
+        _thread_num = thread_num;
+        if (!_work_stealing) {
+            for (int i = 0; i < thread_num; ++i) {
+                _threads.push_back(std::thread(std::bind(&ThreadPool::main_proc, this, i)));
+            }
+            return true;
+        }
+        // every worker exists before any of them steals
+        _workers.clear();
+        _idle.clear();
+        for (int i = 0; i < thread_num; ++i) {
+            _workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
         for (int i = 0; i < thread_num; ++i) {
-            _threads.push_back(std::thread(std::bind(&ThreadPool::main_proc, this)));
+            _threads.push_back(std::thread(std::bind(&ThreadPool::steal_proc, this, i)));
         }
+        _threads.push_back(std::thread(std::bind(&ThreadPool::timer_proc, this)));
         return true;
     }
 
@@ -69,6 +138,10 @@ public:
             _stop = true;
         }
         _cond_var.notify_all();
+        for (auto& worker : _workers) {
+            std::lock_guard<std::mutex> locker(worker->mutex);
+            worker->cond.notify_one();
+        }
         for (auto& t : _threads) {
             t.join();
         }
@@ -76,43 +149,51 @@ public:
         return true;
     }
 
-    void add_task(const task_t& task) {
+    void add_task(task_t&& task) {
+        if (_work_stealing) {
+            push_task(TaskMeta(0, get_micros(), std::move(task)), false);
+            return;
+        }
         std::unique_lock<std::mutex> locker(_mutex);
         if (_stop) {
             return;
         }
-        _normal_queue.push_back(TaskMeta(0, get_micros(), task));
+        _normal_queue.push_back(TaskMeta(0, get_micros(), std::move(task)));
         ++_pending;
         locker.unlock();
         _cond_var.notify_one();
     }
 
     /// Priority task will be scheduled immediately
-    void add_priority_task(const task_t& task) {
+    void add_priority_task(task_t&& task) {
+        if (_work_stealing) {
+            push_task(TaskMeta(0, get_micros(), std::move(task)), true);
+            return;
+        }
         std::unique_lock<std::mutex> locker(_mutex);
         if (_stop) {
             return;
         }
-        _normal_queue.push_front(TaskMeta(0, get_micros(), task));
+        _normal_queue.push_front(TaskMeta(0, get_micros(), std::move(task)));
         ++_pending;
         locker.unlock();
         _cond_var.notify_one();
     }
 
     /// Delays a task for a few milliseconds before scheduling it
-    int64_t delay_task(int64_t delay_in_milliseconds, const task_t& task) {
+    int64_t delay_task(int64_t delay_in_milliseconds, task_t&& task) {
         std::unique_lock<std::mutex> locker(_mutex);
         if (_stop) {
             return 0;
         }
         int64_t now = get_micros();
         int64_t exe_time = now + delay_in_milliseconds * 1000;
-        TaskMeta meta(++_last_task_id, exe_time, task);
-        _time_queue.push(meta);
-        _latest[meta.id] = meta;
+        int64_t id = ++_last_task_id;
+        _time_queue.push(TaskMeta(id, exe_time, std::move(task)));
+        _latest[id] = exe_time;
         locker.unlock();
         _cond_var.notify_one();
-        return meta.id;
+        return id;
     }
 
     /**
@@ -121,6 +202,9 @@ public:
      * @param block       [IN] block if current task is running, default to true
      * @param is_running  [OUT] return true if the specified task is running
      * @return            false if task_id does not exist or task is running when block is false
+     *
+     * A delayed task handed to a worker in work stealing mode can still be cancelled until
+     * the worker starts it.
      */
     bool cancel_task(int64_t task_id, bool block = true, bool* is_running = nullptr) {
         if (task_id == 0) {
@@ -133,19 +217,15 @@ public:
         do {
             std::lock_guard<std::mutex> locker(_mutex);
             // check if specified task is running
-            if (_running_id != task_id) {
-                auto it = _latest.find(task_id);
-                if (it == _latest.end()) {
-                    if (is_running != nullptr) {
-                        *is_running = false;
-                    }
-                    return false;
+            if (_running.count(task_id) == 0) {
+                bool found = _latest.erase(task_id) > 0 || _dispatched.erase(task_id) > 0;
+                if (is_running != nullptr) {
+                    *is_running = false;
                 }
-                _latest.erase(it);
-                return true;
+                return found;
             } else if (!block) {
                 if (is_running != nullptr) {
-                    *is_running = false;
+                    *is_running = true;
                 }
                 return false;
             }
@@ -178,26 +258,100 @@ public:
         int64_t schedule_count;
         int64_t task_cost_sum;
         int64_t task_count;
-        {
-            std::lock_guard<std::mutex> locker(_mutex);
-            schedule_cost_sum = _schedule_cost_sum;
-            _schedule_cost_sum = 0;
-            schedule_count = _schedule_count;
-            _schedule_count = 0;
-            task_cost_sum = _task_cost_sum;
-            _task_cost_sum = 0;
-            task_count = _task_count;
-            _task_count = 0;
-        }
+        schedule_cost_sum = _schedule_cost_sum.exchange(0);
+        schedule_count = _schedule_count.exchange(0);
+        task_cost_sum = _task_cost_sum.exchange(0);
+        task_count = _task_count.exchange(0);
         std::stringstream ss;
         ss << (schedule_count == 0 ? 0 : schedule_cost_sum / schedule_count / 1000)
             << " " << (task_count == 0 ? 0 : task_cost_sum / task_count / 1000)
             << " " << task_count;
         return ss.str();
     }
+
+    const std::string& name() const {
+        return _name;
+    }
+
+    /**
+     * Unlike profiling_str, stats keep counting since the pool started and
+     * tell the tail apart: latencies are recorded in lock-free histograms, and
+     * a worker records a task in them with no lock held.
+     *
+     * @brief Returns gauges and latency percentiles of the pool
+     * @return stats of the pool at this moment
+     */
+    ThreadPoolStats stats() const {
+        ThreadPoolStats stats;
+        stats.name = _name;
+        stats.threads = _thread_num;
+        stats.active = _active;
+        stats.queued = _pending;
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            stats.delayed = _latest.size() + _dispatched.size();
+        }
+        stats.tasks = _run_histogram.count();
+        stats.wait_p50 = _wait_histogram.percentile(50);
+        stats.wait_p99 = _wait_histogram.percentile(99);
+        stats.wait_p999 = _wait_histogram.percentile(99.9);
+        stats.wait_max = _wait_histogram.max();
+        stats.run_p50 = _run_histogram.percentile(50);
+        stats.run_p99 = _run_histogram.percentile(99);
+        stats.run_max = _run_histogram.max();
+        return stats;
+    }
+    /// time from when tasks are due to when workers start them, in microseconds
+    const LatencyHistogram& wait_histogram() const {
+        return _wait_histogram;
+    }
+    /// time tasks run, in microseconds
+    const LatencyHistogram& run_histogram() const {
+        return _run_histogram;
+    }
 private:
+    /// structure to save the meta information of a user task
+    struct TaskMeta {
+        int64_t id;
+        int64_t exe_time;
+        task_t task;
+        TaskMeta() { }
+        TaskMeta(int64_t id, int64_t exe_time, task_t&& task) :
+                id(id), exe_time(exe_time), task(std::move(task)) { }
+        bool operator<(const TaskMeta& meta) const {
+            return (exe_time != meta.exe_time) ?
+                   (exe_time > meta.exe_time) : (id > meta.id);
+        }
+    };
+
+    /// queues and parking place of a worker in work stealing mode
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable cond;
+        // tasks added by other threads, run first in first out
+        std::deque<TaskMeta> tasks;
+        // tasks spawned by this worker, run last in first out and stolen from the front
+        std::deque<TaskMeta> local;
+        // waiting on cond, so a task pushed to it notifies the worker directly
+        bool waiting;
+        // woken by wake_one to look for tasks of other workers
+        bool signaled;
+        Worker() : waiting(false), signaled(false) { }
+    };
+
+    /// pool and index of the worker running on current thread
+    struct WorkerSlot {
+        ThreadPool* pool;
+        size_t index;
+    };
+    static WorkerSlot& current_worker() {
+        static thread_local WorkerSlot slot = {nullptr, 0};
+        return slot;
+    }
+
     /// Working process that executes user tasks
-    void main_proc() {
+    void main_proc(int index) {
+        name_thread(index);
         // loops until recevies a stop command
         while (true) {
             std::unique_lock<std::mutex> locker(_mutex);
@@ -211,26 +365,23 @@ private:
             // check for delay tasks
             if (!_time_queue.empty()) {
                 int64_t now_time = get_micros();
-                auto cur_task = _time_queue.top();
-                int64_t wait_time = cur_task.exe_time - now_time;
+                int64_t wait_time = _time_queue.top().exe_time - now_time;
                 if (wait_time <= 0) {
                     // time is up for current delay task
-                    _time_queue.pop();
+                    TaskMeta cur_task = pop_time_queue();
                     auto it = _latest.find(cur_task.id);
-                    if (it != _latest.end() && it->second.exe_time == cur_task.exe_time) {
-                        _schedule_cost_sum += now_time - cur_task.exe_time;
-                        ++_schedule_count;
-                        const auto& task_exec = cur_task.task;
+                    if (it != _latest.end() && it->second == cur_task.exe_time) {
+                        begin_task(cur_task.exe_time, now_time);
+                        task_t& task_exec = cur_task.task;
                         _latest.erase(it);
-                        _running_id = cur_task.id;
+                        _running.insert(cur_task.id);
                         locker.unlock();
                         // execute user task here
                         task_exec();
                         int64_t end_time = get_micros();
+                        end_task(now_time, end_time);
                         locker.lock();
-                        _task_cost_sum += end_time - now_time;
-                        ++_task_count;
-                        _running_id = 0;
+                        _running.erase(cur_task.id);
                     }
                     continue;
                 } else if (_normal_queue.empty() && !_stop) {
@@ -241,46 +392,297 @@ private:
             }
             // check for normal tasks
             if (!_normal_queue.empty()) {
-                auto task_exec = _normal_queue.front().task;
+                task_t task_exec = std::move(_normal_queue.front().task);
                 int64_t exe_time = _normal_queue.front().exe_time;
                 _normal_queue.pop_front();
                 --_pending;
                 int64_t start_time = get_micros();
-                _schedule_cost_sum += start_time - exe_time;
-                ++_schedule_count;
                 locker.unlock();
+                begin_task(exe_time, start_time);
                 // execute user task here
                 task_exec();
-                int64_t end_time = get_micros();
+                end_task(start_time, get_micros());
+                // captures are released outside the lock
+                task_exec = nullptr;
                 locker.lock();
-                _task_cost_sum += end_time - start_time;
-                ++_task_count;
             }
         }
     }
 
-    /// uses chrono library for time acquiring
+    /// Working process of a worker in work stealing mode
+    void steal_proc(size_t index) {
+        name_thread(static_cast<int>(index));
+        WorkerSlot& slot = current_worker();
+        slot.pool = this;
+        slot.index = index;
+        Worker& self = *_workers[index];
+        // seed of the victims picked by this worker
+        uint64_t seed = index * 2654435761UL + 1;
+        TaskMeta meta;
+        while (!_stop) {
+            if (take_task(index, &seed, &meta)) {
+                run_task(meta);
+                continue;
+            }
+            // parks in sight of the producers before the last scan, a task pushed
+            // meanwhile is either found by the scan or wakes a parked worker
+            ++_parked;
+            {
+                std::lock_guard<std::mutex> locker(_idle_mutex);
+                _idle.push_back(index);
+            }
+            bool found = take_task(index, &seed, &meta);
+            if (!found) {
+                std::unique_lock<std::mutex> locker(self.mutex);
+                self.waiting = true;
+                while (!self.signaled && self.local.empty() && self.tasks.empty() && !_stop) {
+                    self.cond.wait(locker);
+                }
+                self.waiting = false;
+                self.signaled = false;
+            }
+            {
+                std::lock_guard<std::mutex> locker(_idle_mutex);
+                auto it = std::find(_idle.begin(), _idle.end(), index);
+                if (it != _idle.end()) {
+                    _idle.erase(it);
+                }
+            }
+            --_parked;
+            if (found) {
+                run_task(meta);
+            }
+        }
+    }
+
+    /// Hands delayed tasks to the workers once they are due in work stealing mode
+    void timer_proc() {
+        name_thread(-1);
+        std::unique_lock<std::mutex> locker(_mutex);
+        while (!_stop) {
+            if (_time_queue.empty()) {
+                _cond_var.wait(locker);
+                continue;
+            }
+            int64_t wait_time = _time_queue.top().exe_time - get_micros();
+            if (wait_time > 0) {
+                _cond_var.wait_for(locker, std::chrono::microseconds(wait_time));
+                continue;
+            }
+            TaskMeta cur_task = pop_time_queue();
+            auto it = _latest.find(cur_task.id);
+            if (it == _latest.end() || it->second != cur_task.exe_time) {
+                continue;
+            }
+            _latest.erase(it);
+            _dispatched.insert(cur_task.id);
+            locker.unlock();
+            push_task(std::move(cur_task), false);
+            locker.lock();
+        }
+    }
+
+    /// Pushes a task to the worker queues, delayed tasks keep their ids
+    void push_task(TaskMeta&& meta, bool priority) {
+        if (_workers.empty()) {
+            return;
+        }
+        // stop is checked under the lock of the queue, which stop takes after setting it,
+        // so that no task lands in a queue once the workers may have left
+        if (priority) {
+            {
+                std::lock_guard<std::mutex> locker(_mutex);
+                if (_stop) {
+                    return;
+                }
+                if (meta.id == 0) {
+                    ++_pending;
+                }
+                _priority.push_front(std::move(meta));
+                ++_priority_num;
+            }
+            wake_one();
+            return;
+        }
+        bool notified = false;
+        const WorkerSlot& slot = current_worker();
+        if (slot.pool == this) {
+            // spawned by a worker, runs next on the same worker unless stolen
+            Worker& worker = *_workers[slot.index];
+            std::lock_guard<std::mutex> locker(worker.mutex);
+            if (_stop) {
+                return;
+            }
+            if (meta.id == 0) {
+                ++_pending;
+            }
+            worker.local.push_back(std::move(meta));
+        } else {
+            Worker& worker = *_workers[_next_worker++ % _workers.size()];
+            std::lock_guard<std::mutex> locker(worker.mutex);
+            if (_stop) {
+                return;
+            }
+            if (meta.id == 0) {
+                ++_pending;
+            }
+            worker.tasks.push_back(std::move(meta));
+            if (worker.waiting) {
+                worker.cond.notify_one();
+                notified = true;
+            }
+        }
+        if (!notified) {
+            wake_one();
+        }
+    }
+
+    /// Wakes the worker parked last if there is any
+    void wake_one() {
+        if (_parked == 0) {
+            return;
+        }
+        size_t index = 0;
+        {
+            std::lock_guard<std::mutex> locker(_idle_mutex);
+            if (_idle.empty()) {
+                return;
+            }
+            index = _idle.back();
+            _idle.pop_back();
+        }
+        Worker& worker = *_workers[index];
+        std::lock_guard<std::mutex> locker(worker.mutex);
+        worker.signaled = true;
+        worker.cond.notify_one();
+    }
+
+    /// Takes a priority task, a task of the worker, or steals one from another worker
+    bool take_task(size_t index, uint64_t* seed, TaskMeta* meta) {
+        if (_priority_num > 0) {
+            std::lock_guard<std::mutex> locker(_mutex);
+            if (!_priority.empty()) {
+                *meta = std::move(_priority.front());
+                _priority.pop_front();
+                --_priority_num;
+                return true;
+            }
+        }
+        Worker& self = *_workers[index];
+        {
+            std::lock_guard<std::mutex> locker(self.mutex);
+            if (!self.local.empty()) {
+                *meta = std::move(self.local.back());
+                self.local.pop_back();
+                return true;
+            }
+            if (!self.tasks.empty()) {
+                *meta = std::move(self.tasks.front());
+                self.tasks.pop_front();
+                return true;
+            }
+        }
+        // xorshift picks the first victim, so thieves do not gather on the same worker
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 7;
+        *seed ^= *seed << 17;
+        size_t worker_num = _workers.size();
+        size_t first = *seed % worker_num;
+        for (size_t i = 0; i < worker_num; ++i) {
+            size_t victim = (first + i) % worker_num;
+            if (victim == index) {
+                continue;
+            }
+            Worker& worker = *_workers[victim];
+            std::lock_guard<std::mutex> locker(worker.mutex);
+            if (!worker.tasks.empty()) {
+                *meta = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+                return true;
+            }
+            if (!worker.local.empty()) {
+                *meta = std::move(worker.local.front());
+                worker.local.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Runs a task taken by a worker, delayed tasks are skipped once cancelled
+    void run_task(TaskMeta& meta) {
+        if (meta.id == 0) {
+            --_pending;
+        } else {
+            std::lock_guard<std::mutex> locker(_mutex);
+            if (_dispatched.erase(meta.id) == 0) {
+                meta.task = nullptr;
+                return;
+            }
+            _running.insert(meta.id);
+        }
+        int64_t start_time = get_micros();
+        begin_task(meta.exe_time, start_time);
+        // execute user task here
+        meta.task();
+        end_task(start_time, get_micros());
+        // captures are released before the worker looks for the next task
+        meta.task = nullptr;
+        if (meta.id != 0) {
+            std::lock_guard<std::mutex> locker(_mutex);
+            _running.erase(meta.id);
+        }
+    }
+
+    /// accounts a task a worker starts, due is when it could have started
+    void begin_task(int64_t due, int64_t start_time) {
+        _schedule_cost_sum += start_time - due;
+        ++_schedule_count;
+        _wait_histogram.record(start_time - due);
+        ++_active;
+    }
+    void end_task(int64_t start_time, int64_t end_time) {
+        --_active;
+        _task_cost_sum += end_time - start_time;
+        ++_task_count;
+        _run_histogram.record(end_time - start_time);
+    }
+
+    /// names current thread after the pool, index is -1 for the timer thread
+    void name_thread(int index) const {
+        if (_name.empty()) {
+            return;
+        }
+        // linux keeps 15 characters of a thread name
+        std::string name = _name.substr(0, 11) + (index < 0 ? ":t" : ":" + std::to_string(index));
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+    }
+
+    static ThreadPoolOptions with_threads(int32_t thread_num, const std::string& name) {
+        ThreadPoolOptions options;
+        options.thread_num = thread_num;
+        options.name = name;
+        return options;
+    }
+
+    /// moves the most recent delayed task out of the queue, called with mutex locked
+    TaskMeta pop_time_queue() {
+        // ordering of the queue only reads the id and time, which moving leaves intact
+        TaskMeta meta = std::move(const_cast<TaskMeta&>(_time_queue.top()));
+        _time_queue.pop();
+        return meta;
+    }
+
+    /// uses a steady clock, delays and latencies are not affected by changes of wall time
     int64_t get_micros() const {
         return std::chrono::duration_cast<std::chrono::microseconds>(
-               std::chrono::system_clock::now().time_since_epoch()).count();
+               std::chrono::steady_clock::now().time_since_epoch()).count();
     }
 
-    /// structure to save the meta information of a user task
-    struct TaskMeta {
-        int64_t id;
-        int64_t exe_time;
-        task_t task;
-        TaskMeta() { }
-        TaskMeta(int64_t id, int64_t exe_time, const task_t& task) :
-                id(id), exe_time(exe_time), task(task) { }
-        bool operator<(const TaskMeta& meta) const {
-            return (exe_time != meta.exe_time) ?
-                   (exe_time > meta.exe_time) : (id > meta.id);
-        }
-    };
 private:
+    std::string _name;
     /// global mutex for condition variable and critical area
-    std::mutex _mutex;
+    mutable std::mutex _mutex;
     std::condition_variable _cond_var;
     /// pool that holds all working threads
     std::vector<std::thread> _threads;
@@ -288,17 +690,36 @@ private:
     std::deque<TaskMeta> _normal_queue;
     /// priority queue for easily getting a most recent delayed task
     std::priority_queue<TaskMeta> _time_queue;
-    /// for task id lookup
-    std::map<int64_t, TaskMeta> _latest;
+    /// execution time of delayed tasks by id, for task id lookup
+    std::map<int64_t, int64_t> _latest;
+    /// delayed tasks handed to the workers and not started yet
+    std::set<int64_t> _dispatched;
+    /// delayed tasks running now
+    std::set<int64_t> _running;
+    bool _work_stealing;
+    int32_t _thread_num;
     int64_t _last_task_id;
-    int64_t _running_id;
-    volatile int _pending;
-    bool _stop;
-
-    int64_t _schedule_cost_sum;
-    int64_t _schedule_count;
-    int64_t _task_cost_sum;
-    int64_t _task_count;
+    std::atomic<int32_t> _active;
+    std::atomic<int64_t> _pending;
+    std::atomic<bool> _stop;
+
+    /// priority tasks of work stealing mode, guarded by _mutex
+    std::deque<TaskMeta> _priority;
+    std::atomic<int64_t> _priority_num;
+    std::vector<std::unique_ptr<Worker> > _workers;
+    /// worker receiving the next task added by other threads
+    std::atomic<uint64_t> _next_worker;
+    /// parked workers, the last parked is woken first
+    std::mutex _idle_mutex;
+    std::vector<size_t> _idle;
+    std::atomic<int32_t> _parked;
+
+    std::atomic<int64_t> _schedule_cost_sum;
+    std::atomic<int64_t> _schedule_count;
+    std::atomic<int64_t> _task_cost_sum;
+    std::atomic<int64_t> _task_count;
+    LatencyHistogram _wait_histogram;
+    LatencyHistogram _run_histogram;
 };
 
 }
@@ -0,0 +1,303 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "timing_wheel.h"
+
+#include <chrono>
+#include <algorithm>
+
+namespace orion {
+namespace common {
+
+// an id is made of generation, index of the node and shard, low bits first
+static const int32_t s_shard_bits = 8;
+static const int32_t s_index_bits = 32;
+static const int64_t s_generation_mask = (1LL << (63 - s_shard_bits - s_index_bits)) - 1;
+
+TimingWheel::TimingWheel(ThreadPool* pool, int64_t tick_ms, int32_t shard_num,
+        const clock_func_t& clock) : _pool(pool), _tick_ms(std::max(tick_ms, 1L)),
+        _clock(clock), _start_ms(0), _next_shard(0), _stop(false) {
+    _start_ms = now_ms();
+    shard_num = std::min(std::max(shard_num, 1), 1 << s_shard_bits);
+    int32_t slot_num = (1 << s_near_bits) + s_far_wheels * (1 << s_far_bits);
+    for (int32_t i = 0; i < shard_num; ++i) {
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+        _shards.back()->slots.assign(slot_num, -1);
+    }
+    _ticker = std::thread(std::bind(&TimingWheel::tick_proc, this));
+}
+
+TimingWheel::~TimingWheel() {
+    stop();
+}
+
+int64_t TimingWheel::add(int64_t delay_ms, task_t&& task) {
+    uint64_t expire = ticks(delay_ms);
+    uint32_t shard_id = _next_shard++ % _shards.size();
+    Shard* shard = _shards[shard_id].get();
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    if (_stop) {
+        return 0;
+    }
+    int32_t index = shard->free_head;
+    if (index >= 0) {
+        shard->free_head = shard->timers[index].next;
+    } else {
+        index = static_cast<int32_t>(shard->timers.size());
+        shard->timers.push_back(Timer());
+        shard->timers.back().generation = 0;
+    }
+    Timer& timer = shard->timers[index];
+    timer.generation = static_cast<uint32_t>((timer.generation + 1) & s_generation_mask);
+    if (timer.generation == 0) {
+        timer.generation = 1;
+    }
+    timer.task = std::move(task);
+    timer.expire = expire;
+    link(shard, index);
+    ++shard->size;
+    return (static_cast<int64_t>(timer.generation) << (s_index_bits + s_shard_bits))
+        | (static_cast<int64_t>(index) << s_shard_bits) | shard_id;
+}
+
+bool TimingWheel::renew(int64_t id, int64_t delay_ms) {
+    uint64_t expire = ticks(delay_ms);
+    Shard* shard = shard_of(id);
+    if (shard == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> locker(shard->mutex);
+    int32_t index = -1;
+    Timer* timer = find(shard, id, &index);
+    if (timer == nullptr) {
+        return false;
+    }
+    unlink(shard, index);
+    timer->expire = expire;
+    link(shard, index);
+    return true;
+}
+
+bool TimingWheel::cancel(int64_t id) {
+    Shard* shard = shard_of(id);
+    if (shard == nullptr) {
+        return false;
+    }
+    task_t task;
+    {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        int32_t index = -1;
+        Timer* timer = find(shard, id, &index);
+        if (timer == nullptr) {
+            return false;
+        }
+        unlink(shard, index);
+        // captures of the task are released outside the lock
+        task.swap(timer->task);
+        timer->slot = -1;
+        timer->next = shard->free_head;
+        shard->free_head = index;
+        --shard->size;
+    }
+    return true;
+}
+
+void TimingWheel::stop() {
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (_stop) {
+            return;
+        }
+        _stop = true;
+    }
+    _cond.notify_all();
+    if (_ticker.joinable()) {
+        _ticker.join();
+    }
+    for (auto& shard : _shards) {
+        std::vector<Timer> timers;
+        {
+            std::lock_guard<std::mutex> locker(shard->mutex);
+            timers.swap(shard->timers);
+            shard->slots.assign(shard->slots.size(), -1);
+            shard->free_head = -1;
+            shard->size = 0;
+            shard->near_size = 0;
+        }
+    }
+}
+
+size_t TimingWheel::size() const {
+    size_t size = 0;
+    for (const auto& shard : _shards) {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        size += shard->size;
+    }
+    return size;
+}
+
+void TimingWheel::link(Shard* shard, int32_t index) {
+    Timer& timer = shard->timers[index];
+    uint64_t current = shard->current;
+    // an expired timer runs with the next tick
+    if (timer.expire < current) {
+        timer.expire = current;
+    }
+    uint64_t delta = timer.expire - current;
+    int32_t slot = 0;
+    if (delta < (1ULL << s_near_bits)) {
+        slot = static_cast<int32_t>(timer.expire & ((1 << s_near_bits) - 1));
+        ++shard->near_size;
+    } else {
+        int32_t shift = s_near_bits;
+        for (int32_t wheel = 0; wheel < s_far_wheels; ++wheel, shift += s_far_bits) {
+            uint64_t span = 1ULL << (shift + s_far_bits);
+            if (delta < span || wheel == s_far_wheels - 1) {
+                // beyond the last wheel, the timer keeps its expire and waits in the
+                // farthest slot, to be placed again once that slot cascades
+                uint64_t at = delta < span ? timer.expire : current + span - 1;
+                slot = (1 << s_near_bits) + wheel * (1 << s_far_bits)
+                    + static_cast<int32_t>((at >> shift) & ((1 << s_far_bits) - 1));
+                break;
+            }
+        }
+    }
+    timer.slot = slot;
+    timer.prev = -1;
+    timer.next = shard->slots[slot];
+    if (timer.next >= 0) {
+        shard->timers[timer.next].prev = index;
+    }
+    shard->slots[slot] = index;
+}
+
+void TimingWheel::unlink(Shard* shard, int32_t index) {
+    Timer& timer = shard->timers[index];
+    if (timer.prev >= 0) {
+        shard->timers[timer.prev].next = timer.next;
+    } else {
+        shard->slots[timer.slot] = timer.next;
+    }
+    if (timer.next >= 0) {
+        shard->timers[timer.next].prev = timer.prev;
+    }
+    if (timer.slot < (1 << s_near_bits)) {
+        --shard->near_size;
+    }
+    timer.prev = -1;
+    timer.next = -1;
+}
+
+int32_t TimingWheel::cascade(Shard* shard, int32_t wheel) {
+    int32_t shift = s_near_bits + wheel * s_far_bits;
+    int32_t pos = static_cast<int32_t>((shard->current >> shift) & ((1 << s_far_bits) - 1));
+    int32_t slot = (1 << s_near_bits) + wheel * (1 << s_far_bits) + pos;
+    int32_t index = shard->slots[slot];
+    shard->slots[slot] = -1;
+    while (index >= 0) {
+        int32_t next = shard->timers[index].next;
+        link(shard, index);
+        index = next;
+    }
+    return pos;
+}
+
+void TimingWheel::advance(Shard* shard, uint64_t target, std::vector<task_t>* expired) {
+    while (shard->current <= target) {
+        int32_t pos = static_cast<int32_t>(shard->current & ((1 << s_near_bits) - 1));
+        // outer wheels move inward once the inner wheel completes a turn
+        if (pos == 0) {
+            for (int32_t wheel = 0; wheel < s_far_wheels && cascade(shard, wheel) == 0; ++wheel) { }
+        }
+        if (shard->near_size == 0) {
+            // nothing runs before the next turn, when outer timers may move inward
+            shard->current = std::min((shard->current | ((1 << s_near_bits) - 1)) + 1,
+                                      target + 1);
+            continue;
+        }
+        int32_t index = shard->slots[pos];
+        shard->slots[pos] = -1;
+        while (index >= 0) {
+            Timer& timer = shard->timers[index];
+            int32_t next = timer.next;
+            expired->push_back(task_t());
+            expired->back().swap(timer.task);
+            timer.slot = -1;
+            timer.next = shard->free_head;
+            shard->free_head = index;
+            --shard->size;
+            --shard->near_size;
+            index = next;
+        }
+        ++shard->current;
+    }
+}
+
+void TimingWheel::tick_proc() {
+    while (true) {
+        uint64_t target = 0;
+        {
+            std::unique_lock<std::mutex> locker(_mutex);
+            // wakes up at the start of the next tick
+            int64_t elapsed = now_ms() - _start_ms;
+            int64_t wait = _tick_ms - elapsed % _tick_ms;
+            _cond.wait_for(locker, std::chrono::milliseconds(wait));
+            if (_stop) {
+                break;
+            }
+            target = static_cast<uint64_t>((now_ms() - _start_ms) / _tick_ms);
+        }
+        Batch batch;
+        for (auto& shard : _shards) {
+            std::lock_guard<std::mutex> locker(shard->mutex);
+            advance(shard.get(), target, &batch.tasks);
+        }
+        if (!batch.tasks.empty()) {
+            // a batch is one task of pool, moved there without copying the tasks
+            _pool->add_task(std::move(batch));
+        }
+    }
+}
+
+TimingWheel::Timer* TimingWheel::find(Shard* shard, int64_t id, int32_t* index) {
+    uint64_t position = (static_cast<uint64_t>(id) >> s_shard_bits) & ((1ULL << s_index_bits) - 1);
+    uint32_t generation = static_cast<uint32_t>(
+            static_cast<uint64_t>(id) >> (s_index_bits + s_shard_bits));
+    if (position >= shard->timers.size()) {
+        return nullptr;
+    }
+    Timer& timer = shard->timers[position];
+    if (timer.slot < 0 || timer.generation != generation) {
+        return nullptr;
+    }
+    *index = static_cast<int32_t>(position);
+    return &timer;
+}
+
+TimingWheel::Shard* TimingWheel::shard_of(int64_t id) const {
+    if (id <= 0) {
+        return nullptr;
+    }
+    size_t shard_id = static_cast<size_t>(id & ((1 << s_shard_bits) - 1));
+    return shard_id < _shards.size() ? _shards[shard_id].get() : nullptr;
+}
+
+uint64_t TimingWheel::ticks(int64_t delay_ms) const {
+    // rounded up, so that a timer never runs before its delay
+    int64_t at = now_ms() - _start_ms + std::max(delay_ms, 0L);
+    return static_cast<uint64_t>((at + _tick_ms - 1) / _tick_ms);
+}
+
+int64_t TimingWheel::now_ms() const {
+    if (_clock) {
+        return _clock();
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace common
+} // namespace orion
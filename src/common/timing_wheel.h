@@ -0,0 +1,141 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_COMMON_TIMING_WHEEL_H
+#define ORION_COMMON_TIMING_WHEEL_H
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace common {
+
+/**
+ * @brief Hierarchical timing wheel for a large number of timers
+ *
+ * Timers are kept in wheels of slots, the first wheel has a slot for every
+ * tick, a slot of every following wheel spans a whole turn of the previous
+ * one. Timers of an outer slot move inward once the inner wheels come to it.
+ * Adding, renewing and cancelling a timer is O(1) and allocates nothing
+ * once the timer nodes are reused, unlike ThreadPool::delay_task.
+ *
+ * Timers are spread over shards, each locked on its own, so that renewals
+ * from many threads seldom contend. A single ticker thread advances all
+ * the shards and hands the tasks expired in all of them to the pool as a
+ * single batch, so a task they add to a single thread pool runs after all
+ * of them. Tasks run no earlier than their delay and up to a tick later.
+ * All methods are thread-safe.
+ */
+class TimingWheel {
+public:
+    typedef ThreadPool::task_t task_t;
+    /// returns milliseconds of a monotonic clock
+    typedef std::function<int64_t ()> clock_func_t;
+
+    /**
+     * @param pool       [IN] runs expired tasks, must outlive the wheel
+     * @param tick_ms    [IN] resolution of timers in milliseconds
+     * @param shard_num  [IN] shards of timers, more for more threads renewing timers
+     * @param clock      [IN] time of timers, steady clock if empty
+     */
+    TimingWheel(ThreadPool* pool, int64_t tick_ms = 10, int32_t shard_num = 16,
+            const clock_func_t& clock = clock_func_t());
+    /// stops ticking, pending timers are dropped
+    ~TimingWheel();
+    /// disable copy and move for timing wheel
+    TimingWheel(const TimingWheel&) = delete;
+    void operator=(const TimingWheel&) = delete;
+
+    /// returns id of the timer running task after delay, 0 if the wheel is stopped
+    int64_t add(int64_t delay_ms, task_t&& task);
+    /// restarts a timer with a new delay, returns false if it has run or is cancelled
+    bool renew(int64_t id, int64_t delay_ms);
+    /// returns false if the timer has run or is cancelled
+    bool cancel(int64_t id);
+    /// stops ticking and drops pending timers, tasks already handed to pool still run
+    void stop();
+    /// number of pending timers
+    size_t size() const;
+private:
+    // slots of the first wheel and of the others, as bits
+    static const int32_t s_near_bits = 8;
+    static const int32_t s_far_bits = 6;
+    static const int32_t s_far_wheels = 4;
+
+    struct Timer {
+        task_t task;
+        // tick to run at, may be beyond the last wheel
+        uint64_t expire;
+        // bumped every time the node is reused, so that stale ids miss it
+        uint32_t generation;
+        // links in the list of a slot, or of free nodes, -1 for none
+        int32_t prev;
+        int32_t next;
+        // slot holding the timer, -1 if the node is free
+        int32_t slot;
+    };
+    /// expired tasks of a tick, run as a single task of pool
+    struct Batch {
+        std::vector<task_t> tasks;
+
+        void operator()() {
+            for (auto& task : tasks) {
+                task();
+            }
+        }
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Timer> timers;
+        // heads of slot lists, near wheel first
+        std::vector<int32_t> slots;
+        int32_t free_head;
+        // the next tick to run
+        uint64_t current;
+        size_t size;
+        // timers in the near wheel, ticks are skipped up to its next turn if none
+        size_t near_size;
+
+        Shard() : free_head(-1), current(0), size(0), near_size(0) { }
+    };
+
+    /// places timer in the slot of its expire tick, called with shard locked
+    void link(Shard* shard, int32_t index);
+    void unlink(Shard* shard, int32_t index);
+    /// moves the timers of an outer slot inward, returns index of the slot
+    int32_t cascade(Shard* shard, int32_t wheel);
+    /// runs ticks of shard up to target, collecting expired tasks
+    void advance(Shard* shard, uint64_t target, std::vector<task_t>* expired);
+    /// ticker thread
+    void tick_proc();
+    /// locates the timer of id, returns nullptr if not pending, called with shard locked
+    Timer* find(Shard* shard, int64_t id, int32_t* index);
+    Shard* shard_of(int64_t id) const;
+    uint64_t ticks(int64_t delay_ms) const;
+    int64_t now_ms() const;
+private:
+    ThreadPool* _pool;
+    int64_t _tick_ms;
+    clock_func_t _clock;
+    int64_t _start_ms;
+    std::vector<std::unique_ptr<Shard> > _shards;
+    std::atomic<uint32_t> _next_shard;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::atomic<bool> _stop;
+    std::thread _ticker;
+};
+
+} // namespace common
+} // namespace orion
+
+#endif // ORION_COMMON_TIMING_WHEEL_H
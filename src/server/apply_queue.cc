@@ -0,0 +1,174 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "apply_queue.h"
+
+#include <algorithm>
+#include "server/raft_log.h"
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace raft {
+
+// a committed entry failing to be read is tried again after this interval,
+// in milliseconds, up to the max number of times
+static const int64_t s_read_retry_interval = 100;
+static const int32_t s_max_read_retries = 100;
+
+ApplyQueue::ApplyQueue(RaftLog* log, StateMachine* machine, int32_t max_batch_entries,
+        int64_t max_batch_bytes) :
+        _log(log), _machine(machine), _max_batch_entries(max_batch_entries),
+        _max_batch_bytes(max_batch_bytes), _commit_index(0), _applied_index(0),
+        _applying(false), _stop(false), _read_failures(0), _pool(1, "apply") { }
+
+ApplyQueue::~ApplyQueue() {
+    stop();
+}
+
+void ApplyQueue::start(int64_t applied_index) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _applied_index = applied_index;
+    _commit_index = std::max(_commit_index, applied_index);
+}
+
+void ApplyQueue::stop() {
+    std::multimap<int64_t, Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _stop = true;
+        waiters.swap(_waiters);
+    }
+    _pool.stop(false);
+    for (auto& waiter : waiters) {
+        waiter.second.done(ApplyResult(status_code::NOT_LEADER));
+    }
+}
+
+void ApplyQueue::commit(int64_t commit_index) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop || commit_index <= _commit_index) {
+        return;
+    }
+    _commit_index = commit_index;
+    // entries committed while applying are picked up by the running task
+    if (!_applying) {
+        _applying = true;
+        _pool.add_task(std::bind(&ApplyQueue::apply_task, this));
+    }
+}
+
+void ApplyQueue::wait(int64_t index, int64_t term, const done_func_t& done) {
+    wait(index, term, result_func_t([done](const ApplyResult& result) {
+        done(result.status);
+    }));
+}
+
+void ApplyQueue::wait(int64_t index, int64_t term, const result_func_t& done) {
+    std::unique_lock<std::mutex> locker(_mutex);
+    if (_stop || index <= _applied_index) {
+        // the entry is covered by an installed snapshot, result is unknown
+        locker.unlock();
+        done(ApplyResult(status_code::NOT_LEADER));
+        return;
+    }
+    _waiters.insert(std::make_pair(index, Waiter{ term, done }));
+}
+
+void ApplyQueue::set_listener(const apply_listener_t& listener) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _listener = listener;
+}
+
+int64_t ApplyQueue::applied_index() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _applied_index;
+}
+
+void ApplyQueue::exclusive(const std::function<void (int64_t* applied_index)>& func) {
+    std::lock_guard<std::mutex> apply_locker(_apply_mutex);
+    int64_t applied_index = this->applied_index();
+    func(&applied_index);
+    std::multimap<int64_t, Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (applied_index == _applied_index) {
+            return;
+        }
+        _applied_index = applied_index;
+        _commit_index = std::max(_commit_index, applied_index);
+        auto end = _waiters.upper_bound(applied_index);
+        waiters.insert(_waiters.begin(), end);
+        _waiters.erase(_waiters.begin(), end);
+    }
+    for (auto& waiter : waiters) {
+        waiter.second.done(ApplyResult(status_code::NOT_LEADER));
+    }
+}
+
+void ApplyQueue::apply_task() {
+    while (true) {
+        std::vector<Entry> entries;
+        std::vector<ApplyResult> results;
+        std::multimap<int64_t, Waiter> waiters;
+        apply_listener_t listener;
+        int64_t first_index = 0;
+        {
+            std::lock_guard<std::mutex> apply_locker(_apply_mutex);
+            int64_t commit_index = 0;
+            {
+                std::lock_guard<std::mutex> locker(_mutex);
+                if (_stop || _applied_index >= _commit_index) {
+                    _applying = false;
+                    return;
+                }
+                first_index = _applied_index + 1;
+                commit_index = _commit_index;
+            }
+            int32_t max_count = static_cast<int32_t>(std::min(
+                        static_cast<int64_t>(_max_batch_entries), commit_index - first_index + 1));
+            if (!_log->get_range(first_index, max_count, _max_batch_bytes, &entries)
+                    || entries.empty()) {
+                // _applying is kept, entries committed meanwhile wait for the retry
+                if (++_read_failures >= s_max_read_retries) {
+                    LOG(FATAL, "[raft]: failed to read committed entry %ld", first_index);
+                }
+                LOG(WARNING, "[raft]: failed to read committed entry %ld, retry later",
+                        first_index);
+                _pool.delay_task(s_read_retry_interval,
+                        std::bind(&ApplyQueue::apply_task, this));
+                return;
+            }
+            _read_failures = 0;
+            if (_machine->apply(first_index, entries, &results) != status_code::OK) {
+                LOG(FATAL, "[raft]: failed to apply entries from %ld", first_index);
+            }
+            std::lock_guard<std::mutex> locker(_mutex);
+            _applied_index = first_index + entries.size() - 1;
+            auto end = _waiters.upper_bound(_applied_index);
+            waiters.insert(_waiters.begin(), end);
+            _waiters.erase(_waiters.begin(), end);
+            listener = _listener;
+        }
+        // proposers and watchers are woken up after the batch is written
+        for (auto& waiter : waiters) {
+            int64_t offset = waiter.first - first_index;
+            if (offset < 0 || entries[offset].term() != waiter.second.term) {
+                waiter.second.done(ApplyResult(status_code::NOT_LEADER));
+            } else {
+                waiter.second.done(results[offset]);
+            }
+        }
+        if (listener) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                listener(first_index + i, entries[i], results[i]);
+            }
+        }
+    }
+}
+
+} // namespace raft
+} // namespace orion
@@ -0,0 +1,140 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_RAFT_APPLY_QUEUE_H
+#define ORION_RAFT_APPLY_QUEUE_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+#include "proto/raft.pb.h"
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace raft {
+
+class RaftLog; // forward declaration
+
+/// outcome of applying an entry
+struct ApplyResult {
+    int32_t status;
+    // status of every operation carried by a batch entry, empty for other entries
+    std::vector<int32_t> batch_status;
+    // temp nodes removed with revoked leases or by unlock, as namespace and key
+    std::vector<std::pair<std::string, std::string> > removed;
+    // node created under a name chosen on apply, the waiter queued by a lock entry
+    std::string created;
+
+    explicit ApplyResult(int32_t apply_status = 0) : status(apply_status) { }
+};
+
+/// replicated state machine driven by committed entries
+class StateMachine {
+public:
+    /**
+     * @brief Applies consecutive committed entries in one storage write,
+     *        the applied index and term are persisted atomically with the entries
+     * @param first_index  [IN] log index of the first entry
+     * @param entries      [IN] entries to apply
+     * @param results      [OUT] result of every entry
+     * @return             OK if the whole batch has been written
+     */
+    virtual int32_t apply(int64_t first_index, const std::vector<Entry>& entries,
+            std::vector<ApplyResult>* results) = 0;
+    /// the last index persisted by apply and its term, 0 if nothing has been applied
+    virtual int64_t applied_index() const = 0;
+    virtual int64_t applied_term() const = 0;
+
+    virtual ~StateMachine() { }
+};
+
+/// callback to notify the proposer once its entry is applied
+typedef std::function<void (int32_t status)> done_func_t;
+/// same as above, but receives status of every operation of a batch entry
+typedef std::function<void (const ApplyResult& result)> result_func_t;
+/// callback to observe every applied entry, used by watchers
+typedef std::function<void (int64_t index, const Entry& entry,
+        const ApplyResult& result)> apply_listener_t;
+
+/**
+ * @brief Applies committed entries on a dedicated thread
+ *
+ * Raft threads only advance the commit index, entries are read back from log
+ * and applied in large batches, so that a slow storage blocks neither
+ * heartbeats nor replication. Proposers waiting on an index are woken up
+ * after the batch holding it is written.
+ * All methods are thread-safe.
+ */
+class ApplyQueue {
+public:
+    /// ApplyQueue neither owns nor releases the log and state machine
+    ApplyQueue(RaftLog* log, StateMachine* machine, int32_t max_batch_entries,
+            int64_t max_batch_bytes);
+    ~ApplyQueue();
+    /// disable copy and move for apply queue
+    ApplyQueue(const ApplyQueue&) = delete;
+    void operator=(const ApplyQueue&) = delete;
+
+    /// starts applying entries after applied index
+    void start(int64_t applied_index);
+    /// stops applying, all the waiters are notified with NOT_LEADER
+    void stop();
+
+    /// entries up to commit index are ready to apply
+    void commit(int64_t commit_index);
+    /**
+     * @brief Waits for an entry to be applied
+     * @param index  [IN] log index of the entry
+     * @param term   [IN] term of the entry when proposed
+     * @param done   [IN] called with the apply status, or NOT_LEADER if the entry
+     *                    has been overwritten by another leader
+     */
+    void wait(int64_t index, int64_t term, const done_func_t& done);
+    void wait(int64_t index, int64_t term, const result_func_t& done);
+    void set_listener(const apply_listener_t& listener);
+    int64_t applied_index() const;
+
+    /**
+     * @brief Runs a function while no entry is being applied,
+     *        used to take or install snapshots of the state machine
+     * @param func  [IN] receives the applied index and may replace it
+     */
+    void exclusive(const std::function<void (int64_t* applied_index)>& func);
+private:
+    struct Waiter {
+        int64_t term;
+        result_func_t done;
+    };
+    void apply_task();
+private:
+    RaftLog* _log;
+    StateMachine* _machine;
+    int32_t _max_batch_entries;
+    int64_t _max_batch_bytes;
+    // held while a batch is being applied
+    std::mutex _apply_mutex;
+
+    /// protects all the states below
+    mutable std::mutex _mutex;
+    int64_t _commit_index;
+    int64_t _applied_index;
+    // true if apply task has been scheduled
+    bool _applying;
+    bool _stop;
+    // failures in a row to read committed entries, used by apply task only
+    int32_t _read_failures;
+    std::multimap<int64_t, Waiter> _waiters;
+    apply_listener_t _listener;
+    // single thread dedicated to applying
+    common::ThreadPool _pool;
+};
+
+} // namespace raft
+} // namespace orion
+
+#endif // ORION_RAFT_APPLY_QUEUE_H
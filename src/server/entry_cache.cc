@@ -0,0 +1,95 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "entry_cache.h"
+
+namespace orion {
+namespace raft {
+
+void EntryCache::put(int64_t first_index, int64_t count, const std::string& payload) {
+    if (_capacity <= 0 || count <= 0) {
+        return;
+    }
+    // a record rewritten by truncation replaces the old one
+    truncate_suffix(first_index - 1);
+    Record& record = _records[first_index];
+    record.count = count;
+    record.payload = std::make_shared<const std::string>(payload);
+    _bytes += payload.size();
+    evict();
+}
+
+EntryCache::record_t EntryCache::get(int64_t index, int64_t* first_index, int64_t* count) const {
+    auto it = _records.upper_bound(index);
+    if (it == _records.begin()) {
+        return record_t();
+    }
+    --it;
+    if (index >= it->first + it->second.count) {
+        return record_t();
+    }
+    *first_index = it->first;
+    *count = it->second.count;
+    return it->second.payload;
+}
+
+void EntryCache::truncate_suffix(int64_t index) {
+    auto it = _records.upper_bound(index);
+    // the record holding index is dropped as well if it has later entries
+    if (it != _records.begin()) {
+        auto prev = it;
+        --prev;
+        if (prev->first + prev->second.count - 1 > index) {
+            it = prev;
+        }
+    }
+    while (it != _records.end()) {
+        _bytes -= it->second.payload->size();
+        it = _records.erase(it);
+    }
+}
+
+void EntryCache::truncate_prefix(int64_t index) {
+    auto it = _records.begin();
+    while (it != _records.end() && it->first + it->second.count - 1 <= index) {
+        _bytes -= it->second.payload->size();
+        it = _records.erase(it);
+    }
+}
+
+void EntryCache::clear() {
+    _records.clear();
+    _bytes = 0;
+}
+
+void EntryCache::count_lookup(bool hit) const {
+    if (hit) {
+        ++_hits;
+    } else {
+        ++_misses;
+    }
+}
+
+EntryCacheStats EntryCache::stats() const {
+    EntryCacheStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.bytes = _bytes;
+    stats.records = _records.size();
+    return stats;
+}
+
+void EntryCache::evict() {
+    // followers lag behind by a few records at most, the oldest go first
+    while (_bytes > _capacity && !_records.empty()) {
+        auto it = _records.begin();
+        _bytes -= it->second.payload->size();
+        _records.erase(it);
+    }
+}
+
+} // namespace raft
+} // namespace orion
@@ -0,0 +1,85 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_RAFT_ENTRY_CACHE_H
+#define ORION_RAFT_ENTRY_CACHE_H
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <memory>
+
+namespace orion {
+namespace raft {
+
+struct EntryCacheStats {
+    // lookups served from memory and from disk
+    int64_t hits;
+    int64_t misses;
+    int64_t bytes;
+    int64_t records;
+
+    EntryCacheStats() : hits(0), misses(0), bytes(0), records(0) { }
+    double hit_rate() const {
+        return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0;
+    }
+};
+
+/**
+ * @brief Keeps recently appended log records in their encoded form
+ *
+ * A record is a batch of consecutive entries encoded by encode_entries,
+ * records are cached in index order and the oldest are evicted once
+ * the cache exceeds its capacity. Not thread-safe, guarded by RaftLog.
+ */
+class EntryCache {
+public:
+    typedef std::shared_ptr<const std::string> record_t;
+
+    explicit EntryCache(int64_t capacity) :
+            _capacity(capacity), _bytes(0), _hits(0), _misses(0) { }
+    ~EntryCache() { }
+    /// disable copy and move for entry cache
+    EntryCache(const EntryCache&) = delete;
+    void operator=(const EntryCache&) = delete;
+
+    /// caches a record holding count entries starting from first_index
+    void put(int64_t first_index, int64_t count, const std::string& payload);
+    /**
+     * @brief Finds the record holding the entry at index
+     * @param index        [IN] index of the entry
+     * @param first_index  [OUT] index of the first entry of the record
+     * @param count        [OUT] number of entries in the record
+     * @return             nullptr if the record is not cached
+     */
+    record_t get(int64_t index, int64_t* first_index, int64_t* count) const;
+    /// drops records holding any entry after index
+    void truncate_suffix(int64_t index);
+    /// drops records whose entries are all no greater than index
+    void truncate_prefix(int64_t index);
+    void clear();
+
+    /// lookup statistics are counted by user, since only user knows a miss reads disk
+    void count_lookup(bool hit) const;
+    EntryCacheStats stats() const;
+private:
+    struct Record {
+        int64_t count;
+        record_t payload;
+    };
+    void evict();
+private:
+    int64_t _capacity;
+    int64_t _bytes;
+    // records by the index of their first entries
+    std::map<int64_t, Record> _records;
+    mutable int64_t _hits;
+    mutable int64_t _misses;
+};
+
+} // namespace raft
+} // namespace orion
+
+#endif // ORION_RAFT_ENTRY_CACHE_H
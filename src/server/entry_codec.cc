@@ -0,0 +1,144 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "entry_codec.h"
+
+#include <snappy.h>
+#include "common/coding.h"
+
+namespace orion {
+namespace raft {
+
+void encode_entries(int64_t first_index, const std::vector<Entry>& entries,
+        int32_t compression, size_t min_compress_size, std::string* out) {
+    std::string body;
+    common::put_varint64(&body, first_index);
+    common::put_varint64(&body, entries.size());
+    int64_t prev_term = entries.empty() ? 0 : entries.front().term();
+    common::put_varint64(&body, prev_term);
+    for (const auto& entry : entries) {
+        // terms rarely change in a batch, the delta is mostly a single zero byte
+        common::put_varint64(&body, common::zigzag_encode(entry.term() - prev_term));
+        prev_term = entry.term();
+        common::put_varint64(&body, entry.op());
+        common::put_varint64(&body, entry.session_id());
+        common::put_length_prefixed(&body, entry.ns());
+        common::put_length_prefixed(&body, entry.key());
+        common::put_length_prefixed(&body, entry.value());
+    }
+    out->clear();
+    if (compression == COMPRESSION_SNAPPY && body.size() >= min_compress_size) {
+        std::string compressed;
+        snappy::Compress(body.data(), body.size(), &compressed);
+        // incompressible data is kept as it is
+        if (compressed.size() < body.size()) {
+            out->push_back(static_cast<char>(COMPRESSION_SNAPPY));
+            out->append(compressed);
+            return;
+        }
+    }
+    out->push_back(static_cast<char>(COMPRESSION_NONE));
+    out->append(body);
+}
+
+/// uncompresses the body of a batch if needed, body is in [*p, *limit) then
+static bool get_body(const char* data, size_t len, std::string* buffer,
+        const char** p, const char** limit) {
+    if (len == 0) {
+        return false;
+    }
+    *p = data + 1;
+    *limit = data + len;
+    switch (static_cast<uint8_t>(data[0])) {
+    case COMPRESSION_NONE:
+        return true;
+    case COMPRESSION_SNAPPY:
+        if (!snappy::Uncompress(*p, *limit - *p, buffer)) {
+            return false;
+        }
+        *p = buffer->data();
+        *limit = *p + buffer->size();
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool decode_entries(const char* data, size_t len, int64_t* first_index,
+        std::vector<Entry>* entries) {
+    std::string uncompressed;
+    const char* p = nullptr;
+    const char* limit = nullptr;
+    uint64_t index = 0;
+    uint64_t count = 0;
+    uint64_t term = 0;
+    if (!get_body(data, len, &uncompressed, &p, &limit)
+            || !common::get_varint64(&p, limit, &index)
+            || !common::get_varint64(&p, limit, &count)
+            || !common::get_varint64(&p, limit, &term)) {
+        return false;
+    }
+    *first_index = static_cast<int64_t>(index);
+    int64_t prev_term = static_cast<int64_t>(term);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t delta = 0;
+        uint64_t op = 0;
+        uint64_t session_id = 0;
+        entries->push_back(Entry());
+        Entry& entry = entries->back();
+        if (!common::get_varint64(&p, limit, &delta)
+                || !common::get_varint64(&p, limit, &op)
+                || !common::get_varint64(&p, limit, &session_id)
+                || !common::get_length_prefixed(&p, limit, entry.mutable_ns())
+                || !common::get_length_prefixed(&p, limit, entry.mutable_key())
+                || !common::get_length_prefixed(&p, limit, entry.mutable_value())) {
+            return false;
+        }
+        prev_term += common::zigzag_decode(delta);
+        entry.set_term(prev_term);
+        entry.set_op(static_cast<int32_t>(op));
+        if (session_id != 0) {
+            entry.set_session_id(static_cast<int64_t>(session_id));
+        }
+    }
+    return p == limit;
+}
+
+bool decode_terms(const char* data, size_t len, int64_t* first_index,
+        std::vector<int64_t>* terms) {
+    std::string uncompressed;
+    const char* p = nullptr;
+    const char* limit = nullptr;
+    uint64_t index = 0;
+    uint64_t count = 0;
+    uint64_t term = 0;
+    if (!get_body(data, len, &uncompressed, &p, &limit)
+            || !common::get_varint64(&p, limit, &index)
+            || !common::get_varint64(&p, limit, &count)
+            || !common::get_varint64(&p, limit, &term)) {
+        return false;
+    }
+    *first_index = static_cast<int64_t>(index);
+    int64_t prev_term = static_cast<int64_t>(term);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t delta = 0;
+        uint64_t skipped = 0;
+        if (!common::get_varint64(&p, limit, &delta)
+                || !common::get_varint64(&p, limit, &skipped)
+                || !common::get_varint64(&p, limit, &skipped)
+                || !common::get_length_prefixed(&p, limit, nullptr)
+                || !common::get_length_prefixed(&p, limit, nullptr)
+                || !common::get_length_prefixed(&p, limit, nullptr)) {
+            return false;
+        }
+        prev_term += common::zigzag_decode(delta);
+        terms->push_back(prev_term);
+    }
+    return p == limit;
+}
+
+} // namespace raft
+} // namespace orion
@@ -0,0 +1,65 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_RAFT_ENTRY_CODEC_H
+#define ORION_RAFT_ENTRY_CODEC_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "proto/raft.pb.h"
+
+namespace orion {
+namespace raft {
+
+/// compression of an encoded entry batch
+enum EntryCompression {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_SNAPPY = 1,
+};
+
+/**
+ * Consecutive entries are encoded as a batch, used by both log segments
+ * and append requests:
+ *   byte compression | body
+ * and body, compressed as a whole if required, is:
+ *   varint first index | varint count | varint first term | entry...
+ * every entry is:
+ *   varint zigzag(term - previous term) | varint op | varint session id |
+ *   length prefixed ns | length prefixed key | length prefixed value
+ * Index of an entry is implied by its position. User credentials are never encoded,
+ * session id carries the lease id supplied by the client, as is.
+ */
+
+/**
+ * @brief Encodes a batch of entries
+ * @param first_index        [IN] log index of the first entry
+ * @param entries            [IN] entries to encode
+ * @param compression        [IN] compression used if the batch is large enough
+ * @param min_compress_size  [IN] smaller batches are kept uncompressed
+ * @param out                [OUT] encoded batch
+ */
+void encode_entries(int64_t first_index, const std::vector<Entry>& entries,
+        int32_t compression, size_t min_compress_size, std::string* out);
+
+/**
+ * @brief Decodes a batch of entries
+ * @param data         [IN] encoded batch
+ * @param len          [IN] length of the batch
+ * @param first_index  [OUT] log index of the first entry
+ * @param entries      [OUT] decoded entries are appended
+ * @return             false if the batch is corrupted
+ */
+bool decode_entries(const char* data, size_t len, int64_t* first_index,
+        std::vector<Entry>* entries);
+/// decodes only terms of a batch, much cheaper than decoding entries
+bool decode_terms(const char* data, size_t len, int64_t* first_index,
+        std::vector<int64_t>* terms);
+
+} // namespace raft
+} // namespace orion
+
+#endif // ORION_RAFT_ENTRY_CODEC_H
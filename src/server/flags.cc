@@ -0,0 +1,26 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include <gflags/gflags.h>
+
+// server
+DEFINE_string(server_addr, "127.0.0.1:8866", "address of current node, used as node id");
+DEFINE_string(members, "127.0.0.1:8866", "comma separated addresses of all the nodes");
+DEFINE_string(data_dir, "./data", "directory of log, snapshot and storage");
+DEFINE_int32(server_thread_num, 8, "worker threads of rpc server");
+
+// raft
+DEFINE_int32(raft_group_num, 1, "number of raft groups, namespaces are spread over groups");
+DEFINE_int32(raft_thread_num, 10, "threads shared by all the raft groups");
+DEFINE_int32(raft_election_timeout, 1000, "election timeout in milliseconds");
+DEFINE_int32(raft_heartbeat_interval, 100, "heartbeat interval in milliseconds");
+DEFINE_int64(raft_snapshot_interval, 60000, "interval to check snapshot in milliseconds");
+DEFINE_int64(raft_snapshot_min_entries, 100000, "min entries applied between snapshots");
+DEFINE_int64(raft_log_cache_size, 64, "memory of recent log entries cached per group in MB");
+
+// storage
+DEFINE_int64(store_block_cache_size, 8, "block cache of storage per group in MB");
+DEFINE_int32(hot_key_num, 10000, "keys read into block cache per group after restart");
@@ -0,0 +1,103 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "heartbeat_batcher.h"
+
+#include <memory>
+#include "common/rpc_client.h"
+
+namespace orion {
+namespace raft {
+
+using std::placeholders::_1;
+using std::placeholders::_2;
+using std::placeholders::_3;
+using std::placeholders::_4;
+
+HeartbeatBatcher::HeartbeatBatcher(rpc::RpcClient* rpc, int32_t rpc_timeout) :
+        _rpc(rpc), _rpc_timeout(rpc_timeout) { }
+
+HeartbeatBatcher::~HeartbeatBatcher() {
+    // nodes may have gone, heartbeats never sent are dropped silently
+    for (auto& pendings : _pendings) {
+        for (auto& pending : pendings.second) {
+            delete pending.request;
+            delete pending.response;
+        }
+    }
+    for (auto& stub : _stubs) {
+        delete stub.second;
+    }
+}
+
+void HeartbeatBatcher::add(const std::string& addr, const AppendEntriesRequest* request,
+        AppendEntriesResponse* response, const append_callback_t& callback) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _pendings[addr].push_back(Pending{ request, response, callback });
+}
+
+void HeartbeatBatcher::flush() {
+    std::map<std::string, std::vector<Pending> > pendings;
+    std::map<std::string, Raft_Stub*> stubs;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        pendings.swap(_pendings);
+        for (const auto& batch : pendings) {
+            Raft_Stub*& stub = _stubs[batch.first];
+            if (stub == nullptr) {
+                _rpc->get_stub(batch.first, &stub);
+            }
+            stubs[batch.first] = stub;
+        }
+    }
+    // callbacks take locks of raft nodes, so requests are sent without lock
+    for (auto& batch : pendings) {
+        BatchHeartbeatRequest* request = new BatchHeartbeatRequest();
+        BatchHeartbeatResponse* response = new BatchHeartbeatResponse();
+        for (const auto& pending : batch.second) {
+            request->add_requests()->CopyFrom(*pending.request);
+        }
+        std::vector<Pending>* batch_pendings = new std::vector<Pending>();
+        batch_pendings->swap(batch.second);
+        std::function<void (const BatchHeartbeatRequest*, BatchHeartbeatResponse*, bool, int)>
+            callback = std::bind(&HeartbeatBatcher::on_heartbeat, this,
+                    batch_pendings, _1, _2, _3, _4);
+        _rpc->async_request(stubs[batch.first], &Raft_Stub::heartbeat, request, response,
+                callback, _rpc_timeout, 1);
+    }
+}
+
+void HeartbeatBatcher::cancel() {
+    std::map<std::string, std::vector<Pending> > pendings;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        pendings.swap(_pendings);
+    }
+    for (auto& batch : pendings) {
+        for (auto& pending : batch.second) {
+            pending.callback(pending.request, pending.response, true, 0);
+        }
+    }
+}
+
+void HeartbeatBatcher::on_heartbeat(std::vector<Pending>* pendings,
+        const BatchHeartbeatRequest* request, BatchHeartbeatResponse* response,
+        bool failed, int error) {
+    std::unique_ptr<std::vector<Pending> > pendings_guard(pendings);
+    std::unique_ptr<const BatchHeartbeatRequest> request_guard(request);
+    std::unique_ptr<BatchHeartbeatResponse> response_guard(response);
+    for (size_t i = 0; i < pendings->size(); ++i) {
+        Pending& pending = (*pendings)[i];
+        bool missing = failed || static_cast<int>(i) >= response->responses_size();
+        if (!missing) {
+            pending.response->Swap(response->mutable_responses(i));
+        }
+        pending.callback(pending.request, pending.response, missing, error);
+    }
+}
+
+} // namespace raft
+} // namespace orion
@@ -0,0 +1,75 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_RAFT_HEARTBEAT_BATCHER_H
+#define ORION_RAFT_HEARTBEAT_BATCHER_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+#include "proto/raft.pb.h"
+
+namespace orion {
+
+namespace rpc {
+
+class RpcClient; // forward declaration
+
+} // namespace rpc
+
+namespace raft {
+
+/// callback of an append request, same as the one used by RpcClient
+typedef std::function<void (const AppendEntriesRequest*, AppendEntriesResponse*, bool, int)>
+        append_callback_t;
+
+/**
+ * @brief Merges empty append requests of all the raft groups into
+ *        one rpc per destination node
+ *
+ * Requests are queued by add and sent by flush, callbacks are invoked
+ * with the original request and response as if they were sent alone.
+ * All methods are thread-safe.
+ */
+class HeartbeatBatcher {
+public:
+    /// HeartbeatBatcher does not own the rpc client
+    HeartbeatBatcher(rpc::RpcClient* rpc, int32_t rpc_timeout);
+    ~HeartbeatBatcher();
+    /// disable copy and move for heartbeat batcher
+    HeartbeatBatcher(const HeartbeatBatcher&) = delete;
+    void operator=(const HeartbeatBatcher&) = delete;
+
+    /// queues a heartbeat, ownership of request and response is passed to callback,
+    /// or released by batcher if it is never sent
+    void add(const std::string& addr, const AppendEntriesRequest* request,
+            AppendEntriesResponse* response, const append_callback_t& callback);
+    /// sends all the queued heartbeats
+    void flush();
+    /// fails all the queued heartbeats, their callbacks run as if the rpc failed
+    void cancel();
+private:
+    struct Pending {
+        const AppendEntriesRequest* request;
+        AppendEntriesResponse* response;
+        append_callback_t callback;
+    };
+    void on_heartbeat(std::vector<Pending>* pendings, const BatchHeartbeatRequest* request,
+            BatchHeartbeatResponse* response, bool failed, int error);
+private:
+    rpc::RpcClient* _rpc;
+    int32_t _rpc_timeout;
+    std::mutex _mutex;
+    std::map<std::string, std::vector<Pending> > _pendings;
+    std::map<std::string, Raft_Stub*> _stubs;
+};
+
+} // namespace raft
+} // namespace orion
+
+#endif // ORION_RAFT_HEARTBEAT_BATCHER_H
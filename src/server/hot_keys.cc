@@ -0,0 +1,107 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "hot_keys.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include "proto/serialize.pb.h"
+#include "common/record_io.h"
+#include "common/file_util.h"
+
+namespace orion {
+namespace server {
+
+HotKeyRecorder::HotKeyRecorder(size_t capacity, int32_t sample_rate) :
+        _capacity(capacity), _sample_rate(std::max(sample_rate, 1)), _reads(0) { }
+
+void HotKeyRecorder::record(const std::string& ns, const std::string& key) {
+    if (_capacity == 0 || _reads.fetch_add(1) % _sample_rate != 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    ++_counts[std::make_pair(ns, key)];
+    if (_counts.size() <= _capacity * 2) {
+        return;
+    }
+    // keys read only once since last decay are forgotten
+    for (auto it = _counts.begin(); it != _counts.end();) {
+        it->second /= 2;
+        if (it->second == 0) {
+            it = _counts.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<HotKeyRecorder::key_t> HotKeyRecorder::top() const {
+    std::vector<std::pair<int64_t, key_t> > sorted;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        sorted.reserve(_counts.size());
+        for (const auto& count : _counts) {
+            sorted.push_back(std::make_pair(count.second, count.first));
+        }
+    }
+    size_t num = std::min(_capacity, sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + num, sorted.end(),
+            [](const std::pair<int64_t, key_t>& a, const std::pair<int64_t, key_t>& b) {
+                return a.first > b.first;
+            });
+    std::vector<key_t> keys;
+    keys.reserve(num);
+    for (size_t i = 0; i < num; ++i) {
+        keys.push_back(sorted[i].second);
+    }
+    return keys;
+}
+
+bool HotKeyRecorder::save(const std::string& path) const {
+    const std::vector<key_t>& keys = top();
+    if (keys.empty()) {
+        return true;
+    }
+    serialize::HotKeyList list;
+    for (const auto& key : keys) {
+        serialize::HotKey* hot_key = list.add_keys();
+        hot_key->set_ns(key.first);
+        hot_key->set_key(key.second);
+    }
+    std::string payload;
+    std::string content;
+    if (!list.SerializeToString(&payload)) {
+        return false;
+    }
+    common::append_record(payload, &content);
+    return common::replace_file(path, content);
+}
+
+bool HotKeyRecorder::load(const std::string& path, std::vector<key_t>* keys) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::string buffer;
+    std::string payload;
+    serialize::HotKeyList list;
+    bool ok = common::read_file(fd, &buffer)
+        && common::parse_record(buffer.data(), buffer.size(), &payload) != 0
+        && list.ParseFromString(payload);
+    close(fd);
+    if (!ok) {
+        return false;
+    }
+    keys->clear();
+    for (const auto& hot_key : list.keys()) {
+        keys->push_back(std::make_pair(hot_key.ns(), hot_key.key()));
+    }
+    return true;
+}
+
+} // namespace server
+} // namespace orion
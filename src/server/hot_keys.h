@@ -0,0 +1,59 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_HOT_KEYS_H
+#define ORION_SERVER_HOT_KEYS_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <utility>
+
+namespace orion {
+namespace server {
+
+/**
+ * @brief Samples reads to find the keys read most often
+ *
+ * Hot keys are saved before shutdown and read again after restart,
+ * so that they are loaded into block cache before clients ask for them.
+ * Counts are halved once too many keys are tracked, old hot keys fade out.
+ * Thread-safe.
+ */
+class HotKeyRecorder {
+public:
+    /// ns and key of a hot key
+    typedef std::pair<std::string, std::string> key_t;
+
+    /// keeps at most capacity hot keys, and counts one of every sample_rate reads
+    HotKeyRecorder(size_t capacity, int32_t sample_rate);
+    ~HotKeyRecorder() { }
+    /// disable copy and move for hot key recorder
+    HotKeyRecorder(const HotKeyRecorder&) = delete;
+    void operator=(const HotKeyRecorder&) = delete;
+
+    void record(const std::string& ns, const std::string& key);
+    /// returns the hottest keys, the hottest first
+    std::vector<key_t> top() const;
+    /// replaces the file under path with current hot keys, the file is
+    /// kept if no read is recorded, e.g. a node restarted just now
+    bool save(const std::string& path) const;
+    /// returns false if the file is missing or corrupted
+    static bool load(const std::string& path, std::vector<key_t>* keys);
+private:
+    size_t _capacity;
+    int32_t _sample_rate;
+    std::atomic<int64_t> _reads;
+    mutable std::mutex _mutex;
+    std::map<key_t, int64_t> _counts;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_HOT_KEYS_H
@@ -0,0 +1,234 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "lease_table.h"
+
+#include <stdlib.h>
+#include <chrono>
+#include <algorithm>
+#include "proto/serialize.pb.h"
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace server {
+
+LeaseTable::LeaseTable(int32_t group_num, const term_func_t& term, const load_func_t& load,
+        const revoke_func_t& revoke, const LeaseOptions& options) : _options(options),
+        _term(term), _load(load), _revoke(revoke), _groups(group_num),
+        _random(std::chrono::system_clock::now().time_since_epoch().count()), _stop(false),
+        _keepalives(0), _renewals(0), _expired(0), _pool(1, "lease"),
+        _wheel(&_pool, 10, 16, _options.clock) {
+    _wheel.add(_options.check_interval, std::bind(&LeaseTable::check, this));
+}
+
+LeaseTable::~LeaseTable() {
+    stop();
+}
+
+void LeaseTable::on_apply(int32_t group_id, int64_t /*index*/, const raft::Entry& entry,
+        const raft::ApplyResult& result) {
+    if (group_id < 0 || group_id >= static_cast<int32_t>(_groups.size())) {
+        return;
+    }
+    if (entry.op() == raft_op::GRANT_LEASE && result.status == status_code::OK) {
+        std::lock_guard<std::mutex> locker(_mutex);
+        Group& group = _groups[group_id];
+        // followers keep no deadlines, a new leader loads the lease from storage
+        if (_stop || group.term == 0 || group.leases.count(entry.session_id()) > 0) {
+            return;
+        }
+        Lease& lease = group.leases[entry.session_id()];
+        lease.ttl = atol(entry.value().c_str());
+        lease.timer = _wheel.add(lease.ttl,
+                std::bind(&LeaseTable::expire, this, group_id, entry.session_id()));
+    } else if (entry.op() == raft_op::REVOKE_LEASES) {
+        serialize::LeaseList leases;
+        if (!leases.ParseFromString(entry.value())) {
+            return;
+        }
+        std::lock_guard<std::mutex> locker(_mutex);
+        Group& group = _groups[group_id];
+        for (int64_t lease_id : leases.ids()) {
+            auto it = group.leases.find(lease_id);
+            if (it == group.leases.end()) {
+                continue;
+            }
+            if (it->second.timer != 0) {
+                _wheel.cancel(it->second.timer);
+            }
+            group.leases.erase(it);
+        }
+    }
+}
+
+int32_t LeaseTable::keep_alive(int32_t group_id, int64_t term,
+        const std::vector<int64_t>& leases, std::vector<int64_t>* expired) {
+    if (term == 0 || group_id < 0 || group_id >= static_cast<int32_t>(_groups.size())) {
+        return status_code::NOT_LEADER;
+    }
+    // a new leader serves keepalives before the next check
+    lead(group_id, term);
+    std::lock_guard<std::mutex> locker(_mutex);
+    Group& group = _groups[group_id];
+    if (_stop || group.term != term) {
+        return status_code::NOT_LEADER;
+    }
+    ++_keepalives;
+    for (int64_t lease_id : leases) {
+        auto it = group.leases.find(lease_id);
+        // a timer failing to renew is expiring on its way
+        if (it == group.leases.end() || it->second.timer == 0
+                || !_wheel.renew(it->second.timer, it->second.ttl)) {
+            expired->push_back(lease_id);
+            continue;
+        }
+        ++_renewals;
+    }
+    return status_code::OK;
+}
+
+int64_t LeaseTable::new_id() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    int64_t lease_id = 0;
+    do {
+        lease_id = static_cast<int64_t>(_random() >> 1);
+    } while (lease_id == 0);
+    return lease_id;
+}
+
+int64_t LeaseTable::ttl(int64_t ttl) const {
+    return std::min(std::max(ttl, _options.min_ttl), _options.max_ttl);
+}
+
+void LeaseTable::stop() {
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _stop = true;
+        for (auto& group : _groups) {
+            clear(&group);
+        }
+    }
+    _wheel.stop();
+    _pool.stop(false);
+}
+
+LeaseStats LeaseTable::stats() const {
+    LeaseStats stats;
+    std::lock_guard<std::mutex> locker(_mutex);
+    for (const auto& group : _groups) {
+        stats.leases += group.leases.size();
+    }
+    stats.keepalives = _keepalives;
+    stats.renewals = _renewals;
+    stats.expired = _expired;
+    return stats;
+}
+
+void LeaseTable::lead(int32_t group_id, int64_t term) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    Group& group = _groups[group_id];
+    if (_stop || group.term == term) {
+        return;
+    }
+    clear(&group);
+    group.term = term;
+    if (term == 0) {
+        return;
+    }
+    // loaded with mutex locked, a lease applied meanwhile is either in storage
+    // or added by apply listener afterwards
+    std::map<int64_t, int64_t> leases;
+    _load(group_id, &leases);
+    for (const auto& item : leases) {
+        Lease& lease = group.leases[item.first];
+        lease.ttl = item.second;
+        lease.timer = _wheel.add(lease.ttl,
+                std::bind(&LeaseTable::expire, this, group_id, item.first));
+    }
+    LOG(INFO, "[lease]: lead %lu leases of group %d in term %ld",
+            leases.size(), group_id, term);
+}
+
+void LeaseTable::check() {
+    for (int32_t i = 0; i < static_cast<int32_t>(_groups.size()); ++i) {
+        lead(i, _term(i));
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (!_stop) {
+        _wheel.add(_options.check_interval, std::bind(&LeaseTable::check, this));
+    }
+}
+
+void LeaseTable::expire(int32_t group_id, int64_t lease_id) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    Group& group = _groups[group_id];
+    auto it = group.leases.find(lease_id);
+    if (_stop || it == group.leases.end() || it->second.timer == 0) {
+        return;
+    }
+    it->second.timer = 0;
+    group.expired.push_back(lease_id);
+    ++_expired;
+    // queued after the other timers of the tick, which are revoked together
+    if (!group.revoking) {
+        group.revoking = true;
+        _pool.add_task(std::bind(&LeaseTable::revoke, this, group_id));
+    }
+}
+
+void LeaseTable::revoke(int32_t group_id) {
+    while (true) {
+        std::vector<int64_t> leases;
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            Group& group = _groups[group_id];
+            if (_stop || group.term == 0 || group.expired.empty()) {
+                group.expired.clear();
+                group.revoking = false;
+                return;
+            }
+            size_t size = std::min(group.expired.size(),
+                    static_cast<size_t>(_options.max_revoke_batch));
+            leases.assign(group.expired.begin(), group.expired.begin() + size);
+            group.expired.erase(group.expired.begin(), group.expired.begin() + size);
+        }
+        int32_t status = _revoke(group_id, leases);
+        if (status == status_code::OK) {
+            continue;
+        }
+        LOG(WARNING, "[lease]: revoke %lu leases of group %d failed: %d",
+                leases.size(), group_id, status);
+        std::lock_guard<std::mutex> locker(_mutex);
+        Group& group = _groups[group_id];
+        if (_stop || group.term == 0) {
+            group.expired.clear();
+            group.revoking = false;
+            return;
+        }
+        // tried again later, unless the leases are gone meanwhile
+        for (int64_t lease_id : leases) {
+            if (group.leases.count(lease_id) > 0) {
+                group.expired.push_back(lease_id);
+            }
+        }
+        _wheel.add(_options.check_interval, std::bind(&LeaseTable::revoke, this, group_id));
+        return;
+    }
+}
+
+void LeaseTable::clear(Group* group) {
+    for (const auto& item : group->leases) {
+        if (item.second.timer != 0) {
+            _wheel.cancel(item.second.timer);
+        }
+    }
+    group->leases.clear();
+    group->expired.clear();
+}
+
+} // namespace server
+} // namespace orion
@@ -0,0 +1,144 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_LEASE_TABLE_H
+#define ORION_SERVER_LEASE_TABLE_H
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <random>
+#include <functional>
+#include "server/apply_queue.h"
+#include "common/thread_pool.h"
+#include "common/timing_wheel.h"
+
+namespace orion {
+namespace server {
+
+struct LeaseOptions {
+    // ttl granted is kept in this range, in milliseconds
+    int64_t min_ttl;
+    int64_t max_ttl;
+    // interval to check leadership of groups, in milliseconds
+    int64_t check_interval;
+    // most leases revoked by a single entry
+    int32_t max_revoke_batch;
+    // clock of deadlines, steady clock if empty
+    common::TimingWheel::clock_func_t clock;
+
+    LeaseOptions() : min_ttl(1000), max_ttl(3600 * 1000), check_interval(200),
+            max_revoke_batch(10000) { }
+};
+
+struct LeaseStats {
+    int64_t leases;
+    int64_t keepalives;
+    // leases renewed by the keepalives
+    int64_t renewals;
+    int64_t expired;
+
+    LeaseStats() : leases(0), keepalives(0), renewals(0), expired(0) { }
+};
+
+/**
+ * @brief Expires the leases of the groups led by current node
+ *
+ * Leases are granted and revoked by raft entries, so every node has them
+ * in storage, but only the leader keeps their deadlines, in a timing wheel.
+ * A keepalive renews all the leases of a client at once, and renewals are
+ * never replicated. A new leader loads the leases from storage once it has
+ * applied the entries of former terms, and gives all of them a full ttl,
+ * as clients may have lost keepalives during failover. Leases expiring in
+ * the same tick are revoked together by one entry, which removes all the
+ * temp nodes attached to them. Thread-safe.
+ */
+class LeaseTable {
+public:
+    /// returns term of current node if it leads group and has applied an entry of
+    /// the term, 0 if not
+    typedef std::function<int64_t (int32_t group_id)> term_func_t;
+    /// reads the leases of group from storage, as id and ttl
+    typedef std::function<void (int32_t group_id, std::map<int64_t, int64_t>* leases)> load_func_t;
+    /// proposes to revoke leases of group, returns status of proposing
+    typedef std::function<int32_t (int32_t group_id, const std::vector<int64_t>& leases)>
+        revoke_func_t;
+
+    LeaseTable(int32_t group_num, const term_func_t& term, const load_func_t& load,
+            const revoke_func_t& revoke, const LeaseOptions& options = LeaseOptions());
+    ~LeaseTable();
+    /// disable copy and move for lease table
+    LeaseTable(const LeaseTable&) = delete;
+    void operator=(const LeaseTable&) = delete;
+
+    /// applied entries of a group, called by apply listener in order of index
+    void on_apply(int32_t group_id, int64_t index, const raft::Entry& entry,
+            const raft::ApplyResult& result);
+    /**
+     * @brief Renews leases of a client
+     * @param group_id  [IN] group of the leases
+     * @param term      [IN] term of current node, as returned by term function
+     * @param leases    [IN] leases to renew
+     * @param expired   [OUT] leases which are gone or about to be revoked
+     * @return          NOT_LEADER if term is 0
+     */
+    int32_t keep_alive(int32_t group_id, int64_t term, const std::vector<int64_t>& leases,
+            std::vector<int64_t>* expired);
+    /// returns a random id of a new lease
+    int64_t new_id();
+    /// ttl kept in the range of options
+    int64_t ttl(int64_t ttl) const;
+    /// stops expiring leases, revocations in flight are dropped
+    void stop();
+    LeaseStats stats() const;
+private:
+    struct Lease {
+        int64_t ttl;
+        // expiry timer in wheel, 0 once the lease has expired
+        int64_t timer;
+    };
+    struct Group {
+        // term led by current node, 0 if not leading
+        int64_t term;
+        std::map<int64_t, Lease> leases;
+        // leases waiting to be revoked
+        std::vector<int64_t> expired;
+        bool revoking;
+
+        Group() : term(0), revoking(false) { }
+    };
+
+    /// takes or gives up leadership of group, called with term of current node
+    void lead(int32_t group_id, int64_t term);
+    /// checks leadership of all the groups
+    void check();
+    void expire(int32_t group_id, int64_t lease_id);
+    /// revokes expired leases of group in batches
+    void revoke(int32_t group_id);
+    /// forgets all the leases of group, called with mutex locked
+    void clear(Group* group);
+private:
+    LeaseOptions _options;
+    term_func_t _term;
+    load_func_t _load;
+    revoke_func_t _revoke;
+    mutable std::mutex _mutex;
+    std::vector<Group> _groups;
+    std::mt19937_64 _random;
+    bool _stop;
+    int64_t _keepalives;
+    int64_t _renewals;
+    int64_t _expired;
+    // revokes expired leases of _groups and runs the periodic checks
+    common::ThreadPool _pool;
+    // expiry timers, run by _pool
+    common::TimingWheel _wheel;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_LEASE_TABLE_H
@@ -0,0 +1,192 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "lock_manager.h"
+
+#include <set>
+#include <algorithm>
+#include "proto/serialize.pb.h"
+#include "common/const.h"
+
+namespace orion {
+namespace server {
+
+LockManager::LockManager(const holder_func_t& holder, const LockOptions& options) :
+        _holder(holder), _options(options), _stop(false), _next_seq(0), _waiting(0),
+        _wakeups(0), _timeouts(0), _pool(1, "lock"), _wheel(&_pool) {
+}
+
+LockManager::~LockManager() {
+    stop();
+}
+
+void LockManager::on_apply(int32_t group_id, int64_t /*index*/, const raft::Entry& entry,
+        const raft::ApplyResult& result) {
+    replies_t replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        // nothing to wake on followers, nor on a leader without parked requests
+        if (_stop || _locks.empty()) {
+            return;
+        }
+        std::vector<std::pair<std::string, std::string> > removed(result.removed);
+        if (entry.op() == raft_op::REMOVE && result.status == status_code::OK) {
+            removed.push_back(std::make_pair(entry.ns(), entry.key()));
+        } else if (entry.op() == raft_op::BATCH) {
+            serialize::BatchOps ops;
+            if (ops.ParseFromString(entry.value())) {
+                for (int i = 0; i < ops.ops_size()
+                        && i < static_cast<int>(result.batch_status.size()); ++i) {
+                    if (ops.ops(i).op() == raft_op::REMOVE
+                            && result.batch_status[i] == status_code::OK) {
+                        removed.push_back(std::make_pair(entry.ns(), ops.ops(i).key()));
+                    }
+                }
+            }
+        }
+        std::set<lock_t> touched;
+        for (const auto& node : removed) {
+            size_t sep = node.second.rfind('/');
+            if (sep == std::string::npos) {
+                continue;
+            }
+            lock_t lock(group_id, node.first, node.second.substr(0, sep));
+            auto it = _locks.find(lock);
+            if (it == _locks.end()) {
+                continue;
+            }
+            touched.insert(lock);
+            // a parked waiter which is gone stops waiting
+            auto parked = it->second.find(node.second);
+            if (parked != it->second.end()) {
+                replies.push_back(std::make_pair(parked->second.done,
+                            entry.op() == raft_op::REVOKE_LEASES ?
+                            status_code::LEASE_EXPIRED : status_code::NOT_FOUND));
+                _wheel.cancel(parked->second.timer);
+                it->second.erase(parked);
+                --_waiting;
+            }
+        }
+        for (const auto& lock : touched) {
+            wake(lock, &replies);
+        }
+    }
+    reply(replies);
+}
+
+void LockManager::wait(int32_t group_id, const std::string& ns, const std::string& key,
+        const std::string& waiter, int32_t wait_ms, const done_func_t& done) {
+    replies_t replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        lock_t lock(group_id, ns, key);
+        // read with mutex locked, a release applied afterwards finds the request parked
+        if (_stop) {
+            replies.push_back(std::make_pair(done, status_code::TIMEOUT));
+        } else if (_holder(group_id, ns, key) == waiter) {
+            replies.push_back(std::make_pair(done, status_code::OK));
+        } else if (wait_ms <= 0) {
+            replies.push_back(std::make_pair(done, status_code::LOCKED));
+        } else {
+            parked_t& parked = _locks[lock];
+            auto it = parked.find(waiter);
+            if (it != parked.end()) {
+                // the client has given up the former request
+                replies.push_back(std::make_pair(it->second.done, status_code::LOCKED));
+                _wheel.cancel(it->second.timer);
+                parked.erase(it);
+                --_waiting;
+            }
+            int64_t seq = ++_next_seq;
+            Parked& request = parked[waiter];
+            request.done = done;
+            request.seq = seq;
+            request.timer = _wheel.add(std::min(wait_ms, _options.max_wait_ms),
+                    std::bind(&LockManager::expire, this, lock, waiter, seq));
+            ++_waiting;
+        }
+    }
+    reply(replies);
+}
+
+void LockManager::stop() {
+    replies_t replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _stop = true;
+        for (auto& lock : _locks) {
+            for (auto& parked : lock.second) {
+                replies.push_back(std::make_pair(parked.second.done, status_code::TIMEOUT));
+            }
+        }
+        _locks.clear();
+        _waiting = 0;
+    }
+    reply(replies);
+    _wheel.stop();
+    _pool.stop(false);
+}
+
+LockStats LockManager::stats() const {
+    LockStats stats;
+    std::lock_guard<std::mutex> locker(_mutex);
+    stats.waiting = _waiting;
+    stats.wakeups = _wakeups;
+    stats.timeouts = _timeouts;
+    return stats;
+}
+
+void LockManager::wake(const lock_t& lock, replies_t* replies) {
+    auto it = _locks.find(lock);
+    if (it == _locks.end()) {
+        return;
+    }
+    // only the new holder is answered, the others keep waiting
+    auto parked = it->second.find(_holder(std::get<0>(lock), std::get<1>(lock),
+                std::get<2>(lock)));
+    if (parked != it->second.end()) {
+        replies->push_back(std::make_pair(parked->second.done, status_code::OK));
+        _wheel.cancel(parked->second.timer);
+        it->second.erase(parked);
+        --_waiting;
+        ++_wakeups;
+    }
+    if (it->second.empty()) {
+        _locks.erase(it);
+    }
+}
+
+void LockManager::expire(const lock_t& lock, const std::string& waiter, int64_t seq) {
+    replies_t replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        auto it = _locks.find(lock);
+        if (it == _locks.end()) {
+            return;
+        }
+        auto parked = it->second.find(waiter);
+        if (parked == it->second.end() || parked->second.seq != seq) {
+            return;
+        }
+        replies.push_back(std::make_pair(parked->second.done, status_code::LOCKED));
+        it->second.erase(parked);
+        --_waiting;
+        ++_timeouts;
+        if (it->second.empty()) {
+            _locks.erase(it);
+        }
+    }
+    reply(replies);
+}
+
+void LockManager::reply(const replies_t& replies) {
+    for (const auto& reply : replies) {
+        reply.first(reply.second);
+    }
+}
+
+} // namespace server
+} // namespace orion
@@ -0,0 +1,117 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_LOCK_MANAGER_H
+#define ORION_SERVER_LOCK_MANAGER_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <functional>
+#include "server/apply_queue.h"
+#include "common/thread_pool.h"
+#include "common/timing_wheel.h"
+
+namespace orion {
+namespace server {
+
+struct LockOptions {
+    // a lock request is parked at most this long, in milliseconds
+    int32_t max_wait_ms;
+
+    LockOptions() : max_wait_ms(10000) { }
+};
+
+struct LockStats {
+    // lock requests parked now
+    int64_t waiting;
+    // parked requests answered once their waiter got the lock
+    int64_t wakeups;
+    int64_t timeouts;
+
+    LockStats() : waiting(0), wakeups(0), timeouts(0) { }
+};
+
+/**
+ * @brief Parks lock requests until their waiters hold the lock
+ *
+ * Waiters live in storage as temp nodes under the lock key, so the queue
+ * survives failover and a waiter goes away with its lease. The leader parks
+ * the request of a waiter behind others, and whenever a waiter of a lock with
+ * parked requests is removed, reads the new holder and answers its request
+ * alone, so a release wakes one client instead of all of them. A parked
+ * request is answered LOCKED once its wait is over, and the client sends it
+ * again to keep waiting. Thread-safe.
+ */
+class LockManager {
+public:
+    /// returns the waiter holding lock key of group, empty if the lock is free
+    typedef std::function<std::string (int32_t group_id, const std::string& ns,
+            const std::string& key)> holder_func_t;
+    typedef std::function<void (int32_t status)> done_func_t;
+
+    LockManager(const holder_func_t& holder, const LockOptions& options = LockOptions());
+    ~LockManager();
+    /// disable copy and move for lock manager
+    LockManager(const LockManager&) = delete;
+    void operator=(const LockManager&) = delete;
+
+    /// applied entries of a group, called by apply listener in order of index
+    void on_apply(int32_t group_id, int64_t index, const raft::Entry& entry,
+            const raft::ApplyResult& result);
+    /**
+     * @brief Waits for a waiter to hold its lock
+     * @param group_id  [IN] group of the lock
+     * @param ns        [IN] namespace of the lock
+     * @param key       [IN] key of the lock
+     * @param waiter    [IN] waiter node queued by the lock entry
+     * @param wait_ms   [IN] longest wait, 0 to return at once
+     * @param done      [IN] called with OK once the waiter holds the lock, LOCKED if the wait
+     *                       is over, or LEASE_EXPIRED and NOT_FOUND if the waiter is gone
+     */
+    void wait(int32_t group_id, const std::string& ns, const std::string& key,
+            const std::string& waiter, int32_t wait_ms, const done_func_t& done);
+    /// answers parked requests with TIMEOUT, later ones are answered at once
+    void stop();
+    LockStats stats() const;
+private:
+    typedef std::tuple<int32_t, std::string, std::string> lock_t;
+    struct Parked {
+        done_func_t done;
+        int64_t timer;
+        // tells the request apart from the ones it replaces
+        int64_t seq;
+    };
+    // parked requests of a lock by waiter
+    typedef std::map<std::string, Parked> parked_t;
+    typedef std::vector<std::pair<done_func_t, int32_t> > replies_t;
+
+    /// answers the holder of lock if it is parked, called with mutex locked
+    void wake(const lock_t& lock, replies_t* replies);
+    void expire(const lock_t& lock, const std::string& waiter, int64_t seq);
+    static void reply(const replies_t& replies);
+private:
+    holder_func_t _holder;
+    LockOptions _options;
+    mutable std::mutex _mutex;
+    std::map<lock_t, parked_t> _locks;
+    bool _stop;
+    int64_t _next_seq;
+    int64_t _waiting;
+    int64_t _wakeups;
+    int64_t _timeouts;
+    // times out parked waiters of _locks
+    common::ThreadPool _pool;
+    // wait timers, run by _pool
+    common::TimingWheel _wheel;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_LOCK_MANAGER_H
@@ -0,0 +1,210 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "multi_raft.h"
+
+#include <algorithm>
+#include <chrono>
+#include "server/state_machine.h"
+#include "server/hot_keys.h"
+#include "storage/data_store.h"
+#include "storage/tree_struct.h"
+#include "common/file_util.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace server {
+
+static const char* s_hot_key_file = "hot_keys";
+// hot keys are saved periodically in case the node crashes
+static const int64_t s_hot_key_save_interval = 60 * 1000;
+// one of every sample rate reads is counted
+static const int32_t s_hot_key_sample_rate = 16;
+// stats of the shared pool are logged this often
+static const int64_t s_stats_log_interval = 60 * 1000;
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MultiRaft::MultiRaft(const raft::RaftOptions& options, int32_t group_num,
+        const rpc::RpcClient::channel_factory_t& channel_factory) :
+        _options(options), _group_num(std::max(group_num, 1)), _rpc(channel_factory),
+        _batcher(&_rpc, options.rpc_timeout), _pool(options.thread_num, "raft"),
+        _warm_pool(1, "warm"), _stop(false), _started(false), _start_time_ms(0) { }
+
+MultiRaft::~MultiRaft() {
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _stop = true;
+    }
+    // tasks of nodes must not run once nodes are released
+    _warm_pool.stop(false);
+    _pool.stop(false);
+    // nodes send nothing from now on, and every node waits for the callbacks
+    // of its rpc in flight when it is released
+    for (auto& group : _groups) {
+        group.node->stop();
+    }
+    _batcher.cancel();
+    if (_started) {
+        save_hot_keys();
+    }
+    _groups.clear();
+}
+
+bool MultiRaft::start() {
+    int64_t start_time = now_ms();
+    raft::RaftContext context;
+    context.pool = &_pool;
+    context.rpc = &_rpc;
+    context.batcher = &_batcher;
+    for (int32_t i = 0; i < _group_num; ++i) {
+        raft::RaftOptions options = _options;
+        options.group_id = i;
+        options.data_dir = _options.data_dir + "/group_" + std::to_string(i);
+        // leaders of groups are spread over members
+        if (!options.members.empty()) {
+            options.preferred_leader = options.members[i % options.members.size()];
+        }
+        if (!common::make_dirs(options.data_dir)) {
+            LOG(WARNING, "[raft]: create dir %s failed", options.data_dir.c_str());
+            return false;
+        }
+        Group group;
+        group.store.reset(storage::DataStoreFactory::open(options.data_dir + "/data",
+                    options.store_block_cache_size));
+        if (group.store == nullptr) {
+            return false;
+        }
+        group.machine.reset(new OrionStateMachine(group.store.get()));
+        group.node.reset(new raft::RaftNode(options, context,
+                    group.store.get(), group.machine.get()));
+        group.hot_keys.reset(new HotKeyRecorder(options.hot_key_num, s_hot_key_sample_rate));
+        group.hot_key_path = options.data_dir + "/" + s_hot_key_file;
+        _groups.push_back(std::move(group));
+    }
+    // groups replay their logs in parallel
+    std::vector<char> started(_groups.size(), 0);
+    {
+        common::ThreadPool pool(std::min(_options.thread_num, _group_num));
+        for (size_t i = 0; i < _groups.size(); ++i) {
+            pool.add_task([this, i, &started] {
+                started[i] = _groups[i].node->start();
+            });
+        }
+        pool.stop(true);
+    }
+    if (std::find(started.begin(), started.end(), 0) != started.end()) {
+        return false;
+    }
+    _started = true;
+    _start_time_ms = now_ms() - start_time;
+    _pool.delay_task(_options.heartbeat_interval, std::bind(&MultiRaft::heartbeat, this));
+    for (int32_t i = 0; i < _group_num; ++i) {
+        _warm_pool.add_task(std::bind(&MultiRaft::prewarm, this, i));
+    }
+    _pool.delay_task(s_hot_key_save_interval, std::bind(&MultiRaft::save_hot_keys, this));
+    _pool.delay_task(s_stats_log_interval, std::bind(&MultiRaft::log_stats, this));
+    LOG(INFO, "[raft]: %d raft groups started in %ld ms", _group_num, _start_time_ms);
+    return true;
+}
+
+raft::RaftNode* MultiRaft::node(int32_t group_id) const {
+    if (group_id < 0 || group_id >= static_cast<int32_t>(_groups.size())) {
+        return nullptr;
+    }
+    return _groups[group_id].node.get();
+}
+
+storage::DataStore* MultiRaft::store(int32_t group_id) const {
+    if (group_id < 0 || group_id >= static_cast<int32_t>(_groups.size())) {
+        return nullptr;
+    }
+    return _groups[group_id].store.get();
+}
+
+std::vector<raft::RaftNode*> MultiRaft::nodes() const {
+    std::vector<raft::RaftNode*> nodes;
+    for (const auto& group : _groups) {
+        nodes.push_back(group.node.get());
+    }
+    return nodes;
+}
+
+void MultiRaft::record_read(int32_t group_id, const std::string& ns,
+        const std::string& key) {
+    if (group_id >= 0 && group_id < static_cast<int32_t>(_groups.size())) {
+        _groups[group_id].hot_keys->record(ns, key);
+    }
+}
+
+void MultiRaft::heartbeat() {
+    // all the groups queue their heartbeats first, then one rpc goes to every node
+    for (auto& group : _groups) {
+        group.node->heartbeat();
+    }
+    _batcher.flush();
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return;
+    }
+    _pool.delay_task(_options.heartbeat_interval, std::bind(&MultiRaft::heartbeat, this));
+}
+
+void MultiRaft::prewarm(int32_t group_id) {
+    Group& group = _groups[group_id];
+    std::vector<HotKeyRecorder::key_t> keys;
+    if (!HotKeyRecorder::load(group.hot_key_path, &keys)) {
+        return;
+    }
+    int64_t start_time = now_ms();
+    storage::TreeStructure tree(group.store.get());
+    storage::ValueInfo info;
+    for (const auto& key : keys) {
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            if (_stop) {
+                return;
+            }
+        }
+        // values are not needed, reading them brings their blocks into cache
+        tree.get(info, key.first, key.second);
+    }
+    LOG(INFO, "[data]: group %d warmed up with %lu hot keys in %ld ms",
+            group_id, keys.size(), now_ms() - start_time);
+}
+
+void MultiRaft::save_hot_keys() {
+    for (size_t i = 0; i < _groups.size(); ++i) {
+        if (!_groups[i].hot_keys->save(_groups[i].hot_key_path)) {
+            LOG(WARNING, "[data]: save hot keys of group %lu failed", i);
+        }
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return;
+    }
+    _pool.delay_task(s_hot_key_save_interval, std::bind(&MultiRaft::save_hot_keys, this));
+}
+
+void MultiRaft::log_stats() {
+    common::ThreadPoolStats stats = _pool.stats();
+    LOG(INFO, "[raft]: pool %s threads %d active %d queued %ld delayed %ld tasks %ld, "
+            "wait p50 %ld p99 %ld p999 %ld max %ld us, run p50 %ld p99 %ld max %ld us",
+            stats.name.c_str(), stats.threads, stats.active, stats.queued, stats.delayed,
+            stats.tasks, stats.wait_p50, stats.wait_p99, stats.wait_p999, stats.wait_max,
+            stats.run_p50, stats.run_p99, stats.run_max);
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return;
+    }
+    _pool.delay_task(s_stats_log_interval, std::bind(&MultiRaft::log_stats, this));
+}
+
+} // namespace server
+} // namespace orion
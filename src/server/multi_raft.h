@@ -0,0 +1,111 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_MULTI_RAFT_H
+#define ORION_SERVER_MULTI_RAFT_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "server/raft_node.h"
+#include "common/routing_table.h"
+
+namespace orion {
+
+namespace storage {
+
+class DataStore; // forward declaration
+
+} // namespace storage
+
+namespace server {
+
+class OrionStateMachine; // forward declaration
+class HotKeyRecorder; // forward declaration
+
+/**
+ * @brief Hosts all the raft groups of current node
+ *
+ * Namespaces are spread over groups by RoutingTable, every group has its
+ * own log, snapshot and storage, so that groups are written in parallel.
+ * Each group prefers a different member as leader to spread write load.
+ * Groups share one thread pool and rpc client, and heartbeats of all the
+ * groups to the same node are sent in one rpc. Groups are recovered in
+ * parallel on start, and the block cache of every group is warmed up
+ * with the keys read most often before last shutdown, by a thread of its
+ * own so that raft tasks do not queue behind it.
+ */
+class MultiRaft {
+public:
+    /// options is shared by all the groups, group id, data dir and preferred
+    /// leader are filled for every group, channel factory replaces the network if given
+    MultiRaft(const raft::RaftOptions& options, int32_t group_num,
+            const rpc::RpcClient::channel_factory_t& channel_factory =
+            rpc::RpcClient::channel_factory_t());
+    ~MultiRaft();
+    /// disable copy and move for multi raft
+    MultiRaft(const MultiRaft&) = delete;
+    void operator=(const MultiRaft&) = delete;
+
+    /// opens storage and starts nodes of all the groups
+    bool start();
+    /// milliseconds spent by start to recover all the groups
+    int64_t start_time_ms() const {
+        return _start_time_ms;
+    }
+
+    int32_t group_num() const {
+        return _group_num;
+    }
+    /// returns the group owning the namespace
+    int32_t group_of(const std::string& ns) const {
+        return common::RoutingTable::group_of(ns, _group_num);
+    }
+    /// returns nullptr if group does not exist
+    raft::RaftNode* node(int32_t group_id) const;
+    storage::DataStore* store(int32_t group_id) const;
+    /// node of group i is at index i
+    std::vector<raft::RaftNode*> nodes() const;
+    /// samples a read of key for warming up block cache after restart
+    void record_read(int32_t group_id, const std::string& ns, const std::string& key);
+    /// stats of the thread pool shared by all the groups
+    common::ThreadPoolStats pool_stats() const {
+        return _pool.stats();
+    }
+private:
+    void heartbeat();
+    /// reads hot keys saved by last run into block cache of group
+    void prewarm(int32_t group_id);
+    void save_hot_keys();
+    /// logs stats of the shared pool, so that queueing delay shows up in the log
+    void log_stats();
+private:
+    struct Group {
+        std::unique_ptr<storage::DataStore> store;
+        std::unique_ptr<OrionStateMachine> machine;
+        std::unique_ptr<raft::RaftNode> node;
+        std::unique_ptr<HotKeyRecorder> hot_keys;
+        std::string hot_key_path;
+    };
+    raft::RaftOptions _options;
+    int32_t _group_num;
+    rpc::RpcClient _rpc;
+    raft::HeartbeatBatcher _batcher;
+    common::ThreadPool _pool;
+    // one thread reads hot keys of the groups in turn
+    common::ThreadPool _warm_pool;
+    std::vector<Group> _groups;
+    std::mutex _mutex;
+    bool _stop;
+    bool _started;
+    int64_t _start_time_ms;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_MULTI_RAFT_H
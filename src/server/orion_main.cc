@@ -0,0 +1,103 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include <signal.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <gflags/gflags.h>
+#include <sofa/pbrpc/pbrpc.h>
+#include "server/multi_raft.h"
+#include "server/raft_service.h"
+#include "server/orion_service.h"
+#include "common/logging.h"
+
+DECLARE_string(server_addr);
+DECLARE_string(members);
+DECLARE_string(data_dir);
+DECLARE_int32(server_thread_num);
+DECLARE_int32(raft_group_num);
+DECLARE_int32(raft_thread_num);
+DECLARE_int32(raft_election_timeout);
+DECLARE_int32(raft_heartbeat_interval);
+DECLARE_int64(raft_snapshot_interval);
+DECLARE_int64(raft_snapshot_min_entries);
+DECLARE_int64(raft_log_cache_size);
+DECLARE_int64(store_block_cache_size);
+DECLARE_int32(hot_key_num);
+
+namespace orion {
+namespace server {
+
+static volatile bool s_quit = false;
+
+static void signal_handler(int /*sig*/) {
+    s_quit = true;
+}
+
+static std::vector<std::string> split(const std::string& str, char sep) {
+    std::vector<std::string> result;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, sep)) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+/// runs the server until it is interrupted
+static int run() {
+    raft::RaftOptions options;
+    options.self = FLAGS_server_addr;
+    options.members = split(FLAGS_members, ',');
+    options.data_dir = FLAGS_data_dir;
+    options.election_timeout = FLAGS_raft_election_timeout;
+    options.heartbeat_interval = FLAGS_raft_heartbeat_interval;
+    options.snapshot_interval = FLAGS_raft_snapshot_interval;
+    options.snapshot_min_entries = FLAGS_raft_snapshot_min_entries;
+    options.log_cache_size = FLAGS_raft_log_cache_size * 1024 * 1024;
+    options.store_block_cache_size = FLAGS_store_block_cache_size * 1024 * 1024;
+    options.hot_key_num = FLAGS_hot_key_num;
+    options.thread_num = FLAGS_raft_thread_num;
+    MultiRaft multi_raft(options, FLAGS_raft_group_num);
+    if (!multi_raft.start()) {
+        LOG(FATAL, "failed to start raft groups");
+    }
+
+    sofa::pbrpc::RpcServerOptions server_options;
+    server_options.work_thread_num = FLAGS_server_thread_num;
+    sofa::pbrpc::RpcServer rpc_server(server_options);
+    raft::RaftService* raft_service = new raft::RaftService(multi_raft.nodes());
+    OrionServiceImpl* orion_service = new OrionServiceImpl(&multi_raft);
+    // rpc server takes the ownership of services
+    if (!rpc_server.RegisterService(raft_service)
+            || !rpc_server.RegisterService(orion_service)) {
+        LOG(FATAL, "failed to register services");
+    }
+    if (!rpc_server.Start(FLAGS_server_addr)) {
+        LOG(FATAL, "failed to start server on %s", FLAGS_server_addr.c_str());
+    }
+    LOG(INFO, "orion server started on %s", FLAGS_server_addr.c_str());
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    while (!s_quit) {
+        sleep(1);
+    }
+    rpc_server.Stop();
+    return 0;
+}
+
+} // namespace server
+} // namespace orion
+
+int main(int argc, char* argv[]) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    return orion::server::run();
+}
@@ -0,0 +1,537 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "orion_service.h"
+
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <memory>
+#include "server/multi_raft.h"
+#include "server/watch_hub.h"
+#include "server/lease_table.h"
+#include "server/lock_manager.h"
+#include "server/state_machine.h"
+#include "storage/tree_struct.h"
+#include "common/const.h"
+
+namespace orion {
+namespace server {
+
+// a page never grows beyond these limits whatever client asks for
+static const int32_t s_max_page_limit = 10000;
+static const int32_t s_max_page_bytes = 4 * 1024 * 1024;
+
+OrionServiceImpl::OrionServiceImpl(MultiRaft* multi_raft) : _multi_raft(multi_raft),
+        _watch_hub(new WatchHub()) {
+    _lease_table.reset(new LeaseTable(_multi_raft->group_num(),
+                std::bind(&OrionServiceImpl::leading_term, this, std::placeholders::_1),
+                [multi_raft](int32_t group_id, std::map<int64_t, int64_t>* leases) {
+                    OrionStateMachine::list_leases(multi_raft->store(group_id), leases);
+                },
+                [this](int32_t group_id, const std::vector<int64_t>& leases) {
+                    return propose_revoke(group_id, leases,
+                            [](const std::vector<int32_t>&) { });
+                }));
+    _lock_manager.reset(new LockManager(
+                [multi_raft](int32_t group_id, const std::string& ns, const std::string& key) {
+                    return OrionStateMachine::lock_holder(multi_raft->store(group_id), ns, key);
+                }));
+    for (int32_t i = 0; i < _multi_raft->group_num(); ++i) {
+        std::shared_ptr<WatchHub> hub = _watch_hub;
+        std::shared_ptr<LeaseTable> lease_table = _lease_table;
+        std::shared_ptr<LockManager> lock_manager = _lock_manager;
+        _multi_raft->node(i)->set_apply_listener(
+                [hub, lease_table, lock_manager, i](int64_t index, const raft::Entry& entry,
+                    const raft::ApplyResult& result) {
+                    lease_table->on_apply(i, index, entry, result);
+                    lock_manager->on_apply(i, index, entry, result);
+                    hub->on_apply(i, index, entry, result);
+                });
+    }
+}
+
+OrionServiceImpl::~OrionServiceImpl() {
+    // raft groups may be gone already, parked polls are answered here,
+    // and no lease is revoked after
+    _lease_table->stop();
+    _lock_manager->stop();
+    _watch_hub->stop();
+}
+
+void OrionServiceImpl::put(::google::protobuf::RpcController* /*controller*/,
+                           const service::PutRequest* request,
+                           service::PutResponse* response,
+                           ::google::protobuf::Closure* done) {
+    raft::RaftNode* node = _multi_raft->node(_multi_raft->group_of(request->ns()));
+    raft::Entry entry;
+    entry.set_term(0);
+    entry.set_op(raft_op::PUT);
+    entry.set_key(request->key());
+    entry.set_value(request->value());
+    entry.set_ns(request->ns());
+    entry.set_session_id(request->lease_id());
+    // response is sent by apply thread once the entry is applied
+    int32_t ret = node->propose(entry, [response, done](int32_t status) {
+        response->set_status(status);
+        done->Run();
+    });
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+    }
+}
+
+void OrionServiceImpl::get(::google::protobuf::RpcController* /*controller*/,
+                           const service::GetRequest* request,
+                           service::GetResponse* response,
+                           ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    if (!node->is_leader()) {
+        response->set_status(status_code::NOT_LEADER);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+        return;
+    }
+    _multi_raft->record_read(group_id, request->ns(), request->key());
+    storage::TreeStructure tree(_multi_raft->store(group_id));
+    storage::ValueInfo info;
+    int32_t ret = tree.get(info, request->ns(), request->key());
+    response->set_status(ret);
+    if (ret == status_code::OK) {
+        response->set_value(info.value);
+    }
+    done->Run();
+}
+
+void OrionServiceImpl::remove(::google::protobuf::RpcController* /*controller*/,
+                              const service::DeleteRequest* request,
+                              service::DeleteResponse* response,
+                              ::google::protobuf::Closure* done) {
+    raft::RaftNode* node = _multi_raft->node(_multi_raft->group_of(request->ns()));
+    raft::Entry entry;
+    entry.set_term(0);
+    entry.set_op(raft_op::REMOVE);
+    entry.set_key(request->key());
+    entry.set_value("");
+    entry.set_ns(request->ns());
+    int32_t ret = node->propose(entry, [response, done](int32_t status) {
+        response->set_status(status);
+        done->Run();
+    });
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+    }
+}
+
+void OrionServiceImpl::batch_get(::google::protobuf::RpcController* /*controller*/,
+                                 const service::BatchGetRequest* request,
+                                 service::BatchGetResponse* response,
+                                 ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    if (!node->is_leader()) {
+        response->set_status(status_code::NOT_LEADER);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+        return;
+    }
+    std::vector<std::string> keys(request->keys().begin(), request->keys().end());
+    for (const auto& key : keys) {
+        _multi_raft->record_read(group_id, request->ns(), key);
+    }
+    storage::TreeStructure tree(_multi_raft->store(group_id));
+    std::vector<storage::ValueInfo> infos;
+    std::vector<int32_t> statuses;
+    tree.multi_get(&infos, &statuses, request->ns(), keys);
+    response->set_status(status_code::OK);
+    response->mutable_statuses()->Reserve(keys.size());
+    response->mutable_values()->Reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        response->add_statuses(statuses[i]);
+        response->add_values()->swap(infos[i].value);
+    }
+    done->Run();
+}
+
+void OrionServiceImpl::batch_put(::google::protobuf::RpcController* /*controller*/,
+                                 const service::BatchPutRequest* request,
+                                 service::BatchPutResponse* response,
+                                 ::google::protobuf::Closure* done) {
+    if (request->keys_size() != request->values_size()) {
+        response->set_status(status_code::INVALID);
+        done->Run();
+        return;
+    }
+    serialize::BatchOps ops;
+    for (int i = 0; i < request->keys_size(); ++i) {
+        serialize::BatchOp* op = ops.add_ops();
+        op->set_op(raft_op::PUT);
+        op->set_key(request->keys(i));
+        op->set_value(request->values(i));
+    }
+    int32_t ret = propose_batch(request->ns(), ops, response->mutable_statuses(),
+            [response, done](int32_t status) {
+                response->set_status(status);
+                done->Run();
+            });
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(_multi_raft->node(
+                    _multi_raft->group_of(request->ns()))->leader_id());
+        done->Run();
+    }
+}
+
+void OrionServiceImpl::batch_remove(::google::protobuf::RpcController* /*controller*/,
+                                    const service::BatchDeleteRequest* request,
+                                    service::BatchDeleteResponse* response,
+                                    ::google::protobuf::Closure* done) {
+    serialize::BatchOps ops;
+    for (const auto& key : request->keys()) {
+        serialize::BatchOp* op = ops.add_ops();
+        op->set_op(raft_op::REMOVE);
+        op->set_key(key);
+    }
+    int32_t ret = propose_batch(request->ns(), ops, response->mutable_statuses(),
+            [response, done](int32_t status) {
+                response->set_status(status);
+                done->Run();
+            });
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(_multi_raft->node(
+                    _multi_raft->group_of(request->ns()))->leader_id());
+        done->Run();
+    }
+}
+
+int32_t OrionServiceImpl::propose_batch(const std::string& ns, const serialize::BatchOps& ops,
+        google::protobuf::RepeatedField<int32_t>* statuses,
+        const std::function<void (int32_t)>& done) {
+    raft::RaftNode* node = _multi_raft->node(_multi_raft->group_of(ns));
+    raft::Entry entry;
+    entry.set_term(0);
+    entry.set_op(raft_op::BATCH);
+    entry.set_key("");
+    entry.set_ns(ns);
+    if (!ops.SerializeToString(entry.mutable_value())) {
+        return status_code::INVALID;
+    }
+    return node->propose(entry, raft::result_func_t(
+                [statuses, done](const raft::ApplyResult& result) {
+                    for (int32_t status : result.batch_status) {
+                        statuses->Add(status);
+                    }
+                    done(result.status);
+                }));
+}
+
+void OrionServiceImpl::list(::google::protobuf::RpcController* /*controller*/,
+                            const service::ListRequest* request,
+                            service::ScanResponse* response,
+                            ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    if (!node->is_leader()) {
+        response->set_status(status_code::NOT_LEADER);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+        return;
+    }
+    if (request->key().empty()) {
+        response->set_status(status_code::INVALID);
+        done->Run();
+        return;
+    }
+    storage::TreeStructure tree(_multi_raft->store(group_id));
+    std::unique_ptr<storage::StructureIterator> it(tree.list(request->ns(), request->key(),
+                request->continuation_key()));
+    fill_page(it.get(), request, response);
+    done->Run();
+}
+
+void OrionServiceImpl::scan(::google::protobuf::RpcController* /*controller*/,
+                            const service::ScanRequest* request,
+                            service::ScanResponse* response,
+                            ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    if (!node->is_leader()) {
+        response->set_status(status_code::NOT_LEADER);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+        return;
+    }
+    if (request->start().empty()) {
+        response->set_status(status_code::INVALID);
+        done->Run();
+        return;
+    }
+    // the smallest key greater than continuation key
+    std::string start = request->start();
+    if (!request->continuation_key().empty()) {
+        start = request->continuation_key();
+        start.push_back('\0');
+    }
+    storage::TreeStructure tree(_multi_raft->store(group_id));
+    std::unique_ptr<storage::StructureIterator> it(tree.scan(request->ns(), start,
+                request->end()));
+    fill_page(it.get(), request, response);
+    done->Run();
+}
+
+template <class Request>
+void OrionServiceImpl::fill_page(storage::StructureIterator* it, const Request* request,
+        service::ScanResponse* response) {
+    int32_t limit = request->limit() > 0 ?
+        std::min(request->limit(), s_max_page_limit) : s_max_page_limit;
+    int32_t max_bytes = request->max_bytes() > 0 ?
+        std::min(request->max_bytes(), s_max_page_bytes) : s_max_page_bytes;
+    int32_t bytes = 0;
+    response->set_status(status_code::OK);
+    // at least one node is returned, so that client always makes progress
+    for (; !it->done(); it->next()) {
+        if (response->keys_size() >= limit || bytes >= max_bytes) {
+            response->set_continuation_key(response->keys(response->keys_size() - 1));
+            break;
+        }
+        const std::string& key = it->key();
+        bytes += key.size();
+        response->add_keys(key);
+        if (!request->keys_only()) {
+            const std::string& value = it->value();
+            bytes += value.size();
+            response->add_values(value);
+        }
+    }
+}
+
+void OrionServiceImpl::watch(::google::protobuf::RpcController* /*controller*/,
+                             const service::WatchRequest* request,
+                             service::WatchResponse* response,
+                             ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    // streams are served by leader, which applies the writes first
+    if (!node->is_leader()) {
+        response->set_status(status_code::NOT_LEADER);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+        return;
+    }
+    _watch_hub->watch(group_id, node->applied_index(), request, response, done);
+}
+
+void OrionServiceImpl::grant_lease(::google::protobuf::RpcController* /*controller*/,
+                                   const service::GrantLeaseRequest* request,
+                                   service::GrantLeaseResponse* response,
+                                   ::google::protobuf::Closure* done) {
+    raft::RaftNode* node = _multi_raft->node(_multi_raft->group_of(request->ns()));
+    int64_t lease_id = _lease_table->new_id();
+    int64_t ttl = _lease_table->ttl(request->ttl());
+    raft::Entry entry;
+    entry.set_term(0);
+    entry.set_op(raft_op::GRANT_LEASE);
+    entry.set_key("");
+    entry.set_value(std::to_string(ttl));
+    entry.set_ns(request->ns());
+    entry.set_session_id(lease_id);
+    int32_t ret = node->propose(entry, [response, done, lease_id, ttl](int32_t status) {
+        response->set_status(status);
+        if (status == status_code::OK) {
+            response->set_lease_id(lease_id);
+            response->set_ttl(ttl);
+        }
+        done->Run();
+    });
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+    }
+}
+
+void OrionServiceImpl::revoke_lease(::google::protobuf::RpcController* /*controller*/,
+                                    const service::RevokeLeaseRequest* request,
+                                    service::RevokeLeaseResponse* response,
+                                    ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    int32_t ret = propose_revoke(group_id, std::vector<int64_t>(1, request->lease_id()),
+            [response, done](const std::vector<int32_t>& statuses) {
+                response->set_status(statuses.empty() ? status_code::INVALID : statuses[0]);
+                done->Run();
+            });
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(_multi_raft->node(group_id)->leader_id());
+        done->Run();
+    }
+}
+
+void OrionServiceImpl::keep_alive(::google::protobuf::RpcController* /*controller*/,
+                                  const service::KeepAliveRequest* request,
+                                  service::KeepAliveResponse* response,
+                                  ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    std::vector<int64_t> leases(request->lease_ids().begin(), request->lease_ids().end());
+    std::vector<int64_t> expired;
+    int32_t ret = _lease_table->keep_alive(group_id, leading_term(group_id), leases, &expired);
+    response->set_status(ret);
+    if (ret != status_code::OK) {
+        response->set_leader_id(_multi_raft->node(group_id)->leader_id());
+    }
+    for (int64_t lease_id : expired) {
+        response->add_expired(lease_id);
+    }
+    done->Run();
+}
+
+void OrionServiceImpl::lock(::google::protobuf::RpcController* /*controller*/,
+                            const service::LockRequest* request,
+                            service::LockResponse* response,
+                            ::google::protobuf::Closure* done) {
+    int32_t group_id = _multi_raft->group_of(request->ns());
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    const std::string& key = request->key();
+    if (request->lease_id() == 0 || key.empty() || key[0] != '/' || key.back() == '/') {
+        response->set_status(status_code::INVALID);
+        done->Run();
+        return;
+    }
+    // queue is read by a leader which has applied the entries of former terms
+    if (leading_term(group_id) == 0) {
+        response->set_status(status_code::NOT_LEADER);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+        return;
+    }
+    std::shared_ptr<LockManager> lock_manager = _lock_manager;
+    auto wait = [lock_manager, group_id, request, response, done](const std::string& waiter) {
+        response->set_waiter(waiter);
+        lock_manager->wait(group_id, request->ns(), request->key(), waiter,
+                request->queue() ? request->wait_ms() : 0, [response, done](int32_t status) {
+                    response->set_status(status);
+                    done->Run();
+                });
+    };
+    // a lease queued already waits again without a new entry
+    std::string waiter = OrionStateMachine::lock_waiter(_multi_raft->store(group_id),
+            request->ns(), key, request->lease_id());
+    if (!waiter.empty()) {
+        wait(waiter);
+        return;
+    }
+    raft::Entry entry;
+    entry.set_term(0);
+    entry.set_op(raft_op::LOCK);
+    entry.set_key(key);
+    entry.set_value(request->queue() ? "" : "try");
+    entry.set_ns(request->ns());
+    entry.set_session_id(request->lease_id());
+    MultiRaft* multi_raft = _multi_raft;
+    int32_t ret = node->propose(entry, raft::result_func_t(
+                [multi_raft, group_id, request, response, done, wait](
+                    const raft::ApplyResult& result) {
+                    if (result.status != status_code::OK) {
+                        response->set_status(result.status);
+                        done->Run();
+                        return;
+                    }
+                    // no waiter is created if the lease is queued by a request before
+                    wait(!result.created.empty() ? result.created :
+                            OrionStateMachine::lock_waiter(multi_raft->store(group_id),
+                                request->ns(), request->key(), request->lease_id()));
+                }));
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+    }
+}
+
+void OrionServiceImpl::unlock(::google::protobuf::RpcController* /*controller*/,
+                              const service::UnlockRequest* request,
+                              service::UnlockResponse* response,
+                              ::google::protobuf::Closure* done) {
+    if (request->lease_id() == 0) {
+        response->set_status(status_code::INVALID);
+        done->Run();
+        return;
+    }
+    raft::RaftNode* node = _multi_raft->node(_multi_raft->group_of(request->ns()));
+    raft::Entry entry;
+    entry.set_term(0);
+    entry.set_op(raft_op::UNLOCK);
+    entry.set_key(request->key());
+    entry.set_value("");
+    entry.set_ns(request->ns());
+    entry.set_session_id(request->lease_id());
+    int32_t ret = node->propose(entry, [response, done](int32_t status) {
+        response->set_status(status);
+        done->Run();
+    });
+    if (ret != status_code::OK) {
+        response->set_status(ret);
+        response->set_leader_id(node->leader_id());
+        done->Run();
+    }
+}
+
+int32_t OrionServiceImpl::propose_revoke(int32_t group_id, const std::vector<int64_t>& leases,
+        const std::function<void (const std::vector<int32_t>&)>& done) {
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    serialize::LeaseList list;
+    for (int64_t lease_id : leases) {
+        list.add_ids(lease_id);
+    }
+    raft::Entry entry;
+    entry.set_term(0);
+    entry.set_op(raft_op::REVOKE_LEASES);
+    entry.set_key("");
+    if (!list.SerializeToString(entry.mutable_value())) {
+        return status_code::INVALID;
+    }
+    return node->propose(entry, raft::result_func_t(
+                [done](const raft::ApplyResult& result) {
+                    done(result.status == status_code::OK ? result.batch_status
+                            : std::vector<int32_t>(1, result.status));
+                }));
+}
+
+int64_t OrionServiceImpl::leading_term(int32_t group_id) const {
+    raft::RaftNode* node = _multi_raft->node(group_id);
+    if (!node->is_leader()) {
+        return 0;
+    }
+    int64_t term = node->current_term();
+    // the first entry of a term is applied after all the entries before it
+    OrionStateMachine machine(_multi_raft->store(group_id));
+    return machine.applied_term() == term ? term : 0;
+}
+
+void OrionServiceImpl::route(::google::protobuf::RpcController* /*controller*/,
+                             const service::RouteRequest* /*request*/,
+                             service::RouteResponse* response,
+                             ::google::protobuf::Closure* done) {
+    response->set_status(status_code::OK);
+    response->set_group_num(_multi_raft->group_num());
+    for (int32_t i = 0; i < _multi_raft->group_num(); ++i) {
+        raft::RaftNode* node = _multi_raft->node(i);
+        service::GroupRoute* route = response->add_groups();
+        route->set_group_id(i);
+        route->set_leader_id(node->leader_id());
+        route->set_term(node->current_term());
+    }
+    done->Run();
+}
+
+} // namespace server
+} // namespace orion
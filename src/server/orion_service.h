@@ -0,0 +1,147 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_ORION_SERVICE_H
+#define ORION_SERVER_ORION_SERVICE_H
+#include <functional>
+#include <memory>
+#include "proto/service.pb.h"
+#include "proto/serialize.pb.h"
+
+namespace orion {
+
+namespace storage {
+
+class StructureIterator; // forward declaration
+
+} // namespace storage
+
+namespace server {
+
+class MultiRaft; // forward declaration
+class WatchHub; // forward declaration
+class LeaseTable; // forward declaration
+class LockManager; // forward declaration
+
+/**
+ * @brief Serves user requests on top of raft
+ *
+ * Requests are routed to the raft group owning their namespace,
+ * writes are proposed to the group and answered once applied,
+ * reads are served by leader of the group from its local storage.
+ * Leases are granted and revoked through raft, while keepalives are
+ * served by the leader alone. Lock requests queue their lease through raft
+ * and are parked on the leader until the lease holds the lock.
+ */
+class OrionServiceImpl : public service::OrionService {
+public:
+    /// OrionServiceImpl does not own the raft groups
+    OrionServiceImpl(MultiRaft* multi_raft);
+    virtual ~OrionServiceImpl();
+
+    virtual void put(::google::protobuf::RpcController* controller,
+                     const service::PutRequest* request,
+                     service::PutResponse* response,
+                     ::google::protobuf::Closure* done);
+    virtual void get(::google::protobuf::RpcController* controller,
+                     const service::GetRequest* request,
+                     service::GetResponse* response,
+                     ::google::protobuf::Closure* done);
+    virtual void remove(::google::protobuf::RpcController* controller,
+                        const service::DeleteRequest* request,
+                        service::DeleteResponse* response,
+                        ::google::protobuf::Closure* done);
+    /// returns leaders of all the groups for clients to cache
+    virtual void route(::google::protobuf::RpcController* controller,
+                       const service::RouteRequest* request,
+                       service::RouteResponse* response,
+                       ::google::protobuf::Closure* done);
+    /// reads all the keys from one view of storage
+    virtual void batch_get(::google::protobuf::RpcController* controller,
+                           const service::BatchGetRequest* request,
+                           service::BatchGetResponse* response,
+                           ::google::protobuf::Closure* done);
+    /// writes of a batch are proposed as one raft entry
+    virtual void batch_put(::google::protobuf::RpcController* controller,
+                           const service::BatchPutRequest* request,
+                           service::BatchPutResponse* response,
+                           ::google::protobuf::Closure* done);
+    virtual void batch_remove(::google::protobuf::RpcController* controller,
+                              const service::BatchDeleteRequest* request,
+                              service::BatchDeleteResponse* response,
+                              ::google::protobuf::Closure* done);
+    /// children of a directory are returned page by page
+    virtual void list(::google::protobuf::RpcController* controller,
+                      const service::ListRequest* request,
+                      service::ScanResponse* response,
+                      ::google::protobuf::Closure* done);
+    virtual void scan(::google::protobuf::RpcController* controller,
+                      const service::ScanRequest* request,
+                      service::ScanResponse* response,
+                      ::google::protobuf::Closure* done);
+    /// polls the watch stream of a client, answered once it has events
+    virtual void watch(::google::protobuf::RpcController* controller,
+                       const service::WatchRequest* request,
+                       service::WatchResponse* response,
+                       ::google::protobuf::Closure* done);
+    virtual void grant_lease(::google::protobuf::RpcController* controller,
+                             const service::GrantLeaseRequest* request,
+                             service::GrantLeaseResponse* response,
+                             ::google::protobuf::Closure* done);
+    /// temp nodes attached to the lease are removed with it
+    virtual void revoke_lease(::google::protobuf::RpcController* controller,
+                              const service::RevokeLeaseRequest* request,
+                              service::RevokeLeaseResponse* response,
+                              ::google::protobuf::Closure* done);
+    /// renews all the leases of a client in a group
+    virtual void keep_alive(::google::protobuf::RpcController* controller,
+                            const service::KeepAliveRequest* request,
+                            service::KeepAliveResponse* response,
+                            ::google::protobuf::Closure* done);
+    /// answered once the lease holds the lock, or its wait is over
+    virtual void lock(::google::protobuf::RpcController* controller,
+                      const service::LockRequest* request,
+                      service::LockResponse* response,
+                      ::google::protobuf::Closure* done);
+    /// the next waiter of the lock is woken once the entry is applied
+    virtual void unlock(::google::protobuf::RpcController* controller,
+                        const service::UnlockRequest* request,
+                        service::UnlockResponse* response,
+                        ::google::protobuf::Closure* done);
+private:
+    /**
+     * @brief Proposes writes of a namespace as one batch entry
+     * @param ns        [IN] namespace of the writes
+     * @param ops       [IN] writes to propose
+     * @param statuses  [OUT] status of every write, filled before done is called
+     * @param done      [IN] called with the status of the batch
+     * @return          status of proposing, done is not called unless it is OK
+     */
+    int32_t propose_batch(const std::string& ns, const serialize::BatchOps& ops,
+            google::protobuf::RepeatedField<int32_t>* statuses,
+            const std::function<void (int32_t)>& done);
+    /// proposes to revoke leases of a group, done is called with the status of every lease
+    int32_t propose_revoke(int32_t group_id, const std::vector<int64_t>& leases,
+            const std::function<void (const std::vector<int32_t>&)>& done);
+    /// term of current node if it leads group and has applied the entries of
+    /// former terms, 0 if not
+    int64_t leading_term(int32_t group_id) const;
+    /// fills a page from iterator within the limits of request
+    template <class Request>
+    void fill_page(storage::StructureIterator* it, const Request* request,
+            service::ScanResponse* response);
+private:
+    MultiRaft* _multi_raft;
+    // shared with the apply listeners, which may outlive the service
+    std::shared_ptr<WatchHub> _watch_hub;
+    std::shared_ptr<LeaseTable> _lease_table;
+    std::shared_ptr<LockManager> _lock_manager;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_ORION_SERVICE_H
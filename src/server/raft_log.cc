@@ -0,0 +1,599 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "raft_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <algorithm>
+#include "proto/serialize.pb.h"
+#include "common/record_io.h"
+#include "common/file_util.h"
+#include "common/thread_pool.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace raft {
+
+static const char* s_segment_prefix = "segment_";
+static const char* s_state_file = "raft_state";
+
+RaftLog::RaftLog(const std::string& dir, const RaftLogOptions& options) :
+        _dir(dir), _options(options), _last_index(0), _synced_index(0), _truncations(0),
+        _start_index(0), _start_term(0), _current_term(0), _cache(options.cache_size) { }
+
+RaftLog::~RaftLog() {
+    for (auto& segment : _segments) {
+        close(segment.fd);
+    }
+}
+
+bool RaftLog::open() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (!common::make_dirs(_dir)) {
+        LOG(WARNING, "[raft]: create log dir %s failed: %s", _dir.c_str(), strerror(errno));
+        return false;
+    }
+    // load persistent state
+    int state_fd = ::open((_dir + "/" + s_state_file).c_str(), O_RDONLY);
+    if (state_fd >= 0) {
+        std::string buffer;
+        std::string payload;
+        serialize::RaftState state;
+        bool ok = common::read_file(state_fd, &buffer)
+            && common::parse_record(buffer.data(), buffer.size(), &payload) != 0
+            && state.ParseFromString(payload);
+        close(state_fd);
+        if (!ok) {
+            LOG(WARNING, "[raft]: raft state is corrupted");
+            return false;
+        }
+        _current_term = state.current_term();
+        _voted_for = state.voted_for();
+        _start_index = state.start_index();
+        _start_term = state.start_term();
+    }
+    // find all segments
+    DIR* dir = opendir(_dir.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    std::vector<int64_t> first_indexes;
+    size_t prefix_len = strlen(s_segment_prefix);
+    for (struct dirent* ent = readdir(dir); ent != nullptr; ent = readdir(dir)) {
+        const std::string name(ent->d_name);
+        if (name.compare(0, prefix_len, s_segment_prefix) == 0) {
+            first_indexes.push_back(atol(name.c_str() + prefix_len));
+        }
+    }
+    closedir(dir);
+    std::sort(first_indexes.begin(), first_indexes.end());
+    // segments are independent, their indexes are rebuilt in parallel
+    std::vector<Segment> segments(first_indexes.size());
+    std::vector<std::vector<int64_t> > terms(first_indexes.size());
+    std::vector<int> loaded(first_indexes.size(), 0);
+    {
+        common::ThreadPool pool(std::max(std::min(_options.load_threads,
+                        static_cast<int32_t>(first_indexes.size())), 1));
+        for (size_t i = 0; i < first_indexes.size(); ++i) {
+            segments[i].first_index = first_indexes[i];
+            segments[i].fd = -1;
+            segments[i].path = segment_path(first_indexes[i]);
+            pool.add_task([this, &segments, &terms, &loaded, i] {
+                loaded[i] = load_segment(&segments[i], i + 1 == segments.size(), &terms[i]);
+            });
+        }
+        pool.stop(true);
+    }
+    bool ok = true;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        Segment& segment = segments[i];
+        if (!_segments.empty() && ok) {
+            const Segment& prev = _segments.back();
+            if (prev.first_index + static_cast<int64_t>(prev.offsets.size())
+                    != segment.first_index) {
+                LOG(WARNING, "[raft]: log segments are not continuous at %ld",
+                        segment.first_index);
+                ok = false;
+            }
+        }
+        if (!ok || !loaded[i]) {
+            ok = false;
+            if (segment.fd >= 0) {
+                close(segment.fd);
+            }
+            continue;
+        }
+        _terms.insert(_terms.end(), terms[i].begin(), terms[i].end());
+        _segments.push_back(segment);
+    }
+    if (!ok) {
+        return false;
+    }
+    // segments covered by compaction may be left if the node crashed while truncating
+    while (_segments.size() > 1 && _segments[1].first_index <= _start_index + 1) {
+        _terms.erase(_terms.begin(), _terms.begin() +
+                (_segments[1].first_index - _segments[0].first_index));
+        remove_segment(&_segments.front());
+        _segments.pop_front();
+    }
+    if (!_segments.empty()) {
+        const Segment& back = _segments.back();
+        int64_t last = back.first_index + static_cast<int64_t>(back.offsets.size()) - 1;
+        if (_segments.front().first_index > _start_index + 1 || last < _start_index) {
+            // log does not connect with the compaction point, drop it
+            LOG(WARNING, "[raft]: drop log [%ld, %ld] which does not follow %ld",
+                    _segments.front().first_index, last, _start_index);
+            for (auto& segment : _segments) {
+                remove_segment(&segment);
+            }
+            _segments.clear();
+            _terms.clear();
+        }
+    }
+    if (_segments.empty()) {
+        _synced_index = _start_index;
+        return create_segment(_start_index + 1);
+    }
+    const Segment& back = _segments.back();
+    _last_index = back.first_index + static_cast<int64_t>(back.offsets.size()) - 1;
+    _synced_index = _last_index;
+    LOG(INFO, "[raft]: log opened, start: %ld, last: %ld, term: %ld",
+            _start_index, _last_index, _current_term);
+    return true;
+}
+
+bool RaftLog::load_segment(Segment* segment, bool is_last, std::vector<int64_t>* terms) {
+    segment->fd = ::open(segment->path.c_str(), O_RDWR);
+    std::string buffer;
+    if (segment->fd < 0 || !common::read_file(segment->fd, &buffer)) {
+        LOG(WARNING, "[raft]: read segment %s failed", segment->path.c_str());
+        return false;
+    }
+    size_t offset = 0;
+    std::string payload;
+    std::vector<int64_t> record_terms;
+    while (offset < buffer.size()) {
+        size_t len = common::parse_record(buffer.data() + offset,
+                buffer.size() - offset, &payload);
+        int64_t first_index = 0;
+        record_terms.clear();
+        // only terms are needed to rebuild the index, entries are not decoded
+        if (len == 0 || !decode_terms(payload.data(), payload.size(), &first_index,
+                    &record_terms)) {
+            break;
+        }
+        // a record may overwrite the tail of the former one, see truncate_suffix
+        int64_t next_index = segment->first_index + static_cast<int64_t>(segment->offsets.size());
+        if (first_index < segment->first_index || first_index > next_index) {
+            break;
+        }
+        size_t drop = next_index - first_index;
+        segment->offsets.resize(segment->offsets.size() - drop);
+        segment->slots.resize(segment->slots.size() - drop);
+        terms->resize(terms->size() - drop);
+        for (size_t i = 0; i < record_terms.size(); ++i) {
+            segment->offsets.push_back(offset);
+            segment->slots.push_back(i);
+            terms->push_back(record_terms[i]);
+        }
+        offset += len;
+    }
+    if (offset != buffer.size()) {
+        if (!is_last) {
+            LOG(WARNING, "[raft]: segment %s is corrupted at %lu",
+                    segment->path.c_str(), offset);
+            return false;
+        }
+        // the tail was not completely written before crash
+        LOG(WARNING, "[raft]: truncate torn tail of %s at %lu",
+                segment->path.c_str(), offset);
+        if (ftruncate(segment->fd, offset) != 0) {
+            return false;
+        }
+    }
+    segment->size = offset;
+    return true;
+}
+
+bool RaftLog::create_segment(int64_t first_index) {
+    Segment segment;
+    segment.first_index = first_index;
+    segment.size = 0;
+    segment.path = segment_path(first_index);
+    segment.fd = ::open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (segment.fd < 0) {
+        LOG(WARNING, "[raft]: create segment %s failed: %s",
+                segment.path.c_str(), strerror(errno));
+        return false;
+    }
+    _segments.push_back(segment);
+    _last_index = first_index - 1;
+    return true;
+}
+
+void RaftLog::remove_segment(Segment* segment) {
+    close(segment->fd);
+    segment->fd = -1;
+    unlink(segment->path.c_str());
+}
+
+int64_t RaftLog::start_index() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _start_index;
+}
+
+int64_t RaftLog::start_term() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _start_term;
+}
+
+int64_t RaftLog::last_index() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _last_index;
+}
+
+int64_t RaftLog::last_term() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_last_index == _start_index) {
+        return _start_term;
+    }
+    return _terms.back();
+}
+
+int64_t RaftLog::term(int64_t index) const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (index == _start_index) {
+        return _start_term;
+    }
+    int64_t first = first_stored_index();
+    if (index < first || index > _last_index) {
+        return -1;
+    }
+    return _terms[index - first];
+}
+
+bool RaftLog::get(int64_t index, Entry* entry) const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return read_entry(index, entry);
+}
+
+bool RaftLog::get_range(int64_t from, int32_t max_count, int64_t max_bytes,
+        std::vector<Entry>* entries) const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    int64_t bytes = 0;
+    int64_t index = from;
+    std::vector<Entry> batch;
+    while (index <= _last_index && index < from + max_count && bytes < max_bytes) {
+        // every record is read and decoded only once
+        const Segment* segment = find_segment(index);
+        size_t pos = segment != nullptr ? index - segment->first_index : 0;
+        batch.clear();
+        if (segment == nullptr || !read_record(segment, pos, &batch)) {
+            return index != from;
+        }
+        for (size_t i = segment->slots[pos]; i < batch.size(); ++i) {
+            bytes += batch[i].ByteSize();
+            entries->push_back(Entry());
+            entries->back().Swap(&batch[i]);
+            ++index;
+            if (index > _last_index || index >= from + max_count || bytes >= max_bytes) {
+                break;
+            }
+        }
+    }
+    return !entries->empty() || from > _last_index;
+}
+
+bool RaftLog::get_records(int64_t from, int32_t max_count, int64_t max_bytes,
+        std::vector<EntryCache::record_t>* records, int64_t* count) const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    *count = 0;
+    int64_t bytes = 0;
+    int64_t index = from;
+    while (index <= _last_index) {
+        int64_t first_index = 0;
+        int64_t record_count = 0;
+        EntryCache::record_t record = _cache.get(index, &first_index, &record_count);
+        if (record == nullptr || first_index != index) {
+            break;
+        }
+        // the first record is always taken to make progress
+        if (!records->empty() && (*count + record_count > max_count
+                    || bytes + static_cast<int64_t>(record->size()) > max_bytes)) {
+            break;
+        }
+        records->push_back(record);
+        *count += record_count;
+        bytes += record->size();
+        index += record_count;
+    }
+    if (records->empty()) {
+        return false;
+    }
+    _cache.count_lookup(true);
+    return true;
+}
+
+EntryCacheStats RaftLog::cache_stats() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _cache.stats();
+}
+
+bool RaftLog::append(const std::vector<Entry>& entries) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    std::vector<Entry> batch;
+    int64_t batch_bytes = 0;
+    for (const auto& entry : entries) {
+        Segment* segment = &_segments.back();
+        if (batch.empty() && segment->size >= _options.segment_size) {
+            // current segment is full, it needs to be durable before rolling
+            if (fdatasync(segment->fd) != 0 || !create_segment(_last_index + 1)) {
+                return false;
+            }
+            segment = &_segments.back();
+        }
+        batch.push_back(entry);
+        batch_bytes += entry.ByteSize();
+        if (segment->size + batch_bytes >= _options.segment_size) {
+            if (!write_batch(segment, batch)) {
+                return false;
+            }
+            batch.clear();
+            batch_bytes = 0;
+        }
+    }
+    return batch.empty() || write_batch(&_segments.back(), batch);
+}
+
+bool RaftLog::write_batch(Segment* segment, const std::vector<Entry>& batch) {
+    std::string payload;
+    std::string buffer;
+    encode_entries(_last_index + 1, batch, _options.compression,
+            _options.min_compress_size, &payload);
+    common::append_record(payload, &buffer);
+    if (!common::write_file(segment->fd, buffer.data(), buffer.size(), segment->size)) {
+        LOG(WARNING, "[raft]: append log failed: %s", strerror(errno));
+        return false;
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+        segment->offsets.push_back(segment->size);
+        segment->slots.push_back(i);
+        _terms.push_back(batch[i].term());
+    }
+    segment->size += buffer.size();
+    _cache.put(_last_index + 1, batch.size(), payload);
+    _last_index += batch.size();
+    return true;
+}
+
+bool RaftLog::sync() {
+    int fd = -1;
+    int64_t index = 0;
+    uint64_t truncations = 0;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (_synced_index >= _last_index) {
+            return true;
+        }
+        // full segments are synced when rolling, only the active one is left.
+        // fd is duplicated in case the segment is removed while flushing
+        fd = dup(_segments.back().fd);
+        index = _last_index;
+        truncations = _truncations;
+    }
+    bool ok = fd >= 0 && fdatasync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!ok) {
+        LOG(WARNING, "[raft]: sync log failed: %s", strerror(errno));
+        return false;
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    // entries below index may have been rewritten after the flush started,
+    // they are left to the next sync
+    if (truncations == _truncations) {
+        _synced_index = std::max(_synced_index, std::min(index, _last_index));
+    }
+    return true;
+}
+
+int64_t RaftLog::synced_index() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _synced_index;
+}
+
+bool RaftLog::truncate_suffix(int64_t index) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (index >= _last_index) {
+        return true;
+    }
+    ++_truncations;
+    while (_segments.size() > 1 && _segments.back().first_index > index) {
+        remove_segment(&_segments.back());
+        _segments.pop_back();
+    }
+    _cache.truncate_suffix(index);
+    Segment* segment = &_segments.back();
+    size_t keep = static_cast<size_t>(std::max(index - segment->first_index + 1, 0L));
+    if (keep < segment->offsets.size()) {
+        // the record holding index is kept if some of its entries survive,
+        // they are written again in a new record overwriting the old one
+        size_t prefix = segment->slots[keep];
+        std::vector<Entry> batch;
+        if (prefix > 0 && !read_record(segment, keep, &batch)) {
+            return false;
+        }
+        batch.resize(prefix);
+        int64_t new_size = segment->offsets[keep];
+        if (prefix > 0) {
+            auto it = std::upper_bound(segment->offsets.begin(), segment->offsets.end(), new_size);
+            new_size = it != segment->offsets.end() ? *it : segment->size;
+        }
+        if (ftruncate(segment->fd, new_size) != 0) {
+            return false;
+        }
+        segment->offsets.resize(keep - prefix);
+        segment->slots.resize(keep - prefix);
+        segment->size = new_size;
+        _last_index = segment->first_index + static_cast<int64_t>(keep - prefix) - 1;
+        _terms.resize(_last_index - first_stored_index() + 1);
+        if (!batch.empty() && !write_batch(segment, batch)) {
+            return false;
+        }
+    }
+    _last_index = segment->first_index + static_cast<int64_t>(segment->offsets.size()) - 1;
+    _synced_index = std::min(_synced_index, _last_index);
+    _terms.resize(_last_index - first_stored_index() + 1);
+    return fdatasync(segment->fd) == 0;
+}
+
+bool RaftLog::truncate_prefix(int64_t index) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    // active segment is always kept
+    size_t drop = 0;
+    while (drop + 1 < _segments.size() && _segments[drop + 1].first_index - 1 <= index) {
+        ++drop;
+    }
+    if (drop == 0) {
+        return true;
+    }
+    int64_t first = first_stored_index();
+    int64_t new_start = _segments[drop].first_index - 1;
+    if (new_start > _start_index) {
+        _start_term = _terms[new_start - first];
+        _start_index = new_start;
+        // compaction point must be durable before any segment is dropped
+        if (!persist_state()) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < drop; ++i) {
+        remove_segment(&_segments.front());
+        _segments.pop_front();
+    }
+    _terms.erase(_terms.begin(), _terms.begin() + (first_stored_index() - first));
+    _cache.truncate_prefix(first_stored_index() - 1);
+    LOG(INFO, "[raft]: log compacted to %ld", _start_index);
+    return true;
+}
+
+bool RaftLog::reset(int64_t index, int64_t term) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _start_index = index;
+    _start_term = term;
+    if (!persist_state()) {
+        return false;
+    }
+    for (auto& segment : _segments) {
+        remove_segment(&segment);
+    }
+    _segments.clear();
+    _terms.clear();
+    _cache.clear();
+    _synced_index = index;
+    ++_truncations;
+    return create_segment(index + 1);
+}
+
+bool RaftLog::save_state(int64_t current_term, const std::string& voted_for) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _current_term = current_term;
+    _voted_for = voted_for;
+    return persist_state();
+}
+
+void RaftLog::load_state(int64_t* current_term, std::string* voted_for) const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    *current_term = _current_term;
+    *voted_for = _voted_for;
+}
+
+bool RaftLog::persist_state() {
+    serialize::RaftState state;
+    state.set_current_term(_current_term);
+    state.set_voted_for(_voted_for);
+    state.set_start_index(_start_index);
+    state.set_start_term(_start_term);
+    std::string payload;
+    std::string content;
+    if (!state.SerializeToString(&payload)) {
+        return false;
+    }
+    common::append_record(payload, &content);
+    if (!common::replace_file(_dir + "/" + s_state_file, content)) {
+        LOG(WARNING, "[raft]: persist raft state failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+const RaftLog::Segment* RaftLog::find_segment(int64_t index) const {
+    if (index < first_stored_index() || index > _last_index) {
+        return nullptr;
+    }
+    auto it = std::upper_bound(_segments.begin(), _segments.end(), index,
+            [](int64_t idx, const Segment& segment) {
+                return idx < segment.first_index;
+            });
+    return &*(--it);
+}
+
+bool RaftLog::read_entry(int64_t index, Entry* entry) const {
+    const Segment* segment = find_segment(index);
+    if (segment == nullptr) {
+        return false;
+    }
+    size_t pos = index - segment->first_index;
+    std::vector<Entry> batch;
+    if (!read_record(segment, pos, &batch)) {
+        return false;
+    }
+    entry->Swap(&batch[segment->slots[pos]]);
+    return true;
+}
+
+bool RaftLog::read_record(const Segment* segment, size_t pos, std::vector<Entry>* entries) const {
+    int64_t first_index = 0;
+    int64_t count = 0;
+    EntryCache::record_t record = _cache.get(segment->first_index + pos, &first_index, &count);
+    _cache.count_lookup(record != nullptr);
+    if (record != nullptr) {
+        return decode_entries(record->data(), record->size(), &first_index, entries)
+            && static_cast<int64_t>(entries->size()) > segment->slots[pos];
+    }
+    int64_t offset = segment->offsets[pos];
+    // entries of a record share the same offset, the next one starts a new record
+    auto it = std::upper_bound(segment->offsets.begin() + pos, segment->offsets.end(), offset);
+    int64_t end = it != segment->offsets.end() ? *it : segment->size;
+    std::string buffer(end - offset, '\0');
+    if (!common::read_file(segment->fd, &buffer[0], buffer.size(), offset)) {
+        return false;
+    }
+    std::string payload;
+    return common::parse_record(buffer.data(), buffer.size(), &payload) != 0
+        && decode_entries(payload.data(), payload.size(), &first_index, entries)
+        && static_cast<int64_t>(entries->size()) > segment->slots[pos];
+}
+
+std::string RaftLog::segment_path(int64_t first_index) const {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%020ld", s_segment_prefix, first_index);
+    return _dir + "/" + name;
+}
+
+int64_t RaftLog::first_stored_index() const {
+    return _segments.front().first_index;
+}
+
+} // namespace raft
+} // namespace orion
@@ -0,0 +1,152 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_RAFT_RAFT_LOG_H
+#define ORION_RAFT_RAFT_LOG_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "proto/raft.pb.h"
+#include "server/entry_codec.h"
+#include "server/entry_cache.h"
+
+namespace orion {
+namespace raft {
+
+struct RaftLogOptions {
+    // a new segment file is created when current one exceeds this size
+    int64_t segment_size;
+    // compression of entry batches, batches smaller than min_compress_size are not compressed
+    int32_t compression;
+    int32_t min_compress_size;
+    // memory budget of recently appended records kept in encoded form
+    int64_t cache_size;
+    // threads loading segments when the log is opened
+    int32_t load_threads;
+
+    RaftLogOptions() : segment_size(64L * 1024 * 1024), compression(COMPRESSION_SNAPPY),
+            min_compress_size(4096), cache_size(64L * 1024 * 1024), load_threads(4) { }
+};
+
+/**
+ * @brief Persistent raft log, together with the raft state (term and vote)
+ *
+ * Entries are appended to segment files named by the index of their first entry,
+ * entries of one append are written as a single compact batch record.
+ * Compaction drops whole segments whose entries are all covered by a snapshot,
+ * the last dropped index and term are kept as start_index and start_term.
+ * All methods are thread-safe.
+ */
+class RaftLog {
+public:
+    RaftLog(const std::string& dir, const RaftLogOptions& options = RaftLogOptions());
+    ~RaftLog();
+    /// disable copy and move for raft log
+    RaftLog(const RaftLog&) = delete;
+    void operator=(const RaftLog&) = delete;
+
+    /// loads raft state and all segments, a torn tail of the last segment is discarded
+    bool open();
+
+    /// index and term of the last entry dropped by compaction, 0 if none
+    int64_t start_index() const;
+    int64_t start_term() const;
+    /// index and term of the last entry, equal to start if the log is empty
+    int64_t last_index() const;
+    int64_t last_term() const;
+    /// returns the term of the entry at index, -1 if the entry is not available
+    int64_t term(int64_t index) const;
+    /// reads an entry, returns false if the entry is not available
+    bool get(int64_t index, Entry* entry) const;
+    /**
+     * @brief Reads consecutive entries
+     * @param from       [IN] index of the first entry
+     * @param max_count  [IN] max number of entries to read
+     * @param max_bytes  [IN] stop reading once entries exceed this size
+     * @param entries    [OUT] entries read
+     * @return           false if the first entry is not available
+     */
+    bool get_range(int64_t from, int32_t max_count, int64_t max_bytes,
+            std::vector<Entry>* entries) const;
+    /**
+     * @brief Reads consecutive encoded records from cache, without decoding them
+     * @param from       [IN] index of the first entry, must start a record
+     * @param max_count  [IN] records are added while total entries are no more than this
+     * @param max_bytes  [IN] records are added while total size is no more than this
+     * @param records    [OUT] records read, at least one if succeeded
+     * @param count      [OUT] number of entries in the records
+     * @return           false if the record starting from is not cached
+     */
+    bool get_records(int64_t from, int32_t max_count, int64_t max_bytes,
+            std::vector<EntryCache::record_t>* records, int64_t* count) const;
+    EntryCacheStats cache_stats() const;
+
+    /// appends entries after the last entry, sync needs to be called for durability
+    bool append(const std::vector<Entry>& entries);
+    /// flushes appended entries to disk, appending is not blocked while flushing
+    bool sync();
+    /// index of the last entry known to be durable
+    int64_t synced_index() const;
+    /// drops all the entries after index
+    bool truncate_suffix(int64_t index);
+    /// drops segments whose entries are all no greater than index
+    bool truncate_prefix(int64_t index);
+    /// drops all the entries and let the log start after index
+    bool reset(int64_t index, int64_t term);
+
+    /// persists current term and vote of the node
+    bool save_state(int64_t current_term, const std::string& voted_for);
+    void load_state(int64_t* current_term, std::string* voted_for) const;
+private:
+    struct Segment {
+        int64_t first_index;
+        int fd;
+        int64_t size;
+        // offset of the record holding every entry, and position of entry in the record
+        std::vector<int64_t> offsets;
+        std::vector<int32_t> slots;
+        std::string path;
+    };
+    /// rebuilds index of a segment, terms of its entries are returned
+    bool load_segment(Segment* segment, bool is_last, std::vector<int64_t>* terms);
+    /// writes entries following last entry as one record at the end of segment
+    bool write_batch(Segment* segment, const std::vector<Entry>& batch);
+    /// reads all the entries in the record holding entry at pos of segment
+    bool read_record(const Segment* segment, size_t pos, std::vector<Entry>* entries) const;
+    bool create_segment(int64_t first_index);
+    void remove_segment(Segment* segment);
+    bool persist_state();
+    /// returns the segment which holds the entry, nullptr if not exist
+    const Segment* find_segment(int64_t index) const;
+    bool read_entry(int64_t index, Entry* entry) const;
+    std::string segment_path(int64_t first_index) const;
+    /// index of the first entry physically stored
+    int64_t first_stored_index() const;
+private:
+    std::string _dir;
+    RaftLogOptions _options;
+    mutable std::mutex _mutex;
+    std::deque<Segment> _segments;
+    // term of every stored entry, starting from the first stored index
+    std::deque<int64_t> _terms;
+    int64_t _last_index;
+    int64_t _synced_index;
+    // bumped whenever entries are dropped from the tail, so that a flush
+    // started before does not count the entries written in their place
+    uint64_t _truncations;
+    int64_t _start_index;
+    int64_t _start_term;
+    int64_t _current_term;
+    std::string _voted_for;
+    EntryCache _cache;
+};
+
+} // namespace raft
+} // namespace orion
+
+#endif // ORION_RAFT_RAFT_LOG_H
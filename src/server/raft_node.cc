@@ -0,0 +1,843 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "raft_node.h"
+
+#include <algorithm>
+#include <chrono>
+#include "storage/data_store.h"
+#include "common/crc32.h"
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace raft {
+
+using std::placeholders::_1;
+using std::placeholders::_2;
+using std::placeholders::_3;
+using std::placeholders::_4;
+
+static RaftLogOptions get_log_options(const RaftOptions& options) {
+    RaftLogOptions log_options;
+    log_options.segment_size = options.log_segment_size;
+    log_options.compression = options.log_compression;
+    log_options.min_compress_size = options.log_min_compress_size;
+    log_options.cache_size = options.log_cache_size;
+    log_options.load_threads = options.log_load_threads;
+    return log_options;
+}
+
+/// number of entries carried by an append request, encoded or not
+static int64_t entry_count(const AppendEntriesRequest* request) {
+    return request->entry_batches_size() > 0 ? request->entry_count() : request->entries_size();
+}
+
+/// extracts entries of an append request, returns false if any batch is corrupted
+static bool unpack_entries(const AppendEntriesRequest* request, std::vector<Entry>* entries) {
+    if (request->entry_batches_size() == 0) {
+        entries->assign(request->entries().begin(), request->entries().end());
+        return true;
+    }
+    for (const auto& batch : request->entry_batches()) {
+        int64_t first_index = 0;
+        int64_t expected = request->prev_log_index() + static_cast<int64_t>(entries->size()) + 1;
+        if (!decode_entries(batch.data(), batch.size(), &first_index, entries)
+                || first_index != expected) {
+            return false;
+        }
+    }
+    return static_cast<int64_t>(entries->size()) == request->entry_count();
+}
+
+RaftNode::RaftNode(const RaftOptions& options, const RaftContext& context,
+        storage::DataStore* store, StateMachine* machine) :
+        _options(options), _store(store), _machine(machine),
+        _log(options.data_dir + "/log", get_log_options(options)),
+        _snapshots(options.data_dir + "/snapshot"),
+        _applier(&_log, machine, options.apply_batch_entries, options.apply_batch_bytes),
+        _pool(context.pool), _rpc(context.rpc), _batcher(context.batcher),
+        _role(ROLE_FOLLOWER), _current_term(0), _commit_index(0),
+        _votes(0), _last_contact(0), _election_timeout(0), _last_transfer(0),
+        _snapshotting(false), _syncing(false), _stop(false), _rpc_in_flight(0) { }
+
+RaftNode::~RaftNode() {
+    {
+        std::unique_lock<std::mutex> locker(_mutex);
+        _stop = true;
+        // callbacks use the node and the stubs of its peers
+        _rpc_done.wait(locker, [this] { return _rpc_in_flight == 0; });
+    }
+    _applier.stop();
+    for (auto& peer : _peers) {
+        delete peer.second.stub;
+    }
+}
+
+bool RaftNode::start() {
+    if (!_log.open() || !_snapshots.open()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    _log.load_state(&_current_term, &_voted_for);
+    // applied entries are persisted with the data, the latest snapshot is loaded
+    // only if storage lags behind it
+    int64_t applied_index = _machine->applied_index();
+    int64_t snapshot_index = _snapshots.last_index();
+    if (snapshot_index > applied_index) {
+        if (_snapshots.load(_store) != status_code::OK) {
+            LOG(WARNING, "[raft]: load snapshot %ld failed", snapshot_index);
+            return false;
+        }
+        applied_index = snapshot_index;
+    }
+    _commit_index = applied_index;
+    _applier.start(applied_index);
+    if (snapshot_index > 0) {
+        int64_t snapshot_term = _snapshots.last_term();
+        if (_log.term(snapshot_index) != snapshot_term
+                && !_log.reset(snapshot_index, snapshot_term)) {
+            return false;
+        }
+    }
+    int64_t applied_term = _machine->applied_term();
+    if (applied_index > _log.last_index() && applied_index > snapshot_index && applied_term > 0) {
+        // storage is ahead of a lost or damaged log, the log restarts after it
+        // instead of fetching a snapshot of what storage already has
+        LOG(WARNING, "[raft]: log ends at %ld behind applied %ld",
+                _log.last_index(), applied_index);
+        if (!_log.reset(applied_index, applied_term)) {
+            return false;
+        }
+    }
+    for (const auto& member : _options.members) {
+        if (member == _options.self) {
+            continue;
+        }
+        Peer& peer = _peers[member];
+        peer.addr = member;
+        _rpc->get_stub(member, &peer.stub);
+        peer.next_index = _log.last_index() + 1;
+        peer.match_index = 0;
+        peer.in_flight = false;
+        peer.snapshot_index = 0;
+        peer.snapshot_offset = 0;
+    }
+    _random.seed(std::hash<std::string>()(_options.self) ^ now_ms());
+    _last_contact = now_ms();
+    _election_timeout = random_timeout();
+    _pool->delay_task(_options.heartbeat_interval, std::bind(&RaftNode::check_election, this));
+    if (_batcher == nullptr) {
+        _pool->delay_task(_options.heartbeat_interval,
+                std::bind(&RaftNode::heartbeat_timer, this));
+    }
+    _pool->delay_task(_options.snapshot_interval, std::bind(&RaftNode::check_snapshot, this));
+    LOG(INFO, "[raft]: node %s of group %d started, term: %ld, applied: %ld",
+            _options.self.c_str(), _options.group_id, _current_term, applied_index);
+    return true;
+}
+
+void RaftNode::stop() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _stop = true;
+}
+
+int32_t RaftNode::propose(const Entry& entry, const done_func_t& done) {
+    return propose(entry, result_func_t([done](const ApplyResult& result) {
+        done(result.status);
+    }));
+}
+
+int32_t RaftNode::propose(const Entry& entry, const result_func_t& done) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_role != ROLE_LEADER) {
+        return status_code::NOT_LEADER;
+    }
+    std::vector<Entry> entries(1, entry);
+    entries[0].set_term(_current_term);
+    if (!_log.append(entries)) {
+        LOG(WARNING, "[raft]: leader failed to write log");
+        return status_code::DATABASE_ERROR;
+    }
+    // the entry cannot be applied before the lock is released
+    _applier.wait(_log.last_index(), _current_term, done);
+    // followers receive entries while leader is flushing them
+    request_sync();
+    for (auto& peer : _peers) {
+        replicate(&peer.second);
+    }
+    return status_code::OK;
+}
+
+bool RaftNode::is_leader() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _role == ROLE_LEADER;
+}
+
+std::string RaftNode::leader_id() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _leader_id;
+}
+
+int64_t RaftNode::current_term() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _current_term;
+}
+
+int64_t RaftNode::commit_index() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _commit_index;
+}
+
+int64_t RaftNode::applied_index() const {
+    return _applier.applied_index();
+}
+
+int64_t RaftNode::snapshot_index() const {
+    return _snapshots.last_index();
+}
+
+EntryCacheStats RaftNode::log_cache_stats() const {
+    return _log.cache_stats();
+}
+
+void RaftNode::set_apply_listener(const apply_listener_t& listener) {
+    _applier.set_listener(listener);
+}
+
+void RaftNode::handle_vote(const VoteRequest* request, VoteResponse* response) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (request->term() > _current_term) {
+        become_follower(request->term(), "");
+    }
+    bool granted = false;
+    if (request->term() == _current_term
+            && (_voted_for.empty() || _voted_for == request->candidate_id())) {
+        // only vote for a candidate whose log is at least as up-to-date as ours
+        int64_t last_term = _log.last_term();
+        if (request->last_log_term() > last_term || (request->last_log_term() == last_term
+                && request->last_log_index() >= _log.last_index())) {
+            granted = true;
+            _voted_for = request->candidate_id();
+            save_state();
+            _last_contact = now_ms();
+        }
+    }
+    response->set_term(_current_term);
+    response->set_granted(granted);
+}
+
+void RaftNode::handle_append(const AppendEntriesRequest* request,
+        AppendEntriesResponse* response) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    response->set_success(false);
+    if (request->term() < _current_term) {
+        response->set_current_term(_current_term);
+        response->set_log_length(_log.last_index());
+        return;
+    }
+    become_follower(request->term(), request->leader_id());
+    _last_contact = now_ms();
+    response->set_current_term(_current_term);
+    int64_t prev_index = request->prev_log_index();
+    std::vector<Entry> received;
+    if (!unpack_entries(request, &received)) {
+        LOG(WARNING, "[raft]: entry batch from %s is corrupted", request->leader_id().c_str());
+        response->set_log_length(_log.last_index());
+        return;
+    }
+    int64_t start_index = _log.start_index();
+    int64_t skip = 0;
+    if (prev_index > _log.last_index()) {
+        response->set_log_length(_log.last_index());
+        return;
+    } else if (prev_index < start_index) {
+        // entries before start are committed and covered by snapshot
+        skip = std::min(start_index - prev_index, static_cast<int64_t>(received.size()));
+        prev_index += skip;
+    } else if (_log.term(prev_index) != request->prev_log_term()) {
+        response->set_log_length(prev_index - 1);
+        return;
+    }
+    std::vector<Entry> entries;
+    int64_t index = prev_index;
+    int64_t last_index = _log.last_index();
+    for (size_t i = skip; i < received.size(); ++i) {
+        Entry& entry = received[i];
+        ++index;
+        if (entries.empty() && index <= last_index) {
+            if (_log.term(index) == entry.term()) {
+                continue;
+            }
+            // conflict entries and all that follow them are dropped
+            if (index <= _commit_index) {
+                LOG(FATAL, "[raft]: committed entry %ld conflicts with leader", index);
+            }
+            if (!_log.truncate_suffix(index - 1)) {
+                response->set_log_length(_log.last_index());
+                return;
+            }
+        }
+        entries.push_back(Entry());
+        entries.back().Swap(&entry);
+    }
+    if (!entries.empty() && (!_log.append(entries) || !_log.sync())) {
+        LOG(WARNING, "[raft]: follower failed to write log");
+        response->set_log_length(_log.last_index());
+        return;
+    }
+    int64_t last_new_index = prev_index + static_cast<int64_t>(received.size()) - skip;
+    if (request->commit_index() > _commit_index) {
+        _commit_index = std::max(_commit_index,
+                std::min(request->commit_index(), last_new_index));
+        _applier.commit(_commit_index);
+    }
+    response->set_success(true);
+    response->set_log_length(_log.last_index());
+}
+
+void RaftNode::handle_install_snapshot(const InstallSnapshotRequest* request,
+        InstallSnapshotResponse* response) {
+    int64_t index = request->last_included_index();
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        response->set_success(false);
+        if (request->term() < _current_term) {
+            response->set_term(_current_term);
+            return;
+        }
+        become_follower(request->term(), request->leader_id());
+        _last_contact = now_ms();
+        response->set_term(_current_term);
+        int64_t offset = request->offset();
+        int64_t chunk_end = offset + static_cast<int64_t>(request->data().size());
+        if (common::crc32c(request->data()) != request->checksum()) {
+            LOG(WARNING, "[raft]: snapshot chunk at %ld is corrupted", offset);
+            response->set_next_offset(offset);
+            return;
+        }
+        if (index <= _applier.applied_index()) {
+            // state machine has gone further, just drain the transfer
+            response->set_success(true);
+            response->set_next_offset(chunk_end);
+            return;
+        }
+        bool finished = false;
+        int64_t next_offset = _snapshots.write_chunk(index, offset,
+                request->data(), request->done(), &finished);
+        response->set_next_offset(next_offset);
+        if (next_offset != chunk_end) {
+            return;
+        }
+        if (!finished) {
+            response->set_success(true);
+            return;
+        }
+    }
+    // the state machine is replaced while no batch is being applied, without node lock,
+    // as waiting for the batch and notifying the waiters would hold up raft meanwhile
+    int32_t status = status_code::OK;
+    bool loaded = false;
+    _applier.exclusive([this, index, &status, &loaded](int64_t* applied_index) {
+        // a newer snapshot received meanwhile is loaded by its own request
+        if (index != _snapshots.last_index() || index <= *applied_index) {
+            return;
+        }
+        status = _snapshots.load(_store);
+        if (status == status_code::OK) {
+            *applied_index = index;
+            loaded = true;
+        }
+    });
+    if (status != status_code::OK) {
+        LOG(WARNING, "[raft]: failed to load snapshot %ld: %d", index, status);
+        // leader sends the snapshot again from the start
+        response->set_next_offset(0);
+        return;
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (loaded && index == _snapshots.last_index()) {
+        // keep the log following snapshot if it matches
+        int64_t term = request->last_included_term();
+        bool ok = _log.term(index) == term ? _log.truncate_prefix(index) : _log.reset(index, term);
+        if (!ok) {
+            LOG(FATAL, "[raft]: failed to compact log to %ld", index);
+        }
+        _commit_index = std::max(_commit_index, index);
+        LOG(INFO, "[raft]: snapshot %ld installed from %s",
+                index, request->leader_id().c_str());
+    }
+    response->set_success(true);
+}
+
+void RaftNode::handle_timeout_now(const TimeoutNowRequest* request,
+        TimeoutNowResponse* response) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    response->set_success(false);
+    if (request->term() == _current_term && _role == ROLE_FOLLOWER
+            && request->leader_id() == _leader_id) {
+        LOG(INFO, "[raft]: leadership of group %d is transferred from %s",
+                _options.group_id, request->leader_id().c_str());
+        start_election();
+        response->set_success(true);
+    }
+    response->set_term(_current_term);
+}
+
+void RaftNode::check_election() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return;
+    }
+    if (_role != ROLE_LEADER && now_ms() - _last_contact >= _election_timeout) {
+        start_election();
+    }
+    _pool->delay_task(_options.heartbeat_interval, std::bind(&RaftNode::check_election, this));
+}
+
+void RaftNode::heartbeat() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop || _role != ROLE_LEADER) {
+        return;
+    }
+    for (auto& peer : _peers) {
+        replicate(&peer.second);
+    }
+    transfer_leadership();
+}
+
+void RaftNode::heartbeat_timer() {
+    heartbeat();
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return;
+    }
+    _pool->delay_task(_options.heartbeat_interval, std::bind(&RaftNode::heartbeat_timer, this));
+}
+
+void RaftNode::check_snapshot() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (_stop) {
+        return;
+    }
+    if (!_snapshotting &&
+            _applier.applied_index() - _snapshots.last_index() >= _options.snapshot_min_entries) {
+        _snapshotting = true;
+        _pool->add_task(std::bind(&RaftNode::take_snapshot, this));
+    }
+    _pool->delay_task(_options.snapshot_interval, std::bind(&RaftNode::check_snapshot, this));
+}
+
+void RaftNode::take_snapshot() {
+    std::unique_ptr<storage::DataSnapshot> data;
+    int64_t index = 0;
+    int64_t term = 0;
+    // the view is taken between batches, so that it matches applied index
+    _applier.exclusive([this, &data, &index, &term](int64_t* applied_index) {
+        data.reset(_store->snapshot());
+        index = *applied_index;
+        term = _log.term(index);
+    });
+    // dumping is done without lock, which blocks neither writers nor replication
+    bool ok = term >= 0 && _snapshots.save(data.get(), index, term);
+    data.reset();
+    if (ok) {
+        _log.truncate_prefix(index - _options.snapshot_keep_entries);
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    _snapshotting = false;
+}
+
+void RaftNode::start_election() {
+    _role = ROLE_CANDIDATE;
+    ++_current_term;
+    _voted_for = _options.self;
+    _leader_id.clear();
+    save_state();
+    _votes = 1;
+    _last_contact = now_ms();
+    _election_timeout = random_timeout();
+    LOG(INFO, "[raft]: start election for term %ld", _current_term);
+    if (_votes * 2 > static_cast<int32_t>(_options.members.size())) {
+        become_leader();
+        return;
+    }
+    for (auto& peer : _peers) {
+        if (_stop) {
+            break;
+        }
+        VoteRequest* request = new VoteRequest();
+        VoteResponse* response = new VoteResponse();
+        request->set_term(_current_term);
+        request->set_candidate_id(_options.self);
+        request->set_last_log_term(_log.last_term());
+        request->set_last_log_index(_log.last_index());
+        request->set_group_id(_options.group_id);
+        std::function<void (const VoteRequest*, VoteResponse*, bool, int)> callback =
+            std::bind(&RaftNode::on_vote, this, _current_term, _1, _2, _3, _4);
+        begin_rpc();
+        _rpc->async_request(peer.second.stub, &Raft_Stub::vote, request, response,
+                callback, _options.rpc_timeout, 1);
+    }
+}
+
+void RaftNode::become_follower(int64_t term, const std::string& leader) {
+    if (term > _current_term) {
+        _current_term = term;
+        _voted_for.clear();
+        _leader_id.clear();
+        save_state();
+    }
+    if (_role != ROLE_FOLLOWER) {
+        LOG(INFO, "[raft]: step down as follower in term %ld", _current_term);
+    }
+    _role = ROLE_FOLLOWER;
+    if (!leader.empty()) {
+        _leader_id = leader;
+    }
+}
+
+void RaftNode::become_leader() {
+    LOG(INFO, "[raft]: become leader of term %ld", _current_term);
+    _role = ROLE_LEADER;
+    _leader_id = _options.self;
+    for (auto& peer : _peers) {
+        peer.second.next_index = _log.last_index() + 1;
+        peer.second.match_index = 0;
+        peer.second.snapshot_index = 0;
+        peer.second.snapshot_offset = 0;
+    }
+    // entries of previous terms are committed along with an entry of current term
+    Entry entry;
+    entry.set_term(_current_term);
+    entry.set_op(raft_op::NOP);
+    entry.set_key("");
+    entry.set_value("");
+    if (!_log.append(std::vector<Entry>(1, entry))) {
+        LOG(FATAL, "[raft]: leader failed to write log");
+    }
+    request_sync();
+    for (auto& peer : _peers) {
+        replicate(&peer.second);
+    }
+}
+
+void RaftNode::save_state() {
+    if (!_log.save_state(_current_term, _voted_for)) {
+        LOG(FATAL, "[raft]: failed to persist term %ld", _current_term);
+    }
+}
+
+void RaftNode::request_sync() {
+    // flushing requested while syncing will be done in the next round
+    if (!_syncing) {
+        _syncing = true;
+        _pool->add_task(std::bind(&RaftNode::sync_log, this));
+    }
+}
+
+void RaftNode::sync_log() {
+    // flushing is done without lock, replication and heartbeat go on meanwhile
+    bool ok = _log.sync();
+    std::lock_guard<std::mutex> locker(_mutex);
+    _syncing = false;
+    if (!ok) {
+        LOG(FATAL, "[raft]: leader failed to sync log");
+    }
+    if (_stop) {
+        return;
+    }
+    advance_commit();
+    if (_log.synced_index() < _log.last_index()) {
+        request_sync();
+    }
+}
+
+void RaftNode::replicate(Peer* peer) {
+    if (_stop || peer->in_flight) {
+        return;
+    }
+    int64_t prev_index = peer->next_index - 1;
+    int64_t prev_term = _log.term(prev_index);
+    if (prev_term < 0) {
+        // entries needed by follower have been compacted, send snapshot instead
+        int64_t index = _snapshots.last_index();
+        if (index == 0) {
+            LOG(WARNING, "[raft]: no snapshot for %s to catch up", peer->addr.c_str());
+            return;
+        }
+        if (peer->snapshot_index != index) {
+            LOG(INFO, "[raft]: start to send snapshot %ld to %s", index, peer->addr.c_str());
+            peer->snapshot_index = index;
+            peer->snapshot_offset = 0;
+        }
+        peer->in_flight = true;
+        // reading snapshot file is slow, leave it to pool
+        _pool->add_task(std::bind(&RaftNode::send_snapshot_chunk, this, peer->addr,
+                    index, _snapshots.last_term(), peer->snapshot_offset));
+        return;
+    }
+    AppendEntriesRequest* request = new AppendEntriesRequest();
+    AppendEntriesResponse* response = new AppendEntriesResponse();
+    request->set_term(_current_term);
+    request->set_leader_id(_options.self);
+    request->set_prev_log_index(prev_index);
+    request->set_prev_log_term(prev_term);
+    request->set_commit_index(_commit_index);
+    request->set_group_id(_options.group_id);
+    int64_t count = 0;
+    if (peer->next_index <= _log.last_index()) {
+        // recent entries are sent from cache as they are stored in log,
+        // older ones are read from disk and encoded again
+        std::vector<EntryCache::record_t> records;
+        if (_log.get_records(peer->next_index, _options.max_append_entries,
+                    _options.max_append_bytes, &records, &count)) {
+            for (const auto& record : records) {
+                request->add_entry_batches(*record);
+            }
+        } else {
+            std::vector<Entry> entries;
+            _log.get_range(peer->next_index, _options.max_append_entries,
+                    _options.max_append_bytes, &entries);
+            if (!entries.empty()) {
+                encode_entries(peer->next_index, entries, _options.log_compression,
+                        _options.log_min_compress_size, request->add_entry_batches());
+            }
+            count = entries.size();
+        }
+        request->set_entry_count(count);
+    }
+    peer->in_flight = true;
+    append_callback_t callback = std::bind(&RaftNode::on_append, this, peer->addr,
+            _1, _2, _3, _4);
+    begin_rpc();
+    if (_batcher != nullptr && count == 0) {
+        // heartbeats of all the groups are sent together by host
+        _batcher->add(peer->addr, request, response, callback);
+        return;
+    }
+    _rpc->async_request(peer->stub, &Raft_Stub::append, request, response,
+            callback, _options.rpc_timeout, 1);
+}
+
+void RaftNode::transfer_leadership() {
+    const std::string& target = _options.preferred_leader;
+    auto it = _peers.find(target);
+    if (_stop || it == _peers.end()
+            || now_ms() - _last_transfer < _options.election_timeout) {
+        return;
+    }
+    // only a follower which has all the entries is able to win the election
+    if (it->second.match_index != _log.last_index()) {
+        return;
+    }
+    _last_transfer = now_ms();
+    TimeoutNowRequest* request = new TimeoutNowRequest();
+    TimeoutNowResponse* response = new TimeoutNowResponse();
+    request->set_term(_current_term);
+    request->set_leader_id(_options.self);
+    request->set_group_id(_options.group_id);
+    std::function<void (const TimeoutNowRequest*, TimeoutNowResponse*, bool, int)> callback =
+        std::bind(&RaftNode::on_timeout_now, this, _1, _2, _3, _4);
+    begin_rpc();
+    _rpc->async_request(it->second.stub, &Raft_Stub::timeout_now, request, response,
+            callback, _options.rpc_timeout, 1);
+}
+
+void RaftNode::send_snapshot_chunk(const std::string& addr, int64_t index, int64_t term,
+        int64_t offset) {
+    std::string data;
+    bool done = false;
+    bool ok = _snapshots.read_chunk(index, offset, _options.snapshot_chunk_size, &data, &done);
+    std::lock_guard<std::mutex> locker(_mutex);
+    auto it = _peers.find(addr);
+    if (_stop || it == _peers.end()) {
+        return;
+    }
+    Peer* peer = &it->second;
+    if (!ok || _role != ROLE_LEADER) {
+        // snapshot may be replaced by a newer one, start over on next heartbeat
+        peer->in_flight = false;
+        peer->snapshot_index = 0;
+        return;
+    }
+    InstallSnapshotRequest* request = new InstallSnapshotRequest();
+    InstallSnapshotResponse* response = new InstallSnapshotResponse();
+    request->set_term(_current_term);
+    request->set_leader_id(_options.self);
+    request->set_last_included_index(index);
+    request->set_last_included_term(term);
+    request->set_offset(offset);
+    request->set_checksum(common::crc32c(data));
+    request->mutable_data()->swap(data);
+    request->set_done(done);
+    request->set_group_id(_options.group_id);
+    std::function<void (const InstallSnapshotRequest*, InstallSnapshotResponse*, bool, int)>
+        callback = std::bind(&RaftNode::on_install_snapshot, this, addr, _1, _2, _3, _4);
+    begin_rpc();
+    _rpc->async_request(peer->stub, &Raft_Stub::install_snapshot, request, response,
+            callback, _options.rpc_timeout, 1);
+}
+
+void RaftNode::on_vote(int64_t term, const VoteRequest* request,
+        VoteResponse* response, bool failed, int /*error*/) {
+    std::unique_ptr<const VoteRequest> request_guard(request);
+    std::unique_ptr<VoteResponse> response_guard(response);
+    std::lock_guard<std::mutex> locker(_mutex);
+    end_rpc();
+    if (_stop || failed) {
+        return;
+    }
+    if (response->term() > _current_term) {
+        become_follower(response->term(), "");
+        return;
+    }
+    if (_role != ROLE_CANDIDATE || term != _current_term || !response->granted()) {
+        return;
+    }
+    if (++_votes * 2 > static_cast<int32_t>(_options.members.size())) {
+        become_leader();
+    }
+}
+
+void RaftNode::on_append(const std::string& addr, const AppendEntriesRequest* request,
+        AppendEntriesResponse* response, bool failed, int /*error*/) {
+    std::unique_ptr<const AppendEntriesRequest> request_guard(request);
+    std::unique_ptr<AppendEntriesResponse> response_guard(response);
+    std::lock_guard<std::mutex> locker(_mutex);
+    end_rpc();
+    auto it = _peers.find(addr);
+    if (_stop || it == _peers.end()) {
+        return;
+    }
+    Peer* peer = &it->second;
+    peer->in_flight = false;
+    if (failed) {
+        // retry on next heartbeat
+        return;
+    }
+    if (response->current_term() > _current_term) {
+        become_follower(response->current_term(), "");
+        return;
+    }
+    if (_role != ROLE_LEADER || request->term() != _current_term || response->is_busy()) {
+        return;
+    }
+    if (response->success()) {
+        int64_t match_index = request->prev_log_index() + entry_count(request);
+        peer->match_index = std::max(peer->match_index, match_index);
+        peer->next_index = std::max(peer->next_index, match_index + 1);
+        advance_commit();
+    } else {
+        // log of follower does not match, step back and retry
+        int64_t next_index = request->prev_log_index();
+        if (response->has_log_length()) {
+            next_index = std::min(next_index, response->log_length() + 1);
+        }
+        peer->next_index = std::max(next_index, 1L);
+    }
+    if (peer->next_index <= _log.last_index()) {
+        replicate(peer);
+    }
+}
+
+void RaftNode::on_install_snapshot(const std::string& addr,
+        const InstallSnapshotRequest* request, InstallSnapshotResponse* response,
+        bool failed, int /*error*/) {
+    std::unique_ptr<const InstallSnapshotRequest> request_guard(request);
+    std::unique_ptr<InstallSnapshotResponse> response_guard(response);
+    std::lock_guard<std::mutex> locker(_mutex);
+    end_rpc();
+    auto it = _peers.find(addr);
+    if (_stop || it == _peers.end()) {
+        return;
+    }
+    Peer* peer = &it->second;
+    peer->in_flight = false;
+    if (failed) {
+        // resume from the same offset on next heartbeat
+        return;
+    }
+    if (response->term() > _current_term) {
+        become_follower(response->term(), "");
+        return;
+    }
+    if (_role != ROLE_LEADER || request->term() != _current_term
+            || peer->snapshot_index != request->last_included_index()) {
+        return;
+    }
+    int64_t chunk_end = request->offset() + static_cast<int64_t>(request->data().size());
+    if (response->has_next_offset() && response->next_offset() >= 0) {
+        peer->snapshot_offset = response->next_offset();
+    }
+    if (!response->success()) {
+        return;
+    }
+    if (request->done() && response->next_offset() == chunk_end) {
+        int64_t index = request->last_included_index();
+        LOG(INFO, "[raft]: snapshot %ld has been sent to %s", index, addr.c_str());
+        peer->match_index = std::max(peer->match_index, index);
+        peer->next_index = index + 1;
+        peer->snapshot_index = 0;
+        peer->snapshot_offset = 0;
+    }
+    replicate(peer);
+}
+
+void RaftNode::on_timeout_now(const TimeoutNowRequest* request,
+        TimeoutNowResponse* response, bool failed, int /*error*/) {
+    std::unique_ptr<const TimeoutNowRequest> request_guard(request);
+    std::unique_ptr<TimeoutNowResponse> response_guard(response);
+    std::lock_guard<std::mutex> locker(_mutex);
+    end_rpc();
+    if (_stop || failed) {
+        return;
+    }
+    if (response->term() > _current_term) {
+        become_follower(response->term(), "");
+    }
+}
+
+void RaftNode::begin_rpc() {
+    ++_rpc_in_flight;
+}
+
+void RaftNode::end_rpc() {
+    if (--_rpc_in_flight == 0 && _stop) {
+        _rpc_done.notify_all();
+    }
+}
+
+void RaftNode::advance_commit() {
+    if (_role != ROLE_LEADER) {
+        return;
+    }
+    // leader itself counts only durable entries
+    std::vector<int64_t> match_indexes(1, _log.synced_index());
+    for (const auto& peer : _peers) {
+        match_indexes.push_back(peer.second.match_index);
+    }
+    // the index in the middle has been replicated to majority
+    std::sort(match_indexes.begin(), match_indexes.end(), std::greater<int64_t>());
+    int64_t index = match_indexes[match_indexes.size() / 2];
+    // only entries of current term are committed by counting replicas
+    if (index > _commit_index && _log.term(index) == _current_term) {
+        _commit_index = index;
+        _applier.commit(_commit_index);
+    }
+}
+
+int64_t RaftNode::random_timeout() const {
+    return _options.election_timeout + _random() % _options.election_timeout;
+}
+
+int64_t RaftNode::now_ms() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace raft
+} // namespace orion
@@ -0,0 +1,254 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_RAFT_RAFT_NODE_H
+#define ORION_RAFT_RAFT_NODE_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <random>
+#include "proto/raft.pb.h"
+#include "server/raft_log.h"
+#include "server/snapshot.h"
+#include "server/apply_queue.h"
+#include "server/heartbeat_batcher.h"
+#include "common/thread_pool.h"
+#include "common/rpc_client.h"
+
+namespace orion {
+
+namespace storage {
+
+class DataStore; // forward declaration
+
+} // namespace storage
+
+namespace raft {
+
+enum RaftRole {
+    ROLE_FOLLOWER = 0,
+    ROLE_CANDIDATE = 1,
+    ROLE_LEADER = 2,
+};
+
+struct RaftOptions {
+    // id of the raft group, carried by all the raft rpc
+    int32_t group_id;
+    // address of current node, used as node id
+    std::string self;
+    // addresses of all the members, including current node
+    std::vector<std::string> members;
+    // leadership is moved to this member once it catches up, empty for no preference
+    std::string preferred_leader;
+    // log and snapshot are saved under this directory
+    std::string data_dir;
+    // election starts if no leader is heard in a random time in [timeout, 2 * timeout)
+    int32_t election_timeout;
+    int32_t heartbeat_interval;
+    // timeout of raft rpc in seconds
+    int32_t rpc_timeout;
+    // max entries and bytes carried by a single append request
+    int32_t max_append_entries;
+    int64_t max_append_bytes;
+    int64_t log_segment_size;
+    // compression of entries in log and append requests, see EntryCompression
+    int32_t log_compression;
+    int32_t log_min_compress_size;
+    // memory budget of recent log entries cached for replication
+    int64_t log_cache_size;
+    // threads rebuilding the index of log segments on start
+    int32_t log_load_threads;
+    // interval to check whether a snapshot is needed, all in milliseconds
+    int64_t snapshot_interval;
+    // a snapshot is taken only if enough entries are applied since last one
+    int64_t snapshot_min_entries;
+    // entries kept in log after compaction, so that slightly lagged followers
+    // can still catch up by log replication
+    int64_t snapshot_keep_entries;
+    int32_t snapshot_chunk_size;
+    // max entries and bytes written to state machine in a single batch
+    int32_t apply_batch_entries;
+    int64_t apply_batch_bytes;
+    // block cache of the storage of every group, and number of hot keys
+    // read into it after restart
+    int64_t store_block_cache_size;
+    int32_t hot_key_num;
+    int32_t thread_num;
+
+    RaftOptions() : group_id(0), election_timeout(1000), heartbeat_interval(100), rpc_timeout(2),
+            max_append_entries(1000), max_append_bytes(4L * 1024 * 1024),
+            log_segment_size(64L * 1024 * 1024), log_compression(COMPRESSION_SNAPPY),
+            log_min_compress_size(4096), log_cache_size(64L * 1024 * 1024),
+            log_load_threads(4), snapshot_interval(60 * 1000),
+            snapshot_min_entries(100000), snapshot_keep_entries(10000),
+            snapshot_chunk_size(1024 * 1024), apply_batch_entries(1000),
+            apply_batch_bytes(16L * 1024 * 1024), store_block_cache_size(8L * 1024 * 1024),
+            hot_key_num(10000), thread_num(10) { }
+};
+
+/// resources shared by all the raft groups in a process
+struct RaftContext {
+    common::ThreadPool* pool;
+    rpc::RpcClient* rpc;
+    // heartbeats are batched by the host if not null,
+    // and node sends heartbeats only when heartbeat is called
+    HeartbeatBatcher* batcher;
+
+    RaftContext() : pool(nullptr), rpc(nullptr), batcher(nullptr) { }
+};
+
+/**
+ * @brief Consensus core of a raft group
+ *
+ * RaftNode keeps the log and snapshot of the state machine, elects leader,
+ * replicates entries to followers and hands committed entries to ApplyQueue.
+ * A follower falls behind the compacted log is rebuilt by streaming
+ * the latest snapshot to it.
+ */
+class RaftNode {
+public:
+    /// RaftNode neither owns nor releases the store, the state machine upon it
+    /// and the shared context, pool in context should be stopped before node is deleted
+    RaftNode(const RaftOptions& options, const RaftContext& context,
+            storage::DataStore* store, StateMachine* machine);
+    /// waits for the callbacks of all the rpc sent, heartbeats queued in batcher
+    /// need to be cancelled first
+    ~RaftNode();
+    /// disable copy and move for raft node
+    RaftNode(const RaftNode&) = delete;
+    void operator=(const RaftNode&) = delete;
+
+    /// recovers from disk and starts timers
+    bool start();
+    /// sends no more rpc, rpc in flight still call back until node is deleted
+    void stop();
+
+    /**
+     * @brief Appends an entry to the log of leader and replicates it,
+     *        local flushing runs in parallel with replication
+     *        and leader counts itself in quorum only after flushed
+     * @param entry  [IN] entry to propose, term will be filled by leader
+     * @param done   [IN] called with the apply status once the entry is applied,
+     *                    not called if proposing fails
+     * @return       NOT_LEADER if current node is not leader
+     */
+    int32_t propose(const Entry& entry, const done_func_t& done);
+    /// same as above, done receives status of every operation of a batch entry
+    int32_t propose(const Entry& entry, const result_func_t& done);
+    /// registers the observer of applied entries
+    void set_apply_listener(const apply_listener_t& listener);
+
+    /// sends heartbeats to followers if current node is leader
+    void heartbeat();
+
+    bool is_leader() const;
+    std::string leader_id() const;
+    int64_t current_term() const;
+    int64_t commit_index() const;
+    int64_t applied_index() const;
+    /// index of the latest snapshot, 0 if there is none
+    int64_t snapshot_index() const;
+    /// hit rate of the log cache when serving followers
+    EntryCacheStats log_cache_stats() const;
+
+    /// handlers of raft rpc, called by RaftService
+    void handle_vote(const VoteRequest* request, VoteResponse* response);
+    void handle_append(const AppendEntriesRequest* request, AppendEntriesResponse* response);
+    void handle_install_snapshot(const InstallSnapshotRequest* request,
+            InstallSnapshotResponse* response);
+    void handle_timeout_now(const TimeoutNowRequest* request, TimeoutNowResponse* response);
+private:
+    /// replication state of a follower kept by leader
+    struct Peer {
+        std::string addr;
+        Raft_Stub* stub;
+        int64_t next_index;
+        int64_t match_index;
+        // only one request is sent to a follower at a time
+        bool in_flight;
+        // the snapshot being sent and offset of the next chunk
+        int64_t snapshot_index;
+        int64_t snapshot_offset;
+    };
+
+    void check_election();
+    void heartbeat_timer();
+    void check_snapshot();
+    /// takes a snapshot in background, and compacts the log then
+    void take_snapshot();
+
+    void start_election();
+    void become_follower(int64_t term, const std::string& leader);
+    void become_leader();
+    /// persists current term and vote
+    void save_state();
+    /// flushes log of leader in background
+    void request_sync();
+    void sync_log();
+
+    void replicate(Peer* peer);
+    /// moves leadership to the preferred member if it is up to date
+    void transfer_leadership();
+    void send_snapshot_chunk(const std::string& addr, int64_t index, int64_t term,
+            int64_t offset);
+    void on_vote(int64_t term, const VoteRequest* request,
+            VoteResponse* response, bool failed, int error);
+    void on_append(const std::string& addr, const AppendEntriesRequest* request,
+            AppendEntriesResponse* response, bool failed, int error);
+    void on_install_snapshot(const std::string& addr, const InstallSnapshotRequest* request,
+            InstallSnapshotResponse* response, bool failed, int error);
+    void on_timeout_now(const TimeoutNowRequest* request, TimeoutNowResponse* response,
+            bool failed, int error);
+
+    /// counts an rpc about to be sent, called with mutex locked
+    void begin_rpc();
+    /// called by every rpc callback with mutex locked
+    void end_rpc();
+    void advance_commit();
+    int64_t random_timeout() const;
+    int64_t now_ms() const;
+private:
+    RaftOptions _options;
+    storage::DataStore* _store;
+    StateMachine* _machine;
+    RaftLog _log;
+    SnapshotManager _snapshots;
+    ApplyQueue _applier;
+    common::ThreadPool* _pool;
+    rpc::RpcClient* _rpc;
+    HeartbeatBatcher* _batcher;
+
+    /// protects all the states below
+    mutable std::mutex _mutex;
+    RaftRole _role;
+    int64_t _current_term;
+    std::string _voted_for;
+    std::string _leader_id;
+    int64_t _commit_index;
+    int32_t _votes;
+    int64_t _last_contact;
+    int64_t _election_timeout;
+    int64_t _last_transfer;
+    mutable std::default_random_engine _random;
+    bool _snapshotting;
+    // true if log of leader is being flushed
+    bool _syncing;
+    bool _stop;
+    // rpc whose callbacks have not run yet, waited by destructor
+    int32_t _rpc_in_flight;
+    std::condition_variable _rpc_done;
+    std::map<std::string, Peer> _peers;
+};
+
+} // namespace raft
+} // namespace orion
+
+#endif // ORION_RAFT_RAFT_NODE_H
@@ -6,21 +6,93 @@
 
 #include "raft_service.h"
 
+#include "server/raft_node.h"
+
 namespace orion {
 namespace raft {
 
+RaftService::RaftService(const std::vector<RaftNode*>& nodes) : _nodes(nodes) { }
+
+RaftService::~RaftService() { }
+
 void RaftService::append(::google::protobuf::RpcController* controller,
                          const AppendEntriesRequest* request,
                          AppendEntriesResponse* response,
                          ::google::protobuf::Closure* done) {
+    RaftNode* node = find_node(request->group_id());
+    if (node == nullptr) {
+        controller->SetFailed("unknown raft group");
+    } else {
+        node->handle_append(request, response);
+    }
+    done->Run();
 }
 
 void RaftService::vote(::google::protobuf::RpcController* controller,
                        const VoteRequest* request,
                        VoteResponse* response,
                        ::google::protobuf::Closure* done) {
+    RaftNode* node = find_node(request->group_id());
+    if (node == nullptr) {
+        controller->SetFailed("unknown raft group");
+    } else {
+        node->handle_vote(request, response);
+    }
+    done->Run();
+}
+
+void RaftService::install_snapshot(::google::protobuf::RpcController* controller,
+                                   const InstallSnapshotRequest* request,
+                                   InstallSnapshotResponse* response,
+                                   ::google::protobuf::Closure* done) {
+    RaftNode* node = find_node(request->group_id());
+    if (node == nullptr) {
+        controller->SetFailed("unknown raft group");
+    } else {
+        node->handle_install_snapshot(request, response);
+    }
+    done->Run();
+}
+
+void RaftService::heartbeat(::google::protobuf::RpcController* /*controller*/,
+                            const BatchHeartbeatRequest* request,
+                            BatchHeartbeatResponse* response,
+                            ::google::protobuf::Closure* done) {
+    for (int i = 0; i < request->requests_size(); ++i) {
+        const AppendEntriesRequest& append = request->requests(i);
+        AppendEntriesResponse* append_response = response->add_responses();
+        RaftNode* node = find_node(append.group_id());
+        if (node == nullptr) {
+            // leader ignores a busy response, no state is changed
+            append_response->set_current_term(0);
+            append_response->set_success(false);
+            append_response->set_is_busy(true);
+            continue;
+        }
+        node->handle_append(&append, append_response);
+    }
+    done->Run();
+}
+
+void RaftService::timeout_now(::google::protobuf::RpcController* controller,
+                              const TimeoutNowRequest* request,
+                              TimeoutNowResponse* response,
+                              ::google::protobuf::Closure* done) {
+    RaftNode* node = find_node(request->group_id());
+    if (node == nullptr) {
+        controller->SetFailed("unknown raft group");
+    } else {
+        node->handle_timeout_now(request, response);
+    }
+    done->Run();
+}
+
+RaftNode* RaftService::find_node(int32_t group_id) const {
+    if (group_id < 0 || group_id >= static_cast<int32_t>(_nodes.size())) {
+        return nullptr;
+    }
+    return _nodes[group_id];
 }
 
 } // namespace raft
 } // namespace orion
-
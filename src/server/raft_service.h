@@ -6,14 +6,20 @@
 
 #ifndef ORION_RAFT_RAFT_SERVICE_H
 #define ORION_RAFT_RAFT_SERVICE_H
+#include <vector>
 #include "proto/raft.pb.h"
 
 namespace orion {
 namespace raft {
 
+class RaftNode; // forward declaration
+
+/// RPC entry of raft, all the requests are handed to RaftNode
+/// dispatches raft rpc to the nodes of all the groups hosted by current process
 class RaftService : public Raft {
 public:
-    RaftService();
+    /// RaftService does not own the nodes, node of group i is nodes[i]
+    RaftService(const std::vector<RaftNode*>& nodes);
     virtual ~RaftService();
 
     virtual void append(::google::protobuf::RpcController* controller,
@@ -24,10 +30,26 @@ public:
                       const VoteRequest* request,
                       VoteResponse* response,
                       ::google::protobuf::Closure* done);
+    virtual void install_snapshot(::google::protobuf::RpcController* controller,
+                                  const InstallSnapshotRequest* request,
+                                  InstallSnapshotResponse* response,
+                                  ::google::protobuf::Closure* done);
+    virtual void heartbeat(::google::protobuf::RpcController* controller,
+                           const BatchHeartbeatRequest* request,
+                           BatchHeartbeatResponse* response,
+                           ::google::protobuf::Closure* done);
+    virtual void timeout_now(::google::protobuf::RpcController* controller,
+                             const TimeoutNowRequest* request,
+                             TimeoutNowResponse* response,
+                             ::google::protobuf::Closure* done);
+private:
+    /// returns nullptr if the group is not hosted here
+    RaftNode* find_node(int32_t group_id) const;
+private:
+    std::vector<RaftNode*> _nodes;
 };
 
 } // namespace raft
 } // namespace orion
 
 #endif // ORION_RAFT_RAFT_SERVICE_H
-
@@ -0,0 +1,329 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include "proto/serialize.pb.h"
+#include "storage/data_store.h"
+#include "common/record_io.h"
+#include "common/file_util.h"
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace raft {
+
+static const char* s_snapshot_prefix = "snapshot_";
+static const char* s_recv_suffix = ".recv";
+static const size_t s_write_buffer_size = 1024 * 1024;
+
+/// SnapshotReader reads records of a snapshot file one by one
+class SnapshotReader : public storage::DataSnapshot {
+public:
+    SnapshotReader(const std::string& path) : _fp(fopen(path.c_str(), "rb")) { }
+    virtual ~SnapshotReader() {
+        if (_fp != nullptr) {
+            fclose(_fp);
+        }
+    }
+
+    bool read_meta(serialize::SnapshotMeta* meta) {
+        return read_record() && meta->ParseFromString(_payload);
+    }
+
+    virtual bool next(std::string& ns, std::string& key, std::string& value) {
+        if (!read_record() || !_record.ParseFromString(_payload)) {
+            return false;
+        }
+        ns = _record.ns();
+        key = _record.key();
+        value = _record.value();
+        return true;
+    }
+private:
+    bool read_record() {
+        char header[common::RECORD_HEADER_SIZE];
+        if (_fp == nullptr || fread(header, 1, sizeof(header), _fp) != sizeof(header)) {
+            return false;
+        }
+        _buffer.assign(header, sizeof(header));
+        _buffer.resize(sizeof(header) + common::decode_fixed32(header));
+        size_t len = _buffer.size() - sizeof(header);
+        if (len != 0 && fread(&_buffer[sizeof(header)], 1, len, _fp) != len) {
+            return false;
+        }
+        return common::parse_record(_buffer.data(), _buffer.size(), &_payload) != 0;
+    }
+private:
+    FILE* _fp;
+    std::string _buffer;
+    std::string _payload;
+    serialize::SnapshotRecord _record;
+};
+
+SnapshotManager::SnapshotManager(const std::string& dir) :
+        _dir(dir), _last_index(0), _last_term(0), _recv_index(0), _recv_size(0) { }
+
+bool SnapshotManager::open() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (!common::make_dirs(_dir)) {
+        LOG(WARNING, "[snapshot]: create dir %s failed", _dir.c_str());
+        return false;
+    }
+    DIR* dir = opendir(_dir.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    std::vector<std::string> names;
+    for (struct dirent* ent = readdir(dir); ent != nullptr; ent = readdir(dir)) {
+        const std::string name(ent->d_name);
+        if (name.compare(0, strlen(s_snapshot_prefix), s_snapshot_prefix) == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    for (const auto& name : names) {
+        const std::string& path = _dir + "/" + name;
+        int64_t index = atol(name.c_str() + strlen(s_snapshot_prefix));
+        int64_t term = 0;
+        if (name.find('.') != std::string::npos) {
+            // a half-received snapshot is kept so that receiving can be resumed
+            if (path == snapshot_path(index) + s_recv_suffix && index > _recv_index) {
+                struct stat st;
+                if (stat(path.c_str(), &st) == 0) {
+                    _recv_index = index;
+                    _recv_size = st.st_size;
+                }
+            }
+            continue;
+        }
+        if (index > _last_index && read_meta(path, &index, &term)) {
+            _last_index = index;
+            _last_term = term;
+        }
+    }
+    // drops outdated and unfinished files
+    for (const auto& name : names) {
+        const std::string& path = _dir + "/" + name;
+        if (path != snapshot_path(_last_index) &&
+                path != snapshot_path(_recv_index) + s_recv_suffix) {
+            unlink(path.c_str());
+        }
+    }
+    if (_recv_index <= _last_index) {
+        _recv_index = 0;
+        _recv_size = 0;
+    }
+    LOG(INFO, "[snapshot]: latest snapshot index: %ld, term: %ld", _last_index, _last_term);
+    return true;
+}
+
+int64_t SnapshotManager::last_index() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _last_index;
+}
+
+int64_t SnapshotManager::last_term() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _last_term;
+}
+
+bool SnapshotManager::save(storage::DataSnapshot* data, int64_t index, int64_t term) {
+    const std::string& tmp_path = snapshot_path(index) + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG(WARNING, "[snapshot]: create %s failed: %s", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    serialize::SnapshotMeta meta;
+    meta.set_last_included_index(index);
+    meta.set_last_included_term(term);
+    std::string buffer;
+    std::string payload;
+    meta.SerializeToString(&payload);
+    common::append_record(payload, &buffer);
+    int64_t offset = 0;
+    int64_t count = 0;
+    bool ok = true;
+    serialize::SnapshotRecord record;
+    std::string ns;
+    std::string key;
+    std::string value;
+    while (ok && data->next(ns, key, value)) {
+        record.set_ns(ns);
+        record.set_key(key);
+        record.set_value(value);
+        record.SerializeToString(&payload);
+        common::append_record(payload, &buffer);
+        ++count;
+        if (buffer.size() >= s_write_buffer_size) {
+            ok = common::write_file(fd, buffer.data(), buffer.size(), offset);
+            offset += buffer.size();
+            buffer.clear();
+        }
+    }
+    ok = ok && common::write_file(fd, buffer.data(), buffer.size(), offset) && fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        LOG(WARNING, "[snapshot]: write %s failed: %s", tmp_path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    std::lock_guard<std::mutex> locker(_mutex);
+    if (index <= _last_index) {
+        // a newer snapshot has been installed from leader meanwhile
+        unlink(tmp_path.c_str());
+        return true;
+    }
+    if (!install(tmp_path, index)) {
+        return false;
+    }
+    _last_term = term;
+    LOG(INFO, "[snapshot]: snapshot saved, index: %ld, term: %ld, records: %ld, size: %ld",
+            index, term, count, offset + static_cast<int64_t>(buffer.size()));
+    return true;
+}
+
+int32_t SnapshotManager::load(storage::DataStore* store) const {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (_last_index == 0) {
+            return status_code::NOT_FOUND;
+        }
+        path = snapshot_path(_last_index);
+    }
+    SnapshotReader reader(path);
+    serialize::SnapshotMeta meta;
+    if (!reader.read_meta(&meta)) {
+        return status_code::INVALID;
+    }
+    int32_t ret = store->restore(&reader, common::INTERNAL_NS, common::APPLIED_INDEX_KEY);
+    LOG(INFO, "[snapshot]: load snapshot %ld, status: %d", meta.last_included_index(), ret);
+    return ret;
+}
+
+bool SnapshotManager::read_chunk(int64_t index, int64_t offset, int32_t max_size,
+        std::string* data, bool* done) const {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (index != _last_index || index == 0) {
+            return false;
+        }
+        path = snapshot_path(index);
+    }
+    // the file may be replaced by a newer snapshot, but an opened file is always readable
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && offset <= st.st_size;
+    if (ok) {
+        data->resize(std::min(static_cast<int64_t>(max_size), st.st_size - offset));
+        ok = data->empty() || common::read_file(fd, &(*data)[0], data->size(), offset);
+        *done = offset + static_cast<int64_t>(data->size()) >= st.st_size;
+    }
+    close(fd);
+    return ok;
+}
+
+int64_t SnapshotManager::write_chunk(int64_t index, int64_t offset,
+        const std::string& data, bool done, bool* finished) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    *finished = false;
+    if (index != _recv_index) {
+        // leader starts to send another snapshot, drop the old one
+        if (_recv_index != 0) {
+            unlink((snapshot_path(_recv_index) + s_recv_suffix).c_str());
+        }
+        _recv_index = index;
+        _recv_size = 0;
+    }
+    if (offset != _recv_size) {
+        // ask leader to resume from where we are
+        return _recv_size;
+    }
+    const std::string& recv_path = snapshot_path(index) + s_recv_suffix;
+    int fd = ::open(recv_path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    bool ok = common::write_file(fd, data.data(), data.size(), offset)
+        && (!done || fsync(fd) == 0);
+    close(fd);
+    if (!ok) {
+        LOG(WARNING, "[snapshot]: write %s failed: %s", recv_path.c_str(), strerror(errno));
+        return -1;
+    }
+    _recv_size += data.size();
+    if (!done) {
+        return _recv_size;
+    }
+    int64_t meta_index = 0;
+    int64_t meta_term = 0;
+    if (!read_meta(recv_path, &meta_index, &meta_term) || meta_index != index) {
+        LOG(WARNING, "[snapshot]: received snapshot %ld is invalid", index);
+        unlink(recv_path.c_str());
+        _recv_size = 0;
+        return 0;
+    }
+    if (!install(recv_path, index)) {
+        return -1;
+    }
+    _last_term = meta_term;
+    _recv_index = 0;
+    _recv_size = 0;
+    *finished = true;
+    LOG(INFO, "[snapshot]: snapshot %ld received", index);
+    return offset + static_cast<int64_t>(data.size());
+}
+
+std::string SnapshotManager::snapshot_path(int64_t index) const {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%020ld", s_snapshot_prefix, index);
+    return _dir + "/" + name;
+}
+
+bool SnapshotManager::read_meta(const std::string& path, int64_t* index, int64_t* term) const {
+    SnapshotReader reader(path);
+    serialize::SnapshotMeta meta;
+    if (!reader.read_meta(&meta)) {
+        return false;
+    }
+    *index = meta.last_included_index();
+    *term = meta.last_included_term();
+    return true;
+}
+
+bool SnapshotManager::install(const std::string& tmp_path, int64_t index) {
+    const std::string& path = snapshot_path(index);
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOG(WARNING, "[snapshot]: install %s failed: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    // the old snapshot and the log it covers go only after the rename is durable
+    if (!common::sync_dir(_dir)) {
+        LOG(WARNING, "[snapshot]: sync %s failed: %s", _dir.c_str(), strerror(errno));
+        return false;
+    }
+    if (_last_index != 0 && _last_index != index) {
+        unlink(snapshot_path(_last_index).c_str());
+    }
+    _last_index = index;
+    return true;
+}
+
+} // namespace raft
+} // namespace orion
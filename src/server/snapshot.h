@@ -0,0 +1,100 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_RAFT_SNAPSHOT_H
+#define ORION_RAFT_SNAPSHOT_H
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+namespace orion {
+
+namespace storage {
+
+// forward declarations
+class DataStore;
+class DataSnapshot;
+
+} // namespace storage
+
+namespace raft {
+
+/**
+ * @brief Manages snapshot files of the state machine
+ *
+ * A snapshot file is a sequence of framed records, the first is SnapshotMeta
+ * and the following are SnapshotRecord. Only the latest snapshot is kept.
+ * Files are transferred between nodes as opaque chunks, receiving side writes
+ * chunks to a temporary file which turns into a snapshot when completed.
+ * All methods are thread-safe.
+ */
+class SnapshotManager {
+public:
+    SnapshotManager(const std::string& dir);
+    ~SnapshotManager() { }
+    /// disable copy and move for snapshot manager
+    SnapshotManager(const SnapshotManager&) = delete;
+    void operator=(const SnapshotManager&) = delete;
+
+    /// finds the latest snapshot and cleans up outdated files
+    bool open();
+    /// index and term of the latest snapshot, 0 if there is no snapshot
+    int64_t last_index() const;
+    int64_t last_term() const;
+
+    /**
+     * @brief Dumps a data snapshot into a new snapshot file, slow and better run in background
+     * @param data   [IN] consistent view of the state machine
+     * @param index  [IN] the last log index applied to the view
+     * @param term   [IN] term of the entry at index
+     * @return       true if the snapshot is durable
+     */
+    bool save(storage::DataSnapshot* data, int64_t index, int64_t term);
+    /// replaces the data in store with the latest snapshot
+    int32_t load(storage::DataStore* store) const;
+
+    /**
+     * @brief Reads a chunk from the latest snapshot file
+     * @param index     [IN] index of the snapshot to read
+     * @param offset    [IN] offset in the snapshot file
+     * @param max_size  [IN] max size of the chunk
+     * @param data      [OUT] chunk data
+     * @param done      [OUT] true if the chunk reaches the end of the file
+     * @return          false if the snapshot is outdated or read failed
+     */
+    bool read_chunk(int64_t index, int64_t offset, int32_t max_size,
+            std::string* data, bool* done) const;
+    /**
+     * @brief Receives a chunk of snapshot from leader
+     * @param index     [IN] index of the snapshot being received
+     * @param offset    [IN] offset of the chunk in the snapshot file
+     * @param data      [IN] chunk data
+     * @param done      [IN] true if this is the last chunk
+     * @param finished  [OUT] true if the snapshot is completely received
+     * @return          the offset expected for the next chunk, -1 on io error
+     */
+    int64_t write_chunk(int64_t index, int64_t offset, const std::string& data,
+            bool done, bool* finished);
+private:
+    std::string snapshot_path(int64_t index) const;
+    /// reads meta of a snapshot file
+    bool read_meta(const std::string& path, int64_t* index, int64_t* term) const;
+    /// makes the snapshot file latest and drops all the others
+    bool install(const std::string& tmp_path, int64_t index);
+private:
+    std::string _dir;
+    mutable std::mutex _mutex;
+    int64_t _last_index;
+    int64_t _last_term;
+    // state of the snapshot being received
+    int64_t _recv_index;
+    int64_t _recv_size;
+};
+
+} // namespace raft
+} // namespace orion
+
+#endif // ORION_RAFT_SNAPSHOT_H
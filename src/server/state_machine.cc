@@ -0,0 +1,257 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "state_machine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include "storage/batch_store.h"
+#include "storage/tree_struct.h"
+#include "proto/serialize.pb.h"
+#include "common/const.h"
+
+namespace orion {
+namespace server {
+
+const std::string OrionStateMachine::s_applied_term_key("applied_term");
+const std::string OrionStateMachine::s_lease_prefix("lease/");
+
+int32_t OrionStateMachine::apply(int64_t first_index,
+        const std::vector<raft::Entry>& entries, std::vector<raft::ApplyResult>* results) {
+    // later entries see the effect of former ones through the batch
+    storage::BatchStore batch(_store);
+    storage::TreeStructure tree(&batch);
+    results->clear();
+    int64_t index = first_index;
+    for (const auto& entry : entries) {
+        const std::string& ns = entry.ns();
+        raft::ApplyResult result(status_code::OK);
+        if (entry.op() == raft_op::PUT && entry.session_id() != 0) {
+            result.status = apply_temp_put(&batch, &tree, ns, entry.key(), entry.value(),
+                    entry.session_id());
+        } else if (entry.op() == raft_op::PUT) {
+            result.status = apply_put(&tree, ns, entry.key(), entry.value());
+        } else if (entry.op() == raft_op::REMOVE) {
+            result.status = tree.remove(ns, entry.key());
+        } else if (entry.op() == raft_op::BATCH) {
+            serialize::BatchOps batch_ops;
+            if (!batch_ops.ParseFromString(entry.value())) {
+                result.status = status_code::INVALID;
+            }
+            for (const auto& op : batch_ops.ops()) {
+                result.batch_status.push_back(op.op() == raft_op::PUT ?
+                        apply_put(&tree, ns, op.key(), op.value()) : tree.remove(ns, op.key()));
+            }
+        } else if (entry.op() == raft_op::GRANT_LEASE) {
+            result.status = batch.put(common::INTERNAL_NS, lease_key(entry.session_id()),
+                    entry.value());
+        } else if (entry.op() == raft_op::REVOKE_LEASES) {
+            serialize::LeaseList leases;
+            if (!leases.ParseFromString(entry.value())) {
+                result.status = status_code::INVALID;
+            }
+            for (int64_t lease_id : leases.ids()) {
+                result.batch_status.push_back(apply_revoke(&batch, &tree, lease_id, &result));
+            }
+        } else if (entry.op() == raft_op::LOCK) {
+            result.status = apply_lock(&batch, &tree, entry, index, &result);
+        } else if (entry.op() == raft_op::UNLOCK) {
+            result.status = apply_unlock(&batch, &tree, entry, &result);
+        }
+        results->push_back(result);
+        ++index;
+    }
+    int64_t last_index = first_index + entries.size() - 1;
+    batch.put(common::INTERNAL_NS, common::APPLIED_INDEX_KEY, std::to_string(last_index));
+    batch.put(common::INTERNAL_NS, s_applied_term_key, std::to_string(entries.back().term()));
+    return batch.commit();
+}
+
+int32_t OrionStateMachine::apply_put(storage::TreeStructure* tree, const std::string& ns,
+        const std::string& key, const std::string& value) {
+    storage::ValueInfo info = { false, false, value, "" };
+    return tree->put(ns, key, info);
+}
+
+int32_t OrionStateMachine::apply_temp_put(storage::DataStore* batch,
+        storage::TreeStructure* tree, const std::string& ns, const std::string& key,
+        const std::string& value, int64_t lease_id) {
+    std::string ttl;
+    if (batch->get(ttl, common::INTERNAL_NS, lease_key(lease_id)) != status_code::OK) {
+        return status_code::LEASE_EXPIRED;
+    }
+    storage::ValueInfo info = { true, false, value, std::to_string(lease_id) };
+    int32_t ret = tree->put(ns, key, info);
+    if (ret != status_code::OK) {
+        return ret;
+    }
+    return batch->put(common::INTERNAL_NS, attached_key(lease_id, ns, key), "");
+}
+
+int32_t OrionStateMachine::apply_lock(storage::DataStore* batch,
+        storage::TreeStructure* tree, const raft::Entry& entry, int64_t index,
+        raft::ApplyResult* result) {
+    const std::string& ns = entry.ns();
+    int64_t lease_id = entry.session_id();
+    if (lock_waiter(batch, ns, entry.key(), lease_id) != "") {
+        return status_code::OK;
+    }
+    if (entry.value() == "try" && lock_holder(batch, ns, entry.key()) != "") {
+        return status_code::LOCKED;
+    }
+    // fixed width keeps waiters in order of index
+    char name[32];
+    snprintf(name, sizeof(name), "/%020ld", index);
+    std::string waiter = entry.key() + name;
+    int32_t ret = apply_temp_put(batch, tree, ns, waiter, std::to_string(lease_id), lease_id);
+    if (ret == status_code::OK) {
+        result->created = waiter;
+    }
+    return ret;
+}
+
+int32_t OrionStateMachine::apply_unlock(storage::DataStore* batch,
+        storage::TreeStructure* tree, const raft::Entry& entry, raft::ApplyResult* result) {
+    const std::string& ns = entry.ns();
+    std::string waiter = lock_waiter(batch, ns, entry.key(), entry.session_id());
+    if (waiter.empty()) {
+        return status_code::NOT_FOUND;
+    }
+    int32_t ret = tree->remove(ns, waiter);
+    if (ret != status_code::OK) {
+        return ret;
+    }
+    result->removed.push_back(std::make_pair(ns, waiter));
+    return batch->remove(common::INTERNAL_NS, attached_key(entry.session_id(), ns, waiter));
+}
+
+int32_t OrionStateMachine::apply_revoke(storage::DataStore* batch,
+        storage::TreeStructure* tree, int64_t lease_id, raft::ApplyResult* result) {
+    std::string ttl;
+    std::string lease = lease_key(lease_id);
+    if (batch->get(ttl, common::INTERNAL_NS, lease) != status_code::OK) {
+        return status_code::NOT_FOUND;
+    }
+    std::vector<std::string> attached;
+    std::string prefix = attached_key(lease_id, "", "");
+    prefix.resize(prefix.size() - 2);
+    std::unique_ptr<storage::DataIterator> it(batch->iter(common::INTERNAL_NS));
+    for (it->seek(prefix); !it->done() && it->key().compare(0, prefix.size(), prefix) == 0;
+            it->next()) {
+        attached.push_back(it->key());
+    }
+    it.reset();
+    std::string owner = std::to_string(lease_id);
+    for (const auto& record : attached) {
+        // the record is <prefix><ns size>:<ns><key>
+        size_t sep = record.find(':', prefix.size());
+        size_t ns_size = atol(record.c_str() + prefix.size());
+        batch->remove(common::INTERNAL_NS, record);
+        if (sep == std::string::npos || sep + 1 + ns_size > record.size()) {
+            continue;
+        }
+        std::string ns = record.substr(sep + 1, ns_size);
+        std::string key = record.substr(sep + 1 + ns_size);
+        // the node may be removed or rewritten by others since it was attached
+        storage::ValueInfo info;
+        if (tree->get(info, ns, key) == status_code::OK && info.temp && info.owner == owner
+                && tree->remove(ns, key) == status_code::OK) {
+            result->removed.push_back(std::make_pair(ns, key));
+        }
+    }
+    return batch->remove(common::INTERNAL_NS, lease);
+}
+
+void OrionStateMachine::list_leases(const storage::DataStore* store,
+        std::map<int64_t, int64_t>* leases) {
+    leases->clear();
+    std::unique_ptr<storage::DataIterator> it(store->iter(common::INTERNAL_NS));
+    size_t size = lease_key(0).size();
+    it->seek(s_lease_prefix);
+    while (!it->done()) {
+        std::string key = it->key();
+        if (key.size() < size || key.compare(0, s_lease_prefix.size(), s_lease_prefix) != 0) {
+            break;
+        }
+        if (key.size() == size) {
+            (*leases)[atol(key.c_str() + s_lease_prefix.size())] = atol(it->value().c_str());
+        }
+        // nodes attached to the lease are skipped
+        key.resize(size);
+        it->seek(key + "0");
+    }
+}
+
+std::string OrionStateMachine::lock_waiter(storage::DataStore* store, const std::string& ns,
+        const std::string& key, int64_t lease_id) {
+    // nodes of the lease under the lock key, found from the records of the lease
+    std::string prefix = attached_key(lease_id, ns, key + "/");
+    std::vector<std::string> candidates;
+    {
+        std::unique_ptr<storage::DataIterator> it(store->iter(common::INTERNAL_NS));
+        for (it->seek(prefix); !it->done() && it->key().compare(0, prefix.size(), prefix) == 0;
+                it->next()) {
+            // only direct children of the lock key are waiters
+            if (it->key().find('/', prefix.size()) == std::string::npos) {
+                candidates.push_back(it->key().substr(prefix.size() - key.size() - 1));
+            }
+        }
+    }
+    storage::TreeStructure tree(store);
+    std::string owner = std::to_string(lease_id);
+    for (const auto& waiter : candidates) {
+        // the node may be removed or rewritten by others since it was attached
+        storage::ValueInfo info;
+        if (tree.get(info, ns, waiter) == status_code::OK && info.temp && info.owner == owner) {
+            return waiter;
+        }
+    }
+    return "";
+}
+
+std::string OrionStateMachine::lock_holder(storage::DataStore* store, const std::string& ns,
+        const std::string& key) {
+    storage::TreeStructure tree(store);
+    std::unique_ptr<storage::StructureIterator> it(tree.list(ns, key));
+    for (; !it->done(); it->next()) {
+        if (it->temp()) {
+            return it->key();
+        }
+    }
+    return "";
+}
+
+std::string OrionStateMachine::lease_key(int64_t lease_id) {
+    // fixed width keeps the nodes of a lease together
+    char id[32];
+    snprintf(id, sizeof(id), "%019ld", lease_id);
+    return s_lease_prefix + id;
+}
+
+std::string OrionStateMachine::attached_key(int64_t lease_id, const std::string& ns,
+        const std::string& key) {
+    return lease_key(lease_id) + "/" + std::to_string(ns.size()) + ":" + ns + key;
+}
+
+int64_t OrionStateMachine::applied_index() const {
+    return get_internal(common::APPLIED_INDEX_KEY);
+}
+
+int64_t OrionStateMachine::applied_term() const {
+    return get_internal(s_applied_term_key);
+}
+
+int64_t OrionStateMachine::get_internal(const std::string& key) const {
+    std::string value;
+    if (_store->get(value, common::INTERNAL_NS, key) != status_code::OK) {
+        return 0;
+    }
+    return atol(value.c_str());
+}
+
+} // namespace server
+} // namespace orion
@@ -0,0 +1,90 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_STATE_MACHINE_H
+#define ORION_SERVER_STATE_MACHINE_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "server/apply_queue.h"
+
+namespace orion {
+
+namespace storage {
+
+class DataStore; // forward declaration
+class TreeStructure; // forward declaration
+
+} // namespace storage
+
+namespace server {
+
+/**
+ * @brief Applies raft entries to the tree structure of user data
+ *
+ * A batch of entries is staged in memory and written to storage
+ * in one write, together with the index and term of the last entry,
+ * so that restart replays only entries after them. Leases and the temp
+ * nodes attached to them are kept in internal namespace, so that a lease
+ * is revoked with all its nodes by a single entry. Waiters of a lock are
+ * temp nodes under the lock key named by the index of the entry queueing
+ * them, the first one holds the lock.
+ */
+class OrionStateMachine : public raft::StateMachine {
+public:
+    /// OrionStateMachine neither owns nor releases the store
+    OrionStateMachine(storage::DataStore* store) : _store(store) { }
+    virtual ~OrionStateMachine() { }
+    /// disable copy and move for state machine
+    OrionStateMachine(const OrionStateMachine&) = delete;
+    void operator=(const OrionStateMachine&) = delete;
+
+    virtual int32_t apply(int64_t first_index, const std::vector<raft::Entry>& entries,
+            std::vector<raft::ApplyResult>* results);
+    virtual int64_t applied_index() const;
+    virtual int64_t applied_term() const;
+    /// reads all the granted leases of store and their ttl
+    static void list_leases(const storage::DataStore* store, std::map<int64_t, int64_t>* leases);
+    /// returns the waiter of lease queued on lock key, empty if none
+    static std::string lock_waiter(storage::DataStore* store, const std::string& ns,
+            const std::string& key, int64_t lease_id);
+    /// returns the waiter holding lock key, empty if the lock is free
+    static std::string lock_holder(storage::DataStore* store, const std::string& ns,
+            const std::string& key);
+private:
+    int32_t apply_put(storage::TreeStructure* tree, const std::string& ns,
+            const std::string& key, const std::string& value);
+    /// puts a temp node owned by lease, LEASE_EXPIRED if lease is gone
+    int32_t apply_temp_put(storage::DataStore* batch, storage::TreeStructure* tree,
+            const std::string& ns, const std::string& key, const std::string& value,
+            int64_t lease_id);
+    /// queues lease on lock key unless it is queued already
+    int32_t apply_lock(storage::DataStore* batch, storage::TreeStructure* tree,
+            const raft::Entry& entry, int64_t index, raft::ApplyResult* result);
+    int32_t apply_unlock(storage::DataStore* batch, storage::TreeStructure* tree,
+            const raft::Entry& entry, raft::ApplyResult* result);
+    /// removes a lease and the temp nodes it still owns
+    int32_t apply_revoke(storage::DataStore* batch, storage::TreeStructure* tree,
+            int64_t lease_id, raft::ApplyResult* result);
+    static std::string lease_key(int64_t lease_id);
+    /// key recording a node attached to lease, all of them follow the lease key
+    static std::string attached_key(int64_t lease_id, const std::string& ns,
+            const std::string& key);
+    /// reads an integer kept in internal namespace, 0 if not found
+    int64_t get_internal(const std::string& key) const;
+private:
+    // applied term is kept in internal namespace next to APPLIED_INDEX_KEY
+    static const std::string s_applied_term_key;
+    static const std::string s_lease_prefix;
+
+    storage::DataStore* _store;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_STATE_MACHINE_H
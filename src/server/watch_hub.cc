@@ -0,0 +1,467 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "watch_hub.h"
+
+#include <chrono>
+#include <algorithm>
+#include <unordered_set>
+#include "proto/serialize.pb.h"
+#include "common/const.h"
+#include "common/logging.h"
+
+namespace orion {
+namespace server {
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+WatchHub::WatchHub(const WatchOptions& options) : _options(options),
+        _random(std::chrono::system_clock::now().time_since_epoch().count()), _stop(false),
+        _coalesced_events(0), _resyncs(0), _dropped_entries(0), _fanout_entries(0),
+        _timer(1, "watch_timer"), _wheel(&_timer), _fanout(options.fanout_threads, "watch_fanout"),
+        _groups_fanout(&_fanout) {
+}
+
+WatchHub::~WatchHub() {
+    stop();
+    _fanout.stop(false);
+    _wheel.stop();
+    _timer.stop(true);
+}
+
+void WatchHub::on_apply(int32_t group_id, int64_t index, const raft::Entry& entry,
+        const raft::ApplyResult& result) {
+    if (_fanout_entries >= _options.max_fanout_entries) {
+        // the gap is found by the next entry fanned out, streams missing it resync
+        ++_dropped_entries;
+        return;
+    }
+    ++_fanout_entries;
+    // entries of a group keep their order, groups are fanned out in parallel
+    _groups_fanout.add_task(group_id,
+            std::bind(&WatchHub::fan_out, this, group_id, index, entry, result));
+}
+
+void WatchHub::fan_out(int32_t group_id, int64_t index, const raft::Entry& entry,
+        const raft::ApplyResult& result) {
+    --_fanout_entries;
+    std::vector<event_t> events;
+    // encoded once whatever the number of streams watching it
+    auto add_event = [&](const std::string& ns, const std::string& key, const std::string& value,
+            bool deleted) {
+        std::shared_ptr<Event> event(new Event());
+        event->ns = ns;
+        event->revision = index;
+        event->key = key;
+        service::WatchEvent watch_event;
+        watch_event.set_revision(index);
+        watch_event.set_key(key);
+        if (deleted) {
+            watch_event.set_deleted(true);
+        } else {
+            watch_event.set_value(value);
+        }
+        watch_event.SerializeToString(&event->data);
+        events.push_back(event);
+    };
+    if (entry.op() == raft_op::PUT && result.status == status_code::OK) {
+        add_event(entry.ns(), entry.key(), entry.value(), false);
+    } else if (entry.op() == raft_op::REMOVE && result.status == status_code::OK) {
+        add_event(entry.ns(), entry.key(), "", true);
+    } else if (entry.op() == raft_op::BATCH) {
+        serialize::BatchOps ops;
+        if (ops.ParseFromString(entry.value())) {
+            for (int i = 0; i < ops.ops_size() && i < static_cast<int>(result.batch_status.size());
+                    ++i) {
+                if (result.batch_status[i] == status_code::OK) {
+                    const serialize::BatchOp& op = ops.ops(i);
+                    add_event(entry.ns(), op.key(), op.value(), op.op() == raft_op::REMOVE);
+                }
+            }
+        }
+    } else if (entry.op() == raft_op::LOCK && !result.created.empty()) {
+        add_event(entry.ns(), result.created, std::to_string(entry.session_id()), false);
+    }
+    // temp nodes removed with revoked leases or unlocked, which may be of any namespace
+    // of the group
+    for (const auto& node : result.removed) {
+        add_event(node.first, node.second, "", true);
+    }
+    std::vector<reply_t> replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (_stop) {
+            return;
+        }
+        Group& group = this->group(group_id, index - 1);
+        // entries seen when the group is first polled are skipped
+        if (index <= group.revision) {
+            return;
+        }
+        if (index > group.revision + 1) {
+            // entries skipped by installing a snapshot or dropped by a full fan-out
+            // queue, their events are unknown
+            group.history.clear();
+            group.base = index - 1;
+            for (auto& item : _streams) {
+                Stream& stream = item.second;
+                if (stream.group_id == group_id && stream.acked < group.base) {
+                    stream.pending.clear();
+                    stream.pending_bytes = 0;
+                    stream.resync_revision = group.base;
+                    ++_resyncs;
+                }
+            }
+        }
+        group.revision = index;
+        for (const auto& event : events) {
+            group.history.push_back(event);
+        }
+        while (group.history.size() > static_cast<size_t>(_options.history_size)) {
+            group.base = group.history.front()->revision;
+            group.history.pop_front();
+        }
+        // only the streams watching the keys are visited
+        std::vector<int64_t> matched;
+        std::vector<int64_t> touched;
+        for (const auto& event : events) {
+            auto registry = _registries.find(event->ns);
+            if (registry == _registries.end()) {
+                continue;
+            }
+            matched.clear();
+            registry->second.match(event->key, &matched);
+            // a stream watching the key several ways receives the event once
+            std::sort(matched.begin(), matched.end());
+            matched.erase(std::unique(matched.begin(), matched.end()), matched.end());
+            for (int64_t stream_id : matched) {
+                auto it = _streams.find(stream_id);
+                if (it != _streams.end()) {
+                    push(&it->second, group, event);
+                    touched.push_back(stream_id);
+                }
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (int64_t stream_id : touched) {
+            Stream& stream = _streams[stream_id];
+            if (stream.poll != nullptr && (!stream.pending.empty() || stream.resync_revision > 0)) {
+                answer(&stream, group, &replies);
+            }
+        }
+    }
+    for (auto& reply : replies) {
+        reply.first->Run();
+    }
+}
+
+void WatchHub::watch(int32_t group_id, int64_t applied_index,
+        const service::WatchRequest* request, service::WatchResponse* response,
+        google::protobuf::Closure* done) {
+    // a response carries at least one revision, or the stream would never move on
+    int32_t max_events = std::max(request->max_events(), 1);
+    std::vector<reply_t> replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        if (_stop) {
+            response->set_status(status_code::NOT_LEADER);
+            replies.push_back(reply_t(done, response));
+        } else if (request->stream_id() != 0 && _streams.count(request->stream_id()) == 0) {
+            // stream is dropped or opened on another server, client reopens it
+            response->set_status(status_code::NOT_FOUND);
+            replies.push_back(reply_t(done, response));
+        }
+        Group& group = this->group(group_id, applied_index);
+        int64_t stream_id = request->stream_id();
+        if (replies.empty() && stream_id == 0) {
+            do {
+                stream_id = static_cast<int64_t>(_random() >> 1);
+            } while (stream_id == 0 || _streams.count(stream_id) > 0);
+            Stream& stream = _streams[stream_id];
+            stream.group_id = group_id;
+            stream.ns = request->ns();
+            stream.acked = request->revision() > 0 ? request->revision() : group.revision;
+            stream.pending_bytes = 0;
+            stream.resync_revision = 0;
+            stream.last_active = now_ms();
+            stream.poll_seq = 0;
+            stream.idle_timer = _wheel.add(_options.stream_timeout,
+                    std::bind(&WatchHub::expire_stream, this, stream_id));
+            for (const auto& watch : request->add()) {
+                set_watch(stream_id, &stream, watch.key(), watch.type());
+            }
+            if (request->revision() > 0 && request->revision() < group.base) {
+                // events client has not seen are gone
+                stream.resync_revision = group.revision;
+                ++_resyncs;
+            } else {
+                replay(&stream, group);
+            }
+        } else if (replies.empty()) {
+            Stream& stream = _streams[stream_id];
+            for (const auto& key : request->remove()) {
+                set_watch(stream_id, &stream, key, -1);
+            }
+            for (const auto& watch : request->add()) {
+                set_watch(stream_id, &stream, watch.key(), watch.type());
+            }
+            if (stream.poll != nullptr) {
+                // a stream is polled by the latest request, the replaced one carries
+                // the same events, client ignores those seen already
+                answer(&stream, group, &replies);
+            }
+            ack(&stream, request->revision());
+        }
+        if (replies.empty() || replies.back().first != done) {
+            Stream& stream = _streams[stream_id];
+            stream.last_active = now_ms();
+            // a failed renewal means the idle timer is running, it sees last_active
+            _wheel.renew(stream.idle_timer, _options.stream_timeout);
+            bool changed = request->stream_id() == 0 || request->add_size() > 0
+                || request->remove_size() > 0;
+            // changes are acknowledged at once, so that they take effect in a round trip
+            if (changed || !stream.pending.empty() || stream.resync_revision > 0
+                    || request->wait_ms() <= 0) {
+                fill(&stream, group, max_events, response);
+                response->set_stream_id(stream_id);
+                replies.push_back(reply_t(done, response));
+            } else {
+                response->set_stream_id(stream_id);
+                stream.poll.reset(new Poll());
+                stream.poll->response = response;
+                stream.poll->done = done;
+                stream.poll->max_events = max_events;
+                stream.poll->seq = ++stream.poll_seq;
+                stream.poll->timer = _wheel.add(std::min(request->wait_ms(), _options.max_wait),
+                        std::bind(&WatchHub::expire_poll, this, stream_id, stream.poll->seq));
+            }
+        }
+    }
+    for (auto& reply : replies) {
+        reply.first->Run();
+    }
+}
+
+void WatchHub::stop() {
+    std::vector<reply_t> replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _stop = true;
+        for (auto& item : _streams) {
+            Stream& stream = item.second;
+            if (stream.poll != nullptr) {
+                answer(&stream, group(stream.group_id, 0), &replies);
+            }
+            _wheel.cancel(stream.idle_timer);
+        }
+        _streams.clear();
+        _registries.clear();
+    }
+    for (auto& reply : replies) {
+        reply.first->Run();
+    }
+}
+
+size_t WatchHub::stream_num() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _streams.size();
+}
+
+WatchStats WatchHub::stats() const {
+    WatchStats stats;
+    std::lock_guard<std::mutex> locker(_mutex);
+    stats.streams = _streams.size();
+    stats.coalesced_events = _coalesced_events;
+    stats.resyncs = _resyncs;
+    stats.dropped_entries = _dropped_entries;
+    return stats;
+}
+
+void WatchHub::push(Stream* stream, const Group& group, const event_t& event) {
+    if (event->revision <= stream->acked) {
+        return;
+    }
+    if (stream->resync_revision > 0 && event->revision <= stream->resync_revision) {
+        return;
+    }
+    stream->pending.push_back(event);
+    stream->pending_bytes += event->data.size();
+    if (stream->pending.size() > static_cast<size_t>(_options.max_pending_events)
+            || stream->pending_bytes > _options.max_pending_bytes) {
+        coalesce(stream, group);
+    }
+}
+
+void WatchHub::coalesce(Stream* stream, const Group& group) {
+    std::unordered_set<std::string> keys;
+    std::deque<event_t> latest;
+    int64_t bytes = 0;
+    for (auto it = stream->pending.rbegin(); it != stream->pending.rend(); ++it) {
+        if (keys.insert((*it)->key).second) {
+            latest.push_front(*it);
+            bytes += (*it)->data.size();
+        }
+    }
+    _coalesced_events += stream->pending.size() - latest.size();
+    // half of the queue is left free, so that a busy key does not coalesce the
+    // queue on every event
+    if (latest.size() > static_cast<size_t>(_options.max_pending_events / 2)
+            || bytes > _options.max_pending_bytes / 2) {
+        // client is too slow, queued events are replaced by a resync
+        LOG(INFO, "[watch]: stream of ns %s is too far behind", stream->ns.c_str());
+        stream->pending.clear();
+        stream->pending_bytes = 0;
+        stream->resync_revision = group.revision;
+        ++_resyncs;
+        return;
+    }
+    stream->pending.swap(latest);
+    stream->pending_bytes = bytes;
+}
+
+void WatchHub::replay(Stream* stream, const Group& group) {
+    for (const auto& event : group.history) {
+        if (event->ns != stream->ns) {
+            continue;
+        }
+        for (const auto& watch : stream->watches) {
+            if (WatchRegistry::matches(watch.second, watch.first, event->key)) {
+                push(stream, group, event);
+                break;
+            }
+        }
+    }
+}
+
+void WatchHub::set_watch(int64_t stream_id, Stream* stream, const std::string& key,
+        int32_t type) {
+    WatchRegistry& registry = _registries[stream->ns];
+    auto it = stream->watches.find(key);
+    if (it != stream->watches.end()) {
+        registry.remove(key, it->second, stream_id);
+        stream->watches.erase(it);
+    }
+    if (type >= 0) {
+        registry.add(key, type, stream_id);
+        stream->watches[key] = type;
+    }
+    if (registry.empty()) {
+        _registries.erase(stream->ns);
+    }
+}
+
+std::map<int64_t, WatchHub::Stream>::iterator WatchHub::drop(
+        std::map<int64_t, Stream>::iterator it) {
+    Stream& stream = it->second;
+    _wheel.cancel(stream.idle_timer);
+    auto registry = _registries.find(stream.ns);
+    if (registry != _registries.end()) {
+        for (const auto& watch : stream.watches) {
+            registry->second.remove(watch.first, watch.second, it->first);
+        }
+        if (registry->second.empty()) {
+            _registries.erase(registry);
+        }
+    }
+    return _streams.erase(it);
+}
+
+void WatchHub::ack(Stream* stream, int64_t revision) {
+    stream->acked = std::max(stream->acked, revision);
+    while (!stream->pending.empty()
+            && stream->pending.front()->revision <= stream->acked) {
+        stream->pending_bytes -= stream->pending.front()->data.size();
+        stream->pending.pop_front();
+    }
+    if (stream->resync_revision > 0 && stream->acked >= stream->resync_revision) {
+        stream->resync_revision = 0;
+    }
+}
+
+void WatchHub::fill(Stream* stream, const Group& group, int32_t max_events,
+        service::WatchResponse* response) {
+    response->clear_events();
+    if (stream->resync_revision > 0) {
+        response->set_status(status_code::RESYNC);
+        response->set_revision(stream->resync_revision);
+        return;
+    }
+    response->set_status(status_code::OK);
+    int64_t revision = std::max(stream->acked, group.revision);
+    int64_t last = 0;
+    for (const auto& event : stream->pending) {
+        // events of a revision are never split
+        if (response->events_size() >= max_events && event->revision != last) {
+            revision = last;
+            break;
+        }
+        response->add_events(event->data);
+        last = event->revision;
+    }
+    response->set_revision(revision);
+}
+
+WatchHub::Group& WatchHub::group(int32_t group_id, int64_t applied_index) {
+    Group& group = _groups[group_id];
+    if (!group.known) {
+        // history starts from the first applied index seen
+        group.known = true;
+        group.base = applied_index;
+        group.revision = applied_index;
+    }
+    return group;
+}
+
+void WatchHub::answer(Stream* stream, const Group& group, std::vector<reply_t>* replies) {
+    _wheel.cancel(stream->poll->timer);
+    fill(stream, group, stream->poll->max_events, stream->poll->response);
+    replies->push_back(reply_t(stream->poll->done, stream->poll->response));
+    stream->poll.reset();
+}
+
+void WatchHub::expire_poll(int64_t stream_id, int64_t seq) {
+    std::vector<reply_t> replies;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        auto it = _streams.find(stream_id);
+        // the poll may be answered while its timer is on the way
+        if (it == _streams.end() || it->second.poll == nullptr || it->second.poll->seq != seq) {
+            return;
+        }
+        Stream& stream = it->second;
+        answer(&stream, group(stream.group_id, 0), &replies);
+        stream.last_active = now_ms();
+    }
+    for (auto& reply : replies) {
+        reply.first->Run();
+    }
+}
+
+void WatchHub::expire_stream(int64_t stream_id) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    auto it = _streams.find(stream_id);
+    if (it == _streams.end()) {
+        return;
+    }
+    Stream& stream = it->second;
+    int64_t idle = now_ms() - stream.last_active;
+    if (stream.poll == nullptr && idle >= _options.stream_timeout) {
+        LOG(DEBUG, "[watch]: drop idle stream %ld", stream_id);
+        drop(it);
+        return;
+    }
+    // polled while the timer was running, or parked
+    int64_t delay = stream.poll != nullptr ? _options.stream_timeout
+        : _options.stream_timeout - idle;
+    stream.idle_timer = _wheel.add(delay, std::bind(&WatchHub::expire_stream, this, stream_id));
+}
+
+} // namespace server
+} // namespace orion
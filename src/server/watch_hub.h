@@ -0,0 +1,205 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_WATCH_HUB_H
+#define ORION_SERVER_WATCH_HUB_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include "proto/service.pb.h"
+#include "server/apply_queue.h"
+#include "server/watch_registry.h"
+#include "common/thread_pool.h"
+#include "common/strands.h"
+#include "common/timing_wheel.h"
+
+namespace orion {
+namespace server {
+
+struct WatchOptions {
+    // events kept by every group for streams to resume from
+    int32_t history_size;
+    // events and bytes a stream holds, beyond which events of the same key are
+    // coalesced, and the client needs to resync if that is not enough
+    int32_t max_pending_events;
+    int64_t max_pending_bytes;
+    // applied entries waiting to be fanned out, beyond which entries are dropped
+    // and streams missing them resync
+    int32_t max_fanout_entries;
+    // longest time a poll waits for events, in milliseconds
+    int32_t max_wait;
+    // a stream not polled for this long is dropped, in milliseconds
+    int64_t stream_timeout;
+    // threads fanning out applied entries, entries of a group are fanned out in order
+    int32_t fanout_threads;
+
+    WatchOptions() : history_size(100000), max_pending_events(10000),
+            max_pending_bytes(16 * 1024 * 1024), max_fanout_entries(100000), max_wait(10000),
+            stream_timeout(60000), fanout_threads(4) { }
+};
+
+struct WatchStats {
+    int64_t streams;
+    // events replaced by a later event of the same key in a full stream
+    int64_t coalesced_events;
+    // times a stream fell too far behind and asked its client to resync
+    int64_t resyncs;
+    // applied entries dropped for a full fan-out queue
+    int64_t dropped_entries;
+
+    WatchStats() : streams(0), coalesced_events(0), resyncs(0), dropped_entries(0) { }
+};
+
+/**
+ * @brief Delivers applied writes to watch streams
+ *
+ * Every client polls a single stream holding all its watches. Applied
+ * writes are handed to a fan-out thread, so that apply threads never wait
+ * for watchers. There they are matched against the watches in a
+ * WatchRegistry of the namespace and queued in the streams, a parked poll
+ * is answered as soon as its stream has events. An event is encoded once
+ * and shared by all the streams and the history. Events stay queued until
+ * the client acknowledges them by the revision of its next poll, so a lost
+ * response is never a lost event. The queue of a slow client is bounded,
+ * only the latest event of every key is kept once it is full, and the
+ * client resyncs if it is still too far behind. Recent events of every
+ * group are kept in history, a stream reopened after reconnecting, even on
+ * another server, replays events after the revision the client has seen.
+ * Clients resync if the events they need are gone. Thread-safe.
+ */
+class WatchHub {
+public:
+    explicit WatchHub(const WatchOptions& options = WatchOptions());
+    /// answers all the parked polls
+    ~WatchHub();
+    /// disable copy and move for watch hub
+    WatchHub(const WatchHub&) = delete;
+    void operator=(const WatchHub&) = delete;
+
+    /// applied entries of a group, called by apply listener in order of index,
+    /// returns at once as entries are fanned out in background
+    void on_apply(int32_t group_id, int64_t index, const raft::Entry& entry,
+            const raft::ApplyResult& result);
+    /**
+     * @brief Serves a poll of a watch stream
+     * @param group_id       [IN] group owning the namespace of request
+     * @param applied_index  [IN] applied index of the group, used before any entry is applied
+     * @param request        [IN] poll of the stream
+     * @param response       [OUT] events of the stream, or NOT_FOUND if stream is unknown
+     * @param done           [IN] called once response is ready, which may wait for events
+     */
+    void watch(int32_t group_id, int64_t applied_index, const service::WatchRequest* request,
+            service::WatchResponse* response, google::protobuf::Closure* done);
+    /// answers all the parked polls and refuses new ones
+    void stop();
+    size_t stream_num() const;
+    WatchStats stats() const;
+private:
+    struct Event {
+        std::string ns;
+        int64_t revision;
+        std::string key;
+        // encoded WatchEvent sent to clients
+        std::string data;
+    };
+    typedef std::shared_ptr<const Event> event_t;
+
+    struct Poll {
+        service::WatchResponse* response;
+        google::protobuf::Closure* done;
+        int32_t max_events;
+        // tells the poll from later ones of the stream
+        int64_t seq;
+        // answers the poll once it has waited long enough
+        int64_t timer;
+    };
+    struct Stream {
+        int32_t group_id;
+        std::string ns;
+        // watched keys and their types
+        std::map<std::string, int32_t> watches;
+        // client has received all the events up to acked
+        int64_t acked;
+        // matched events after acked
+        std::deque<event_t> pending;
+        int64_t pending_bytes;
+        // client needs to resync up to this revision, 0 if not
+        int64_t resync_revision;
+        int64_t last_active;
+        // drops the stream once it is idle, renewed by every poll
+        int64_t idle_timer;
+        int64_t poll_seq;
+        std::unique_ptr<Poll> poll;
+    };
+    struct Group {
+        // history holds all the events in (base, revision]
+        int64_t base;
+        int64_t revision;
+        bool known;
+        std::deque<event_t> history;
+
+        Group() : base(0), revision(0), known(false) { }
+    };
+    typedef std::pair<google::protobuf::Closure*, service::WatchResponse*> reply_t;
+
+    /// matches events of an applied entry and answers the streams receiving them
+    void fan_out(int32_t group_id, int64_t index, const raft::Entry& entry,
+            const raft::ApplyResult& result);
+    /// queues an event matching stream
+    void push(Stream* stream, const Group& group, const event_t& event);
+    /// keeps the latest event of every key in a full stream, or asks client to resync
+    void coalesce(Stream* stream, const Group& group);
+    /// queues events of history matching any watch of stream
+    void replay(Stream* stream, const Group& group);
+    /// changes a watch of stream, type is -1 to remove the watch
+    void set_watch(int64_t stream_id, Stream* stream, const std::string& key, int32_t type);
+    /// drops a stream and its watches
+    std::map<int64_t, Stream>::iterator drop(std::map<int64_t, Stream>::iterator it);
+    /// drops the events client has received
+    void ack(Stream* stream, int64_t revision);
+    /// fills response with pending events of stream
+    void fill(Stream* stream, const Group& group, int32_t max_events,
+            service::WatchResponse* response);
+    Group& group(int32_t group_id, int64_t applied_index);
+    /// answers the parked poll of stream
+    void answer(Stream* stream, const Group& group, std::vector<reply_t>* replies);
+    /// timer of a parked poll
+    void expire_poll(int64_t stream_id, int64_t seq);
+    /// idle timer of a stream
+    void expire_stream(int64_t stream_id);
+private:
+    WatchOptions _options;
+    mutable std::mutex _mutex;
+    std::map<int32_t, Group> _groups;
+    std::map<int64_t, Stream> _streams;
+    // watches of all the streams by namespace
+    std::map<std::string, WatchRegistry> _registries;
+    std::mt19937_64 _random;
+    bool _stop;
+    int64_t _coalesced_events;
+    int64_t _resyncs;
+    std::atomic<int64_t> _dropped_entries;
+    // entries handed to fan-out threads and not matched yet
+    std::atomic<int32_t> _fanout_entries;
+    // expires polls and idle streams of _streams
+    common::ThreadPool _timer;
+    // timers of polls and streams, run by _timer
+    common::TimingWheel _wheel;
+    common::ThreadPool _fanout;
+    // entries of every group in order, run by _fanout
+    common::Strands _groups_fanout;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_WATCH_HUB_H
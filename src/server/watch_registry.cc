@@ -0,0 +1,117 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "watch_registry.h"
+
+#include <algorithm>
+
+namespace orion {
+namespace server {
+
+void WatchRegistry::add(const std::string& key, int32_t type, int64_t watcher) {
+    if (type < WATCH_KEY || type > WATCH_SUBTREE) {
+        return;
+    }
+    Node* node = &_root;
+    for (const auto& component : split(key)) {
+        std::unique_ptr<Node>& child = node->children[component];
+        if (child == nullptr) {
+            child.reset(new Node());
+        }
+        node = child.get();
+    }
+    node->watchers[type].push_back(watcher);
+    ++_size;
+}
+
+bool WatchRegistry::remove(const std::string& key, int32_t type, int64_t watcher) {
+    if (type < WATCH_KEY || type > WATCH_SUBTREE) {
+        return false;
+    }
+    const std::vector<std::string>& components = split(key);
+    std::vector<Node*> path(1, &_root);
+    for (const auto& component : components) {
+        auto it = path.back()->children.find(component);
+        if (it == path.back()->children.end()) {
+            return false;
+        }
+        path.push_back(it->second.get());
+    }
+    std::vector<int64_t>& watchers = path.back()->watchers[type];
+    auto it = std::find(watchers.begin(), watchers.end(), watcher);
+    if (it == watchers.end()) {
+        return false;
+    }
+    *it = watchers.back();
+    watchers.pop_back();
+    --_size;
+    // nodes without watchers below are pruned bottom up
+    for (size_t i = components.size(); i > 0 && path[i]->empty(); --i) {
+        path[i - 1]->children.erase(components[i - 1]);
+    }
+    return true;
+}
+
+void WatchRegistry::match(const std::string& key, std::vector<int64_t>* watchers) const {
+    const std::vector<std::string>& components = split(key);
+    const Node* node = &_root;
+    for (size_t depth = 0; ; ++depth) {
+        const auto& subtree = node->watchers[WATCH_SUBTREE];
+        watchers->insert(watchers->end(), subtree.begin(), subtree.end());
+        if (depth == components.size()) {
+            const auto& exact = node->watchers[WATCH_KEY];
+            watchers->insert(watchers->end(), exact.begin(), exact.end());
+            return;
+        }
+        if (depth + 1 == components.size()) {
+            const auto& children = node->watchers[WATCH_CHILDREN];
+            watchers->insert(watchers->end(), children.begin(), children.end());
+        }
+        auto it = node->children.find(components[depth]);
+        if (it == node->children.end()) {
+            return;
+        }
+        node = it->second.get();
+    }
+}
+
+bool WatchRegistry::matches(int32_t type, const std::string& watched, const std::string& key) {
+    const std::vector<std::string>& parent = split(watched);
+    const std::vector<std::string>& components = split(key);
+    if (components.size() < parent.size()
+            || !std::equal(parent.begin(), parent.end(), components.begin())) {
+        return false;
+    }
+    switch (type) {
+    case WATCH_KEY:
+        return components.size() == parent.size();
+    case WATCH_CHILDREN:
+        return components.size() == parent.size() + 1;
+    case WATCH_SUBTREE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::vector<std::string> WatchRegistry::split(const std::string& key) {
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start < key.size()) {
+        size_t end = key.find('/', start);
+        if (end == std::string::npos) {
+            end = key.size();
+        }
+        if (end > start) {
+            components.push_back(key.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return components;
+}
+
+} // namespace server
+} // namespace orion
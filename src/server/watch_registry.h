@@ -0,0 +1,86 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_SERVER_WATCH_REGISTRY_H
+#define ORION_SERVER_WATCH_REGISTRY_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace orion {
+namespace server {
+
+/// types of watch, see WatchKey in service.proto
+enum WatchType {
+    WATCH_KEY = 0,
+    WATCH_CHILDREN = 1,
+    WATCH_SUBTREE = 2,
+};
+
+/**
+ * @brief Finds the watchers of a changed key
+ *
+ * Watches are kept in a trie of the / separated components of keys, the
+ * same hierarchy as TreeStructure. A watcher of a key sits on the node of
+ * the key, so matching a change only walks the path of the changed key,
+ * visiting its ancestors for subtree watches and its parent for children
+ * watches. The cost does not grow with the watchers of other keys. Nodes
+ * left without watchers are pruned. Not thread-safe.
+ */
+class WatchRegistry {
+public:
+    WatchRegistry() : _size(0) { }
+    ~WatchRegistry() { }
+    /// disable copy and move for watch registry
+    WatchRegistry(const WatchRegistry&) = delete;
+    void operator=(const WatchRegistry&) = delete;
+
+    /// a watcher watching a key several times is matched as many times
+    void add(const std::string& key, int32_t type, int64_t watcher);
+    /// returns false if the watch is not found
+    bool remove(const std::string& key, int32_t type, int64_t watcher);
+    /**
+     * @brief Appends the watchers matching a changed key
+     * @param key       [IN] changed key
+     * @param watchers  [OUT] watchers of the key, children watchers of its parent
+     *                        and subtree watchers of the key and its ancestors
+     */
+    void match(const std::string& key, std::vector<int64_t>* watchers) const;
+    /// number of watches
+    size_t size() const {
+        return _size;
+    }
+    bool empty() const {
+        return _size == 0;
+    }
+
+    /// same as match, for a single watch
+    static bool matches(int32_t type, const std::string& watched, const std::string& key);
+private:
+    struct Node {
+        std::unordered_map<std::string, std::unique_ptr<Node> > children;
+        // watchers by type
+        std::vector<int64_t> watchers[3];
+
+        bool empty() const {
+            return children.empty() && watchers[0].empty() && watchers[1].empty()
+                && watchers[2].empty();
+        }
+    };
+
+    /// splits a key into its components, / and empty components are dropped
+    static std::vector<std::string> split(const std::string& key);
+private:
+    Node _root;
+    size_t _size;
+};
+
+} // namespace server
+} // namespace orion
+
+#endif // ORION_SERVER_WATCH_REGISTRY_H
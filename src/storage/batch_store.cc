@@ -0,0 +1,178 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "batch_store.h"
+
+#include <memory>
+#include "common/const.h"
+
+namespace orion {
+namespace storage {
+
+/// MergedIterator walks the underlying iterator and buffered writes in key order,
+/// buffered writes override underlying data with the same key
+class BatchStore::MergedIterator : public DataIterator {
+public:
+    MergedIterator(DataIterator* base, const pending_map_t* pending) :
+            _base(base), _pending(pending), _from_pending(false) {
+        if (_pending != nullptr) {
+            _pos = _pending->end();
+        }
+    }
+    virtual ~MergedIterator() { }
+
+    virtual std::string key() const {
+        return _from_pending ? _pos->first : _base->key();
+    }
+
+    virtual std::string value() const {
+        return _from_pending ? _pos->second.value : _base->value();
+    }
+
+    virtual bool done() const {
+        return !_from_pending && !base_valid();
+    }
+
+    virtual DataIterator* seek(const std::string& key) {
+        if (_base != nullptr) {
+            _base->seek(key);
+        }
+        if (_pending != nullptr) {
+            _pos = _pending->lower_bound(key);
+        }
+        settle();
+        return this;
+    }
+
+    virtual DataIterator* next() {
+        if (_from_pending) {
+            ++_pos;
+        } else if (base_valid()) {
+            _base->next();
+        }
+        settle();
+        return this;
+    }
+private:
+    bool base_valid() const {
+        return _base != nullptr && !_base->done();
+    }
+
+    /// decides which source the current position comes from
+    void settle() {
+        _from_pending = false;
+        while (_pending != nullptr && _pos != _pending->end()) {
+            if (base_valid()) {
+                int cmp = _base->key().compare(_pos->first);
+                if (cmp < 0) {
+                    return;
+                } else if (cmp == 0) {
+                    // overridden by buffered write
+                    _base->next();
+                }
+            }
+            if (!_pos->second.deleted) {
+                _from_pending = true;
+                return;
+            }
+            ++_pos;
+        }
+    }
+private:
+    std::unique_ptr<DataIterator> _base;
+    const pending_map_t* _pending;
+    pending_map_t::const_iterator _pos;
+    bool _from_pending;
+};
+
+int32_t BatchStore::get(std::string& value, const std::string& ns,
+        const std::string& key) const {
+    auto it = _pending.find(ns);
+    if (it != _pending.end()) {
+        auto jt = it->second.find(key);
+        if (jt != it->second.end()) {
+            if (jt->second.deleted) {
+                return status_code::NOT_FOUND;
+            }
+            value = jt->second.value;
+            return status_code::OK;
+        }
+    }
+    return _underlying->get(value, ns, key);
+}
+
+int32_t BatchStore::put(const std::string& ns, const std::string& key,
+        const std::string& value) {
+    Pending& pending = _pending[ns][key];
+    pending.value = value;
+    pending.deleted = false;
+    return status_code::OK;
+}
+
+int32_t BatchStore::remove(const std::string& ns, const std::string& key) {
+    std::string value;
+    int32_t ret = get(value, ns, key);
+    if (ret != status_code::OK) {
+        return ret;
+    }
+    Pending& pending = _pending[ns][key];
+    pending.value.clear();
+    pending.deleted = true;
+    return status_code::OK;
+}
+
+int32_t BatchStore::write(const WriteBatch& batch) {
+    for (const auto& op : batch.ops()) {
+        Pending& pending = _pending[op.ns][op.key];
+        pending.value = op.value;
+        pending.deleted = op.deleted;
+    }
+    return status_code::OK;
+}
+
+DataIterator* BatchStore::iter(const std::string& ns) const {
+    auto it = _pending.find(ns);
+    return new MergedIterator(_underlying->iter(ns),
+            it != _pending.end() ? &it->second : nullptr);
+}
+
+DataSnapshot* BatchStore::snapshot() const {
+    return _underlying->snapshot();
+}
+
+int32_t BatchStore::restore(DataSnapshot* snapshot, const std::string& marker_ns,
+        const std::string& marker_key) {
+    clear();
+    return _underlying->restore(snapshot, marker_ns, marker_key);
+}
+
+int32_t BatchStore::commit() {
+    if (_pending.empty()) {
+        return status_code::OK;
+    }
+    WriteBatch batch;
+    for (const auto& ns : _pending) {
+        for (const auto& kv : ns.second) {
+            if (kv.second.deleted) {
+                batch.remove(ns.first, kv.first);
+            } else {
+                batch.put(ns.first, kv.first, kv.second.value);
+            }
+        }
+    }
+    int32_t ret = _underlying->write(batch);
+    if (ret == status_code::OK) {
+        _pending.clear();
+    }
+    return ret;
+}
+
+void BatchStore::clear() {
+    _pending.clear();
+}
+
+} // namespace storage
+} // namespace orion
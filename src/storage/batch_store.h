@@ -0,0 +1,69 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_STORAGE_BATCH_STORE_H
+#define ORION_STORAGE_BATCH_STORE_H
+#include "storage/data_store.h"
+
+#include <string>
+#include <map>
+
+namespace orion {
+namespace storage {
+
+/**
+ * @brief Buffers writes on top of another store and commits them in one batch
+ *
+ * Reads and iterators see the buffered writes, so structures built on
+ * BatchStore behave as if every write had been applied. Nothing reaches
+ * the underlying store until commit is called. Not thread-safe.
+ */
+class BatchStore : public DataStore {
+public:
+    /// BatchStore does not own the underlying store
+    BatchStore(DataStore* underlying) : _underlying(underlying) { }
+    virtual ~BatchStore() { }
+    /// disable copy and move for batch store
+    BatchStore(const BatchStore&) = delete;
+    void operator=(const BatchStore&) = delete;
+
+    virtual int32_t get(std::string& value, const std::string& ns,
+            const std::string& key) const;
+    virtual int32_t put(const std::string& ns, const std::string& key,
+            const std::string& value);
+    virtual int32_t remove(const std::string& ns, const std::string& key);
+    virtual int32_t write(const WriteBatch& batch);
+    /// iterator merges buffered writes with the underlying data
+    virtual DataIterator* iter(const std::string& ns) const;
+    /// snapshot and restore go to the underlying store directly
+    virtual DataSnapshot* snapshot() const;
+    virtual int32_t restore(DataSnapshot* snapshot, const std::string& marker_ns,
+            const std::string& marker_key);
+
+    /// writes all the buffered writes to underlying store in one batch
+    int32_t commit();
+    /// drops all the buffered writes
+    void clear();
+    bool empty() const {
+        return _pending.empty();
+    }
+private:
+    struct Pending {
+        std::string value;
+        bool deleted;
+    };
+    typedef std::map<std::string, Pending> pending_map_t;
+    class MergedIterator;
+private:
+    DataStore* _underlying;
+    // buffered writes, organized as (ns, [<key, value>]...)
+    std::map<std::string, pending_map_t> _pending;
+};
+
+} // namespace storage
+} // namespace orion
+
+#endif // ORION_STORAGE_BATCH_STORE_H
@@ -8,6 +8,8 @@
 
 #include <mutex>
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
+#include "leveldb/cache.h"
 #include "common/logging.h"
 #include "common/const.h"
 
@@ -21,7 +23,7 @@ std::unique_ptr<DataStore> DataStoreFactory::_s_store(nullptr);
 class DataIteratorImpl : public DataIterator {
 public:
     DataIteratorImpl(leveldb::Iterator* it, const std::string& ns) :
-            _it(it), _ns(ns) { }
+            _it(it), _ns(ns), _ns_prefix(get_key_in_ns(ns, "")) { }
     virtual ~DataIteratorImpl() {
         if (_it != nullptr) {
             delete _it;
@@ -38,7 +40,8 @@ public:
     }
 
     virtual bool done() const {
-        return _it != nullptr ? !_it->Valid() : false;
+        // iterating stops at the end of namespace
+        return _it != nullptr ? !_it->Valid() || !_it->key().starts_with(_ns_prefix) : false;
     }
 
     virtual DataIterator* seek(const std::string& key) {
@@ -71,12 +74,55 @@ private:
 private:
     leveldb::Iterator* _it;
     std::string _ns;
+    std::string _ns_prefix;
+};
+
+/// DataSnapshotImpl iterates all the kv through a leveldb snapshot
+class DataSnapshotImpl : public DataSnapshot {
+public:
+    DataSnapshotImpl(leveldb::DB* db) : _db(db), _snapshot(db->GetSnapshot()) {
+        leveldb::ReadOptions options;
+        options.snapshot = _snapshot;
+        // a full scan should not pollute block cache
+        options.fill_cache = false;
+        _it.reset(_db->NewIterator(options));
+        _it->SeekToFirst();
+    }
+    virtual ~DataSnapshotImpl() {
+        // iterator must be released before the snapshot it depends on
+        _it.reset();
+        _db->ReleaseSnapshot(_snapshot);
+    }
+
+    virtual bool next(std::string& ns, std::string& key, std::string& value) {
+        for (; _it->Valid(); _it->Next()) {
+            // raw key is constructed as /ns/key
+            const std::string& raw_key = _it->key().ToString();
+            size_t ns_sep = raw_key.find_first_of("/", 1);
+            if (raw_key.empty() || raw_key[0] != '/' || ns_sep == std::string::npos) {
+                LOG(WARNING, "[data]: skip malformed key in snapshot: %s", raw_key.c_str());
+                continue;
+            }
+            ns = raw_key.substr(1, ns_sep - 1);
+            key = raw_key.substr(ns_sep + 1);
+            value = _it->value().ToString();
+            _it->Next();
+            return true;
+        }
+        return false;
+    }
+private:
+    leveldb::DB* _db;
+    const leveldb::Snapshot* _snapshot;
+    std::unique_ptr<leveldb::Iterator> _it;
 };
 
 /// DataStoreImpl is a wrapper for leveldb pointer
 class DataStoreImpl : public DataStore {
 public:
-    DataStoreImpl(leveldb::DB* db) : _db(db) { }
+    /// block cache is owned by store if given, and released after db
+    DataStoreImpl(leveldb::DB* db, leveldb::Cache* cache = nullptr) :
+            _cache(cache), _db(db) { }
     virtual ~DataStoreImpl() { }
 
     virtual int32_t get(std::string& value, const std::string& ns,
@@ -88,6 +134,22 @@ public:
                                            status_code::DATABASE_ERROR);
     }
 
+    virtual void multi_get(std::vector<std::string>* values, std::vector<int32_t>* statuses,
+            const std::string& ns, const std::vector<std::string>& keys) const {
+        // all the keys are read from the same version
+        leveldb::ReadOptions options;
+        options.snapshot = _db->GetSnapshot();
+        values->assign(keys.size(), "");
+        statuses->resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            leveldb::Status st = _db->Get(options, get_key_in_ns(ns, keys[i]), &(*values)[i]);
+            (*statuses)[i] = st.ok() ? status_code::OK : (
+                             st.IsNotFound() ? status_code::NOT_FOUND :
+                                               status_code::DATABASE_ERROR);
+        }
+        _db->ReleaseSnapshot(options.snapshot);
+    }
+
     virtual int32_t put(const std::string& ns, const std::string& key,
             const std::string& value) {
         leveldb::Status st = _db->Put(leveldb::WriteOptions(),
@@ -100,15 +162,87 @@ public:
         return st.ok() ? status_code::OK : status_code::DATABASE_ERROR;
     }
 
+    virtual int32_t write(const WriteBatch& batch) {
+        leveldb::WriteBatch db_batch;
+        for (const auto& op : batch.ops()) {
+            if (op.deleted) {
+                db_batch.Delete(get_key_in_ns(op.ns, op.key));
+            } else {
+                db_batch.Put(get_key_in_ns(op.ns, op.key), op.value);
+            }
+        }
+        leveldb::Status st = _db->Write(leveldb::WriteOptions(), &db_batch);
+        return st.ok() ? status_code::OK : status_code::DATABASE_ERROR;
+    }
+
     virtual DataIterator* iter(const std::string& ns) const {
         return new DataIteratorImpl(_db->NewIterator(leveldb::ReadOptions()), ns);
     }
+
+    virtual DataSnapshot* snapshot() const {
+        return new DataSnapshotImpl(_db.get());
+    }
+
+    virtual int32_t restore(DataSnapshot* snapshot, const std::string& marker_ns,
+            const std::string& marker_key) {
+        std::lock_guard<std::mutex> locker(_mu);
+        const std::string marker = get_key_in_ns(marker_ns, marker_key);
+        leveldb::WriteBatch batch;
+        // the marker goes away durably before the old data is touched
+        batch.Delete(marker);
+        if (!flush_batch(&batch, true)) {
+            return status_code::DATABASE_ERROR;
+        }
+        // drop all the existing data
+        std::unique_ptr<leveldb::Iterator> it(_db->NewIterator(leveldb::ReadOptions()));
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            batch.Delete(it->key());
+            if (!flush_batch(&batch, false)) {
+                return status_code::DATABASE_ERROR;
+            }
+        }
+        std::string ns;
+        std::string key;
+        std::string value;
+        std::string marker_value;
+        bool has_marker = false;
+        while (snapshot->next(ns, key, value)) {
+            std::string db_key = get_key_in_ns(ns, key);
+            if (db_key == marker) {
+                marker_value.swap(value);
+                has_marker = true;
+                continue;
+            }
+            batch.Put(db_key, value);
+            if (!flush_batch(&batch, false)) {
+                return status_code::DATABASE_ERROR;
+            }
+        }
+        // the marker comes with the last synced batch, after all the other data
+        if (has_marker) {
+            batch.Put(marker, marker_value);
+        }
+        return flush_batch(&batch, true) ? status_code::OK : status_code::DATABASE_ERROR;
+    }
 private:
+    /// writes the batch when it is large enough or forced
+    bool flush_batch(leveldb::WriteBatch* batch, bool force) {
+        static const size_t s_batch_size = 4 * 1024 * 1024;
+        if (!force && batch->ApproximateSize() < s_batch_size) {
+            return true;
+        }
+        leveldb::WriteOptions options;
+        options.sync = force;
+        leveldb::Status st = _db->Write(options, batch);
+        batch->Clear();
+        return st.ok();
+    }
     std::string get_key_in_ns(const std::string& ns, const std::string& key) const {
         return std::string("/") + ns + "/" + key;
     }
 private:
     std::mutex _mu;
+    std::unique_ptr<leveldb::Cache> _cache;
     std::unique_ptr<leveldb::DB> _db;
 };
 
@@ -138,6 +272,24 @@ DataStore* DataStoreFactory::get() {
     return _s_store.get();
 }
 
+DataStore* DataStoreFactory::open(const std::string& path, int64_t block_cache_size) {
+    leveldb::Options options;
+    options.create_if_missing = true;
+    options.compression = leveldb::kSnappyCompression;
+    std::unique_ptr<leveldb::Cache> cache;
+    if (block_cache_size > 0) {
+        cache.reset(leveldb::NewLRUCache(block_cache_size));
+        options.block_cache = cache.get();
+    }
+    leveldb::DB* db = nullptr;
+    leveldb::Status st = leveldb::DB::Open(options, path, &db);
+    if (!st.ok() || db == nullptr) {
+        LOG(WARNING, "[data]: open %s failed: %s", path.c_str(), st.ToString().c_str());
+        return nullptr;
+    }
+    return new DataStoreImpl(db, cache.release());
+}
+
 } // namespace storage
 } // namespace orion
 
@@ -6,7 +6,9 @@
 
 #ifndef ORION_STORAGE_DATA_STORE_H
 #define ORION_STORAGE_DATA_STORE_H
+#include <stdint.h>
 #include <string>
+#include <vector>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -29,20 +31,93 @@ public:
     virtual ~DataIterator() { }
 };
 
+/// a group of writes which are applied to storage atomically
+class WriteBatch {
+public:
+    struct Op {
+        std::string ns;
+        std::string key;
+        std::string value;
+        bool deleted;
+    };
+
+    void put(const std::string& ns, const std::string& key, const std::string& value) {
+        _ops.push_back(Op{ ns, key, value, false });
+    }
+    void remove(const std::string& ns, const std::string& key) {
+        _ops.push_back(Op{ ns, key, "", true });
+    }
+    const std::vector<Op>& ops() const {
+        return _ops;
+    }
+    bool empty() const {
+        return _ops.empty();
+    }
+    void clear() {
+        _ops.clear();
+    }
+private:
+    std::vector<Op> _ops;
+};
+
+/// point-in-time view over all the namespaces of underlying storage
+class DataSnapshot {
+public:
+    /// fetches the next kv and its namespace, returns false if there is no more
+    virtual bool next(std::string& ns, std::string& key, std::string& value) = 0;
+
+    virtual ~DataSnapshot() { }
+};
+
 /// interface of underlying storage, provide namespace and kv i/o
 class DataStore {
 public:
     virtual int32_t get(std::string& value, const std::string& ns,
             const std::string& key) const = 0;
+    /**
+     * @brief Reads many keys of a namespace, by calling get for every key
+     *        unless storage is able to read them from one consistent view
+     * @param values    [OUT] value of every key, empty if the key is not found
+     * @param statuses  [OUT] status of every key
+     * @param ns        [IN] namespace of the keys
+     * @param keys      [IN] keys to read
+     */
+    virtual void multi_get(std::vector<std::string>* values, std::vector<int32_t>* statuses,
+            const std::string& ns, const std::vector<std::string>& keys) const {
+        values->assign(keys.size(), "");
+        statuses->resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            (*statuses)[i] = get((*values)[i], ns, keys[i]);
+        }
+    }
     virtual int32_t put(const std::string& ns, const std::string& key,
             const std::string& value) = 0;
     virtual int32_t remove(const std::string& ns, const std::string& key) = 0;
+    /// applies all the writes in batch atomically
+    virtual int32_t write(const WriteBatch& batch) = 0;
     /**
      * @brief Returns DataIterator for a certain namespace
      * @param ns  [IN] namespace of the data
      * @return    DataIterator pointer which needs to call seek first
      */
     virtual DataIterator* iter(const std::string& ns) const = 0;
+    /**
+     * @brief Returns a consistent view over the whole storage,
+     *        writers are not blocked while the view is alive
+     * @return    DataSnapshot pointer, user needs to delete it
+     */
+    virtual DataSnapshot* snapshot() const = 0;
+    /**
+     * @brief Replaces all the data in storage with the content of a snapshot,
+     *        the marker key is removed before any other change and written
+     *        last, so a store interrupted halfway has no marker
+     * @param snapshot    [IN] source of the new data
+     * @param marker_ns   [IN] namespace of the marker key
+     * @param marker_key  [IN] marker key, its value is taken from the snapshot
+     * @return            OK if all the data has been replaced
+     */
+    virtual int32_t restore(DataSnapshot* snapshot, const std::string& marker_ns,
+            const std::string& marker_key) = 0;
 
     virtual ~DataStore() { }
 };
@@ -51,6 +126,10 @@ public:
 class DataStoreFactory {
 public:
     static DataStore* get();
+    /// opens a standalone store under path, returns nullptr on failure
+    /// user needs to delete the returned pointer. Store gets a block cache
+    /// of its own if block_cache_size is positive, or shares the default one
+    static DataStore* open(const std::string& path, int64_t block_cache_size = 0);
 private:
     static std::unique_ptr<DataStore> _s_store;
 };
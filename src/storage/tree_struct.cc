@@ -17,8 +17,9 @@ namespace storage {
 /// iterator on the tree structure
 class TreeIterator : public StructureIterator {
 public:
-    TreeIterator(DataIterator* it, const std::string& prefix) :
-            _it(it), _prefix(prefix) {
+    /// iterating stops before end if it is not empty
+    TreeIterator(DataIterator* it, const std::string& prefix, const std::string& end = "") :
+            _it(it), _prefix(prefix), _end(end) {
         if (done()) {
             return;
         }
@@ -44,7 +45,8 @@ public:
     }
 
     virtual bool done() const {
-        return _it->done() || (_it->key().compare(0, _prefix.length(), _prefix) != 0);
+        return _it->done() || (_it->key().compare(0, _prefix.length(), _prefix) != 0)
+            || (!_end.empty() && _it->key() >= _end);
     }
 
     virtual StructureIterator* next() {
@@ -77,6 +79,7 @@ private:
     std::unique_ptr<DataIterator> _it;
     // record parent directory and abort scanning accordingly
     std::string _prefix;
+    std::string _end;
     std::string _key;
     ValueInfo _value;
 };
@@ -97,6 +100,30 @@ int32_t TreeStructure::get(ValueInfo& info, const std::string& ns,
     return status_code::OK;
 }
 
+void TreeStructure::multi_get(std::vector<ValueInfo>* infos, std::vector<int32_t>* statuses,
+        const std::string& ns, const std::vector<std::string>& keys) const {
+    std::vector<std::string> structured_keys;
+    structured_keys.reserve(keys.size());
+    for (const auto& key : keys) {
+        structured_keys.push_back(get_structured_key(key));
+    }
+    std::vector<std::string> raw_values;
+    _underlying->multi_get(&raw_values, statuses, ns, structured_keys);
+    infos->assign(keys.size(), ValueInfo());
+    serialize::DataValue value;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if ((*statuses)[i] != status_code::OK) {
+            continue;
+        }
+        if (!value.ParseFromString(raw_values[i])) {
+            (*statuses)[i] = status_code::INVALID;
+            continue;
+        }
+        (*infos)[i] = { value.type() == serialize::NODE_TEMP, value.has_value(),
+                        value.value(), value.owner() };
+    }
+}
+
 int32_t TreeStructure::put(const std::string& ns, const std::string& key,
         const ValueInfo& info) {
     // prepare data value
@@ -165,6 +192,28 @@ StructureIterator* TreeStructure::list(const std::string& ns,
     return new TreeIterator(it->seek(list_key), list_key);
 }
 
+StructureIterator* TreeStructure::list(const std::string& ns, const std::string& key,
+        const std::string& after) const {
+    if (after.empty()) {
+        return list(ns, key);
+    }
+    auto it = _underlying->iter(ns);
+    // the smallest key greater than after
+    std::string start = get_structured_key(after);
+    start.push_back('\0');
+    return new TreeIterator(it->seek(start), get_list_key(key));
+}
+
+StructureIterator* TreeStructure::scan(const std::string& ns, const std::string& start,
+        const std::string& end) const {
+    auto it = _underlying->iter(ns);
+    const std::string& structured_start = get_structured_key(start);
+    // nodes of the same depth share the level prefix
+    std::string level = structured_start.substr(0, structured_start.find('#') + 1);
+    return new TreeIterator(it->seek(structured_start), level,
+            end.empty() ? "" : level + end);
+}
+
 } // namespace storage
 } // namespace orion
 
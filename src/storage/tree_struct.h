@@ -27,6 +27,15 @@ public:
 
     virtual int32_t get(ValueInfo& info, const std::string& ns,
             const std::string& key) const;
+    /**
+     * @brief Reads many nodes of a namespace in one storage read
+     * @param infos     [OUT] node of every key
+     * @param statuses  [OUT] status of every key
+     * @param ns        [IN] namespace of the keys
+     * @param keys      [IN] keys of the nodes
+     */
+    void multi_get(std::vector<ValueInfo>* infos, std::vector<int32_t>* statuses,
+            const std::string& ns, const std::vector<std::string>& keys) const;
     virtual int32_t put(const std::string& ns, const std::string& key,
             const ValueInfo& info);
     /// removes an empty node which has no children nodes
@@ -42,6 +51,19 @@ public:
      */
     virtual StructureIterator* list(const std::string& ns,
             const std::string& key) const;
+    /// same as above, but starts from the first child after the given one
+    StructureIterator* list(const std::string& ns, const std::string& key,
+            const std::string& after) const;
+    /**
+     * @brief Returns a iterator over the nodes at the same depth as start,
+     *        whose keys are in [start, end), in order of keys
+     * @param ns     [IN] namespace of the nodes
+     * @param start  [IN] the first key to visit, must not be empty
+     * @param end    [IN] the key to stop at, no limit if it is empty
+     * @return       a StructureIterator pointer
+     */
+    StructureIterator* scan(const std::string& ns, const std::string& start,
+            const std::string& end) const;
 private:
     /// returns the key used in underlying storage
     std::string get_structured_key(const std::string& key) const {
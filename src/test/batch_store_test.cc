@@ -0,0 +1,87 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "storage/batch_store.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <memory>
+#include "storage/tree_struct.h"
+#include "test/mock_data_store.h"
+#include "common/const.h"
+
+TEST(BatchStoreTest, ReadYourWrites) {
+    orion::testcase::MockDataStore base;
+    base.put("ns", "a", "1");
+    base.put("ns", "b", "2");
+    base.put("ns", "c", "3");
+    orion::storage::BatchStore batch(&base);
+    std::string value;
+
+    EXPECT_EQ(batch.put("ns", "b", "22"), orion::status_code::OK);
+    EXPECT_EQ(batch.remove("ns", "c"), orion::status_code::OK);
+    EXPECT_EQ(batch.remove("ns", "x"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(batch.put("ns", "d", "4"), orion::status_code::OK);
+    EXPECT_EQ(batch.put("other", "e", "5"), orion::status_code::OK);
+
+    EXPECT_EQ(batch.get(value, "ns", "b"), orion::status_code::OK);
+    EXPECT_EQ(value, "22");
+    EXPECT_EQ(batch.get(value, "ns", "c"), orion::status_code::NOT_FOUND);
+    // nothing reaches underlying store before commit
+    EXPECT_EQ(base.get(value, "ns", "b"), orion::status_code::OK);
+    EXPECT_EQ(value, "2");
+    EXPECT_EQ(base.get(value, "ns", "d"), orion::status_code::NOT_FOUND);
+
+    // iterator merges buffered writes in key order
+    std::string keys;
+    std::string values;
+    std::unique_ptr<orion::storage::DataIterator> it(batch.iter("ns"));
+    for (it->seek(""); !it->done(); it->next()) {
+        keys += it->key();
+        values += it->value();
+    }
+    EXPECT_EQ(keys, "abd");
+    EXPECT_EQ(values, "1224");
+    // a namespace which only exists in batch
+    it.reset(batch.iter("other"));
+    it->seek("");
+    ASSERT_FALSE(it->done());
+    EXPECT_EQ(it->key(), "e");
+    EXPECT_TRUE(it->next()->done());
+
+    EXPECT_EQ(batch.commit(), orion::status_code::OK);
+    EXPECT_TRUE(batch.empty());
+    EXPECT_EQ(base.get(value, "ns", "b"), orion::status_code::OK);
+    EXPECT_EQ(value, "22");
+    EXPECT_EQ(base.get(value, "ns", "c"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(base.get(value, "other", "e"), orion::status_code::OK);
+    EXPECT_EQ(value, "5");
+}
+
+TEST(BatchStoreTest, TreeOnBatch) {
+    orion::testcase::MockDataStore base;
+    orion::storage::BatchStore batch(&base);
+    orion::storage::TreeStructure tree(&batch);
+    orion::storage::ValueInfo value = { false, false, "v", "" };
+
+    // parent nodes created in the batch are visible to following writes
+    EXPECT_EQ(tree.put("", "/a/b", value), orion::status_code::OK);
+    EXPECT_EQ(tree.remove("", "/a"), orion::status_code::INVALID);
+    EXPECT_EQ(tree.remove("", "/a/b"), orion::status_code::OK);
+    EXPECT_EQ(tree.remove("", "/a"), orion::status_code::OK);
+    EXPECT_EQ(tree.put("", "/c", value), orion::status_code::OK);
+    EXPECT_EQ(batch.commit(), orion::status_code::OK);
+
+    orion::storage::TreeStructure direct(&base);
+    EXPECT_EQ(direct.get(value, "", "/a"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(direct.get(value, "", "/c"), orion::status_code::OK);
+    EXPECT_EQ(value.value, "v");
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,243 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "cluster.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "server/multi_raft.h"
+#include "server/raft_service.h"
+#include "server/orion_service.h"
+#include "common/const.h"
+
+namespace orion {
+namespace testcase {
+
+static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// returns the value at ratio of sorted values
+static int64_t percentile(const std::vector<int64_t>& sorted, double ratio) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t pos = static_cast<size_t>(ratio * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(pos, sorted.size() - 1)];
+}
+
+std::string WriteReport::to_string() const {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "count: %ld, failed: %ld, elapsed: %ldms, "
+            "throughput: %.1f/s, latency(us) p50: %ld, p90: %ld, p99: %ld, max: %ld",
+            count, failed, elapsed_ms, throughput, latency_p50, latency_p90,
+            latency_p99, latency_max);
+    return buffer;
+}
+
+Cluster::Cluster(const ClusterOptions& options) :
+        _options(options), _network(options.network_threads, options.rpc_timeout_ms),
+        _nodes(options.node_num) {
+    _network.set_link(options.link);
+    _options.raft.members.clear();
+    for (int32_t i = 0; i < _options.node_num; ++i) {
+        _options.raft.members.push_back(addr(i));
+    }
+}
+
+Cluster::~Cluster() {
+    for (int32_t i = 0; i < _options.node_num; ++i) {
+        stop_node(i);
+    }
+}
+
+bool Cluster::start() {
+    for (int32_t i = 0; i < _options.node_num; ++i) {
+        if (!start_node(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Cluster::start_node(int32_t i) {
+    Node& node = _nodes[i];
+    if (node.raft != nullptr) {
+        return false;
+    }
+    raft::RaftOptions options = _options.raft;
+    options.self = addr(i);
+    options.data_dir = _options.data_dir + "/node_" + std::to_string(i);
+    node.raft.reset(new server::MultiRaft(options, _options.group_num,
+                _network.channel_factory(options.self)));
+    if (!node.raft->start()) {
+        node.raft.reset();
+        return false;
+    }
+    // raft nodes are created by start
+    node.service.reset(new raft::RaftService(node.raft->nodes()));
+    node.orion_service.reset(new server::OrionServiceImpl(node.raft.get()));
+    _network.add_node(options.self, node.service.get());
+    _network.add_node(options.self, node.orion_service.get());
+    return true;
+}
+
+void Cluster::stop_node(int32_t i) {
+    Node& node = _nodes[i];
+    if (node.raft == nullptr) {
+        return;
+    }
+    _network.remove_node(addr(i));
+    node.raft.reset();
+    node.service.reset();
+    node.orion_service.reset();
+}
+
+bool Cluster::is_running(int32_t i) const {
+    return _nodes[i].raft != nullptr;
+}
+
+int64_t Cluster::start_time_ms(int32_t i) const {
+    const Node& node = _nodes[i];
+    return node.raft != nullptr ? node.raft->start_time_ms() : -1;
+}
+
+std::string Cluster::addr(int32_t i) const {
+    return "node_" + std::to_string(i);
+}
+
+raft::RaftNode* Cluster::raft_node(int32_t i, int32_t group_id) const {
+    const Node& node = _nodes[i];
+    return node.raft != nullptr ? node.raft->node(group_id) : nullptr;
+}
+
+storage::DataStore* Cluster::store(int32_t i, int32_t group_id) const {
+    const Node& node = _nodes[i];
+    return node.raft != nullptr ? node.raft->store(group_id) : nullptr;
+}
+
+int32_t Cluster::find_leader(int32_t group_id) const {
+    int32_t leader = -1;
+    int64_t term = -1;
+    // an old leader may not know it is deposed yet, the one with latest term wins
+    for (int32_t i = 0; i < _options.node_num; ++i) {
+        raft::RaftNode* node = raft_node(i, group_id);
+        if (node != nullptr && node->is_leader() && node->current_term() > term) {
+            leader = i;
+            term = node->current_term();
+        }
+    }
+    return leader;
+}
+
+int32_t Cluster::wait_leader(int32_t group_id, int64_t timeout_ms) const {
+    int64_t deadline = now_us() + timeout_ms * 1000;
+    do {
+        int32_t leader = find_leader(group_id);
+        if (leader >= 0) {
+            return leader;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } while (now_us() < deadline);
+    return -1;
+}
+
+WriteReport Cluster::write(int32_t group_id, int64_t count, int32_t concurrency,
+        size_t value_size) {
+    // state is shared with callbacks, which may outlive this call if the leader is lost
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cond;
+        int64_t in_flight;
+        std::vector<int64_t> latencies;
+    };
+    std::shared_ptr<State> state(new State());
+    state->in_flight = 0;
+    WriteReport report;
+    report.count = count;
+    const std::string value(value_size, 'v');
+    int64_t start = now_us();
+    for (int64_t i = 0; i < count; ++i) {
+        {
+            std::unique_lock<std::mutex> locker(state->mutex);
+            while (state->in_flight >= concurrency) {
+                state->cond.wait(locker);
+            }
+            ++state->in_flight;
+        }
+        raft::Entry entry;
+        entry.set_op(raft_op::PUT);
+        entry.set_ns("bench");
+        entry.set_key("/key_" + std::to_string(i));
+        entry.set_value(value);
+        int64_t begin = now_us();
+        auto done = [state, begin](int32_t status) {
+            std::lock_guard<std::mutex> locker(state->mutex);
+            if (status == status_code::OK) {
+                state->latencies.push_back(now_us() - begin);
+            }
+            --state->in_flight;
+            state->cond.notify_all();
+        };
+        int32_t leader = wait_leader(group_id, _options.raft.election_timeout * 10L);
+        raft::RaftNode* node = leader >= 0 ? raft_node(leader, group_id) : nullptr;
+        if (node == nullptr || node->propose(entry, done) != status_code::OK) {
+            done(status_code::NOT_LEADER);
+        }
+    }
+    std::unique_lock<std::mutex> locker(state->mutex);
+    // entries of a deposed leader may never be applied
+    state->cond.wait_for(locker, std::chrono::seconds(30), [state] {
+        return state->in_flight == 0;
+    });
+    report.elapsed_ms = (now_us() - start) / 1000;
+    report.failed = count - static_cast<int64_t>(state->latencies.size());
+    report.throughput = state->latencies.size() * 1000.0 / std::max(report.elapsed_ms, 1L);
+    std::vector<int64_t> latencies = state->latencies;
+    std::sort(latencies.begin(), latencies.end());
+    report.latency_p50 = percentile(latencies, 0.5);
+    report.latency_p90 = percentile(latencies, 0.9);
+    report.latency_p99 = percentile(latencies, 0.99);
+    report.latency_max = latencies.empty() ? 0 : latencies.back();
+    return report;
+}
+
+int64_t Cluster::measure_election(int32_t group_id, int64_t timeout_ms) {
+    int32_t old_leader = wait_leader(group_id, timeout_ms);
+    if (old_leader < 0) {
+        return -1;
+    }
+    int64_t start = now_us();
+    stop_node(old_leader);
+    int32_t leader = wait_leader(group_id, timeout_ms);
+    return leader >= 0 ? (now_us() - start) / 1000 : -1;
+}
+
+int64_t Cluster::wait_catch_up(int32_t group_id, int32_t i, int64_t timeout_ms) {
+    int32_t leader = wait_leader(group_id, timeout_ms);
+    raft::RaftNode* node = raft_node(i, group_id);
+    if (leader < 0 || node == nullptr) {
+        return -1;
+    }
+    int64_t target = raft_node(leader, group_id)->commit_index();
+    int64_t start = now_us();
+    int64_t deadline = start + timeout_ms * 1000;
+    while (node->applied_index() < target) {
+        if (now_us() >= deadline) {
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return (now_us() - start) / 1000;
+}
+
+} // namespace testcase
+} // namespace orion
@@ -0,0 +1,145 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_TEST_CLUSTER_H
+#define ORION_TEST_CLUSTER_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "server/raft_node.h"
+#include "test/sim_network.h"
+
+namespace orion {
+
+namespace raft {
+
+class RaftService; // forward declaration
+
+} // namespace raft
+
+namespace server {
+
+class MultiRaft; // forward declaration
+class OrionServiceImpl; // forward declaration
+
+} // namespace server
+
+namespace testcase {
+
+struct ClusterOptions {
+    // number of nodes, 3 to 7 in general
+    int32_t node_num;
+    int32_t group_num;
+    // every node keeps its data under data_dir/node_i
+    std::string data_dir;
+    // shared by all the nodes, self, members and data dir are filled for every node
+    raft::RaftOptions raft;
+    LinkOptions link;
+    int32_t network_threads;
+    // a lost rpc fails after this time
+    int32_t rpc_timeout_ms;
+
+    ClusterOptions() : node_num(3), group_num(1), network_threads(4), rpc_timeout_ms(200) {
+        raft.election_timeout = 150;
+        raft.heartbeat_interval = 30;
+        raft.thread_num = 4;
+    }
+};
+
+/// result of a write workload
+struct WriteReport {
+    int64_t count;
+    int64_t failed;
+    int64_t elapsed_ms;
+    // committed entries per second
+    double throughput;
+    // latency from propose to apply on leader, in microseconds
+    int64_t latency_p50;
+    int64_t latency_p90;
+    int64_t latency_p99;
+    int64_t latency_max;
+
+    WriteReport() : count(0), failed(0), elapsed_ms(0), throughput(0), latency_p50(0),
+            latency_p90(0), latency_p99(0), latency_max(0) { }
+    std::string to_string() const;
+};
+
+/**
+ * @brief Orion nodes running in one process and connected by SimNetwork
+ *
+ * Every node hosts the raft groups of a real server, only the network is simulated.
+ * Nodes can be stopped and restarted on their data to simulate crashes,
+ * and the network may be slowed down, made lossy or partitioned.
+ * Methods measuring performance block until the measured event happens.
+ */
+class Cluster {
+public:
+    Cluster(const ClusterOptions& options);
+    ~Cluster();
+    /// disable copy and move for cluster
+    Cluster(const Cluster&) = delete;
+    void operator=(const Cluster&) = delete;
+
+    /// starts all the nodes
+    bool start();
+    /// starts node i on its data, it must not be running
+    bool start_node(int32_t i);
+    /// crashes node i, rpc in flight are finished first
+    void stop_node(int32_t i);
+    bool is_running(int32_t i) const;
+    /// milliseconds spent by node i to recover on its last start
+    int64_t start_time_ms(int32_t i) const;
+
+    int32_t node_num() const {
+        return _options.node_num;
+    }
+    std::string addr(int32_t i) const;
+    SimNetwork* network() {
+        return &_network;
+    }
+    /// returns nullptr if node i is not running
+    raft::RaftNode* raft_node(int32_t i, int32_t group_id) const;
+    storage::DataStore* store(int32_t i, int32_t group_id) const;
+
+    /// waits until a running node becomes leader of group,
+    /// returns index of the leader or -1 on timeout
+    int32_t wait_leader(int32_t group_id, int64_t timeout_ms) const;
+    /**
+     * @brief Proposes puts of keys /key_0, /key_1 ... to namespace bench
+     *        of the leader of a group and waits until they are applied
+     * @param group_id     [IN] group to write
+     * @param count        [IN] number of entries
+     * @param concurrency  [IN] max entries in flight
+     * @param value_size   [IN] size of every value
+     * @return             throughput and latency of the workload
+     */
+    WriteReport write(int32_t group_id, int64_t count, int32_t concurrency, size_t value_size);
+    /// crashes the leader of group and returns milliseconds until another node is
+    /// elected, -1 on timeout. The old leader is left stopped
+    int64_t measure_election(int32_t group_id, int64_t timeout_ms);
+    /// returns milliseconds until node i applies all the entries committed by leader
+    /// when called, -1 on timeout
+    int64_t wait_catch_up(int32_t group_id, int32_t i, int64_t timeout_ms);
+private:
+    struct Node {
+        std::unique_ptr<server::MultiRaft> raft;
+        std::unique_ptr<raft::RaftService> service;
+        // serves clients connected to the network
+        std::unique_ptr<server::OrionServiceImpl> orion_service;
+    };
+    /// returns -1 if there is no leader
+    int32_t find_leader(int32_t group_id) const;
+private:
+    ClusterOptions _options;
+    SimNetwork _network;
+    std::vector<Node> _nodes;
+};
+
+} // namespace testcase
+} // namespace orion
+
+#endif // ORION_TEST_CLUSTER_H
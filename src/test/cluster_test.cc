@@ -0,0 +1,198 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "test/cluster.h"
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "storage/data_store.h"
+#include "storage/tree_struct.h"
+#include "common/const.h"
+
+namespace orion {
+namespace testcase {
+
+/// creates an empty directory for a test cluster
+std::string make_cluster_dir() {
+    char dir[] = "/tmp/orion_cluster_XXXXXX";
+    return mkdtemp(dir);
+}
+
+/// returns true if node i has applied the put of key
+bool has_key(Cluster* cluster, int32_t i, const std::string& key) {
+    storage::DataStore* store = cluster->store(i, 0);
+    if (store == nullptr) {
+        return false;
+    }
+    storage::ValueInfo info;
+    return storage::TreeStructure(store).get(info, "bench", key) == status_code::OK;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(ClusterTest, Replication) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    orion::testcase::WriteReport report = cluster.write(0, 200, 10, 100);
+    EXPECT_EQ(report.failed, 0);
+    for (int32_t i = 0; i < cluster.node_num(); ++i) {
+        ASSERT_GE(cluster.wait_catch_up(0, i, 5000), 0);
+        EXPECT_TRUE(orion::testcase::has_key(&cluster, i, "/key_199"));
+    }
+}
+
+TEST(ClusterTest, PartitionAndRestart) {
+    orion::testcase::ClusterOptions options;
+    options.node_num = 5;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    int32_t leader = cluster.wait_leader(0, 5000);
+    ASSERT_GE(leader, 0);
+    // the isolated leader can no longer commit, the majority elects a new one
+    cluster.network()->partition({cluster.addr(leader)});
+    int32_t new_leader = leader;
+    for (int i = 0; i < 500 && new_leader == leader; ++i) {
+        usleep(10000);
+        new_leader = cluster.wait_leader(0, 5000);
+    }
+    ASSERT_NE(new_leader, leader);
+    // one more follower crashes, the other three are still a majority
+    int32_t crashed = 0;
+    while (crashed == leader || crashed == new_leader) {
+        ++crashed;
+    }
+    cluster.stop_node(crashed);
+    EXPECT_EQ(cluster.write(0, 100, 10, 100).failed, 0);
+    // the old leader steps down and catches up once the partition is healed,
+    // and the stopped node recovers from its own log
+    cluster.network()->heal();
+    for (int32_t i = 0; i < cluster.node_num(); ++i) {
+        if (!cluster.is_running(i)) {
+            ASSERT_TRUE(cluster.start_node(i));
+        }
+    }
+    for (int32_t i = 0; i < cluster.node_num(); ++i) {
+        ASSERT_GE(cluster.wait_catch_up(0, i, 5000), 0);
+        EXPECT_TRUE(orion::testcase::has_key(&cluster, i, "/key_99"));
+    }
+}
+
+TEST(ClusterTest, FullRestart) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    EXPECT_EQ(cluster.write(0, 200, 10, 100).failed, 0);
+    std::vector<int64_t> applied;
+    for (int32_t i = 0; i < cluster.node_num(); ++i) {
+        ASSERT_GE(cluster.wait_catch_up(0, i, 5000), 0);
+    }
+    for (int32_t i = 0; i < cluster.node_num(); ++i) {
+        applied.push_back(cluster.raft_node(i, 0)->applied_index());
+        cluster.stop_node(i);
+    }
+    // applied entries are not applied again, every node resumes where it stopped
+    for (int32_t i = 0; i < cluster.node_num(); ++i) {
+        ASSERT_TRUE(cluster.start_node(i));
+        EXPECT_EQ(cluster.raft_node(i, 0)->applied_index(), applied[i]);
+        EXPECT_TRUE(orion::testcase::has_key(&cluster, i, "/key_199"));
+    }
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    EXPECT_EQ(cluster.write(0, 10, 10, 100).failed, 0);
+}
+
+TEST(ClusterTest, InstallSnapshot) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    options.raft.snapshot_interval = 100;
+    options.raft.snapshot_min_entries = 50;
+    options.raft.snapshot_keep_entries = 0;
+    options.raft.log_segment_size = 1024;
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    int32_t leader = cluster.wait_leader(0, 5000);
+    ASSERT_GE(leader, 0);
+    int32_t stopped = (leader + 1) % cluster.node_num();
+    cluster.stop_node(stopped);
+    EXPECT_EQ(cluster.write(0, 200, 10, 100).failed, 0);
+    // the stopped node is behind the compacted log of the others and gets a snapshot
+    for (int i = 0; i < 500 && cluster.raft_node(leader, 0)->snapshot_index() == 0; ++i) {
+        usleep(10000);
+    }
+    ASSERT_GT(cluster.raft_node(leader, 0)->snapshot_index(), 0);
+    ASSERT_TRUE(cluster.start_node(stopped));
+    ASSERT_GE(cluster.wait_catch_up(0, stopped, 5000), 0);
+    // a leader elected meanwhile may not have committed the last writes again yet
+    for (int i = 0; i < 500 && !orion::testcase::has_key(&cluster, stopped, "/key_199"); ++i) {
+        usleep(10000);
+    }
+    EXPECT_TRUE(orion::testcase::has_key(&cluster, stopped, "/key_199"));
+    // the node keeps serving the entries following the snapshot
+    EXPECT_EQ(cluster.write(0, 10, 10, 100).failed, 0);
+    ASSERT_GE(cluster.wait_catch_up(0, stopped, 5000), 0);
+}
+
+TEST(ClusterTest, LossyNetwork) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    options.link.latency_ms = 2;
+    options.link.jitter_ms = 3;
+    options.link.drop_rate = 0.05;
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    cluster.write(0, 200, 10, 100);
+    for (int32_t i = 0; i < cluster.node_num(); ++i) {
+        ASSERT_GE(cluster.wait_catch_up(0, i, 10000), 0);
+    }
+    EXPECT_GT(cluster.network()->dropped(), 0);
+}
+
+/// prints replication metrics, node number and link latency are taken from
+/// ORION_BENCH_NODES and ORION_BENCH_LATENCY if set
+TEST(ClusterTest, Benchmark) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    const char* nodes = getenv("ORION_BENCH_NODES");
+    const char* latency = getenv("ORION_BENCH_LATENCY");
+    options.node_num = nodes != nullptr ? atoi(nodes) : 3;
+    options.link.latency_ms = latency != nullptr ? atoi(latency) : 1;
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    orion::testcase::WriteReport report = cluster.write(0, 2000, 64, 256);
+    printf("nodes: %d, latency: %dms\n", options.node_num, options.link.latency_ms);
+    printf("write: %s\n", report.to_string().c_str());
+    // the follower misses entries written while it is down
+    int32_t leader = cluster.wait_leader(0, 5000);
+    int32_t lagger = (leader + 1) % cluster.node_num();
+    cluster.stop_node(lagger);
+    cluster.write(0, 2000, 64, 256);
+    ASSERT_TRUE(cluster.start_node(lagger));
+    int64_t catch_up = cluster.wait_catch_up(0, lagger, 10000);
+    orion::raft::EntryCacheStats stats = cluster.raft_node(leader, 0)->log_cache_stats();
+    printf("restart: %ldms, catch up: %ldms, log cache hit rate: %.3f\n",
+            cluster.start_time_ms(lagger), catch_up, stats.hit_rate());
+    int64_t election = cluster.measure_election(0, 5000);
+    printf("election: %ldms\n", election);
+    EXPECT_GE(catch_up, 0);
+    EXPECT_GE(election, 0);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,210 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "server/lease_table.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "proto/serialize.pb.h"
+#include "common/const.h"
+
+namespace orion {
+namespace testcase {
+
+/// a single group whose storage and log are faked, revoked leases are applied at once
+class LeaseGroup {
+public:
+    /// deadlines follow a clock moved by advance if manual, the steady clock if not
+    explicit LeaseGroup(int64_t term = 1, bool manual = false) : _term(term), _now(0),
+            _failures(0), _revokes(0) {
+        server::LeaseOptions options;
+        options.check_interval = 20;
+        if (manual) {
+            options.clock = [this]() { return _now.load(); };
+        }
+        _table.reset(new server::LeaseTable(1, [this](int32_t) { return _term.load(); },
+                    std::bind(&LeaseGroup::load, this, std::placeholders::_2),
+                    std::bind(&LeaseGroup::revoke, this, std::placeholders::_2), options));
+    }
+    ~LeaseGroup() {
+        _table->stop();
+    }
+
+    void grant(int64_t lease_id, int64_t ttl) {
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            _stored[lease_id] = ttl;
+        }
+        raft::Entry entry;
+        entry.set_term(_term);
+        entry.set_op(raft_op::GRANT_LEASE);
+        entry.set_key("");
+        entry.set_value(std::to_string(ttl));
+        entry.set_session_id(lease_id);
+        _table->on_apply(0, 0, entry, raft::ApplyResult(status_code::OK));
+    }
+    std::vector<int64_t> keep_alive(const std::vector<int64_t>& leases, int32_t* status) {
+        std::vector<int64_t> expired;
+        *status = _table->keep_alive(0, _term, leases, &expired);
+        return expired;
+    }
+    bool stored(int64_t lease_id) {
+        std::lock_guard<std::mutex> locker(_mutex);
+        return _stored.count(lease_id) > 0;
+    }
+    size_t stored_num() {
+        std::lock_guard<std::mutex> locker(_mutex);
+        return _stored.size();
+    }
+    server::LeaseTable* table() {
+        return _table.get();
+    }
+    void set_term(int64_t term) {
+        _term = term;
+    }
+    void advance(int64_t ms) {
+        _now += ms;
+    }
+    /// the next revocations fail before reaching the log
+    void fail(int32_t failures) {
+        _failures = failures;
+    }
+    int32_t revokes() const {
+        return _revokes;
+    }
+private:
+    void load(std::map<int64_t, int64_t>* leases) {
+        std::lock_guard<std::mutex> locker(_mutex);
+        *leases = _stored;
+    }
+    int32_t revoke(const std::vector<int64_t>& leases) {
+        if (_failures > 0) {
+            --_failures;
+            return status_code::TIMEOUT;
+        }
+        ++_revokes;
+        serialize::LeaseList list;
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            for (int64_t lease_id : leases) {
+                _stored.erase(lease_id);
+                list.add_ids(lease_id);
+            }
+        }
+        raft::Entry entry;
+        entry.set_term(_term);
+        entry.set_op(raft_op::REVOKE_LEASES);
+        entry.set_key("");
+        entry.set_value(list.SerializeAsString());
+        _table->on_apply(0, 0, entry, raft::ApplyResult(status_code::OK));
+        return status_code::OK;
+    }
+private:
+    std::atomic<int64_t> _term;
+    std::atomic<int64_t> _now;
+    std::atomic<int32_t> _failures;
+    std::atomic<int32_t> _revokes;
+    std::mutex _mutex;
+    std::map<int64_t, int64_t> _stored;
+    std::unique_ptr<server::LeaseTable> _table;
+};
+
+/// waits until storage keeps no more than num leases
+bool wait_stored(LeaseGroup* group, size_t num, int64_t timeout_ms) {
+    for (int64_t i = 0; i < timeout_ms / 10 && group->stored_num() > num; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return group->stored_num() <= num;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(LeaseTableTest, ExpireInBatch) {
+    orion::testcase::LeaseGroup group(1, true);
+    int32_t status = 0;
+    // leader serves keepalives before the grants are applied
+    EXPECT_TRUE(group.keep_alive({}, &status).empty());
+    const int64_t lease_num = 1000;
+    std::vector<int64_t> kept;
+    for (int64_t i = 1; i <= lease_num; ++i) {
+        group.grant(i, 200);
+        if (i % 2 == 0) {
+            kept.push_back(i);
+        }
+    }
+    EXPECT_EQ(group.table()->stats().leases, lease_num);
+    // one keepalive renews all the leases of a client
+    for (int i = 0; i < 8; ++i) {
+        group.advance(50);
+        EXPECT_TRUE(group.keep_alive(kept, &status).empty());
+        EXPECT_EQ(status, orion::status_code::OK);
+    }
+    ASSERT_TRUE(orion::testcase::wait_stored(&group, kept.size(), 2000));
+    for (int64_t lease_id : kept) {
+        EXPECT_TRUE(group.stored(lease_id));
+    }
+    // leases granted at the same time expire in the same tick and share an entry
+    EXPECT_EQ(group.revokes(), 1);
+    orion::server::LeaseStats stats = group.table()->stats();
+    EXPECT_EQ(stats.leases, static_cast<int64_t>(kept.size()));
+    EXPECT_EQ(stats.expired, lease_num - static_cast<int64_t>(kept.size()));
+    EXPECT_EQ(stats.keepalives, 9);
+    EXPECT_EQ(stats.renewals, 8 * static_cast<int64_t>(kept.size()));
+    // revoked leases are reported expired to their clients
+    std::vector<int64_t> expired = group.keep_alive({1, 2}, &status);
+    EXPECT_EQ(expired, std::vector<int64_t>({1}));
+}
+
+TEST(LeaseTableTest, Lead) {
+    orion::testcase::LeaseGroup group(0);
+    int32_t status = 0;
+    // followers keep no deadlines
+    group.grant(1, 100);
+    group.grant(2, 100);
+    EXPECT_EQ(group.table()->stats().leases, 0);
+    group.keep_alive({1}, &status);
+    EXPECT_EQ(status, orion::status_code::NOT_LEADER);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(group.stored_num(), 2UL);
+    // a new leader loads the leases with a full ttl, and serves keepalives at once
+    group.set_term(2);
+    EXPECT_TRUE(group.keep_alive({1}, &status).empty());
+    EXPECT_EQ(status, orion::status_code::OK);
+    EXPECT_EQ(group.table()->stats().leases, 2);
+    ASSERT_TRUE(orion::testcase::wait_stored(&group, 0, 2000));
+    EXPECT_EQ(group.keep_alive({1, 2}, &status).size(), 2UL);
+    // leases are dropped once leadership is lost
+    group.grant(3, 100);
+    EXPECT_EQ(group.table()->stats().leases, 1);
+    group.set_term(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(group.table()->stats().leases, 0);
+    EXPECT_TRUE(group.stored(3));
+}
+
+TEST(LeaseTableTest, RetryRevoke) {
+    orion::testcase::LeaseGroup group;
+    int32_t status = 0;
+    EXPECT_TRUE(group.keep_alive({}, &status).empty());
+    group.fail(2);
+    group.grant(1, 50);
+    // expired lease is revoked again until the entry is proposed
+    ASSERT_TRUE(orion::testcase::wait_stored(&group, 0, 3000));
+    EXPECT_EQ(group.revokes(), 1);
+    EXPECT_EQ(group.keep_alive({1}, &status), std::vector<int64_t>({1}));
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
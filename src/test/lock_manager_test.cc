@@ -0,0 +1,157 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "server/lock_manager.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "common/const.h"
+
+namespace orion {
+namespace testcase {
+
+/// queues of waiters standing for storage, released through the lock manager
+class LockQueues {
+public:
+    LockQueues() : _next(0), _manager([this](int32_t, const std::string&,
+                const std::string& key) {
+                std::lock_guard<std::mutex> locker(_mutex);
+                auto& queue = _queues[key];
+                return queue.empty() ? std::string() : queue.front();
+            }) { }
+
+    std::string queue(const std::string& key) {
+        std::lock_guard<std::mutex> locker(_mutex);
+        std::string waiter = key + "/" + std::to_string(++_next);
+        _queues[key].push_back(waiter);
+        return waiter;
+    }
+    /// removes a waiter as unlock or lease revocation does
+    void remove(const std::string& key, const std::string& waiter, int32_t op) {
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            auto& queue = _queues[key];
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+                if (*it == waiter) {
+                    queue.erase(it);
+                    break;
+                }
+            }
+        }
+        raft::Entry entry;
+        entry.set_term(1);
+        entry.set_op(op);
+        entry.set_key(key);
+        entry.set_value("");
+        raft::ApplyResult result(status_code::OK);
+        result.removed.push_back(std::make_pair("", waiter));
+        _manager.on_apply(0, 0, entry, result);
+    }
+    server::LockManager* manager() {
+        return &_manager;
+    }
+private:
+    std::mutex _mutex;
+    std::map<std::string, std::deque<std::string> > _queues;
+    int64_t _next;
+    server::LockManager _manager;
+};
+
+} // namespace testcase
+} // namespace orion
+
+TEST(LockManagerTest, WakeInOrder) {
+    orion::testcase::LockQueues queues;
+    const int32_t waiter_num = 10;
+    std::vector<std::string> waiters;
+    for (int32_t i = 0; i < waiter_num; ++i) {
+        waiters.push_back(queues.queue("/lock"));
+    }
+    std::mutex mutex;
+    std::vector<int32_t> woken;
+    std::vector<int32_t> statuses(waiter_num, -1);
+    for (int32_t i = 0; i < waiter_num; ++i) {
+        queues.manager()->wait(0, "", "/lock", waiters[i], 10000, [&, i](int32_t status) {
+                    std::lock_guard<std::mutex> locker(mutex);
+                    statuses[i] = status;
+                    woken.push_back(i);
+                });
+    }
+    // holder is answered at once, the others are parked
+    EXPECT_EQ(woken, std::vector<int32_t>({0}));
+    EXPECT_EQ(queues.manager()->stats().waiting, waiter_num - 1);
+    // every release wakes the next waiter alone
+    for (int32_t i = 0; i < waiter_num - 1; ++i) {
+        queues.remove("/lock", waiters[i], orion::raft_op::UNLOCK);
+        std::lock_guard<std::mutex> locker(mutex);
+        ASSERT_EQ(woken.size(), static_cast<size_t>(i + 2));
+        EXPECT_EQ(woken.back(), i + 1);
+    }
+    for (int32_t status : statuses) {
+        EXPECT_EQ(status, orion::status_code::OK);
+    }
+    orion::server::LockStats stats = queues.manager()->stats();
+    EXPECT_EQ(stats.waiting, 0);
+    EXPECT_EQ(stats.wakeups, waiter_num - 1);
+}
+
+TEST(LockManagerTest, WaiterGone) {
+    orion::testcase::LockQueues queues;
+    std::string holder = queues.queue("/lock");
+    std::string expired = queues.queue("/lock");
+    std::string next = queues.queue("/lock");
+    std::atomic<int32_t> expired_status(-1);
+    std::atomic<int32_t> next_status(-1);
+    queues.manager()->wait(0, "", "/lock", expired, 10000, [&](int32_t status) {
+                expired_status = status;
+            });
+    queues.manager()->wait(0, "", "/lock", next, 10000, [&](int32_t status) {
+                next_status = status;
+            });
+    // a waiter leaving the middle of the queue wakes nobody
+    queues.remove("/lock", expired, orion::raft_op::REVOKE_LEASES);
+    EXPECT_EQ(expired_status, orion::status_code::LEASE_EXPIRED);
+    EXPECT_EQ(next_status, -1);
+    // lease of the holder expires and the next waiter holds the lock
+    queues.remove("/lock", holder, orion::raft_op::REVOKE_LEASES);
+    EXPECT_EQ(next_status, orion::status_code::OK);
+}
+
+TEST(LockManagerTest, Timeout) {
+    orion::testcase::LockQueues queues;
+    queues.queue("/lock");
+    std::string waiter = queues.queue("/lock");
+    std::atomic<int32_t> status(-1);
+    queues.manager()->wait(0, "", "/lock", waiter, 0, [&](int32_t ret) { status = ret; });
+    EXPECT_EQ(status, orion::status_code::LOCKED);
+    // a request sent again replaces the parked one
+    std::atomic<int32_t> first(-1);
+    queues.manager()->wait(0, "", "/lock", waiter, 50, [&](int32_t ret) { first = ret; });
+    status = -1;
+    queues.manager()->wait(0, "", "/lock", waiter, 50, [&](int32_t ret) { status = ret; });
+    EXPECT_EQ(first, orion::status_code::LOCKED);
+    for (int i = 0; i < 100 && status == -1; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(status, orion::status_code::LOCKED);
+    EXPECT_EQ(queues.manager()->stats().timeouts, 1);
+    // parked requests are answered once manager stops
+    queues.manager()->wait(0, "", "/lock", waiter, 10000, [&](int32_t ret) { status = ret; });
+    queues.manager()->stop();
+    EXPECT_EQ(status, orion::status_code::TIMEOUT);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
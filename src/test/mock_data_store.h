@@ -0,0 +1,120 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_TEST_MOCK_DATA_STORE_H
+#define ORION_TEST_MOCK_DATA_STORE_H
+#include <string>
+#include <map>
+#include "storage/data_store.h"
+#include "common/const.h"
+
+namespace orion {
+namespace testcase {
+
+/// Mock the data iterator to match mock data store
+class MockDataIterator : public storage::DataIterator {
+public:
+    typedef std::map<std::string, std::string> pool_t;
+    MockDataIterator(pool_t& data) : _pool(data), _cur(_pool.end()) { }
+    virtual ~MockDataIterator() { }
+
+    virtual std::string key() const {
+        return _cur->first;
+    }
+    virtual std::string value() const {
+        return _cur->second;
+    }
+    virtual bool done() const {
+        return _cur == _pool.end();
+    }
+    virtual DataIterator* seek(const std::string& key) {
+        for (auto it = _pool.begin(); it != _pool.end(); ++it) {
+            if (it->first >= key) {
+                _cur = it;
+                break;
+            }
+        }
+        return this;
+    }
+    virtual DataIterator* next() {
+        ++_cur;
+        return this;
+    }
+private:
+    pool_t& _pool;
+    pool_t::iterator _cur;
+};
+
+/// Mock the data store, provide in-memory storage
+class MockDataStore : public storage::DataStore {
+public:
+    MockDataStore() { }
+    virtual ~MockDataStore() { }
+
+    virtual int32_t get(std::string& value, const std::string& ns,
+            const std::string& key) const {
+        auto it = _store.find(ns);
+        if (it == _store.end()) {
+            return status_code::NOT_FOUND;
+        }
+        auto jt = it->second.find(key);
+        if (jt == it->second.end()) {
+            return status_code::NOT_FOUND;
+        }
+        value = jt->second;
+        return status_code::OK;
+    }
+    virtual int32_t put(const std::string& ns, const std::string& key,
+            const std::string& value) {
+        _store[ns][key] = value;
+        return status_code::OK;
+    }
+    virtual int32_t remove(const std::string& ns, const std::string& key) {
+        auto it = _store.find(ns);
+        if (it == _store.end()) {
+            return status_code::NOT_FOUND;
+        }
+        auto jt = it->second.find(key);
+        if (jt == it->second.end()) {
+            return status_code::NOT_FOUND;
+        }
+        it->second.erase(jt);
+        return status_code::OK;
+    }
+    virtual int32_t write(const storage::WriteBatch& batch) {
+        for (const auto& op : batch.ops()) {
+            if (op.deleted) {
+                _store[op.ns].erase(op.key);
+            } else {
+                _store[op.ns][op.key] = op.value;
+            }
+        }
+        return status_code::OK;
+    }
+    virtual storage::DataIterator* iter(const std::string& ns) const {
+        auto it = _store.find(ns);
+        if (it == _store.end()) {
+            return nullptr;
+        }
+        auto map_ptr = const_cast< std::map<std::string, std::string>* >(&it->second);
+        return new MockDataIterator(*map_ptr);
+    }
+    virtual storage::DataSnapshot* snapshot() const {
+        return nullptr;
+    }
+    virtual int32_t restore(storage::DataSnapshot* /*snapshot*/,
+            const std::string& /*marker_ns*/, const std::string& /*marker_key*/) {
+        return status_code::INVALID;
+    }
+private:
+    // data structure is (ns, [<key, value>]...)
+    std::map< std::string, std::map<std::string, std::string> > _store;
+};
+
+} // namespace testcase
+} // namespace orion
+
+#endif // ORION_TEST_MOCK_DATA_STORE_H
@@ -0,0 +1,114 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "client/near_cache.h"
+#include <gtest/gtest.h>
+
+#include <map>
+#include <chrono>
+#include <thread>
+#include "common/const.h"
+
+TEST(NearCacheTest, FillAndInvalidate) {
+    orion::client::NearCache cache(100, 60000, 60000);
+    int32_t status = 0;
+    std::string value;
+    EXPECT_FALSE(cache.get(status, value, "/a"));
+    cache.fill("/a", cache.begin_fill("/a"), orion::status_code::OK, "1");
+    cache.fill("/b", cache.begin_fill("/b"), orion::status_code::NOT_FOUND, "");
+    // failures are not cached
+    cache.fill("/c", cache.begin_fill("/c"), orion::status_code::TIMEOUT, "");
+    ASSERT_TRUE(cache.get(status, value, "/a"));
+    EXPECT_EQ(status, orion::status_code::OK);
+    EXPECT_EQ(value, "1");
+    ASSERT_TRUE(cache.get(status, value, "/b"));
+    EXPECT_EQ(status, orion::status_code::NOT_FOUND);
+    EXPECT_FALSE(cache.get(status, value, "/c"));
+
+    // a result read before the key changes is stale
+    int64_t ticket = cache.begin_fill("/c");
+    cache.invalidate("/c");
+    cache.fill("/c", ticket, orion::status_code::OK, "old");
+    EXPECT_FALSE(cache.get(status, value, "/c"));
+
+    cache.update("/a", "2");
+    ASSERT_TRUE(cache.get(status, value, "/a"));
+    EXPECT_EQ(value, "2");
+    cache.fill("/dir/x", cache.begin_fill("/dir/x"), orion::status_code::OK, "x");
+    cache.fill("/dirty", cache.begin_fill("/dirty"), orion::status_code::OK, "y");
+    cache.invalidate_prefix("/dir");
+    EXPECT_FALSE(cache.get(status, value, "/dir/x"));
+    EXPECT_TRUE(cache.get(status, value, "/dirty"));
+
+    orion::CacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 4);
+    EXPECT_EQ(stats.misses, 4);
+    EXPECT_EQ(stats.invalidations, 1);
+    EXPECT_EQ(stats.size, 3);
+}
+
+TEST(NearCacheTest, EvictAndExpire) {
+    orion::client::NearCache cache(10, 50, 20);
+    int32_t status = 0;
+    std::string value;
+    for (int i = 0; i < 20; ++i) {
+        std::string key = "/key_" + std::to_string(i);
+        cache.fill(key, cache.begin_fill(key), orion::status_code::OK, "v");
+        // the first key stays the most recently used
+        cache.get(status, value, "/key_0");
+    }
+    EXPECT_EQ(cache.stats().size, 10);
+    EXPECT_EQ(cache.stats().evictions, 10);
+    EXPECT_TRUE(cache.get(status, value, "/key_0"));
+    EXPECT_TRUE(cache.get(status, value, "/key_19"));
+    EXPECT_FALSE(cache.get(status, value, "/key_1"));
+
+    // unwatched entries are revalidated sooner than ttl
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_FALSE(cache.get(status, value, "/key_0"));
+    cache.set_watching(true);
+    cache.set_watched("/key_0", orion::WATCH_KEY);
+    // the entry read before its watch is not trusted
+    EXPECT_FALSE(cache.get(status, value, "/key_0"));
+    cache.fill("/key_0", cache.begin_fill("/key_0"), orion::status_code::OK, "v");
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_TRUE(cache.get(status, value, "/key_0"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_FALSE(cache.get(status, value, "/key_0"));
+}
+
+TEST(NearCacheTest, Changes) {
+    orion::client::NearCache cache(1, 60000, 60000);
+    std::map<std::string, int32_t> changes;
+    cache.fill("/a", cache.begin_fill("/a"), orion::status_code::OK, "1");
+    cache.take_changes(&changes);
+    ASSERT_EQ(changes.size(), 1UL);
+    EXPECT_EQ(changes["/a"], orion::WATCH_KEY);
+    // a missing key is watched with the keys under it, which create it
+    cache.fill("/b", cache.begin_fill("/b"), orion::status_code::NOT_FOUND, "");
+    cache.take_changes(&changes);
+    ASSERT_EQ(changes.size(), 2UL);
+    EXPECT_EQ(changes["/a"], -1);
+    EXPECT_EQ(changes["/b"], orion::WATCH_SUBTREE);
+    // refilling with the same status needs no other watch
+    cache.fill("/b", cache.begin_fill("/b"), orion::status_code::NOT_FOUND, "");
+    cache.take_changes(&changes);
+    EXPECT_TRUE(changes.empty());
+    // a created key needs a watch of its own
+    cache.fill("/b", cache.begin_fill("/b"), orion::status_code::OK, "2");
+    cache.take_changes(&changes);
+    ASSERT_EQ(changes.size(), 1UL);
+    EXPECT_EQ(changes["/b"], orion::WATCH_KEY);
+    cache.invalidate("/b");
+    cache.take_changes(&changes);
+    ASSERT_EQ(changes.size(), 1UL);
+    EXPECT_EQ(changes["/b"], -1);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,465 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "client/ori_impl.h"
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include "test/cluster.h"
+#include "common/const.h"
+
+namespace orion {
+namespace testcase {
+
+/// creates an empty directory for a test cluster
+std::string make_cluster_dir() {
+    char dir[] = "/tmp/orion_ori_XXXXXX";
+    return mkdtemp(dir);
+}
+
+/// client connected to servers through the simulated network
+client::OriImpl* connect(Cluster* cluster, const std::vector<std::string>& servers,
+        int32_t cache_size = 0) {
+    OriOptions options;
+    options.servers = servers;
+    options.cache_size = cache_size;
+    options.ns = "user";
+    return new client::OriImpl(options, cluster->network()->channel_factory("client"));
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(OriTest, PutGetRemove) {
+    orion::testcase::ClusterOptions options;
+    options.group_num = 2;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster,
+                {cluster.addr(0), cluster.addr(1), cluster.addr(2)}));
+    EXPECT_EQ(ori->put("/a", "1"), orion::status_code::OK);
+    std::string value;
+    EXPECT_EQ(ori->get(value, "/a"), orion::status_code::OK);
+    EXPECT_EQ(value, "1");
+    EXPECT_EQ(ori->remove("/a"), orion::status_code::OK);
+    EXPECT_EQ(ori->get(value, "/a"), orion::status_code::NOT_FOUND);
+    // leader of the group owning the namespace is cached
+    int32_t group = orion::common::RoutingTable::group_of("user", options.group_num);
+    int32_t leader = cluster.wait_leader(group, 5000);
+    ASSERT_GE(leader, 0);
+    EXPECT_EQ(ori->leader("user"), cluster.addr(leader));
+}
+
+TEST(OriTest, Redirect) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    int32_t leader = cluster.wait_leader(0, 5000);
+    ASSERT_GE(leader, 0);
+    // client only knows a follower, which points it to the leader
+    int32_t follower = (leader + 1) % cluster.node_num();
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster,
+                {cluster.addr(follower)}));
+    EXPECT_EQ(ori->put("/a", "1"), orion::status_code::OK);
+    EXPECT_EQ(ori->leader("user"), cluster.addr(leader));
+    std::string value;
+    EXPECT_EQ(ori->get(value, "/a"), orion::status_code::OK);
+}
+
+TEST(OriTest, Failover) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster,
+                {cluster.addr(0), cluster.addr(1), cluster.addr(2)}));
+    std::atomic<int32_t> written(0);
+    std::atomic<int32_t> failed(0);
+    std::thread writer([&] {
+        for (int i = 0; i < 200; ++i) {
+            if (ori->put("/key_" + std::to_string(i), "v") == orion::status_code::OK) {
+                ++written;
+            } else {
+                ++failed;
+            }
+        }
+    });
+    while (written < 50) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // requests in flight wait for the new leader instead of failing
+    EXPECT_GE(cluster.measure_election(0, 5000), 0);
+    writer.join();
+    EXPECT_EQ(written, 200);
+    EXPECT_EQ(failed, 0);
+    std::string value;
+    EXPECT_EQ(ori->get(value, "/key_199"), orion::status_code::OK);
+}
+
+TEST(OriTest, Async) {
+    orion::testcase::ClusterOptions options;
+    options.group_num = 2;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster,
+                {cluster.addr(0), cluster.addr(1), cluster.addr(2)}));
+    // all the requests are in flight together
+    std::vector<std::future<int32_t> > puts;
+    for (int i = 0; i < 200; ++i) {
+        puts.push_back(ori->async_put("/key_" + std::to_string(i), std::to_string(i)));
+    }
+    EXPECT_EQ(orion::Ori::wait_all(puts), orion::status_code::OK);
+    EXPECT_TRUE(puts.empty());
+    std::vector<std::future<orion::GetResult> > gets;
+    for (int i = 0; i < 200; ++i) {
+        gets.push_back(ori->async_get("/key_" + std::to_string(i)));
+    }
+    gets.push_back(ori->async_get("/missing"));
+    std::vector<orion::GetResult> results;
+    EXPECT_EQ(orion::Ori::wait_all(gets, &results), orion::status_code::NOT_FOUND);
+    ASSERT_EQ(results.size(), 201UL);
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_EQ(results[i].status, orion::status_code::OK);
+        EXPECT_EQ(results[i].value, std::to_string(i));
+    }
+    // callbacks are called once for every request
+    std::atomic<int32_t> removed(0);
+    std::promise<void> all_removed;
+    for (int i = 0; i < 200; ++i) {
+        ori->async_remove("/key_" + std::to_string(i), [&](int32_t status) {
+            EXPECT_EQ(status, orion::status_code::OK);
+            if (++removed == 200) {
+                all_removed.set_value();
+            }
+        });
+    }
+    all_removed.get_future().wait();
+    std::string value;
+    EXPECT_EQ(ori->get(value, "/key_0"), orion::status_code::NOT_FOUND);
+}
+
+TEST(OriTest, Batch) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster,
+                {cluster.addr(0), cluster.addr(1), cluster.addr(2)}));
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for (int i = 0; i < 100; ++i) {
+        keys.push_back("/dir/key_" + std::to_string(i));
+        values.push_back(std::to_string(i));
+    }
+    std::vector<int32_t> statuses;
+    ASSERT_EQ(ori->batch_put(statuses, keys, values), orion::status_code::OK);
+    EXPECT_EQ(statuses, std::vector<int32_t>(100, orion::status_code::OK));
+    keys.push_back("/missing");
+    std::vector<std::string> read;
+    ASSERT_EQ(ori->batch_get(read, statuses, keys), orion::status_code::OK);
+    ASSERT_EQ(statuses.size(), 101UL);
+    EXPECT_EQ(statuses[100], orion::status_code::NOT_FOUND);
+    values.push_back("");
+    EXPECT_EQ(read, values);
+    // writes are applied in order, a directory is removable after its children
+    std::vector<std::string> removed = {"/dir", "/dir/key_0"};
+    ASSERT_EQ(ori->batch_remove(statuses, removed), orion::status_code::OK);
+    EXPECT_EQ(statuses, std::vector<int32_t>({orion::status_code::INVALID,
+                orion::status_code::OK}));
+    std::string value;
+    EXPECT_EQ(ori->get(value, "/dir/key_0"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(ori->get(value, "/dir/key_1"), orion::status_code::OK);
+}
+
+TEST(OriTest, ListAndScan) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster,
+                {cluster.addr(0), cluster.addr(1), cluster.addr(2)}));
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for (int i = 0; i < 1000; ++i) {
+        char key[32];
+        snprintf(key, sizeof(key), "/dir/%04d", i);
+        keys.push_back(key);
+        values.push_back(std::to_string(i));
+    }
+    std::vector<int32_t> statuses;
+    ASSERT_EQ(ori->batch_put(statuses, keys, values), orion::status_code::OK);
+    // children are fetched in many pages
+    orion::ScanOptions scan_options;
+    scan_options.page_size = 64;
+    std::vector<std::string> listed;
+    std::unique_ptr<orion::ScanIterator> it(ori->list("/dir", scan_options));
+    for (; !it->done(); it->next()) {
+        listed.push_back(it->key());
+        EXPECT_EQ(it->value(), std::to_string(listed.size() - 1));
+    }
+    EXPECT_EQ(it->status(), orion::status_code::OK);
+    EXPECT_EQ(listed, keys);
+    // a page stops once it holds enough bytes
+    scan_options.page_size = 1000;
+    scan_options.page_bytes = 100;
+    scan_options.keys_only = true;
+    std::vector<std::string> scanned;
+    it.reset(ori->scan("/dir/0100", "/dir/0200", scan_options));
+    for (; !it->done(); it->next()) {
+        scanned.push_back(it->key());
+        EXPECT_EQ(it->value(), "");
+    }
+    EXPECT_EQ(it->status(), orion::status_code::OK);
+    EXPECT_EQ(scanned, std::vector<std::string>(keys.begin() + 100, keys.begin() + 200));
+    // iterator may be dropped with a page in flight
+    it.reset(ori->list("/dir", scan_options));
+    EXPECT_FALSE(it->done());
+    it.reset();
+    it.reset(ori->list("/missing"));
+    EXPECT_TRUE(it->done());
+    EXPECT_EQ(it->status(), orion::status_code::OK);
+}
+
+TEST(OriTest, NearCache) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    std::vector<std::string> servers = {cluster.addr(0), cluster.addr(1), cluster.addr(2)};
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster, servers, 100));
+    ASSERT_EQ(ori->put("/conf/a", "1"), orion::status_code::OK);
+    // the write is delivered by watch as well, which drops the key again
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::string value;
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(ori->get(value, "/conf/a"), orion::status_code::OK);
+        EXPECT_EQ(value, "1");
+    }
+    EXPECT_EQ(ori->get(value, "/conf/b"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(ori->get(value, "/conf/b"), orion::status_code::NOT_FOUND);
+    orion::CacheStats stats = ori->cache_stats();
+    EXPECT_EQ(stats.misses, 2);
+    EXPECT_EQ(stats.hits, 10);
+    // writes of the client itself are seen at once
+    ASSERT_EQ(ori->put("/conf/a", "2"), orion::status_code::OK);
+    ASSERT_EQ(ori->get(value, "/conf/a"), orion::status_code::OK);
+    EXPECT_EQ(value, "2");
+    // writes of other clients are dropped from cache by the watch of the cached key
+    std::unique_ptr<orion::client::OriImpl> writer(orion::testcase::connect(&cluster, servers));
+    ASSERT_EQ(writer->put("/conf/b", "3"), orion::status_code::OK);
+    int32_t status = orion::status_code::NOT_FOUND;
+    for (int i = 0; i < 100 && status != orion::status_code::OK; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        status = ori->get(value, "/conf/b");
+    }
+    ASSERT_EQ(status, orion::status_code::OK);
+    EXPECT_EQ(value, "3");
+}
+
+TEST(OriTest, Watch) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    std::vector<std::string> servers = {cluster.addr(0), cluster.addr(1), cluster.addr(2)};
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster, servers));
+    std::mutex mutex;
+    std::vector<orion::WatchParam> changes;
+    std::atomic<int32_t> resyncs(0);
+    auto callback = [&](const orion::WatchParam& param, int32_t status) {
+        if (status == orion::status_code::RESYNC) {
+            ++resyncs;
+            return;
+        }
+        std::lock_guard<std::mutex> locker(mutex);
+        changes.push_back(param);
+    };
+    auto count = [&]() {
+        std::lock_guard<std::mutex> locker(mutex);
+        return changes.size();
+    };
+    // many keys share the stream of the client
+    const int32_t key_num = 50;
+    for (int i = 0; i < key_num; ++i) {
+        ASSERT_EQ(ori->watch("/key_" + std::to_string(i), orion::WATCH_KEY, callback),
+                orion::status_code::OK);
+    }
+    ASSERT_EQ(ori->watch("/dir", orion::WATCH_CHILDREN, callback), orion::status_code::OK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::unique_ptr<orion::client::OriImpl> writer(orion::testcase::connect(&cluster, servers));
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for (int i = 0; i < key_num; ++i) {
+        keys.push_back("/key_" + std::to_string(i));
+        values.push_back(std::to_string(i));
+    }
+    std::vector<int32_t> statuses;
+    ASSERT_EQ(writer->batch_put(statuses, keys, values), orion::status_code::OK);
+    ASSERT_EQ(writer->put("/dir/a", "x"), orion::status_code::OK);
+    ASSERT_EQ(writer->put("/dir/a/b", "y"), orion::status_code::OK);
+    ASSERT_EQ(writer->put("/other", "z"), orion::status_code::OK);
+    ASSERT_EQ(writer->remove("/key_0"), orion::status_code::OK);
+    for (int i = 0; i < 300 && count() < key_num + 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        ASSERT_EQ(changes.size(), static_cast<size_t>(key_num + 2));
+        // changes of a batch share the revision and are delivered in order
+        for (int i = 0; i < key_num; ++i) {
+            EXPECT_EQ(changes[i].key, keys[i]);
+            EXPECT_EQ(changes[i].value, values[i]);
+            EXPECT_EQ(changes[i].revision, changes[0].revision);
+        }
+        EXPECT_EQ(changes[key_num].key, "/dir/a");
+        EXPECT_TRUE(changes[key_num + 1].deleted);
+        EXPECT_GT(changes[key_num + 1].revision, changes[key_num].revision);
+        changes.clear();
+    }
+    // stream is reopened on the new leader from the revision received
+    ASSERT_GE(cluster.measure_election(0, 5000), 0);
+    ASSERT_EQ(writer->put("/key_1", "new"), orion::status_code::OK);
+    ASSERT_EQ(ori->unwatch("/key_2"), orion::status_code::OK);
+    ASSERT_EQ(writer->put("/key_2", "new"), orion::status_code::OK);
+    ASSERT_EQ(writer->put("/key_3", "new"), orion::status_code::OK);
+    for (int i = 0; i < 500 && count() < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::lock_guard<std::mutex> locker(mutex);
+    ASSERT_EQ(changes.size(), 2UL);
+    EXPECT_EQ(changes[0].key, "/key_1");
+    EXPECT_EQ(changes[1].key, "/key_3");
+    EXPECT_EQ(resyncs, 0);
+}
+
+TEST(OriTest, Lease) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    std::vector<std::string> servers = {cluster.addr(0), cluster.addr(1), cluster.addr(2)};
+    std::unique_ptr<orion::client::OriImpl> ori(orion::testcase::connect(&cluster, servers));
+    std::atomic<int32_t> expired(0);
+    int64_t lease_id = 0;
+    ASSERT_EQ(ori->grant_lease(lease_id, 1000, [&](int64_t) { ++expired; }),
+            orion::status_code::OK);
+    ASSERT_EQ(ori->put_with_lease("/lease/a", "1", lease_id), orion::status_code::OK);
+    ASSERT_EQ(ori->put_with_lease("/lease/b", "2", lease_id), orion::status_code::OK);
+    // temp node of the session lease
+    EXPECT_TRUE(ori->current_session().empty());
+    ASSERT_EQ(ori->put("/session", "3", true), orion::status_code::OK);
+    EXPECT_FALSE(ori->current_session().empty());
+    // leases outlive their ttl while kept alive
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    std::string value;
+    EXPECT_EQ(ori->get(value, "/lease/a"), orion::status_code::OK);
+    EXPECT_EQ(ori->get(value, "/session"), orion::status_code::OK);
+    EXPECT_EQ(expired, 0);
+    // all the nodes of a lease are removed by revoking it
+    ASSERT_EQ(ori->revoke_lease(lease_id), orion::status_code::OK);
+    EXPECT_EQ(ori->get(value, "/lease/a"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(ori->get(value, "/lease/b"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(ori->put_with_lease("/lease/c", "4", lease_id), orion::status_code::LEASE_EXPIRED);
+    // nodes of a client gone expire with its session
+    std::unique_ptr<orion::client::OriImpl> other(orion::testcase::connect(&cluster, servers));
+    ASSERT_EQ(other->put("/other", "5", true), orion::status_code::OK);
+    other.reset();
+    for (int i = 0; i < 300 && ori->get(value, "/other") == orion::status_code::OK; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    EXPECT_EQ(ori->get(value, "/other"), orion::status_code::NOT_FOUND);
+    EXPECT_EQ(ori->get(value, "/session"), orion::status_code::OK);
+    EXPECT_EQ(expired, 0);
+}
+
+TEST(OriTest, Lock) {
+    orion::testcase::ClusterOptions options;
+    options.data_dir = orion::testcase::make_cluster_dir();
+    orion::testcase::Cluster cluster(options);
+    ASSERT_TRUE(cluster.start());
+    ASSERT_GE(cluster.wait_leader(0, 5000), 0);
+    std::vector<std::string> servers = {cluster.addr(0), cluster.addr(1), cluster.addr(2)};
+    // clients contend for a lock, which is held by one of them at a time
+    const int32_t client_num = 4;
+    const int32_t round_num = 5;
+    std::vector<std::unique_ptr<orion::client::OriImpl> > clients;
+    for (int32_t i = 0; i < client_num; ++i) {
+        clients.emplace_back(orion::testcase::connect(&cluster, servers));
+    }
+    std::atomic<int32_t> holders(0);
+    std::atomic<int32_t> overlaps(0);
+    std::atomic<int32_t> failures(0);
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < client_num; ++i) {
+        threads.push_back(std::thread([&, i]() {
+                    for (int32_t round = 0; round < round_num; ++round) {
+                        if (clients[i]->lock("/job") != orion::status_code::OK) {
+                            ++failures;
+                            continue;
+                        }
+                        if (++holders > 1) {
+                            ++overlaps;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                        --holders;
+                        if (clients[i]->unlock("/job") != orion::status_code::OK) {
+                            ++failures;
+                        }
+                    }
+                }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(overlaps, 0);
+    // waiters are gone with their unlock
+    std::unique_ptr<orion::ScanIterator> it(clients[0]->list("/job"));
+    EXPECT_TRUE(it->done());
+    EXPECT_EQ(it->status(), orion::status_code::OK);
+    it.reset();
+    // try_lock never queues
+    ASSERT_EQ(clients[0]->lock("/job"), orion::status_code::OK);
+    EXPECT_EQ(clients[1]->try_lock("/job"), orion::status_code::LOCKED);
+    EXPECT_EQ(clients[1]->unlock("/job"), orion::status_code::NOT_FOUND);
+    // lock of a client gone goes to the next waiter once its session expires
+    orion::OriOptions ori_options;
+    ori_options.servers = servers;
+    ori_options.ns = "user";
+    ori_options.session_ttl = 1000;
+    std::unique_ptr<orion::client::OriImpl> short_lived(new orion::client::OriImpl(ori_options,
+                cluster.network()->channel_factory("client")));
+    ASSERT_EQ(clients[0]->unlock("/job"), orion::status_code::OK);
+    ASSERT_EQ(short_lived->lock("/job"), orion::status_code::OK);
+    std::future<int32_t> next = std::async(std::launch::async, [&]() {
+                return clients[2]->lock("/job");
+            });
+    EXPECT_EQ(next.wait_for(std::chrono::milliseconds(300)), std::future_status::timeout);
+    short_lived.reset();
+    ASSERT_EQ(next.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_EQ(next.get(), orion::status_code::OK);
+    EXPECT_EQ(clients[1]->try_lock("/job"), orion::status_code::LOCKED);
+    EXPECT_EQ(clients[2]->unlock("/job"), orion::status_code::OK);
+    EXPECT_EQ(clients[1]->try_lock("/job"), orion::status_code::OK);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
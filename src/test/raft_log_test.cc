@@ -0,0 +1,207 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "server/raft_log.h"
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace orion {
+namespace testcase {
+
+/// creates an empty directory for a test log
+std::string make_log_dir() {
+    char dir[] = "/tmp/orion_raft_log_XXXXXX";
+    return mkdtemp(dir);
+}
+
+/// builds entries with key equal to its index
+std::vector<raft::Entry> make_entries(int64_t first, int64_t last, int64_t term) {
+    std::vector<raft::Entry> entries;
+    for (int64_t i = first; i <= last; ++i) {
+        raft::Entry entry;
+        entry.set_term(term);
+        entry.set_op(1);
+        entry.set_key(std::to_string(i));
+        entry.set_value(std::string(100, 'v'));
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(RaftLogTest, AppendAndTruncate) {
+    std::string dir = orion::testcase::make_log_dir();
+    orion::raft::RaftLogOptions options;
+    // small segment size to make sure entries span several segments
+    options.segment_size = 1024;
+    {
+        orion::raft::RaftLog log(dir, options);
+        ASSERT_TRUE(log.open());
+        EXPECT_EQ(log.last_index(), 0);
+        EXPECT_EQ(log.last_term(), 0);
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(1, 50, 1)));
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(51, 100, 2)));
+        // appended entries are not durable until synced
+        EXPECT_LT(log.synced_index(), 100);
+        ASSERT_TRUE(log.sync());
+        EXPECT_EQ(log.synced_index(), 100);
+        EXPECT_EQ(log.last_index(), 100);
+        EXPECT_EQ(log.last_term(), 2);
+        EXPECT_EQ(log.term(50), 1);
+        EXPECT_EQ(log.term(51), 2);
+        EXPECT_EQ(log.term(101), -1);
+        orion::raft::Entry entry;
+        ASSERT_TRUE(log.get(77, &entry));
+        EXPECT_EQ(entry.key(), "77");
+
+        // drop a conflict suffix and append entries of a new term
+        ASSERT_TRUE(log.truncate_suffix(80));
+        EXPECT_EQ(log.last_index(), 80);
+        EXPECT_EQ(log.synced_index(), 80);
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(81, 90, 3)));
+        EXPECT_EQ(log.term(85), 3);
+        ASSERT_TRUE(log.save_state(3, "node1"));
+    }
+    // everything should survive a restart
+    orion::raft::RaftLog log(dir, options);
+    ASSERT_TRUE(log.open());
+    EXPECT_EQ(log.last_index(), 90);
+    EXPECT_EQ(log.term(80), 2);
+    EXPECT_EQ(log.term(81), 3);
+    int64_t term = 0;
+    std::string voted_for;
+    log.load_state(&term, &voted_for);
+    EXPECT_EQ(term, 3);
+    EXPECT_EQ(voted_for, "node1");
+    std::vector<orion::raft::Entry> entries;
+    ASSERT_TRUE(log.get_range(10, 20, 1024 * 1024, &entries));
+    ASSERT_EQ(entries.size(), 20);
+    EXPECT_EQ(entries.front().key(), "10");
+    EXPECT_EQ(entries.back().key(), "29");
+}
+
+TEST(RaftLogTest, Compaction) {
+    std::string dir = orion::testcase::make_log_dir();
+    orion::raft::RaftLogOptions options;
+    options.segment_size = 1024;
+    {
+        orion::raft::RaftLog log(dir, options);
+        ASSERT_TRUE(log.open());
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(1, 100, 1)));
+        // only whole segments are dropped, so the start is no greater than 60
+        ASSERT_TRUE(log.truncate_prefix(60));
+        EXPECT_GT(log.start_index(), 0);
+        EXPECT_LE(log.start_index(), 60);
+        EXPECT_EQ(log.start_term(), 1);
+        EXPECT_EQ(log.term(log.start_index() - 1), -1);
+        orion::raft::Entry entry;
+        EXPECT_FALSE(log.get(log.start_index(), &entry));
+        ASSERT_TRUE(log.get(61, &entry));
+        EXPECT_EQ(entry.key(), "61");
+    }
+    {
+        orion::raft::RaftLog log(dir, options);
+        ASSERT_TRUE(log.open());
+        EXPECT_GT(log.start_index(), 0);
+        EXPECT_EQ(log.last_index(), 100);
+        // a snapshot from leader replaces the whole log
+        ASSERT_TRUE(log.reset(200, 5));
+        EXPECT_EQ(log.last_index(), 200);
+        EXPECT_EQ(log.last_term(), 5);
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(201, 210, 5)));
+    }
+    orion::raft::RaftLog log(dir, options);
+    ASSERT_TRUE(log.open());
+    EXPECT_EQ(log.start_index(), 200);
+    EXPECT_EQ(log.last_index(), 210);
+    EXPECT_EQ(log.term(200), 5);
+    EXPECT_EQ(log.term(100), -1);
+}
+
+TEST(RaftLogTest, TruncateInsideBatch) {
+    std::string dir = orion::testcase::make_log_dir();
+    orion::raft::RaftLogOptions options;
+    // all the entries of an append are in one compressed record
+    options.min_compress_size = 0;
+    {
+        orion::raft::RaftLog log(dir, options);
+        ASSERT_TRUE(log.open());
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(1, 50, 1)));
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(51, 100, 1)));
+        std::vector<orion::raft::Entry> entries;
+        ASSERT_TRUE(log.get_range(40, 20, 1024 * 1024, &entries));
+        ASSERT_EQ(entries.size(), 20);
+        EXPECT_EQ(entries.front().key(), "40");
+        EXPECT_EQ(entries.back().key(), "59");
+        // the surviving head of the second record is written again
+        ASSERT_TRUE(log.truncate_suffix(70));
+        EXPECT_EQ(log.last_index(), 70);
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(71, 75, 2)));
+        orion::raft::Entry entry;
+        ASSERT_TRUE(log.get(70, &entry));
+        EXPECT_EQ(entry.key(), "70");
+        EXPECT_EQ(entry.value(), std::string(100, 'v'));
+    }
+    orion::raft::RaftLog log(dir, options);
+    ASSERT_TRUE(log.open());
+    EXPECT_EQ(log.last_index(), 75);
+    EXPECT_EQ(log.term(70), 1);
+    EXPECT_EQ(log.term(71), 2);
+    orion::raft::Entry entry;
+    ASSERT_TRUE(log.get(60, &entry));
+    EXPECT_EQ(entry.key(), "60");
+    ASSERT_TRUE(log.get(75, &entry));
+    EXPECT_EQ(entry.key(), "75");
+    EXPECT_EQ(entry.term(), 2);
+}
+
+TEST(RaftLogTest, HotCache) {
+    std::string dir = orion::testcase::make_log_dir();
+    orion::raft::RaftLogOptions options;
+    // room for about two records of ten entries
+    options.cache_size = 2500;
+    orion::raft::RaftLog log(dir, options);
+    ASSERT_TRUE(log.open());
+    for (int64_t i = 1; i <= 100; i += 10) {
+        ASSERT_TRUE(log.append(orion::testcase::make_entries(i, i + 9, 1)));
+    }
+    // recent records are served in encoded form
+    std::vector<orion::raft::EntryCache::record_t> records;
+    int64_t count = 0;
+    ASSERT_TRUE(log.get_records(81, 100, 1024 * 1024, &records, &count));
+    EXPECT_EQ(records.size(), 2);
+    EXPECT_EQ(count, 20);
+    // old records are evicted, and a record is only served from its start
+    records.clear();
+    EXPECT_FALSE(log.get_records(1, 100, 1024 * 1024, &records, &count));
+    EXPECT_FALSE(log.get_records(85, 100, 1024 * 1024, &records, &count));
+    orion::raft::Entry entry;
+    ASSERT_TRUE(log.get(5, &entry));
+    ASSERT_TRUE(log.get(95, &entry));
+    orion::raft::EntryCacheStats stats = log.cache_stats();
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_LE(stats.bytes, options.cache_size);
+    // truncated entries never come back from cache
+    ASSERT_TRUE(log.truncate_suffix(95));
+    ASSERT_TRUE(log.append(orion::testcase::make_entries(96, 100, 2)));
+    records.clear();
+    ASSERT_TRUE(log.get_records(91, 100, 1024 * 1024, &records, &count));
+    EXPECT_EQ(count, 10);
+    ASSERT_TRUE(log.get(96, &entry));
+    EXPECT_EQ(entry.term(), 2);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
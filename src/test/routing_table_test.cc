@@ -0,0 +1,58 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "common/routing_table.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+TEST(RoutingTableTest, GroupOf) {
+    orion::common::RoutingTable table(8);
+    EXPECT_EQ(table.group_num(), 8);
+    EXPECT_EQ(table.group_of(orion::common::INTERNAL_NS), 0);
+    // every namespace stays in the same group, and groups are all used
+    std::vector<int> counts(8, 0);
+    for (int i = 0; i < 800; ++i) {
+        const std::string& ns = "user_" + std::to_string(i);
+        int32_t group = table.group_of(ns);
+        ASSERT_GE(group, 0);
+        ASSERT_LT(group, 8);
+        EXPECT_EQ(group, orion::common::RoutingTable::group_of(ns, 8));
+        ++counts[group];
+    }
+    for (int count : counts) {
+        EXPECT_GT(count, 0);
+    }
+    EXPECT_EQ(orion::common::RoutingTable::group_of("user_1", 1), 0);
+}
+
+TEST(RoutingTableTest, Update) {
+    orion::common::RoutingTable table(2);
+    EXPECT_EQ(table.leader(0), "");
+    EXPECT_TRUE(table.update(0, "a:1", 3));
+    EXPECT_EQ(table.leader(0), "a:1");
+    // outdated leader is ignored
+    EXPECT_FALSE(table.update(0, "b:1", 2));
+    EXPECT_FALSE(table.update(0, "a:1", 3));
+    EXPECT_EQ(table.leader(0), "a:1");
+    // leader learned from a redirect carries no term
+    EXPECT_TRUE(table.update(0, "b:1", 0));
+    EXPECT_EQ(table.leader(0), "b:1");
+    EXPECT_TRUE(table.update(0, "c:1", 4));
+    EXPECT_EQ(table.leader(0), "c:1");
+    EXPECT_FALSE(table.update(5, "c:1", 4));
+    EXPECT_EQ(table.leader(5), "");
+
+    table.reset(4);
+    EXPECT_EQ(table.group_num(), 4);
+    EXPECT_EQ(table.leader(0), "");
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
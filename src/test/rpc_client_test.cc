@@ -0,0 +1,235 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "common/rpc_client.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <set>
+#include <thread>
+#include "proto/service.pb.h"
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace testcase {
+
+/// channel failing the first fail_times calls, calls are answered on another thread
+class FlakyChannel : public google::protobuf::RpcChannel {
+public:
+    FlakyChannel(int32_t fail_times) : _fail_times(fail_times), _calls(0), _pool(1) { }
+    virtual ~FlakyChannel() {
+        _pool.stop(true);
+    }
+
+    virtual void CallMethod(const google::protobuf::MethodDescriptor* /*method*/,
+                            google::protobuf::RpcController* controller,
+                            const google::protobuf::Message* /*request*/,
+                            google::protobuf::Message* response,
+                            google::protobuf::Closure* done) {
+        bool fail = _calls++ < _fail_times;
+        _pool.add_task([controller, response, done, fail] {
+            if (fail) {
+                controller->SetFailed("server unavailable");
+            } else {
+                static_cast<service::RouteResponse*>(response)->set_status(0);
+            }
+            done->Run();
+        });
+    }
+    int32_t calls() const {
+        return _calls;
+    }
+private:
+    int32_t _fail_times;
+    std::atomic<int32_t> _calls;
+    common::ThreadPool _pool;
+};
+
+/// channel holding all the calls until released
+class HoldChannel : public google::protobuf::RpcChannel {
+public:
+    HoldChannel() { }
+    virtual ~HoldChannel() {
+        release();
+    }
+
+    virtual void CallMethod(const google::protobuf::MethodDescriptor* /*method*/,
+                            google::protobuf::RpcController* /*controller*/,
+                            const google::protobuf::Message* /*request*/,
+                            google::protobuf::Message* /*response*/,
+                            google::protobuf::Closure* done) {
+        std::lock_guard<std::mutex> locker(_mutex);
+        _held.push_back(done);
+    }
+    size_t held() const {
+        std::lock_guard<std::mutex> locker(_mutex);
+        return _held.size();
+    }
+    void release() {
+        std::vector<google::protobuf::Closure*> held;
+        {
+            std::lock_guard<std::mutex> locker(_mutex);
+            held.swap(_held);
+        }
+        for (auto* done : held) {
+            done->Run();
+        }
+    }
+private:
+    mutable std::mutex _mutex;
+    std::vector<google::protobuf::Closure*> _held;
+};
+
+/// sends a route request through a client whose only channel is given
+bool route(FlakyChannel* channel, const rpc::RetryOptions& retry) {
+    rpc::RpcClient client([channel](const std::string&) { return channel; });
+    service::OrionService_Stub* stub = nullptr;
+    client.get_stub("server", &stub);
+    service::RouteRequest request;
+    service::RouteResponse response;
+    bool ok = client.send_request(stub, &service::OrionService_Stub::route,
+            &request, &response, 1, retry);
+    delete stub;
+    return ok;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(RpcClientTest, RetryWithBackoff) {
+    // channel is released by client
+    orion::testcase::FlakyChannel* channel = new orion::testcase::FlakyChannel(2);
+    orion::rpc::RetryOptions retry(3);
+    retry.initial_backoff = 10;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(orion::testcase::route(channel, retry));
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    // backoff is 10ms and 20ms, shortened by jitter at most a half
+    EXPECT_GE(elapsed, 15);
+}
+
+TEST(RpcClientTest, NotIdempotent) {
+    orion::testcase::FlakyChannel* channel = new orion::testcase::FlakyChannel(1);
+    orion::rpc::RetryOptions retry(3);
+    retry.idempotent = false;
+    // the request may have reached server, it is not sent again
+    orion::rpc::RpcClient client([channel](const std::string&) { return channel; });
+    orion::service::OrionService_Stub* stub = nullptr;
+    client.get_stub("server", &stub);
+    orion::service::RouteRequest request;
+    orion::service::RouteResponse response;
+    EXPECT_FALSE(client.send_request(stub, &orion::service::OrionService_Stub::route,
+                &request, &response, 1, retry));
+    EXPECT_EQ(channel->calls(), 1);
+    delete stub;
+}
+
+TEST(RpcClientTest, Deadline) {
+    orion::testcase::FlakyChannel* channel = new orion::testcase::FlakyChannel(1000);
+    orion::rpc::RetryOptions retry(1000);
+    retry.initial_backoff = 20;
+    retry.max_backoff = 50;
+    retry.deadline = 300;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(orion::testcase::route(channel, retry));
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    EXPECT_LE(elapsed, 400);
+}
+
+TEST(RpcClientTest, SyncInPool) {
+    // requests sent by every thread of a pool are retried without deadlock
+    orion::common::ThreadPool pool(2);
+    std::vector<std::future<bool> > results;
+    for (int i = 0; i < 4; ++i) {
+        std::shared_ptr<std::promise<bool> > result(new std::promise<bool>());
+        results.push_back(result->get_future());
+        pool.add_task([result] {
+            orion::rpc::RetryOptions retry(2);
+            retry.initial_backoff = 10;
+            result->set_value(orion::testcase::route(new orion::testcase::FlakyChannel(2), retry));
+        });
+    }
+    for (auto& result : results) {
+        EXPECT_TRUE(result.get());
+    }
+}
+
+TEST(RpcClientTest, CachedStubs) {
+    std::vector<orion::testcase::HoldChannel*> channels;
+    std::mutex mutex;
+    orion::rpc::RpcClientOptions options;
+    options.channel_num = 3;
+    orion::rpc::RpcClient client(options, [&](const std::string&) {
+        std::lock_guard<std::mutex> locker(mutex);
+        channels.push_back(new orion::testcase::HoldChannel());
+        return channels.back();
+    });
+    // stubs to many servers are looked up while new servers are being added
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&client] {
+            for (int i = 0; i < 1000; ++i) {
+                std::string server = "server_" + std::to_string(i % 50);
+                ASSERT_NE(client.stub<orion::service::OrionService_Stub>(server), nullptr);
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(channels.size(), 150UL);
+    orion::service::OrionService_Stub* stub =
+        client.stub<orion::service::OrionService_Stub>("server_0");
+    std::set<orion::service::OrionService_Stub*> stubs;
+    for (int i = 0; i < 3; ++i) {
+        stubs.insert(client.stub<orion::service::OrionService_Stub>("server_0"));
+    }
+    EXPECT_EQ(stubs.size(), 3UL);
+    EXPECT_EQ(stubs.count(stub), 1UL);
+}
+
+TEST(RpcClientTest, LeastPending) {
+    std::vector<orion::testcase::HoldChannel*> channels;
+    orion::rpc::RpcClientOptions options;
+    options.channel_num = 4;
+    orion::rpc::RpcClient client(options, [&](const std::string&) {
+        channels.push_back(new orion::testcase::HoldChannel());
+        return channels.back();
+    });
+    orion::service::RouteRequest request;
+    std::vector<orion::service::RouteResponse> responses(40);
+    std::atomic<int32_t> done(0);
+    for (auto& response : responses) {
+        orion::service::OrionService_Stub* stub =
+            client.stub<orion::service::OrionService_Stub>("server");
+        client.async_request(stub, &orion::service::OrionService_Stub::route, &request, &response,
+                std::function<void (const orion::service::RouteRequest*,
+                    orion::service::RouteResponse*, bool, int)>(
+                    [&done](const orion::service::RouteRequest*,
+                        orion::service::RouteResponse*, bool, int) { ++done; }), 1, 1);
+        // one channel answers at once, the others keep their requests
+        channels[0]->release();
+    }
+    ASSERT_EQ(channels.size(), 4UL);
+    // requests in flight are spread evenly over the busy channels
+    for (size_t i = 1; i < channels.size(); ++i) {
+        EXPECT_GE(channels[i]->held(), 1UL);
+        EXPECT_LE(channels[i]->held(), 2UL);
+    }
+    for (auto* channel : channels) {
+        channel->release();
+    }
+    EXPECT_EQ(done, 40);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,284 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "sim_network.h"
+
+#include <functional>
+#include <memory>
+#include <google/protobuf/message.h>
+
+namespace orion {
+namespace testcase {
+
+/// RpcChannel from one node to all the others
+class SimNetwork::Channel : public google::protobuf::RpcChannel {
+public:
+    Channel(SimNetwork* network, const std::string& src, const std::string& dst) :
+            _network(network), _src(src), _dst(dst) { }
+    virtual ~Channel() { }
+
+    virtual void CallMethod(const google::protobuf::MethodDescriptor* method,
+                            google::protobuf::RpcController* controller,
+                            const google::protobuf::Message* request,
+                            google::protobuf::Message* response,
+                            google::protobuf::Closure* done) {
+        Call* call = new Call();
+        call->src = _src;
+        call->dst = _dst;
+        call->method = method;
+        call->controller = controller;
+        call->request = request;
+        call->response = response;
+        call->done = done;
+        _network->send(call);
+    }
+private:
+    SimNetwork* _network;
+    std::string _src;
+    std::string _dst;
+};
+
+/// controller seen by the service, only failure is carried back to caller
+class ServerController : public google::protobuf::RpcController {
+public:
+    ServerController() : _failed(false) { }
+    virtual ~ServerController() { }
+
+    virtual void Reset() {
+        _failed = false;
+        _reason.clear();
+    }
+    virtual bool Failed() const {
+        return _failed;
+    }
+    virtual std::string ErrorText() const {
+        return _reason;
+    }
+    virtual void StartCancel() { }
+    virtual void SetFailed(const std::string& reason) {
+        _failed = true;
+        _reason = reason;
+    }
+    virtual bool IsCanceled() const {
+        return false;
+    }
+    virtual void NotifyOnCancel(google::protobuf::Closure* /*callback*/) { }
+private:
+    bool _failed;
+    std::string _reason;
+};
+
+/// sends the response back once the service is done with a request,
+/// the service works on copies so that a crashed server never touches caller
+class SimNetwork::CallClosure : public google::protobuf::Closure {
+public:
+    CallClosure(SimNetwork* network, Call* call) : _network(network), _call(call),
+            _request(call->request->New()), _response(call->response->New()) {
+        _request->CopyFrom(*call->request);
+    }
+    virtual ~CallClosure() { }
+
+    ServerController* controller() {
+        return &_controller;
+    }
+    const google::protobuf::Message* request() const {
+        return _request.get();
+    }
+    google::protobuf::Message* response() {
+        return _response.get();
+    }
+    /// server crashed before answering, returns the call to fail, called with lock held
+    Call* orphan() {
+        Call* call = _call;
+        _call = nullptr;
+        return call;
+    }
+    virtual void Run() {
+        std::string error = _controller.Failed() ? _controller.ErrorText() : "";
+        int64_t delay = 0;
+        Call* call = nullptr;
+        {
+            std::lock_guard<std::mutex> locker(_network->_mutex);
+            call = _call;
+            if (call != nullptr) {
+                _network->_serving[call->dst].erase(this);
+                delay = _network->message_delay(call->dst, call->src);
+                if (delay < 0) {
+                    ++_network->_dropped;
+                    delay = _network->_rpc_timeout;
+                    error = "request timeout";
+                }
+            }
+        }
+        if (call != nullptr) {
+            if (error.empty()) {
+                call->response->CopyFrom(*_response);
+            }
+            _network->reply(call, delay, error);
+        }
+        delete this;
+    }
+private:
+    SimNetwork* _network;
+    Call* _call;
+    ServerController _controller;
+    std::unique_ptr<google::protobuf::Message> _request;
+    std::unique_ptr<google::protobuf::Message> _response;
+};
+
+SimNetwork::SimNetwork(int32_t thread_num, int32_t rpc_timeout_ms) :
+        _rpc_timeout(rpc_timeout_ms), _pool(thread_num),
+        _random(std::random_device()()), _sent(0), _dropped(0) { }
+
+SimNetwork::~SimNetwork() {
+    _pool.stop(false);
+}
+
+void SimNetwork::add_node(const std::string& addr, google::protobuf::Service* service) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _services[addr].push_back(service);
+    _down.erase(addr);
+}
+
+void SimNetwork::remove_node(const std::string& addr) {
+    std::unique_lock<std::mutex> locker(_mutex);
+    _services.erase(addr);
+    _down.insert(addr);
+    for (auto* closure : _serving[addr]) {
+        reply(closure->orphan(), _rpc_timeout, "server crashed");
+    }
+    _serving.erase(addr);
+    while (_in_flight[addr] > 0 || _executing[addr] > 0) {
+        _cond.wait(locker);
+    }
+}
+
+rpc::RpcClient::channel_factory_t SimNetwork::channel_factory(const std::string& addr) {
+    return [this, addr](const std::string& dst) -> google::protobuf::RpcChannel* {
+        return new Channel(this, addr, dst);
+    };
+}
+
+void SimNetwork::set_link(const LinkOptions& options) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _default_link = options;
+    _links.clear();
+}
+
+void SimNetwork::set_link(const std::string& src, const std::string& dst,
+        const LinkOptions& options) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _links[std::make_pair(src, dst)] = options;
+}
+
+void SimNetwork::partition(const std::vector<std::string>& side) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _side.clear();
+    _side.insert(side.begin(), side.end());
+}
+
+void SimNetwork::heal() {
+    std::lock_guard<std::mutex> locker(_mutex);
+    _side.clear();
+}
+
+int64_t SimNetwork::sent() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _sent;
+}
+
+int64_t SimNetwork::dropped() const {
+    std::lock_guard<std::mutex> locker(_mutex);
+    return _dropped;
+}
+
+void SimNetwork::send(Call* call) {
+    std::lock_guard<std::mutex> locker(_mutex);
+    ++_in_flight[call->src];
+    if (_down.find(call->src) != _down.end()) {
+        // a crashed node reaches nobody, the call fails at once so that its caller is released
+        reply(call, 0, "node is down");
+        return;
+    }
+    ++_sent;
+    if (_services.find(call->dst) == _services.end()) {
+        reply(call, _default_link.latency_ms, "connection refused");
+        return;
+    }
+    int64_t delay = message_delay(call->src, call->dst);
+    if (delay < 0) {
+        ++_dropped;
+        reply(call, _rpc_timeout, "request timeout");
+        return;
+    }
+    _pool.delay_task(delay, std::bind(&SimNetwork::deliver, this, call));
+}
+
+void SimNetwork::deliver(Call* call) {
+    google::protobuf::Service* service = nullptr;
+    CallClosure* closure = nullptr;
+    {
+        std::lock_guard<std::mutex> locker(_mutex);
+        auto it = _services.find(call->dst);
+        // destination may crash or be partitioned while the request is on the way
+        if (it != _services.end() && _side.count(call->src) == _side.count(call->dst)) {
+            for (auto* candidate : it->second) {
+                if (candidate->GetDescriptor() == call->method->service()) {
+                    service = candidate;
+                }
+            }
+        }
+        if (service != nullptr) {
+            ++_executing[call->dst];
+            closure = new CallClosure(this, call);
+            _serving[call->dst].insert(closure);
+        }
+    }
+    if (service == nullptr) {
+        finish(call, "server unreachable");
+        return;
+    }
+    const std::string dst = call->dst;
+    // closure and call may be released once the service answers
+    service->CallMethod(call->method, closure->controller(), closure->request(),
+            closure->response(), closure);
+    std::lock_guard<std::mutex> locker(_mutex);
+    --_executing[dst];
+    _cond.notify_all();
+}
+
+void SimNetwork::reply(Call* call, int64_t delay, const std::string& error) {
+    _pool.delay_task(delay, std::bind(&SimNetwork::finish, this, call, error));
+}
+
+void SimNetwork::finish(Call* call, const std::string& error) {
+    if (!error.empty()) {
+        call->controller->SetFailed(error);
+    }
+    call->done->Run();
+    std::lock_guard<std::mutex> locker(_mutex);
+    --_in_flight[call->src];
+    _cond.notify_all();
+    delete call;
+}
+
+int64_t SimNetwork::message_delay(const std::string& src, const std::string& dst) {
+    if (_side.count(src) != _side.count(dst)) {
+        return -1;
+    }
+    auto it = _links.find(std::make_pair(src, dst));
+    const LinkOptions& link = it != _links.end() ? it->second : _default_link;
+    if (link.drop_rate > 0
+            && std::uniform_real_distribution<double>(0, 1)(_random) < link.drop_rate) {
+        return -1;
+    }
+    int64_t jitter = link.jitter_ms > 0 ?
+        std::uniform_int_distribution<int32_t>(0, link.jitter_ms)(_random) : 0;
+    return link.latency_ms + jitter;
+}
+
+} // namespace testcase
+} // namespace orion
@@ -0,0 +1,125 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#ifndef ORION_TEST_SIM_NETWORK_H
+#define ORION_TEST_SIM_NETWORK_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <random>
+#include <condition_variable>
+#include <google/protobuf/service.h>
+#include <google/protobuf/descriptor.h>
+#include "common/rpc_client.h"
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace testcase {
+
+/// behavior of a one-way link between two nodes
+struct LinkOptions {
+    // a message is delivered after latency plus a random jitter in [0, jitter]
+    int32_t latency_ms;
+    int32_t jitter_ms;
+    // probability that a message is lost, a lost request fails after rpc timeout
+    double drop_rate;
+
+    LinkOptions() : latency_ms(1), jitter_ms(0), drop_rate(0) { }
+};
+
+/**
+ * @brief In-memory network connecting services of nodes in one process
+ *
+ * Every node registers its services under an address and sends rpc through
+ * channels created by channel_factory, so the code above RpcClient runs
+ * unchanged. Requests are handed to the service and responses are sent back
+ * on the network threads after the simulated delay. Links may drop messages,
+ * and nodes on different sides of a partition cannot reach each other.
+ * All methods are thread-safe.
+ */
+class SimNetwork {
+public:
+    SimNetwork(int32_t thread_num = 4, int32_t rpc_timeout_ms = 500);
+    ~SimNetwork();
+    /// disable copy and move for sim network
+    SimNetwork(const SimNetwork&) = delete;
+    void operator=(const SimNetwork&) = delete;
+
+    /// makes the service reachable at addr, network does not own the service.
+    /// A node may host several services, calls are dispatched by method
+    void add_node(const std::string& addr, google::protobuf::Service* service);
+    /**
+     * @brief Takes a node off the network as if it crashed, blocks until all the
+     *        rpc sent by the node are finished and no service of the node is handling
+     *        a request. Requests accepted by the node and not answered yet fail after
+     *        rpc timeout, requests on the way to it fail once they arrive, and later
+     *        rpc sent by the node fail at once. The node needs to wait for the callbacks
+     *        of those before it is released.
+     */
+    void remove_node(const std::string& addr);
+    /// channels of RpcClient used by node at addr
+    rpc::RpcClient::channel_factory_t channel_factory(const std::string& addr);
+
+    /// sets the options of all the links
+    void set_link(const LinkOptions& options);
+    /// sets the options of the link from src to dst
+    void set_link(const std::string& src, const std::string& dst, const LinkOptions& options);
+    /// nodes in side can only reach each other, and the others are in the other side
+    void partition(const std::vector<std::string>& side);
+    void heal();
+
+    /// number of messages sent and lost
+    int64_t sent() const;
+    int64_t dropped() const;
+private:
+    class Channel;
+    class CallClosure;
+    friend class Channel;
+
+    struct Call {
+        std::string src;
+        std::string dst;
+        const google::protobuf::MethodDescriptor* method;
+        google::protobuf::RpcController* controller;
+        const google::protobuf::Message* request;
+        google::protobuf::Message* response;
+        google::protobuf::Closure* done;
+    };
+    void send(Call* call);
+    void deliver(Call* call);
+    /// responds to caller after delay, error is empty on success
+    void reply(Call* call, int64_t delay, const std::string& error);
+    void finish(Call* call, const std::string& error);
+    /// returns delay of a message from src to dst, -1 if it is lost, called with lock held
+    int64_t message_delay(const std::string& src, const std::string& dst);
+private:
+    int32_t _rpc_timeout;
+    common::ThreadPool _pool;
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    std::map<std::string, std::vector<google::protobuf::Service*> > _services;
+    std::set<std::string> _down;
+    // calls in flight sent by every node
+    std::map<std::string, int64_t> _in_flight;
+    // requests being handed to the services of every node
+    std::map<std::string, int64_t> _executing;
+    // requests accepted by the services of every node and not answered yet
+    std::map<std::string, std::set<CallClosure*> > _serving;
+    LinkOptions _default_link;
+    std::map<std::pair<std::string, std::string>, LinkOptions> _links;
+    std::set<std::string> _side;
+    std::default_random_engine _random;
+    int64_t _sent;
+    int64_t _dropped;
+};
+
+} // namespace testcase
+} // namespace orion
+
+#endif // ORION_TEST_SIM_NETWORK_H
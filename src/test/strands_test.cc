@@ -0,0 +1,126 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "common/strands.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+namespace orion {
+namespace testcase {
+
+/// a key whose tasks check they run alone and in order, without locking
+struct Serial {
+    std::atomic<int32_t> running;
+    std::vector<int32_t> order;
+    int32_t overlaps;
+
+    Serial() : running(0), overlaps(0) { }
+    void run(int32_t no) {
+        if (++running != 1) {
+            ++overlaps;
+        }
+        order.push_back(no);
+        // gives the other workers a chance to pick a task of the same key
+        if (no % 100 == 0) {
+            std::this_thread::yield();
+        }
+        --running;
+    }
+};
+
+/// waits until strands have no task left
+bool wait_idle(const common::Strands& strands, int64_t timeout_ms) {
+    for (int64_t i = 0; i < timeout_ms / 5 && strands.size() > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return strands.size() == 0;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(StrandsTest, Order) {
+    const int32_t key_num = 8;
+    const int32_t task_num = 2000;
+    for (bool work_stealing : {false, true}) {
+        orion::common::ThreadPoolOptions options;
+        options.thread_num = 4;
+        options.work_stealing = work_stealing;
+        orion::common::ThreadPool pool(options);
+        orion::common::Strands strands(&pool, 4, 4);
+        std::vector<orion::testcase::Serial> keys(key_num);
+        // keys are added from several threads, each key from a single one
+        std::vector<std::thread> threads;
+        for (int32_t t = 0; t < 2; ++t) {
+            threads.push_back(std::thread([&, t]() {
+                        for (int32_t i = 0; i < task_num; ++i) {
+                            for (int32_t key = t; key < key_num; key += 2) {
+                                strands.add_task(key, std::bind(&orion::testcase::Serial::run,
+                                            &keys[key], i));
+                            }
+                        }
+                    }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        ASSERT_TRUE(orion::testcase::wait_idle(strands, 10000));
+        pool.stop(true);
+        EXPECT_EQ(strands.pending(), 0);
+        for (const auto& key : keys) {
+            EXPECT_EQ(key.overlaps, 0);
+            ASSERT_EQ(key.order.size(), static_cast<size_t>(task_num));
+            for (int32_t i = 0; i < task_num; ++i) {
+                EXPECT_EQ(key.order[i], i);
+            }
+        }
+    }
+}
+
+TEST(StrandsTest, Turns) {
+    orion::common::ThreadPool pool(1);
+    orion::common::Strands strands(&pool, 16);
+    std::atomic<bool> release(false);
+    pool.add_task([&]() {
+                while (!release) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+    for (int i = 0; i < 100 && pool.pending() > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::mutex mutex;
+    std::vector<int64_t> keys;
+    auto record = [&](int64_t key) {
+        std::lock_guard<std::mutex> locker(mutex);
+        keys.push_back(key);
+    };
+    for (int32_t i = 0; i < 100; ++i) {
+        strands.add_task(1, std::bind(record, 1));
+    }
+    strands.add_task(2, std::bind(record, 2));
+    // a turn in pool for each key
+    EXPECT_EQ(pool.pending(), 2);
+    EXPECT_EQ(strands.size(), 2UL);
+    EXPECT_EQ(strands.pending(), 101);
+    release = true;
+    ASSERT_TRUE(orion::testcase::wait_idle(strands, 5000));
+    pool.stop(true);
+    // the busy key runs a batch and lets the other one go
+    ASSERT_EQ(keys.size(), 101UL);
+    EXPECT_EQ(std::find(keys.begin(), keys.end(), 2) - keys.begin(), 16);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "common/task.h"
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <new>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "common/thread_pool.h"
+
+namespace orion {
+namespace testcase {
+
+/// allocations of the whole process, counted by the operator new below
+static std::atomic<int64_t> s_allocations(0);
+
+/// a callable which can only be moved
+class MoveOnly {
+public:
+    explicit MoveOnly(std::atomic<int32_t>* runs) : _runs(new int32_t(0)), _counter(runs) { }
+    void operator()() {
+        ++*_runs;
+        ++*_counter;
+    }
+private:
+    std::unique_ptr<int32_t> _runs;
+    std::atomic<int32_t>* _counter;
+};
+
+} // namespace testcase
+} // namespace orion
+
+void* operator new(size_t size) {
+    ++orion::testcase::s_allocations;
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+TEST(TaskTest, Inline) {
+    std::shared_ptr<int32_t> request(new int32_t(1));
+    std::shared_ptr<int32_t> response(new int32_t(0));
+    int64_t allocations = orion::testcase::s_allocations;
+    // a completion capturing its request and response is kept inline
+    orion::common::Task task([request, response]() { *response = *request + 1; });
+    orion::common::Task moved(std::move(task));
+    orion::common::Task assigned;
+    assigned = std::move(moved);
+    EXPECT_FALSE(task);
+    EXPECT_FALSE(moved);
+    ASSERT_TRUE(assigned);
+    assigned();
+    EXPECT_EQ(*response, 2);
+    EXPECT_EQ(orion::testcase::s_allocations - allocations, 0);
+    // captures are released along with the task
+    EXPECT_EQ(request.use_count(), 2);
+    assigned = nullptr;
+    EXPECT_EQ(request.use_count(), 1);
+}
+
+TEST(TaskTest, Heap) {
+    std::array<char, 256> large;
+    large.fill('a');
+    char result = 0;
+    int64_t allocations = orion::testcase::s_allocations;
+    orion::common::Task task([large, &result]() { result = large[255]; });
+    EXPECT_EQ(orion::testcase::s_allocations - allocations, 1);
+    // large callables are moved by pointer
+    orion::common::Task moved(std::move(task));
+    orion::common::Task other;
+    other.swap(moved);
+    EXPECT_EQ(orion::testcase::s_allocations - allocations, 1);
+    other();
+    EXPECT_EQ(result, 'a');
+}
+
+TEST(TaskTest, MoveOnly) {
+    std::atomic<int32_t> runs(0);
+    orion::common::Task task = orion::testcase::MoveOnly(&runs);
+    task();
+    orion::common::Task moved(std::move(task));
+    moved();
+    EXPECT_EQ(runs, 2);
+    // move-only tasks pass through the pool
+    orion::common::ThreadPool pool(1);
+    pool.add_task(std::move(moved));
+    pool.add_task(orion::testcase::MoveOnly(&runs));
+    pool.delay_task(10, orion::testcase::MoveOnly(&runs));
+    for (int i = 0; i < 100 && runs < 5; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(runs, 5);
+}
+
+TEST(TaskTest, ThreadPool) {
+    const int64_t task_num = 10000;
+    for (bool work_stealing : {false, true}) {
+        orion::common::ThreadPoolOptions options;
+        options.thread_num = 2;
+        options.work_stealing = work_stealing;
+        orion::common::ThreadPool pool(options);
+        std::shared_ptr<std::atomic<int64_t> > count(new std::atomic<int64_t>(0));
+        std::shared_ptr<int64_t> step(new int64_t(1));
+        int64_t allocations = orion::testcase::s_allocations;
+        for (int64_t i = 0; i < task_num; ++i) {
+            pool.add_task([count, step]() { *count += *step; });
+        }
+        pool.stop(true);
+        EXPECT_EQ(*count, task_num);
+        // only the queues grow, a std::function would allocate for every task
+        EXPECT_LE(orion::testcase::s_allocations - allocations, task_num / 4);
+    }
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
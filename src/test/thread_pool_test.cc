@@ -7,6 +7,11 @@
 #include "common/thread_pool.h"
 #include <gtest/gtest.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <memory>
+#include <atomic>
 #include <chrono>
 #include <algorithm>
 
@@ -37,6 +42,44 @@ void thread_test_func(int no) {
     s_cv.notify_one();
 }
 
+common::ThreadPool* stealing_pool(int32_t thread_num) {
+    common::ThreadPoolOptions options;
+    options.thread_num = thread_num;
+    options.work_stealing = true;
+    return new common::ThreadPool(options);
+}
+
+/// spawns children from a worker, each of them counts once
+void spawn(common::ThreadPool* pool, std::atomic<int64_t>* count, int32_t children) {
+    for (int32_t i = 0; i < children; ++i) {
+        pool->add_task([count]() { ++*count; });
+    }
+    ++*count;
+}
+
+/**
+ * @brief Runs tiny tasks added from outside and spawned by workers
+ * @return tasks run per millisecond
+ */
+int64_t run_tiny_tasks(common::ThreadPool* pool, int64_t task_num) {
+    const int32_t children = 99;
+    std::atomic<int64_t> count(0);
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < task_num / 2; ++i) {
+        pool->add_task([&count]() { ++count; });
+    }
+    for (int64_t i = 0; i < task_num / 2 / (children + 1); ++i) {
+        pool->add_task(std::bind(&spawn, pool, &count, children));
+    }
+    while (count < task_num / 2 + task_num / 2 / (children + 1) * (children + 1)) {
+        std::this_thread::yield();
+    }
+    int64_t cost = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    pool->stop(true);
+    return count / std::max(cost, 1L);
+}
+
 } // namespace testcase
 } // namespace orion
 
@@ -93,6 +136,8 @@ TEST(ThreadPoolTest, DelayTest) {
 
 TEST(ThreadPoolTest, CancelTask) {
     orion::common::ThreadPool tp;
+    // ids pushed by the former tests are dropped
+    orion::testcase::s_no_list.clear();
     int64_t tid = tp.delay_task(1000,
             std::bind(&orion::testcase::thread_test_func, 0));
     EXPECT_NE(tid, 0);
@@ -105,6 +150,182 @@ TEST(ThreadPoolTest, CancelTask) {
     EXPECT_EQ(orion::testcase::s_no_list.size(), 0);
 }
 
+TEST(ThreadPoolTest, StealingOrder) {
+    std::unique_ptr<orion::common::ThreadPool> tp(orion::testcase::stealing_pool(1));
+    std::mutex mutex;
+    std::vector<int> order;
+    auto record = [&](int no) {
+        std::lock_guard<std::mutex> locker(mutex);
+        order.push_back(no);
+    };
+    std::atomic<bool> release(false);
+    tp->add_task([&]() {
+                record(-1);
+                while (!release) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                // spawned by the worker, run last in first out
+                tp->add_task(std::bind(record, 3));
+                tp->add_task(std::bind(record, 4));
+            });
+    for (int i = 0; i < 100 && tp->pending() > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    tp->add_task(std::bind(record, 1));
+    tp->add_task(std::bind(record, 2));
+    // priority task runs ahead of all the queued ones
+    tp->add_priority_task(std::bind(record, 0));
+    EXPECT_EQ(tp->pending(), 3);
+    release = true;
+    tp->stop(true);
+    EXPECT_EQ(order, std::vector<int>({-1, 0, 4, 3, 1, 2}));
+}
+
+TEST(ThreadPoolTest, StealingSpawn) {
+    const int32_t thread_num = 4;
+    std::unique_ptr<orion::common::ThreadPool> tp(orion::testcase::stealing_pool(thread_num));
+    std::mutex mutex;
+    std::condition_variable cond;
+    int32_t blocked = 0;
+    std::set<std::thread::id> threads;
+    std::atomic<int64_t> count(0);
+    // a single root spawns tasks which block until all the workers run one of them,
+    // so the other workers have to steal them
+    tp->add_task([&]() {
+                for (int32_t i = 0; i < thread_num; ++i) {
+                    tp->add_task([&]() {
+                                std::unique_lock<std::mutex> locker(mutex);
+                                threads.insert(std::this_thread::get_id());
+                                if (++blocked == thread_num) {
+                                    cond.notify_all();
+                                }
+                                cond.wait_for(locker, std::chrono::seconds(10),
+                                        [&]() { return blocked == thread_num; });
+                                ++count;
+                            });
+                }
+            });
+    for (int i = 0; i < 1000 && count < thread_num; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(count, thread_num);
+    EXPECT_EQ(threads.size(), static_cast<size_t>(thread_num));
+    tp->stop(false);
+}
+
+TEST(ThreadPoolTest, StealingDelay) {
+    std::unique_ptr<orion::common::ThreadPool> tp(orion::testcase::stealing_pool(4));
+    std::atomic<int32_t> count(0);
+    std::vector<int64_t> ids;
+    for (int i = 0; i < 20; ++i) {
+        ids.push_back(tp->delay_task(200, [&]() { ++count; }));
+        EXPECT_NE(ids.back(), 0);
+    }
+    bool running = true;
+    EXPECT_TRUE(tp->cancel_task(ids[0], true, &running));
+    EXPECT_FALSE(running);
+    EXPECT_FALSE(tp->cancel_task(ids[0]));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(count, 0);
+    for (int i = 0; i < 100 && count < 19; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(count, 19);
+    // a running task fails to cancel without blocking
+    std::atomic<bool> release(false);
+    int64_t id = tp->delay_task(0, [&]() {
+                while (!release) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(tp->cancel_task(id, false, &running));
+    EXPECT_TRUE(running);
+    release = true;
+    EXPECT_FALSE(tp->cancel_task(id));
+    tp->stop(false);
+}
+
+TEST(ThreadPoolTest, Histogram) {
+    orion::common::LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(99), 0);
+    for (int64_t i = 1; i <= 1000; ++i) {
+        histogram.record(i);
+    }
+    histogram.record(100000);
+    EXPECT_EQ(histogram.count(), 1001);
+    EXPECT_EQ(histogram.max(), 100000);
+    // percentiles are within a quarter above the exact values
+    EXPECT_GE(histogram.percentile(50), 501);
+    EXPECT_LE(histogram.percentile(50), 501 * 5 / 4);
+    EXPECT_GE(histogram.percentile(99), 991);
+    EXPECT_LE(histogram.percentile(99), 991 * 5 / 4);
+    EXPECT_EQ(histogram.percentile(100), 100000);
+    histogram.reset();
+    EXPECT_EQ(histogram.count(), 0);
+    EXPECT_EQ(histogram.percentile(50), 0);
+}
+
+TEST(ThreadPoolTest, Stats) {
+    for (bool work_stealing : {false, true}) {
+        orion::common::ThreadPoolOptions options;
+        options.thread_num = 1;
+        options.work_stealing = work_stealing;
+        options.name = "stats";
+        orion::common::ThreadPool tp(options);
+        std::atomic<bool> release(false);
+        tp.add_task([&]() {
+                    while (!release) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                });
+        for (int i = 0; i < 100 && tp.pending() > 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        for (int i = 0; i < 10; ++i) {
+            tp.add_task([]() { std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
+        }
+        tp.delay_task(60000, []() { });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        orion::common::ThreadPoolStats stats = tp.stats();
+        EXPECT_EQ(stats.name, "stats");
+        EXPECT_EQ(stats.threads, 1);
+        EXPECT_EQ(stats.active, 1);
+        EXPECT_EQ(stats.queued, 10);
+        EXPECT_EQ(stats.delayed, 1);
+        release = true;
+        tp.stop(true);
+        // the tasks queued behind the blocking one waited at least as long as it blocked
+        stats = tp.stats();
+        EXPECT_EQ(stats.active, 0);
+        EXPECT_EQ(stats.queued, 0);
+        EXPECT_EQ(stats.tasks, 11);
+        EXPECT_GE(stats.wait_p99, 20000);
+        EXPECT_GE(stats.wait_max, stats.wait_p99);
+        EXPECT_GE(stats.run_p50, 2000);
+        EXPECT_GE(stats.run_max, 20000);
+    }
+}
+
+/// prints tasks/ms of both queue modes at 1 to 8 threads, not run by default,
+/// task number is taken from ORION_BENCH_TASKS if set
+TEST(ThreadPoolTest, DISABLED_ScalingBenchmark) {
+    const char* tasks = getenv("ORION_BENCH_TASKS");
+    const int64_t task_num = tasks != nullptr ? atol(tasks) : 200000;
+    for (bool work_stealing : {false, true}) {
+        for (int32_t thread_num : {1, 2, 4, 8}) {
+            orion::common::ThreadPoolOptions options;
+            options.thread_num = thread_num;
+            options.work_stealing = work_stealing;
+            orion::common::ThreadPool tp(options);
+            int64_t throughput = orion::testcase::run_tiny_tasks(&tp, task_num);
+            printf("%s queue, %d threads: %ld tasks/ms\n",
+                    work_stealing ? "stealing" : "shared", thread_num, throughput);
+            EXPECT_EQ(tp.pending(), 0);
+        }
+    }
+}
+
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
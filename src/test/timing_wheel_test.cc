@@ -0,0 +1,176 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "common/timing_wheel.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+namespace orion {
+namespace testcase {
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// waits until wheel has no pending timer
+bool wait_empty(const common::TimingWheel& wheel, int64_t timeout_ms) {
+    int64_t deadline = now_ms() + timeout_ms;
+    while (wheel.size() > 0 && now_ms() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return wheel.size() == 0;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(TimingWheelTest, Order) {
+    orion::common::ThreadPool pool(1);
+    orion::common::TimingWheel wheel(&pool, 1, 1);
+    std::mutex mutex;
+    std::vector<int> order;
+    int64_t start = orion::testcase::now_ms();
+    std::vector<int64_t> elapsed(5);
+    for (int i = 4; i >= 0; --i) {
+        EXPECT_NE(wheel.add(20 * (i + 1), [&, i]() {
+                    std::lock_guard<std::mutex> locker(mutex);
+                    order.push_back(i);
+                    elapsed[i] = orion::testcase::now_ms() - start;
+                }), 0);
+    }
+    EXPECT_EQ(wheel.size(), 5UL);
+    ASSERT_TRUE(orion::testcase::wait_empty(wheel, 2000));
+    // batches handed to pool are all in its queue once the wheel is stopped
+    wheel.stop();
+    pool.stop(true);
+    EXPECT_EQ(order, std::vector<int>({0, 1, 2, 3, 4}));
+    // never earlier than the delay
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_GE(elapsed[i], 20 * (i + 1));
+    }
+}
+
+TEST(TimingWheelTest, RenewAndCancel) {
+    orion::common::ThreadPool pool(1);
+    orion::common::TimingWheel wheel(&pool, 1);
+    std::atomic<int> fired(0);
+    int64_t renewed = wheel.add(50, [&]() { fired += 1; });
+    int64_t cancelled = wheel.add(50, [&]() { fired += 10; });
+    ASSERT_TRUE(wheel.cancel(cancelled));
+    EXPECT_FALSE(wheel.cancel(cancelled));
+    EXPECT_FALSE(wheel.renew(cancelled, 10));
+    // renewed timer keeps being pushed back
+    for (int i = 0; i < 10; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ASSERT_TRUE(wheel.renew(renewed, 50));
+    }
+    EXPECT_EQ(fired, 0);
+    ASSERT_TRUE(orion::testcase::wait_empty(wheel, 2000));
+    // a timer that has run is gone
+    EXPECT_FALSE(wheel.renew(renewed, 10));
+    wheel.stop();
+    pool.stop(true);
+    EXPECT_EQ(fired, 1);
+    EXPECT_EQ(wheel.add(10, [&]() { fired += 1; }), 0);
+}
+
+TEST(TimingWheelTest, Cascade) {
+    orion::common::ThreadPool pool(1);
+    orion::common::TimingWheel wheel(&pool, 1, 1);
+    std::atomic<int> fired(0);
+    int64_t start = orion::testcase::now_ms();
+    std::atomic<int64_t> elapsed(0);
+    // beyond the first wheel, it moves inward before running
+    wheel.add(600, [&]() {
+                elapsed = orion::testcase::now_ms() - start;
+                ++fired;
+            });
+    int64_t far = wheel.add(100000, [&]() { fired += 10; });
+    EXPECT_EQ(wheel.size(), 2UL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(800));
+    EXPECT_EQ(fired, 1);
+    EXPECT_GE(elapsed, 600);
+    EXPECT_EQ(wheel.size(), 1UL);
+    EXPECT_TRUE(wheel.cancel(far));
+    wheel.stop();
+    pool.stop(true);
+    EXPECT_EQ(fired, 1);
+}
+
+TEST(TimingWheelTest, BeyondLastWheel) {
+    std::atomic<int64_t> now(0);
+    orion::common::ThreadPool pool(1);
+    orion::common::TimingWheel wheel(&pool, 1, 1, [&]() { return now.load(); });
+    std::atomic<int> fired(0);
+    // the farthest tick the wheels reach, and a timer beyond it
+    const int64_t last = (1LL << 32) - 1;
+    wheel.add(last, [&]() { fired += 1; });
+    wheel.add(last + 1000, [&]() { fired += 10; });
+    now = last + 500;
+    int64_t deadline = orion::testcase::now_ms() + 5000;
+    while (fired == 0 && orion::testcase::now_ms() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    // the far timer is placed again rather than run with the last tick
+    EXPECT_EQ(fired, 1);
+    EXPECT_EQ(wheel.size(), 1UL);
+    now = last + 1000;
+    ASSERT_TRUE(orion::testcase::wait_empty(wheel, 5000));
+    wheel.stop();
+    pool.stop(true);
+    EXPECT_EQ(fired, 11);
+}
+
+TEST(TimingWheelTest, ConcurrentRenew) {
+    orion::common::ThreadPool pool(4);
+    orion::common::TimingWheel wheel(&pool, 10);
+    const int32_t timer_num = 100000;
+    const int32_t thread_num = 4;
+    std::atomic<int32_t> fired(0);
+    std::vector<int64_t> ids(timer_num);
+    for (int32_t i = 0; i < timer_num; ++i) {
+        ids[i] = wheel.add(2000, [&]() { ++fired; });
+        ASSERT_NE(ids[i], 0);
+    }
+    // every timer is renewed from several threads, as sessions kept alive
+    std::vector<std::thread> threads;
+    std::atomic<int64_t> failures(0);
+    for (int32_t t = 0; t < thread_num; ++t) {
+        threads.push_back(std::thread([&, t]() {
+                    for (int round = 0; round < 3; ++round) {
+                        for (int32_t i = t; i < timer_num; i += thread_num / 2) {
+                            if (!wheel.renew(ids[i], 2000)) {
+                                ++failures;
+                            }
+                        }
+                    }
+                }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(fired, 0);
+    // half of them are cancelled, the others run
+    for (int32_t i = 0; i < timer_num; i += 2) {
+        ASSERT_TRUE(wheel.cancel(ids[i]));
+    }
+    ASSERT_TRUE(orion::testcase::wait_empty(wheel, 5000));
+    wheel.stop();
+    pool.stop(true);
+    EXPECT_EQ(fired, timer_num / 2);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
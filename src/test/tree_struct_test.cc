@@ -11,98 +11,9 @@
 #include <vector>
 #include <algorithm>
 #include <memory>
-#include "storage/data_store.h"
+#include "test/mock_data_store.h"
 #include "common/const.h"
 
-namespace orion {
-namespace testcase {
-
-/// Mock the data iterator to match mock data store
-class MockDataIterator : public storage::DataIterator {
-public:
-    typedef std::map<std::string, std::string> pool_t;
-    MockDataIterator(pool_t& data) : _pool(data), _cur(_pool.end()) { }
-    virtual ~MockDataIterator() { }
-
-    virtual std::string key() const {
-        return _cur->first;
-    }
-    virtual std::string value() const {
-        return _cur->second;
-    }
-    virtual bool done() const {
-        return _cur == _pool.end();
-    }
-    virtual DataIterator* seek(const std::string& key) {
-        for (auto it = _pool.begin(); it != _pool.end(); ++it) {
-            if (it->first >= key) {
-                _cur = it;
-                break;
-            }
-        }
-        return this;
-    }
-    virtual DataIterator* next() {
-        ++_cur;
-        return this;
-    }
-private:
-    pool_t& _pool;
-    pool_t::iterator _cur;
-};
-
-/// Mock the data store, provide in-memory storage
-class MockDataStore : public storage::DataStore {
-public:
-    MockDataStore() { }
-    virtual ~MockDataStore() { }
-
-    virtual int32_t get(std::string& value, const std::string& ns,
-            const std::string& key) const {
-        auto it = _store.find(ns);
-        if (it == _store.end()) {
-            return status_code::NOT_FOUND;
-        }
-        auto jt = it->second.find(key);
-        if (jt == it->second.end()) {
-            return status_code::NOT_FOUND;
-        }
-        value = jt->second;
-        return status_code::OK;
-    }
-    virtual int32_t put(const std::string& ns, const std::string& key,
-            const std::string& value) {
-        _store[ns][key] = value;
-        return status_code::OK;
-    }
-    virtual int32_t remove(const std::string& ns, const std::string& key) {
-        auto it = _store.find(ns);
-        if (it == _store.end()) {
-            return status_code::NOT_FOUND;
-        }
-        auto jt = it->second.find(key);
-        if (jt == it->second.end()) {
-            return status_code::NOT_FOUND;
-        }
-        it->second.erase(jt);
-        return status_code::OK;
-    }
-    virtual storage::DataIterator* iter(const std::string& ns) const {
-        auto it = _store.find(ns);
-        if (it == _store.end()) {
-            return nullptr;
-        }
-        auto map_ptr = const_cast< std::map<std::string, std::string>* >(&it->second);
-        return new MockDataIterator(*map_ptr);
-    }
-private:
-    // data structure is (ns, [<key, value>]...)
-    std::map< std::string, std::map<std::string, std::string> > _store;
-};
-
-} // namespace testcase
-} // namespace orion
-
 TEST(TreeStructureTest, NormalTest) {
     std::unique_ptr<orion::storage::TreeStructure> tree(
             new orion::storage::TreeStructure(new orion::testcase::MockDataStore()));
@@ -176,6 +87,22 @@ TEST(TreeStructureTest, NormalTest) {
     EXPECT_EQ(result[1], "/testb");
     EXPECT_EQ(result[2], "/testc");
 
+    // list continues after a given child
+    result.clear();
+    for (std::unique_ptr<orion::storage::StructureIterator>
+            it(tree->list("test", "/", "/testa")); !it->done(); it->next()) {
+        result.push_back(it->key());
+    }
+    EXPECT_EQ(result, std::vector<std::string>({"/testb", "/testc"}));
+
+    // scan nodes at the depth of start within a range
+    result.clear();
+    for (std::unique_ptr<orion::storage::StructureIterator>
+            it(tree->scan("test", "/testa/testab", "/testc")); !it->done(); it->next()) {
+        result.push_back(it->key());
+    }
+    EXPECT_EQ(result, std::vector<std::string>({"/testa/testab", "/testb/testba"}));
+
     // list a leaf node
     std::unique_ptr<orion::storage::StructureIterator>
         leaf_it(tree->list("test", "/testa/testaa/testaaa"));
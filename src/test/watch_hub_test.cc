@@ -0,0 +1,183 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "server/watch_hub.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <map>
+#include <future>
+#include <thread>
+#include <chrono>
+#include "common/const.h"
+
+namespace orion {
+namespace testcase {
+
+/// closure waited by test
+class Done : public google::protobuf::Closure {
+public:
+    Done() : _result(_promise.get_future()) { }
+    virtual void Run() {
+        _promise.set_value();
+    }
+    void wait() {
+        _result.wait();
+    }
+private:
+    std::promise<void> _promise;
+    std::future<void> _result;
+};
+
+/// polls a stream and waits for the response
+int32_t poll(server::WatchHub* hub, const service::WatchRequest& request,
+        service::WatchResponse* response) {
+    Done done;
+    response->Clear();
+    hub->watch(0, 0, &request, response, &done);
+    done.wait();
+    return response->status();
+}
+
+/// opens a stream watching everything, returns its id
+int64_t open(server::WatchHub* hub) {
+    service::WatchRequest request;
+    service::WatchResponse response;
+    request.set_ns("user");
+    service::WatchKey* key = request.add_add();
+    key->set_key("/");
+    key->set_type(server::WATCH_SUBTREE);
+    EXPECT_EQ(poll(hub, request, &response), status_code::OK);
+    return response.stream_id();
+}
+
+void put(server::WatchHub* hub, int64_t index, const std::string& key,
+        const std::string& value) {
+    raft::Entry entry;
+    entry.set_term(1);
+    entry.set_op(raft_op::PUT);
+    entry.set_key(key);
+    entry.set_value(value);
+    entry.set_ns("user");
+    hub->on_apply(0, index, entry, raft::ApplyResult(status_code::OK));
+}
+
+/// polls without acknowledging anything until all the entries up to index are fanned out
+int32_t wait_fanout(server::WatchHub* hub, int64_t stream_id, int64_t index,
+        service::WatchResponse* response) {
+    service::WatchRequest request;
+    request.set_ns("user");
+    request.set_stream_id(stream_id);
+    request.set_wait_ms(0);
+    int32_t status = status_code::OK;
+    for (int i = 0; i < 1000; ++i) {
+        status = poll(hub, request, response);
+        if (status != status_code::OK || response->revision() >= index) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return status;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(WatchHubTest, Coalesce) {
+    orion::server::WatchOptions options;
+    options.max_pending_events = 10;
+    orion::server::WatchHub hub(options);
+    int64_t stream_id = orion::testcase::open(&hub);
+    ASSERT_NE(stream_id, 0);
+    // a busy key does not push out the events of other keys
+    for (int i = 1; i <= 100; ++i) {
+        orion::testcase::put(&hub, i, "/key_" + std::to_string(i % 3), std::to_string(i));
+    }
+    orion::service::WatchResponse response;
+    ASSERT_EQ(orion::testcase::wait_fanout(&hub, stream_id, 100, &response),
+            orion::status_code::OK);
+    EXPECT_EQ(response.revision(), 100);
+    EXPECT_LE(response.events_size(), 10);
+    std::map<std::string, std::string> latest;
+    int64_t last = 0;
+    for (const auto& data : response.events()) {
+        orion::service::WatchEvent event;
+        ASSERT_TRUE(event.ParseFromString(data));
+        EXPECT_GT(event.revision(), last);
+        last = event.revision();
+        latest[event.key()] = event.value();
+    }
+    EXPECT_EQ(latest["/key_0"], "99");
+    EXPECT_EQ(latest["/key_1"], "100");
+    EXPECT_EQ(latest["/key_2"], "98");
+    orion::server::WatchStats stats = hub.stats();
+    EXPECT_GT(stats.coalesced_events, 0);
+    EXPECT_EQ(stats.resyncs, 0);
+}
+
+TEST(WatchHubTest, Resync) {
+    orion::server::WatchOptions options;
+    options.max_pending_events = 10;
+    orion::server::WatchHub hub(options);
+    int64_t stream_id = orion::testcase::open(&hub);
+    // too many keys for the stream to hold
+    for (int i = 1; i <= 20; ++i) {
+        orion::testcase::put(&hub, i, "/key_" + std::to_string(i), "v");
+    }
+    orion::service::WatchResponse response;
+    ASSERT_EQ(orion::testcase::wait_fanout(&hub, stream_id, 20, &response),
+            orion::status_code::RESYNC);
+    int64_t revision = response.revision();
+    EXPECT_GT(revision, 10);
+    EXPECT_EQ(hub.stats().resyncs, 1);
+    // stream goes on once client has read everything up to revision
+    orion::service::WatchRequest request;
+    request.set_ns("user");
+    request.set_stream_id(stream_id);
+    request.set_revision(revision);
+    request.set_wait_ms(0);
+    ASSERT_EQ(orion::testcase::poll(&hub, request, &response), orion::status_code::OK);
+    orion::testcase::put(&hub, 21, "/key_21", "v");
+    ASSERT_EQ(orion::testcase::wait_fanout(&hub, stream_id, 21, &response),
+            orion::status_code::OK);
+    int32_t after = 0;
+    for (const auto& data : response.events()) {
+        orion::service::WatchEvent event;
+        ASSERT_TRUE(event.ParseFromString(data));
+        EXPECT_GT(event.revision(), revision);
+        ++after;
+    }
+    EXPECT_EQ(after, 21 - revision);
+}
+
+TEST(WatchHubTest, ZeroMaxEvents) {
+    orion::server::WatchOptions options;
+    orion::server::WatchHub hub(options);
+    int64_t stream_id = orion::testcase::open(&hub);
+    for (int i = 1; i <= 3; ++i) {
+        orion::testcase::put(&hub, i, "/key_" + std::to_string(i), "v");
+    }
+    orion::service::WatchResponse response;
+    ASSERT_EQ(orion::testcase::wait_fanout(&hub, stream_id, 3, &response),
+            orion::status_code::OK);
+    // a poll asking for no events still gets one revision
+    orion::service::WatchRequest request;
+    request.set_ns("user");
+    request.set_stream_id(stream_id);
+    request.set_wait_ms(0);
+    request.set_max_events(0);
+    for (int64_t revision = 1; revision <= 3; ++revision) {
+        ASSERT_EQ(orion::testcase::poll(&hub, request, &response), orion::status_code::OK);
+        EXPECT_EQ(response.events_size(), 1);
+        EXPECT_EQ(response.revision(), revision);
+        request.set_revision(response.revision());
+    }
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2017, Kai-Zhang
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file.
+//
+// Author: Kai Zhang (cs.zhangkai@outlook.com)
+
+#include "server/watch_registry.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace orion {
+namespace testcase {
+
+/// sorted watchers matching key
+std::vector<int64_t> match(const server::WatchRegistry& registry, const std::string& key) {
+    std::vector<int64_t> watchers;
+    registry.match(key, &watchers);
+    std::sort(watchers.begin(), watchers.end());
+    return watchers;
+}
+
+} // namespace testcase
+} // namespace orion
+
+TEST(WatchRegistryTest, Match) {
+    using orion::server::WatchRegistry;
+    WatchRegistry registry;
+    registry.add("/a/b", orion::server::WATCH_KEY, 1);
+    registry.add("/a", orion::server::WATCH_CHILDREN, 2);
+    registry.add("/a", orion::server::WATCH_SUBTREE, 3);
+    registry.add("/", orion::server::WATCH_SUBTREE, 4);
+    registry.add("/", orion::server::WATCH_CHILDREN, 5);
+    registry.add("/ab", orion::server::WATCH_SUBTREE, 6);
+    EXPECT_EQ(registry.size(), 6UL);
+    EXPECT_EQ(orion::testcase::match(registry, "/a/b"), std::vector<int64_t>({1, 2, 3, 4}));
+    EXPECT_EQ(orion::testcase::match(registry, "/a/b/c"), std::vector<int64_t>({3, 4}));
+    // a directory watch sees the directory itself only if it is a subtree watch
+    EXPECT_EQ(orion::testcase::match(registry, "/a"), std::vector<int64_t>({3, 4, 5}));
+    EXPECT_EQ(orion::testcase::match(registry, "/ab/c"), std::vector<int64_t>({4, 6}));
+    EXPECT_EQ(orion::testcase::match(registry, "/b"), std::vector<int64_t>({4, 5}));
+    // single watch matching agrees with the trie
+    for (const char* key : {"/a", "/a/b", "/a/b/c", "/ab", "/ab/c", "/b"}) {
+        for (int32_t type = 0; type < 3; ++type) {
+            for (const char* watched : {"/", "/a", "/a/b", "/ab"}) {
+                WatchRegistry single;
+                single.add(watched, type, 1);
+                EXPECT_EQ(WatchRegistry::matches(type, watched, key),
+                        !orion::testcase::match(single, key).empty())
+                    << type << " " << watched << " " << key;
+            }
+        }
+    }
+}
+
+TEST(WatchRegistryTest, Remove) {
+    orion::server::WatchRegistry registry;
+    registry.add("/a/b", orion::server::WATCH_KEY, 1);
+    registry.add("/a/b", orion::server::WATCH_KEY, 2);
+    registry.add("/a/b/c/d", orion::server::WATCH_SUBTREE, 3);
+    EXPECT_FALSE(registry.remove("/a/b", orion::server::WATCH_SUBTREE, 1));
+    EXPECT_FALSE(registry.remove("/a/x", orion::server::WATCH_KEY, 1));
+    EXPECT_TRUE(registry.remove("/a/b", orion::server::WATCH_KEY, 1));
+    EXPECT_EQ(orion::testcase::match(registry, "/a/b"), std::vector<int64_t>({2}));
+    EXPECT_TRUE(registry.remove("/a/b/c/d", orion::server::WATCH_SUBTREE, 3));
+    EXPECT_TRUE(orion::testcase::match(registry, "/a/b/c/d/e").empty());
+    EXPECT_TRUE(registry.remove("/a/b", orion::server::WATCH_KEY, 2));
+    EXPECT_TRUE(registry.empty());
+    // watchers of other keys are not visited
+    for (int64_t i = 0; i < 100000; ++i) {
+        registry.add("/dir_" + std::to_string(i % 1000) + "/key_" + std::to_string(i),
+                orion::server::WATCH_KEY, i);
+    }
+    EXPECT_EQ(orion::testcase::match(registry, "/dir_7/key_1007"),
+            std::vector<int64_t>({1007}));
+    EXPECT_TRUE(orion::testcase::match(registry, "/dir_7/key_1008").empty());
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}